@@ -0,0 +1,145 @@
+#include <VJobSystem.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/**
+* Scaling benchmark of VJobSystem, every case is timed from 1 worker up to the number of hardware threads
+*
+* - parallel_for: ParallelFor over a compute bound array, the pattern of the light and scene table builds
+* - fine_jobs: many tiny jobs queued by worker 0 and stolen by the others, stresses the Chase-Lev deques
+* - nested: jobs that queue jobs on their own worker, thieves take from the top while owners pop the bottom
+*
+* Usage: job_system_bench [maxWorkers] [repeats]
+*/
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Result
+    {
+        double best = 0.0;
+        bool valid = true;
+    };
+
+    template<typename Function>
+    Result Measure(uint32_t repeats, Function function)
+    {
+        Result result;
+        result.best = 1e30;
+        for (uint32_t i = 0; i < repeats; ++i)
+        {
+            const auto start = Clock::now();
+            result.valid &= function();
+            const auto end = Clock::now();
+            result.best = std::min(result.best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        return result;
+    }
+
+    bool ParallelForCase(VJobSystem& jobs, std::vector<float>& data)
+    {
+        jobs.ParallelFor(data.size(), 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                float x = static_cast<float>(i);
+                for (int k = 0; k < 16; ++k)
+                    x = std::sqrt(x * 1.0001f + 1.0f) + std::sin(x);
+                data[i] = x;
+            }
+        });
+        return std::all_of(data.begin(), data.end(), [](float x) { return std::isfinite(x); });
+    }
+
+    bool FineJobsCase(VJobSystem& jobs, uint32_t jobCount)
+    {
+        VJobSystem::Counter counter;
+        std::atomic<uint32_t> done{ 0 };
+        for (uint32_t i = 0; i < jobCount; ++i)
+        {
+            jobs.Run([&done]
+            {
+                volatile float x = 1.0f;
+                for (int k = 0; k < 256; ++k)
+                    x = x * 1.0001f + 0.5f;
+                done.fetch_add(1, std::memory_order_relaxed);
+            }, &counter);
+        }
+        jobs.Wait(counter);
+        return done.load() == jobCount;
+    }
+
+    void Spawn(VJobSystem& jobs, VJobSystem::Counter& counter, std::atomic<uint32_t>& leaves, uint32_t depth)
+    {
+        if (depth == 0)
+        {
+            volatile float x = 1.0f;
+            for (int k = 0; k < 512; ++k)
+                x = x * 1.0001f + 0.5f;
+            leaves.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        for (int child = 0; child < 2; ++child)
+            jobs.Run([&jobs, &counter, &leaves, depth] { Spawn(jobs, counter, leaves, depth - 1); }, &counter);
+    }
+
+    bool NestedCase(VJobSystem& jobs, uint32_t depth)
+    {
+        VJobSystem::Counter counter;
+        std::atomic<uint32_t> leaves{ 0 };
+        Spawn(jobs, counter, leaves, depth);
+        jobs.Wait(counter);
+        return leaves.load() == (1u << depth);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t repeats = 5;
+    if (argc > 1)
+        maxWorkers = std::max(1, std::atoi(argv[1]));
+    if (argc > 2)
+        repeats = std::max(1, std::atoi(argv[2]));
+
+    const uint32_t fineJobCount = 3000;
+    const uint32_t nestedDepth = 14;
+    std::vector<float> data(1 << 20);
+
+    std::printf("%-8s %14s %8s %14s %8s %14s %8s\n", "workers", "parallel_for", "speedup", "fine_jobs", "speedup",
+        "nested", "speedup");
+
+    Result reference[3];
+    bool valid = true;
+    for (uint32_t workers = 1; workers <= maxWorkers; ++workers)
+    {
+        VJobSystem jobs(workers);
+        const Result results[3] = {
+            Measure(repeats, [&] { return ParallelForCase(jobs, data); }),
+            Measure(repeats, [&] { return FineJobsCase(jobs, fineJobCount); }),
+            Measure(repeats, [&] { return NestedCase(jobs, nestedDepth); }),
+        };
+        if (workers == 1)
+            std::copy(results, results + 3, reference);
+
+        std::printf("%-8u", workers);
+        for (int i = 0; i < 3; ++i)
+        {
+            std::printf(" %11.2f ms %7.2fx", results[i].best, reference[i].best / results[i].best);
+            valid &= results[i].valid;
+        }
+        std::printf("\n");
+    }
+
+    if (!valid)
+    {
+        std::printf("error: a job was lost or run twice\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <VJobSystem.h>
+#include <VLightBvh.h>
+#include <VLightTable.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+/**
+* Noise of the light picked for a shadow ray, alias table against light BVH
+*
+* Street lamps of uneven power on a square city, plus the three lights of SetupGame. The irradiance of the ground is
+* estimated from one picked light (power * cos / d², no visibility). The variance of that estimator is computed exactly at random ground points
+* from the pick probabilities of each method, so the comparison has no sampling noise of its own:
+*
+* - alias: the table of VLightTable, weights estimated once at the camera
+* - bvh: the traversal of VLightBvh at the shading point
+*
+* Usage: light_sampling_bench [points] [workers]
+*/
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t Hash(uint32_t v)
+    {
+        const uint32_t state = v * 747796405u + 2891336453u;
+        const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    float NextFloat(uint32_t& seed)
+    {
+        seed = Hash(seed);
+        return static_cast<float>(seed >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /** @brief Probability of every light under the traversal of the tree, by walking down every branch */
+    void BvhPdfs(const VLightBvh& bvh, const glm::vec3& position, const glm::vec3& normal, std::vector<double>& pdfs)
+    {
+        std::fill(pdfs.begin(), pdfs.end(), 0.0);
+        const std::vector<VLightBvhNode>& nodes = bvh.GetNodes();
+        const std::function<void(uint32_t, double)> visit = [&](uint32_t index, double probability)
+        {
+            const VLightBvhNode& node = nodes[index];
+            if (node.second == 0xffffffffu)
+            {
+                pdfs[node.first] += probability;
+                return;
+            }
+            const double left = VLightBvh::Importance(nodes[node.first], position, normal);
+            const double right = VLightBvh::Importance(nodes[node.second], position, normal);
+            if (left + right <= 0.0)
+                return;
+            visit(node.first, probability * left / (left + right));
+            visit(node.second, probability * right / (left + right));
+        };
+        visit(0, 1.0);
+    }
+
+    /** @brief Relative standard deviation of the one-light estimator, averaged over the points */
+    double RelativeDeviation(const std::vector<VLightData>& lights, const std::vector<glm::vec3>& points, const glm::vec3& normal,
+        const std::function<void(const glm::vec3&, std::vector<double>&)>& pickPdfs)
+    {
+        std::vector<double> pdfs(lights.size());
+        double sum = 0.0;
+        for (const glm::vec3& point : points)
+        {
+            pickPdfs(point, pdfs);
+            double total = 0.0, secondMoment = 0.0;
+            for (size_t i = 0; i < lights.size(); ++i)
+            {
+                const glm::vec3 toLight = glm::normalize(glm::vec3(lights[i].position) - point);
+                const double contribution = VLightTable::EstimateContribution(lights[i], point) * std::max(glm::dot(toLight, normal), 0.0f);
+                if (contribution <= 0.0)
+                    continue;
+                total += contribution;
+                //A light that reaches the point but is never picked would bias the estimator
+                secondMoment += pdfs[i] > 0.0 ? contribution * contribution / pdfs[i] : 1e30;
+            }
+            sum += std::sqrt(std::max(secondMoment - total * total, 0.0)) / total;
+        }
+        return sum / points.size();
+    }
+
+    /** @brief Build both samplers at the camera and print their noise at the ground points */
+    void Compare(const char* name, const std::vector<VLight>& lights, const glm::vec3& camera, const std::vector<glm::vec3>& points,
+        const glm::vec3& up, VJobSystem& jobSystem)
+    {
+        VLightTable table;
+        table.Build(lights, camera);
+
+        VLightBvh bvh;
+        const auto start = Clock::now();
+        bvh.Build(table.GetLights(), jobSystem);
+        const double buildTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        const std::vector<VLightTable::AliasEntry>& entries = table.GetAliasTable();
+        const double alias = RelativeDeviation(table.GetLights(), points, up, [&](const glm::vec3&, std::vector<double>& pdfs)
+        {
+            for (size_t i = 0; i < entries.size(); ++i)
+                pdfs[i] = entries[i].pdf;
+        });
+        const double tree = RelativeDeviation(table.GetLights(), points, up, [&](const glm::vec3& point, std::vector<double>& pdfs)
+        {
+            BvhPdfs(bvh, point, up, pdfs);
+        });
+
+        std::printf("%-14s %10zu %10.2f %10.2f %10.2f\n", name, lights.size(), buildTime, alias, tree);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t pointCount = 256;
+    uint32_t workerCount = 0;
+    if (argc > 1)
+        pointCount = std::max(1, std::atoi(argv[1]));
+    if (argc > 2)
+        workerCount = std::max(0, std::atoi(argv[2]));
+
+    VJobSystem jobSystem(workerCount);
+    std::printf("%-14s %10s %10s %10s %10s\n", "scene", "lights", "build ms", "alias", "bvh");
+
+    //SetupGame, up is -y, points on the ground within 10 units of the camera
+    uint32_t seed = 1;
+    std::vector<VLight> gameLights(3);
+    gameLights[0].SetPosition({ 0, -200, -1200 });
+    gameLights[0].SetRadius(100);
+    gameLights[0].SetIntensity(1.5e6f);
+    gameLights[1].SetPosition({ -3, -8, 4 });
+    gameLights[1].SetRadius(0.5);
+    gameLights[1].SetColor(1.0, 0.6, 0.3);
+    gameLights[1].SetIntensity(20);
+    gameLights[2].SetPosition({ 4, -9, -10 });
+    gameLights[2].SetRadius(0.5);
+    gameLights[2].SetColor(0.4, 0.6, 1.0);
+    gameLights[2].SetIntensity(30);
+    std::vector<glm::vec3> points(pointCount);
+    for (glm::vec3& point : points)
+        point = glm::vec3((NextFloat(seed) - 0.5f) * 20.0f, 0, (NextFloat(seed) - 0.5f) * 20.0f);
+    Compare("SetupGame", gameLights, glm::vec3(0, -2, 0), points, glm::vec3(0, -1, 0), jobSystem);
+
+    const uint32_t lightCounts[] = { 1024, 4096, 16384, 65536 };
+    for (uint32_t lightCount : lightCounts)
+    {
+        //Lamps 5 units above the ground every ~10 units, on a square city around the camera
+        const float citySize = 10.0f * std::sqrt(static_cast<float>(lightCount));
+        std::vector<VLight> lamps(lightCount);
+        for (VLight& lamp : lamps)
+        {
+            lamp.SetPosition({ (NextFloat(seed) - 0.5f) * citySize, 5.0f, (NextFloat(seed) - 0.5f) * citySize });
+            lamp.SetRadius(0.2f);
+            lamp.SetColor(1.0f, 0.8f + 0.2f * NextFloat(seed), 0.6f + 0.4f * NextFloat(seed));
+            lamp.SetIntensity(std::pow(10.0f, 2.0f * NextFloat(seed)));
+        }
+
+        //Ground points within a quarter of the city from the camera, where the image is
+        for (glm::vec3& point : points)
+            point = glm::vec3((NextFloat(seed) - 0.5f) * citySize * 0.5f, 0, (NextFloat(seed) - 0.5f) * citySize * 0.5f);
+        Compare("street lamps", lamps, glm::vec3(0, 1.7f, 0), points, glm::vec3(0, 1, 0), jobSystem);
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <VSceneTable.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/**
+* Cost of finding the first triangle of a hit instance, as done by ray_chit.glsl
+*
+* - linear: the loop ray_chit used to run, summing the triangle counts of every previous instance
+* - table: one load from the prefix sums of VSceneTable
+*
+* Every instance count replays the same number of hits on random instances, the table cost stays flat while the
+* loop grows with the instance count.
+*
+* Usage: scene_table_bench [hits] [repeats]
+*/
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Hit
+    {
+        uint32_t instance;
+        uint32_t primitive;
+    };
+
+    uint32_t Hash(uint32_t v)
+    {
+        const uint32_t state = v * 747796405u + 2891336453u;
+        const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    template<typename Function>
+    double Measure(uint32_t repeats, uint64_t& checksum, Function function)
+    {
+        double best = 1e30;
+        for (uint32_t i = 0; i < repeats; ++i)
+        {
+            const auto start = Clock::now();
+            checksum = function();
+            const auto end = Clock::now();
+            best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t hitCount = 1 << 20;
+    uint32_t repeats = 5;
+    if (argc > 1)
+        hitCount = std::max(1, std::atoi(argv[1]));
+    if (argc > 2)
+        repeats = std::max(1, std::atoi(argv[2]));
+
+    std::printf("%-10s %16s %16s %10s\n", "instances", "linear ns/hit", "table ns/hit", "speedup");
+
+    bool valid = true;
+    const uint32_t instanceCounts[] = { 1, 10, 100, 300, 1000, 3000 };
+    for (uint32_t instanceCount : instanceCounts)
+    {
+        VSceneTable table;
+        std::vector<uint32_t> triangleCounts(instanceCount);
+        uint32_t seed = instanceCount;
+        for (uint32_t i = 0; i < instanceCount; ++i)
+        {
+            seed = Hash(seed);
+            triangleCounts[i] = 12 + seed % 5000;
+            table.Add(triangleCounts[i]);
+        }
+
+        std::vector<Hit> hits(hitCount);
+        for (Hit& hit : hits)
+        {
+            seed = Hash(seed);
+            hit.instance = seed % instanceCount;
+            seed = Hash(seed);
+            hit.primitive = seed % triangleCounts[hit.instance];
+        }
+
+        uint64_t linearChecksum = 0;
+        const double linear = Measure(repeats, linearChecksum, [&]
+        {
+            uint64_t sum = 0;
+            for (const Hit& hit : hits)
+            {
+                uint32_t triangle = 0;
+                for (uint32_t i = 0; i < hit.instance; ++i)
+                    triangle += triangleCounts[i];
+                sum += triangle + hit.primitive;
+            }
+            return sum;
+        });
+
+        uint64_t tableChecksum = 0;
+        const std::vector<uint32_t>& firstTriangles = table.GetFirstPrimitives();
+        const double lookup = Measure(repeats, tableChecksum, [&]
+        {
+            uint64_t sum = 0;
+            for (const Hit& hit : hits)
+                sum += firstTriangles[hit.instance] + hit.primitive;
+            return sum;
+        });
+
+        valid &= linearChecksum == tableChecksum;
+        std::printf("%-10u %16.2f %16.2f %9.1fx\n", instanceCount, linear / hitCount, lookup / hitCount, linear / lookup);
+    }
+
+    if (!valid)
+    {
+        std::printf("error: the table and the linear scan found different triangles\n");
+        return 1;
+    }
+    return 0;
+}
@@ -1,21 +1,44 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+/**
+* Ray generation constants, uploaded in the camera uniform buffer (std140, six vec4).
+*
+* The direction through the sample (x, y) of the render target, in pixels, is
+* lowerLeft + x * du + y * dv (not normalized), so the raygen shader only does a couple of FMAs per ray.
+*/
+struct CameraConstants
+{
+    // xyz: ray origin (center of the lens), w: focus distance
+    glm::vec4 origin;
+    // xyz: direction through the corner of pixel (0, 0), w: 1 if the thin lens is enabled
+    glm::vec4 lowerLeft;
+    // xyz: direction step of one pixel along x, w: subpixel jitter x of the frame
+    glm::vec4 du;
+    // xyz: direction step of one pixel along y, w: subpixel jitter y of the frame
+    glm::vec4 dv;
+    // xyz: lens axes scaled by the aperture radius
+    glm::vec4 lensU;
+    glm::vec4 lensV;
+};
+
 
 class Camera
 {
 private:
     float fov;
     float znear, zfar;
+    float aspect;
 
 public:
 
-    Camera() : fov(60.0f), znear(0.1f), zfar(512.0f){}
+    Camera() : fov(60.0f), znear(0.1f), zfar(512.0f), aspect(1.0f){}
 
     void updateViewMatrix()
     {
@@ -49,6 +72,12 @@ public:
     float movementSpeed = 1.0f;
     int sample = 2;
 
+    //Thin lens, a radius of 0 is a pinhole camera
+    float apertureRadius = 0.0f;
+    float focusDistance = 10.0f;
+    //Subpixel jitter of the primary rays, only useful while accumulating
+    bool jitter = true;
+
     bool updated = false;
 
     struct
@@ -70,9 +99,16 @@ public:
         this->fov = fov;
         this->znear = znear;
         this->zfar = zfar;
+        this->aspect = aspect;
         matrices.perspective = glm::perspective(glm::radians(fov), aspect, znear, zfar);
     };
 
+    void updateAspectRatio(float aspect)
+    {
+        this->aspect = aspect;
+        matrices.perspective = glm::perspective(glm::radians(fov), aspect, znear, zfar);
+    }
+
     void setPosition(glm::vec3 position)
     {
         this->position = position;
@@ -91,4 +127,70 @@ public:
         updateViewMatrix();
     }
 
+    /**
+    * Ray generation constants matching the view and perspective matrices, updateViewMatrix must have been called
+    *
+    * @param width Width in pixels of the render target
+    * @param height Height in pixels of the render target
+    * @param subpixel Offset of the sample inside the pixel, in [0, 1)
+    */
+    CameraConstants BuildRayConstants(uint32_t width, uint32_t height, glm::vec2 subpixel) const
+    {
+        //Same rays as unprojecting (2 * pixel / size - 1, -1) with the inverse matrices:
+        //view space (x * aspect * t, y * t, -1) and view space -z is Front
+        const float t = std::tan(glm::radians(fov) * 0.5f);
+        const glm::vec3 right = Right * (aspect * t);
+        const glm::vec3 up = Up * t;
+
+        CameraConstants constants;
+        constants.origin = glm::vec4(position, focusDistance);
+        constants.lowerLeft = glm::vec4(Front - right - up, apertureRadius > 0.0f ? 1.0f : 0.0f);
+        constants.du = glm::vec4(right * (2.0f / static_cast<float>(width)), subpixel.x);
+        constants.dv = glm::vec4(up * (2.0f / static_cast<float>(height)), subpixel.y);
+        constants.lensU = glm::vec4(Right * apertureRadius, 0.0f);
+        constants.lensV = glm::vec4(Up * apertureRadius, 0.0f);
+        return constants;
+    }
+
+    /**
+    * CPU version of the ray generation done in ray_gen.glsl, used as a reference
+    *
+    * @param constants Constants built by BuildRayConstants
+    * @param pixel Integer coordinates of the pixel
+    * @param lensSample Point on the unit disk, ignored by a pinhole camera
+    * @param origin Origin of the ray
+    * @param direction Normalized direction of the ray
+    */
+    static void GenerateRay(const CameraConstants& constants, glm::uvec2 pixel, glm::vec2 lensSample, glm::vec3& origin, glm::vec3& direction)
+    {
+        const glm::vec2 sample = glm::vec2(pixel) + glm::vec2(constants.du.w, constants.dv.w);
+        const glm::vec3 dir = glm::vec3(constants.lowerLeft) + sample.x * glm::vec3(constants.du) + sample.y * glm::vec3(constants.dv);
+
+        origin = glm::vec3(constants.origin);
+        if (constants.lowerLeft.w == 0.0f)
+        {
+            direction = glm::normalize(dir);
+            return;
+        }
+
+        //The forward component of dir is 1, so the focus plane is at origin + dir * focusDistance
+        const glm::vec3 focusPoint = origin + dir * constants.origin.w;
+        origin += lensSample.x * glm::vec3(constants.lensU) + lensSample.y * glm::vec3(constants.lensV);
+        direction = glm::normalize(focusPoint - origin);
+    }
+
+    /** @brief Radical inverse of index in the given base, (2, 3) gives the Halton sequence used for the jitter */
+    static float Halton(uint32_t index, uint32_t base)
+    {
+        float result = 0.0f;
+        float fraction = 1.0f;
+        while (index > 0)
+        {
+            fraction /= static_cast<float>(base);
+            result += fraction * static_cast<float>(index % base);
+            index /= base;
+        }
+        return result;
+    }
+
 };
\ No newline at end of file
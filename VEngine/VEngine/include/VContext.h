@@ -1,6 +1,7 @@
 #pragma once
 
 #include <accctrl.h>
+#include <array>
 #include <cstdint>
 #include <optional>
 #include <vector>
@@ -10,10 +11,24 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <VCamera.h>
+#include <VDeletionQueue.h>
+#include <VDenoiser.h>
 #include <VDevice.h>
 #include <VInitializers.h>
+#include <VInterleave.h>
+#include <VJobSystem.h>
+#include <VLightBvh.h>
+#include <VLightTable.h>
+#include <VMaterialTable.h>
 #include <VTools.h>
+#include <VTransientPool.h>
 #include <VObject.h>
+#include <VPrimitive.h>
+#include <VQualityPreset.h>
+#include <VResolutionController.h>
+#include <VSampler.h>
+#include <VSceneTable.h>
+#include <VWavefront.h>
 
 //#include <vulkan/vulkan.h>
 //#define VK_USE_PLATFORM_WIN32_KHR
@@ -41,9 +56,129 @@ struct Semaphore {
 };
 
 struct UniformData {
-    glm::mat4 viewInverse;
-    glm::mat4 projInverse;
+    glm::mat4 view;
+    glm::mat4 projection;
+    CameraConstants camera;
+    // x: samples per pixel, y: frames already accumulated (0 restarts the average), z: frame number used as seed
     glm::vec4 data;
+    // x: light sampler (see LightSampler), y: flags, z: ReSTIR candidates, w: ReSTIR neighbours
+    glm::uvec4 settings;
+    // Ray constants of the previous frame, to find where a surface was seen
+    CameraConstants previousCamera;
+};
+
+// Flags sent in UniformData::settings.y
+constexpr uint32_t RESTIR_ENABLED = 1;
+// The reservoirs of the previous frame can be reused
+constexpr uint32_t RESTIR_HISTORY = 2;
+// The primary hits were traced by the visibility pass
+constexpr uint32_t VISIBILITY_BUFFER_ENABLED = 4;
+// The ray tracing pass writes the guides of the CPU denoiser
+constexpr uint32_t DENOISER_GUIDES = 8;
+// The ray tracing pass writes the motion and surface of every pixel for the temporal reprojection
+constexpr uint32_t TEMPORAL_REPROJECTION = 16;
+// The InterleaveMode of the ray tracing pass is in the 2 bits from INTERLEAVE_SHIFT (see VInterleave.h)
+
+// Bits of the primitive index in the visibility buffer, the instance index gets the rest (see visibility.glsl)
+constexpr uint32_t VISIBILITY_PRIMITIVE_BITS = 22;
+
+// Reservoir of one pixel for the reservoir resampling of the direct light, same layout as Reservoir in ray_gen.glsl
+struct RestirReservoir {
+    // xyz: sampled point on the light, w: index of the light (bits of a uint)
+    glm::vec4 lightPoint;
+    float M;
+    float W;
+    // Normal (packSnorm4x8) and distance to the camera of the surface owning the reservoir
+    uint32_t normal;
+    float depth;
+};
+
+// History of one pixel for the temporal reprojection, same layout as TemporalSample in temporal.glsl
+struct TemporalSample {
+    // rgb: mean radiance, a: samples
+    glm::vec4 radiance;
+    // Mean squared luminance
+    float moment;
+    // Distance to the camera (0 for the sky) and normal (packSnorm4x8) of the surface
+    float depth;
+    uint32_t normal;
+    // Distance of the same point to the camera of the previous frame
+    float previousDepth;
+};
+
+// Push constants of the temporal reprojection pass
+struct TemporalConstants {
+    // Width of the box the history is clamped to, in standard deviations of the neighbourhood
+    float clampGamma;
+    // Samples the reprojected history counts for at most
+    float historyLimit;
+    uint32_t frame;
+    // 0: blend into the history, 1: copy the history back into the accumulation
+    uint32_t pass;
+    // 1 when the accumulation restarted because of motion and the history of the previous frame is valid
+    uint32_t reproject;
+    // InterleaveMode of the ray tracing pass, the pixels it skipped are left alone
+    uint32_t interleave;
+};
+
+// Push constants of the tonemap pass
+struct TonemapConstants {
+    float exposure;
+    // 0: clamp, 1: Reinhard, 2: ACES
+    uint32_t tonemapOperator;
+};
+
+// Side of the tiles of the adaptive sampling map, same as TILE_SIZE in adaptive.comp
+constexpr uint32_t ADAPTIVE_TILE_SIZE = 8;
+
+// Push constants of the adaptive sampling pass
+struct AdaptiveSamplingConstants {
+    // Mean relative standard error under which a tile stops receiving samples
+    float errorThreshold;
+    uint32_t maxSamples;
+    // Samples every pixel of a tile receives before its variance estimate is trusted
+    uint32_t minSamples;
+    // 0: uniform sampling, the error is still measured so both modes can be compared
+    uint32_t enabled;
+    uint32_t frame;
+    // 1 when the ray tracing pass of this frame restarted the accumulation
+    uint32_t restarted;
+};
+
+// Written by the adaptive sampling pass of a frame, read back once the frame has completed
+struct AdaptiveSamplingStats {
+    // Primary samples traced by the frame
+    uint32_t samples;
+    // Tiles that receive samples in the next frame
+    uint32_t activeTiles;
+    // Sum of the tile errors, 1/1024 fixed point
+    uint32_t errorSum;
+    uint32_t tileCount;
+};
+
+// Push constants of the wavefront kernels, same as WavefrontConstants in wavefront_data.glsl
+struct WavefrontConstants {
+    uint32_t bounce;
+    uint32_t maxBounces;
+    // One path per pixel
+    uint32_t pathCount;
+    uint32_t width;
+    uint32_t softShadows;
+    uint32_t reflections;
+};
+
+// Queues and path states of the wavefront path tracer (set 1 of the wavefront pipelines)
+struct WavefrontBuffers {
+    // WavefrontCounters, cleared by the frame before every stage that appends to a queue
+    VBuffer::Buffer counters;
+    VBuffer::Buffer paths;
+    VBuffer::Buffer hits;
+    // Two queues of path indices, the extension rays of the current and of the next bounce
+    VBuffer::Buffer rayQueues;
+    VBuffer::Buffer sortedQueue;
+    VBuffer::Buffer shadowRays;
+    // WavefrontDispatch of the compute stages of the current bounce, sized from its queue on the GPU
+    VBuffer::Buffer dispatchArgs;
 };
 
 struct SwapChainBuffer {
@@ -57,6 +192,7 @@ struct SwapChain {
     /** @brief Handle to the current swap chain, required for recreation */
     VkSwapchainKHR swapChain = nullptr;
     uint32_t imageCount;
+    VkExtent2D extent{};
     std::vector<VkImage> images;
     std::vector<SwapChainBuffer> buffers;
     /** @brief Queue family index of the detected graphics and presenting device queue */
@@ -69,9 +205,54 @@ struct AccelerationStructure {
     uint64_t handle;
 };
 
+/** @brief Everything a frame in flight owns, reused once the GPU has finished the frame submitted with it */
+struct FrameData {
+    VkCommandBuffer commandBuffer{};
+    // Signaled when the GPU has finished the frame submitted with this slot
+    VkFence fence{};
+    Semaphore semaphores{};
+    VBuffer::Buffer ubo;
+    VkDescriptorSet descriptorSet{};
+    VkDescriptorSet tonemapDescriptorSet{};
+    VkDescriptorSet adaptiveDescriptorSet{};
+    VkDescriptorSet temporalDescriptorSet{};
+    // Only written once the wavefront buffers exist
+    VkDescriptorSet wavefrontDescriptorSet{};
+    // AdaptiveSamplingStats of the frame, host visible
+    VBuffer::Buffer adaptiveStats;
+    // Lights and their alias table, rebuilt when the camera moves so each frame owns its copy
+    VBuffer::Buffer lightBuffer;
+    VBuffer::Buffer lightAliasBuffer;
+    // TLAS rebuilt at the start of the frame, each slot owns one so frames in flight never share it
+    AccelerationStructure topLevelAS{};
+    VBuffer::Buffer instanceBuffer;
+    VBuffer::Buffer scratchBuffer;
+    // Transforms of the instances in the previous frame, rows of a 3x4 matrix, for the motion of moving objects
+    VBuffer::Buffer previousTransformBuffer;
+    uint32_t instanceCapacity = 0;
+    // Trace half of the frame, submitted on its own when the CPU denoiser runs between the trace and the tonemap
+    VkCommandBuffer denoiseCommandBuffer{};
+    // Only used when the TLAS is built on the async compute queue
+    VkCommandBuffer computeCommandBuffer{};
+    VkSemaphore asBuildComplete{};
+    // First of the two timestamp queries of this slot
+    uint32_t timestampQuery = 0;
+    // Render targets version the descriptor set was written with
+    uint32_t targetsVersion = 0;
+    // Frame value of the last submission using this slot
+    uint64_t frameValue = 0;
+};
+
+struct RayTracingPipeline {
+    VkPipeline pipeline{};
+    VBuffer::Buffer shaderBindingTable;
+};
+
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    //Compute only family, used for async compute when available
+    std::optional<uint32_t> computeFamily;
 
     [[nodiscard]] bool isComplete() const
     {
@@ -132,8 +313,26 @@ public:
     void CreateBottomLevelAccelerationStructure(const VkGeometryNV* geometries);
     void CreateTopLevelAccelerationStructure(AccelerationStructure& accelerationStruct, int instanceCount) const;
     void CreateStorageImage();
+    void CreateTargetImage(StorageImage& target, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT);
+    void createSceneGeometry(const std::vector<VObject>& objects);
     void createScene(std::vector<VObject>& objects);
     void createRayTracingPipeline();
+    void createTonemapPipeline();
+    void createAdaptiveSamplingPipeline();
+    void SetAdaptiveSampling(bool enabled);
+    void SetLightSampler(LightSampler sampler);
+    void SetRestir(bool enabled);
+    void SetRestirCandidates(uint32_t candidates);
+    void SetRestirNeighbours(uint32_t neighbours);
+    void createWavefrontPipelines();
+    void createWavefrontBuffers();
+    void destroyWavefrontBuffers();
+    void recordWavefront(VkCommandBuffer cmdBuffer, const FrameData& frame) const;
+    void SetWavefront(bool enabled);
+    void createVisibilityPipeline();
+    void SetVisibilityBuffer(bool enabled);
+    void SetQualityPreset(QualityPreset preset);
+    void SetSamplerType(SamplerType type);
     void createSynchronizationPrimitives();
     void createPipelineCache();
     void setupFrameBuffer();
@@ -143,14 +342,36 @@ public:
     void createDescriptorSets();
     void createUniformBuffer();
     void updateUniformBuffers(bool updateAcc);
-    void buildCommandbuffers();
-    void setupRayTracingSupport(std::vector<VObject>& objects, std::vector<int>& trianglesNumber);
-    void prepareFrame();
-    void submitFrame() const;
+    void recordCommandBuffer(const FrameData& frame, uint32_t imageIndex);
+    void recordTrace(VkCommandBuffer cmdBuffer, const FrameData& frame) const;
+    void createDenoiserBuffers();
+    void destroyDenoiserBuffers();
+    void recordDenoiseTrace(const FrameData& frame) const;
+    void runDenoiser();
+    void SetDenoiser(bool enabled);
+    void createTemporalPipeline();
+    void recordTemporalReprojection(VkCommandBuffer cmdBuffer, const FrameData& frame) const;
+    void SetTemporalReprojection(bool enabled);
+    void recordInterleaveReconstruction(VkCommandBuffer cmdBuffer, const FrameData& frame) const;
+    void SetInterleaveMode(InterleaveMode mode);
+    void writeDescriptorSet(FrameData& frame);
+    void setupRayTracingSupport(std::vector<VObject>& objects, const std::vector<VLight>& lights, std::vector<int>& trianglesNumber);
+    VkResult prepareFrame(const FrameData& frame);
+    void submitFrame(const FrameData& frame);
+    void windowResize();
+    void resizeRenderTargets();
+    static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
     void draw();
     void SetupDebugMessenger();
     void CleanUp();
     void UpdateObjects(std::vector<VObject>& objects);
+    void UpdateObjects(const std::vector<glm::mat3x4>& transforms);
+    void createFrameTopLevel(FrameData& frame, uint32_t instanceCount);
+    void recordTopLevelBuild(VkCommandBuffer cmdBuffer, const FrameData& frame) const;
+    void DestroyDeferred(const VBuffer::Buffer& buffer);
+    void DestroyDeferred(const AccelerationStructure& accelerationStruct);
+    void DestroyDeferred(const StorageImage& image);
+    void DestroyDeferred(VkDeviceMemory memory);
     
     void InitOptix();
     void AllocateBuffers();
@@ -198,6 +419,8 @@ public:
     uint32_t getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, VkBool32* memTypeFound = nullptr) const;
     VkPipelineShaderStageCreateInfo loadShader(std::string file_name, VkShaderStageFlagBits stage);
     static VkBool32 getSupportedDepthFormat(VkPhysicalDevice physicalDevice, VkFormat* depthFormat);
+    uint32_t addTransientBuffer(VTransientPool& pool, VkBufferUsageFlags usageFlags, VkDeviceSize size, uint32_t firstUse, uint32_t lastUse, VBuffer::Buffer* buffer) const;
+    VkDeviceMemory bindTransientBuffers(VTransientPool& pool, std::vector<VBuffer::Buffer>& buffers, VkMemoryPropertyFlags memoryPropertyFlags) const;
     VkDeviceSize copyShaderIdentifier(uint8_t* data, const uint8_t* shaderHandleStorage, uint32_t groupIndex) const;
     bool CheckValidationLayerSupport() const;
     bool IsDeviceSuitable(VkPhysicalDevice device);
@@ -218,7 +441,8 @@ public:
     VkResult acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex) const;
     VkResult queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore) const;
     VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory, void* data = nullptr) const;
-    VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VBuffer::Buffer* buffer, VkDeviceSize size, void* data = nullptr) const;
+    VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VBuffer::Buffer* buffer, VkDeviceSize size, void* data = nullptr,
+                          bool sharedWithCompute = false) const;
 #pragma endregion
 
 #pragma region Getter Setters
@@ -264,20 +488,137 @@ public:
     QueueFamilyIndices queueFamily;
     VkQueue graphicsQueue{};
     VkQueue presentQueue{};
+    //Build the TLAS on a dedicated compute queue, must be set before createLogicalDevice
+    bool useAsyncCompute = false;
+    //Graphics and compute families, buffers used by both queues are shared between them (VK_SHARING_MODE_CONCURRENT)
+    std::vector<uint32_t> asyncQueueFamilies;
+    VkQueue computeQueue{};
+    VkCommandPool computeCommandPool{};
 
 
 
     //Commands
     VkCommandPool commandPool{};
-    std::vector<VkCommandBuffer> commandBuffers;
+
+    //Frames in flight, must be set before CreateCommandBuffers
+    uint32_t framesInFlight = 2;
+    std::vector<FrameData> frames;
+    uint32_t currentFrame = 0;
+    //Fence of the last frame that rendered to each swap chain image
+    std::vector<VkFence> imagesInFlight;
+    //Time in ms the CPU spent waiting for the GPU during the last draw
+    float cpuWaitTime = 0;
+    //Time in ms spent in the last UpdateObjects
+    float updateObjectsTime = 0;
+    //GPU time in ms of the last completed frame
+    float gpuFrameTime = 0;
+    VkQueryPool timestampPool{};
+
+    //Trace resolution, scaled from the swap chain extent by the resolution controller
+    VkExtent2D renderExtent{};
+    VResolutionController resolutionController;
+    VkFilter upscaleFilter = VK_FILTER_LINEAR;
+    uint32_t targetsVersion = 0;
+    bool framebufferResized = false;
 
     //Semaphores
     VkSemaphore imageAvailableSemaphore{};
     VkSemaphore renderFinishedSemaphore{};
 
+    //Engine-wide job system, the thread creating the context is its worker 0
+    VJobSystem jobSystem;
+
+    //Deferred destruction, frame values start at 1 so 0 means "nothing completed yet"
+    VDeletionQueue deletionQueue;
+    uint64_t frameNumber = 1;
+    uint64_t completedFrame = 0;
+
     //AccelerationStructure
     std::vector<AccelerationStructure> bottomLevelAS{};
-    AccelerationStructure topLevelAS{};
+    std::vector<GeometryInstance> sceneInstances;
+    VSceneTable sceneTable;
+    VMaterialTable materialTable;
+    //Lights of the scene, the table is rebuilt around the camera by updateUniformBuffers
+    std::vector<VLight> sceneLights;
+    VLightTable lightTable;
+    //Static lights, the tree is built once at setup
+    VLightBvh lightBvh;
+    VBuffer::Buffer lightBvhBuffer;
+    LightSampler lightSampler = LightSampler::AliasTable;
+
+    //Reservoir resampling of the direct light (ReSTIR). Two reservoirs per pixel: the one written this frame and the
+    //one of the previous frame, reused temporally and spatially
+    VBuffer::Buffer reservoirBuffer;
+    bool restirEnabled = false;
+    bool restirHistory = false;
+    //Candidates drawn from the light sampler per pixel, previous reservoirs merged per pixel (the reprojected one
+    //first, then random neighbours)
+    uint32_t restirCandidates = 8;
+    uint32_t restirNeighbours = 3;
+
+    //Wavefront path tracing: camera rays, extension rays, material shading and shadow rays run as separate passes and
+    //exchange paths through queues (see wavefront.glsl). The buffers only exist while the mode is enabled
+    bool wavefrontEnabled = false;
+    WavefrontBuffers wavefrontBuffers;
+    //Raygen groups of the extension and shadow stages, then the miss and hit groups of the megakernel pipelines
+    RayTracingPipeline wavefrontRayPipeline{};
+    VkDeviceSize wavefrontSbtStride = 0;
+    VkPipeline wavefrontCameraPipeline{};
+    VkPipeline wavefrontBinCountPipeline{};
+    VkPipeline wavefrontBinScatterPipeline{};
+    VkPipeline wavefrontShadePipeline{};
+    VkPipeline wavefrontAccumulatePipeline{};
+    VkPipeline wavefrontArgsPipeline{};
+    VkPipelineLayout wavefrontPipelineLayout{};
+    VkDescriptorSetLayout wavefrontDescriptorSetLayout{};
+
+    //Visibility buffer: a first pass only traces the camera rays and stores instance, triangle and barycentrics of the
+    //hit, the ray tracing pass rebuilds its first hit from them instead of tracing it
+    StorageImage visibilityImage{};
+    RayTracingPipeline visibilityPipeline{};
+    VkDeviceSize visibilitySbtStride = 0;
+    bool visibilityBuffer = false;
+    //False when the scene has too many instances or triangles per instance for the packing
+    bool visibilityBufferSupported = true;
+
+    //CPU denoiser: the trace is submitted first, its radiance, moments and guides are read back and filtered on the
+    //job system, the result is uploaded to denoisedImage which the tonemap pass reads instead of the accumulation.
+    //The readback and upload buffers only exist while the denoiser is enabled
+    VDenoiser denoiser{ jobSystem };
+    bool denoiserEnabled = false;
+    StorageImage guideImage{};
+    StorageImage denoisedImage{};
+    // Accumulation image, moments image and guide image, one after the other
+    VBuffer::Buffer denoiseReadback;
+    VBuffer::Buffer denoiseUpload;
+    std::vector<float> denoiseVariance;
+    std::vector<glm::vec4> denoiseGuides;
+    std::vector<glm::vec4> denoiseAlbedo;
+    float denoiseTime = 0;
+
+    //Temporal reprojection: the ray tracing pass writes the motion of every pixel and the surface it sees, a compute
+    //pass blends the history the previous frame left on the same surface into an accumulation restarted by motion.
+    //Only the megakernel writes the surfaces, the wavefront mode keeps restarting from scratch
+    StorageImage motionImage{};
+    // Two TemporalSample per pixel, the frame parity picks the half written this frame
+    VBuffer::Buffer temporalBuffer;
+    VkPipeline temporalPipeline{};
+    VkPipelineLayout temporalPipelineLayout{};
+    VkDescriptorSetLayout temporalDescriptorSetLayout{};
+    bool temporalReprojection = true;
+    //The previous frame wrote the history at the current resolution
+    bool temporalHistory = false;
+    //This frame restarted the accumulation because of motion, the history is blended in
+    bool temporalReuse = false;
+    float temporalClampGamma = 1.25f;
+    float temporalHistoryLimit = 32.0f;
+    //Transforms of the instances in the last frame drawn
+    std::vector<glm::mat3x4> previousTransforms;
+
+    //Interleaved tracing: the megakernel only traces a checkerboard or a quarter of the pixels every frame, a restarted
+    //accumulation rebuilds the others from their neighbours and the temporal history (same layout as the reprojection)
+    VkPipeline reconstructPipeline{};
+    InterleaveMode interleaveMode = InterleaveMode::Off;
 
     //SwapChain
     SwapChain swapChain;
@@ -289,46 +630,77 @@ public:
     VkRenderPass imGuiRenderPass{};
 
     //Rendering Pipeline
-    VkPipeline Rpipeline{};
+    //One ray tracing pipeline and shader binding table per quality preset, all built at startup
+    std::array<RayTracingPipeline, QUALITY_PRESET_COUNT> rayTracingPipelines{};
+    QualityPreset qualityPreset = QualityPreset::Balanced;
     VkPipelineLayout RpipelineLayout{};
 
     //Descriptor Sets
-    VkDescriptorSet RdescriptorSet{};
     VkDescriptorSetLayout RdescriptorSetLayout{};
 
+    //Tonemap pass, resolves the accumulation image into storageImage
+    VkPipeline tonemapPipeline{};
+    VkPipelineLayout tonemapPipelineLayout{};
+    VkDescriptorSetLayout tonemapDescriptorSetLayout{};
+    float exposure = 1.0f;
+    uint32_t tonemapOperator = 0;
+
+    //Progressive accumulation, restarted whenever updateUniformBuffers is told the view changed
+    bool accumulationEnabled = true;
+    uint32_t accumulationFrame = 0;
+
+    //Adaptive sampling pass, builds the per tile sample map the ray tracing pass reads in the next frame
+    VkPipeline adaptivePipeline{};
+    VkPipelineLayout adaptivePipelineLayout{};
+    VkDescriptorSetLayout adaptiveDescriptorSetLayout{};
+    bool adaptiveSampling = true;
+    float adaptiveErrorThreshold = 0.02f;
+    uint32_t adaptiveMaxSamples = 4;
+    uint32_t adaptiveMinSamples = 8;
+    //Statistics of the last completed frame: rays traced relative to one sample per pixel, mean tile error
+    float adaptiveRayRatio = 1.0f;
+    float adaptiveError = 0;
+
+    //Sequence drawn by the raygen sampler (see sampling.glsl), sent in data.w
+    SamplerType samplerType = SamplerType::Sobol;
+
     VkDescriptorPool descriptorPool{};
     std::vector<VkShaderModule> shaderModules;
 
-    uint32_t indexCount{};
 
-
-    VBuffer::Buffer mShaderBindingTable;
+    //Scene-wide geometry, every object is a range of these buffers (see sceneTable)
     VBuffer::Buffer vertexBuffer;
     VBuffer::Buffer indexBuffer;
-    VBuffer::Buffer ubo;
     VBuffer::Buffer matBuffer;
-    VBuffer::Buffer vertBuffer;
-    VBuffer::Buffer NumberOfTriangles;
+    VBuffer::Buffer materialIdBuffer;
+    VBuffer::Buffer instanceOffsetBuffer;
+    //Primitive type of every instance, and object space AABB of every procedural primitive for its BLAS
+    VBuffer::Buffer primitiveTypeBuffer;
+    VBuffer::Buffer aabbBuffer;
     VBuffer::Buffer TimeBuffer;
+    VBuffer::Buffer blueNoiseBuffer;
 
     StorageImage storageImage{};
     StorageImage accImage{};
+    StorageImage momentsImage{};
+    StorageImage sampleMapImage{};
     VkPhysicalDeviceRayTracingPropertiesNV rayTracingProperties{};
-    std::vector<VkFence> waitFences;
     VkFormat depthFormat;
     VkPipelineCache pipelineCache{};
     UniformData uniformData{};
 
     uint32_t currentBuffer = 0;
-    Semaphore semaphores{};
-    VkSubmitInfo submitInfo{};
     VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
     VkMemoryRequirements2 memReqBottomLevelAS;
     Camera camera;
 
+    //Scene vertex layout: pos.xyz, instance id, normal.xyz, padding. The position comes first so the BLAS reads it in place
+    static constexpr uint32_t SCENE_VERTEX_FLOATS = 8;
     std::vector<float> bufferVertices;
     std::vector<uint32_t> sceneIndices;
+    std::vector<uint32_t> sceneMaterialIds;
+    std::vector<float> sceneAabbs;
     struct
     {
         VkImage image;
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+/**
+* Deferred destruction of GPU resources.
+*
+* Every entry is tagged with the frame (or timeline) value of the last submission that used the resource.
+* Entries are only released once that value is known to have completed on the GPU, so replacing a resource
+* never requires the CPU to wait for the device.
+*/
+class VDeletionQueue
+{
+public:
+    VDeletionQueue() = default;
+    ~VDeletionQueue() = default;
+
+    /**
+    * Queue a resource for destruction
+    *
+    * @param frameValue Frame value of the last submission using the resource
+    * @param deleter Function releasing the resource
+    */
+    void Push(uint64_t frameValue, std::function<void()> deleter)
+    {
+        // Keep the queue sorted by frame value, entries with the same value stay in push order
+        const auto it = std::upper_bound(m_entries.begin(), m_entries.end(), frameValue,
+            [](uint64_t value, const Entry& entry) { return value < entry.frameValue; });
+        m_entries.insert(it, Entry{ frameValue, std::move(deleter) });
+    }
+
+    /**
+    * Release every resource whose last use has completed
+    *
+    * @param completedValue Last frame value known to be finished on the GPU
+    *
+    * @return Number of resources released
+    */
+    size_t Collect(uint64_t completedValue)
+    {
+        size_t released = 0;
+        while (!m_entries.empty() && m_entries.front().frameValue <= completedValue)
+        {
+            // Pop before calling so a deleter can safely push new entries
+            Entry entry = std::move(m_entries.front());
+            m_entries.pop_front();
+            entry.deleter();
+            released++;
+        }
+        return released;
+    }
+
+    /** @brief Release everything, only valid once the device is idle */
+    void Flush()
+    {
+        Collect(UINT64_MAX);
+    }
+
+    size_t Size() const { return m_entries.size(); }
+    bool Empty() const { return m_entries.empty(); }
+
+private:
+    struct Entry
+    {
+        uint64_t frameValue;
+        std::function<void()> deleter;
+    };
+
+    std::deque<Entry> m_entries;
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <VJobSystem.h>
+
+/** @brief Parameters of the à-trous filter, the defaults are the ones of the SVGF paper */
+struct VDenoiserSettings
+{
+    // Wavelet passes, the footprint doubles every pass (5 passes cover 61x61 pixels)
+    uint32_t iterations = 5;
+    // Edge stopping on the luminance, in standard deviations of the pixel
+    float sigmaLuminance = 4.0f;
+    // Exponent of the normal weight
+    float sigmaNormal = 128.0f;
+    // Edge stopping on the depth, relative to the depth gradient of the pixel
+    float sigmaDepth = 1.0f;
+    // Lowest weight of the new frame in the temporal moments, once the history is long enough
+    float temporalAlpha = 0.2f;
+};
+
+/**
+* Portable edge-aware denoiser: an à-trous wavelet filter guided by normal, depth and albedo (Spatiotemporal
+* Variance-Guided Filtering, Schied 2017), run on the CPU with the job system.
+*
+* The albedo is divided out before filtering so textures stay sharp, only the lighting is blurred. The luminance
+* weight scales with the standard deviation of every pixel: noisy pixels are filtered wide, converged ones are
+* left alone. The variance comes either from the caller (the accumulation of the ray tracing pass knows the
+* variance of its mean) or from the first and second luminance moments the denoiser integrates over the frames
+* it is given. The temporal history is dropped where the surface under a pixel changes, there is no reprojection.
+* Pixels with less than a few frames of history estimate their variance over their 3x3 neighbourhood.
+*
+* The inputs are plain arrays so the filter can run headless against reference images.
+*/
+class VDenoiser
+{
+public:
+    struct Frame
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // rgb: radiance
+        const glm::vec4* color = nullptr;
+        // (Optional) Variance of the luminance of every pixel. Pixels without one (null array or negative value) use the
+        // temporal moments, or a spatial estimate while their history is short
+        const float* variance = nullptr;
+        // (Optional) xyz: normal, w: distance to the camera, 0 where there is no surface
+        const glm::vec4* normalDepth = nullptr;
+        // (Optional) rgb: albedo of the surface
+        const glm::vec4* albedo = nullptr;
+    };
+
+    explicit VDenoiser(VJobSystem& jobSystem) : m_jobSystem(jobSystem) {}
+    ~VDenoiser() = default;
+
+    /**
+    * Filter a frame
+    *
+    * @param frame Inputs, every array holds width * height pixels
+    * @param output Filtered radiance, width * height pixels, alpha is 1
+    */
+    void Denoise(const Frame& frame, glm::vec4* output);
+
+    /** @brief Drop the temporal moments, the next frame estimates its variance spatially */
+    void Reset();
+
+    VDenoiserSettings settings;
+
+private:
+    // Build the guides, the demodulated radiance and the variance of every pixel
+    void Prepare(const Frame& frame);
+    // One wavelet pass from m_work[source] into the other buffer
+    void Filter(uint32_t step, uint32_t source);
+
+    VJobSystem& m_jobSystem;
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+
+    // xyz: normal, w: depth
+    std::vector<glm::vec4> m_guides;
+    std::vector<float> m_depthGradients;
+    std::vector<glm::vec3> m_albedo;
+    // rgb: demodulated radiance, a: variance of its luminance. Ping-pong buffers of the wavelet passes
+    std::vector<glm::vec4> m_work[2];
+
+    // Temporal moments: x: mean luminance, y: mean squared luminance, z: frames integrated
+    std::vector<glm::vec3> m_moments;
+    // Guides of the previous frame, the history of a pixel is kept while they match
+    std::vector<glm::vec4> m_previousGuides;
+};
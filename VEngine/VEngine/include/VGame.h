@@ -1,14 +1,46 @@
 #pragma once
+#include <atomic>
+#include <chrono>
 #include <optional>
+#include <thread>
 #include <optix_stubs.h>
 #include <basics.h>
 #include <VContext.h>
 #include <VLight.h>
+#include <VTripleBuffer.h>
 
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 
+/** @brief Input sampled by the main thread, values are cumulative so a dropped update loses nothing */
+struct InputState
+{
+    bool forward = false;
+    bool backward = false;
+    bool left = false;
+    bool right = false;
+    double cursorX = 0;
+    double cursorY = 0;
+    uint32_t mouseToggleCount = 0;
+};
+
+/** @brief State of the last two simulation steps, handed from the simulation thread to the render thread */
+struct SceneSnapshot
+{
+    std::vector<glm::mat3x4> previousTransforms;
+    std::vector<glm::mat3x4> currentTransforms;
+    glm::vec3 previousCameraPosition{};
+    glm::vec3 cameraPosition{};
+    float previousPitch = 0;
+    float pitch = 0;
+    float previousYaw = 0;
+    float yaw = 0;
+    // Time (glfwGetTime) the current step corresponds to
+    double stepTime = 0;
+    uint64_t step = 0;
+};
+
 class Game
 {
 public:
@@ -20,7 +52,9 @@ public:
     void InitAPI();
     void SetupGame();
     void GameLoop();
-    void InputManager();
+    void InputManager(InputState& input);
+    void SimulationLoop();
+    void SimulationStep(const InputState& input);
     static void CursorCallBack(GLFWwindow *window, double xpos, double ypos );
     void DenoiseImage(const VkImage& imgIn, VkImage& imgOut);
     void InitOptix();
@@ -43,5 +77,13 @@ public:
     std::vector<VLight> m_lights;
     std::vector<int> trianglesNumber;
     std::vector<float> time{};
+
+    //Simulation thread, it owns m_objects once the game loop has started
+    double m_simulationStep = 1.0 / 60.0;
+    std::thread m_simulationThread;
+    std::atomic<bool> m_running{ false };
+    Camera m_simCamera;
+    VTripleBuffer<InputState> m_input;
+    VTripleBuffer<SceneSnapshot> m_snapshots;
 };
 
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+
+/**
+* Interleaved tracing of the megakernel: every frame traces a subset of the pixels, the pattern moves with the frame
+* number so every pixel is traced after 2 (checkerboard) or 4 (quarter) frames.
+*
+* The mapping from launch index to pixel is in interleave.glsl. While the view is static the skipped pixels keep
+* their accumulation, after a restart reconstruct.comp rebuilds them from their traced neighbours and the history.
+*/
+enum class InterleaveMode : uint32_t
+{
+    Off,
+    //Half of the pixels, alternating every frame
+    Checkerboard,
+    //One pixel of every 2x2 block, cycling over the block in 4 frames
+    Quarter,
+    Count
+};
+
+constexpr uint32_t INTERLEAVE_MODE_COUNT = static_cast<uint32_t>(InterleaveMode::Count);
+//First bit of the mode in the settings flags of the uniform buffer, same value as in interleave.glsl
+constexpr uint32_t INTERLEAVE_SHIFT = 5;
+
+//Launch size of the ray generation shaders for a render target of width x height, updated in place
+inline void GetInterleavedLaunchSize(InterleaveMode mode, uint32_t& width, uint32_t& height)
+{
+    if (mode != InterleaveMode::Off)
+        width = (width + 1) / 2;
+    if (mode == InterleaveMode::Quarter)
+        height = (height + 1) / 2;
+}
+
+inline const char* GetInterleaveModeName(InterleaveMode mode)
+{
+    switch (mode)
+    {
+    case InterleaveMode::Checkerboard:
+        return "Checkerboard";
+    case InterleaveMode::Quarter:
+        return "Quarter";
+    case InterleaveMode::Off:
+    default:
+        return "Off";
+    }
+}
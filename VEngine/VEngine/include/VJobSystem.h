@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Work-stealing job system shared by the whole engine.
+*
+* Every worker owns a Chase-Lev deque: it pushes and pops jobs at the bottom while idle workers steal from
+* the top. The thread that created the system is worker 0 and executes jobs while it waits on a counter.
+* Threads that are not workers (the simulation thread for instance) submit through a shared queue.
+*/
+class VJobSystem
+{
+    struct Job;
+
+public:
+    using JobFunction = std::function<void()>;
+
+    /**
+    * Number of unfinished jobs of a group. Jobs can be made to wait for a counter, they are queued once it
+    * reaches zero.
+    */
+    class Counter
+    {
+    public:
+        Counter() = default;
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+
+        bool IsDone() const { return m_value.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class VJobSystem;
+
+        std::atomic<uint32_t> m_value{ 0 };
+        std::mutex m_mutex;
+        std::vector<Job*> m_waiting;
+    };
+
+    /**
+    * @param workerCount (Optional) Number of threads, including the calling thread. 0 uses every hardware thread
+    */
+    explicit VJobSystem(uint32_t workerCount = 0);
+    ~VJobSystem();
+
+    VJobSystem(const VJobSystem&) = delete;
+    VJobSystem& operator=(const VJobSystem&) = delete;
+
+    /**
+    * Queue a job
+    *
+    * @param job Function to execute
+    * @param counter (Optional) Counter incremented now and decremented once the job has run
+    * @param dependency (Optional) The job is only queued once this counter reaches zero
+    */
+    void Run(JobFunction job, Counter* counter = nullptr, Counter* dependency = nullptr);
+
+    /** @brief Execute queued jobs on the calling thread until the counter reaches zero */
+    void Wait(Counter& counter);
+
+    /**
+    * Split [0, count) into ranges of at most grainSize elements and process them in parallel, returns once
+    * every range is done
+    *
+    * @param count Number of elements
+    * @param grainSize Maximum number of elements per job, 0 picks a size giving a few jobs per worker
+    * @param function Called with the [begin, end) range of each job
+    */
+    void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function);
+
+    uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_queues.size()); }
+
+private:
+    /** @brief Chase-Lev deque: the owner pushes and pops at the bottom, thieves take from the top */
+    class WorkQueue
+    {
+    public:
+        static constexpr int64_t CAPACITY = 4096;
+
+        bool Push(Job* job);
+        Job* Pop();
+        Job* Steal();
+
+    private:
+        std::atomic<int64_t> m_top{ 0 };
+        std::atomic<int64_t> m_bottom{ 0 };
+        std::atomic<Job*> m_jobs[CAPACITY]{};
+    };
+
+    void WorkerLoop(uint32_t index);
+    void Submit(Job* job);
+    Job* FindJob(uint32_t index);
+    void Execute(Job* job);
+    static void Finish(VJobSystem& system, Counter* counter);
+    int32_t GetCurrentWorker() const;
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    // Jobs submitted from threads that are not workers
+    std::mutex m_sharedMutex;
+    std::deque<Job*> m_sharedJobs;
+
+    // Sleeping workers are woken when jobs are queued
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<uint32_t> m_queuedJobs{ 0 };
+    std::atomic<bool> m_running{ true };
+};
@@ -2,15 +2,15 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 
+/**
+* GPU light, uploaded as is (std430, two vec4 per light). Spherical area light.
+* position: center and radius
+* colorIntensity: color and intensity, the radiance reaching a point at distance d is color * intensity / d²
+*/
 struct VLightData
 {
-    glm::vec4 position;
-    glm::mat4 transform;
-    glm::vec3 sizeIntensity;
-    glm::vec3 recDirx{1, 0, 0};
-    glm::vec3 recDiry{0, 1, 0};
-    float dummyFloat{0};
-
+    glm::vec4 position{0, 0, 0, 1};
+    glm::vec4 colorIntensity{1, 1, 1, 1};
 };
 class VLight
 {
@@ -20,27 +20,34 @@ public:
 
     void SetPosition(glm::vec3 pos)
     {
-        const glm::mat4 translate = glm::translate(glm::mat4(1.0f), pos);
-        transMat = translate;
-        data.transform = glm::transpose(transMat * rotationMat * scaleMat);
+        transMat = glm::translate(glm::mat4(1.0f), pos);
+        UpdatePosition();
     }
     void Translate(glm::vec3 pos)
     {
-        const glm::mat4 translate = glm::translate(glm::mat4(1.0f), pos);
-        transMat *= translate;
-        data.transform = transMat * rotationMat * scaleMat;
+        transMat *= glm::translate(glm::mat4(1.0f), pos);
+        UpdatePosition();
     }
     void SetRotation(glm::vec3 angle)
     {
         rotationMat = glm::rotate(rotationMat, glm::radians(angle.x), glm::vec3(1, 0, 0));
         rotationMat = glm::rotate(rotationMat, glm::radians(angle.y), glm::vec3(0, 1, 0));
         rotationMat = glm::rotate(rotationMat, glm::radians(angle.z), glm::vec3(0, 0, 1));
-        data.transform = glm::transpose(transMat * rotationMat * scaleMat);
+        UpdatePosition();
     }
+    void SetRadius(float radius) { data.position.w = radius; }
+    void SetColor(float r, float g, float b) { data.colorIntensity = glm::vec4(r, g, b, data.colorIntensity.w); }
+    void SetIntensity(float intensity) { data.colorIntensity.w = intensity; }
 
     glm::mat4 transMat;
     glm::mat4 rotationMat;
     glm::mat4 scaleMat;
     VLightData data{};
-};
 
+private:
+    void UpdatePosition()
+    {
+        const glm::mat4 transform = transMat * rotationMat * scaleMat;
+        data.position = glm::vec4(glm::vec3(transform[3]), data.position.w);
+    }
+};
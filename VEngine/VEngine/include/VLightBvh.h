@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <VJobSystem.h>
+#include <VLight.h>
+
+/** @brief How the shaders pick the light of a shadow ray */
+enum class LightSampler : uint32_t
+{
+    AliasTable,
+    Bvh,
+    Count
+};
+
+constexpr uint32_t LIGHT_SAMPLER_COUNT = static_cast<uint32_t>(LightSampler::Count);
+//Below this many lights the alias table is as good as the tree and cheaper to sample
+constexpr size_t LIGHT_BVH_MIN_LIGHTS = 16;
+
+inline const char* GetLightSamplerName(LightSampler sampler)
+{
+    return sampler == LightSampler::Bvh ? "Light BVH" : "Alias table";
+}
+
+/**
+* GPU node of the light BVH, uploaded as is (std430, 64 bytes).
+* boundsMin: bounds of the lights, w: their total power
+* boundsMax: bounds of the lights, w: cosine of the spread of their normal cone (-1 for omnidirectional lights)
+* axis: axis of the normal cone, w: cosine of the emission spread around the normals
+* first, second: children of an interior node, light index and LIGHT_BVH_LEAF for a leaf
+*/
+struct VLightBvhNode
+{
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    glm::vec4 axis;
+    uint32_t first;
+    uint32_t second;
+    uint32_t padding[2];
+};
+
+/**
+* Bounding volume hierarchy over the scene lights, one light per leaf.
+*
+* Every node bounds the position, the power and the emission directions of its lights. The shader walks down the
+* tree picking a child with a probability proportional to its importance at the shading point, so lights that
+* are far, dim or facing away are rarely picked even among thousands of emitters.
+*
+* The build is a linear BVH (Karras 2012): lights are sorted on the Morton code of their center, every interior
+* node is found independently from the sorted codes and the bounds are merged bottom-up, all three steps run on
+* the job system.
+*/
+class VLightBvh
+{
+public:
+    VLightBvh() = default;
+    ~VLightBvh() = default;
+
+    /**
+    * Build the tree
+    *
+    * @param lights Scene lights, leaves reference them by index
+    * @param jobSystem Job system running the build
+    */
+    void Build(const std::vector<VLightData>& lights, VJobSystem& jobSystem);
+
+    /**
+    * CPU reference of the traversal of ray_gen.glsl
+    *
+    * @param position Shading point
+    * @param normal Shading normal, zero to ignore the orientation of the receiver
+    * @param u Uniform number in [0, 1), consumed by the traversal
+    * @param pdf Probability of picking the returned light
+    *
+    * @return Index of the light, -1 if no light can reach the point
+    */
+    int32_t SampleLight(const glm::vec3& position, const glm::vec3& normal, float u, float& pdf) const;
+
+    /** @brief Importance of a node at a shading point, same as the shader */
+    static float Importance(const VLightBvhNode& node, const glm::vec3& position, const glm::vec3& normal);
+
+    const std::vector<VLightBvhNode>& GetNodes() const { return m_nodes; }
+    size_t GetNodeCount() const { return m_nodes.size(); }
+
+private:
+    std::vector<VLightBvhNode> m_nodes;
+};
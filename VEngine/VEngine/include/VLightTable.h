@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <VLight.h>
+
+/**
+* Scene lights and the alias table used to pick one of them.
+*
+* A light is picked with a probability proportional to its estimated contribution at a reference point (the
+* camera): its power over its squared distance. The alias table (Vose's method) makes the pick O(1) on the GPU
+* with a single uniform number, whatever the number of lights.
+*/
+class VLightTable
+{
+public:
+    /** @brief Entry of the alias table, uploaded as is (std430, 16 bytes) */
+    struct AliasEntry
+    {
+        // Probability of keeping this entry instead of its alias
+        float probability;
+        uint32_t alias;
+        // Probability of picking the light of this entry, the estimator divides by it
+        float pdf;
+        float padding;
+    };
+
+    VLightTable() = default;
+    ~VLightTable() = default;
+
+    /**
+    * Gather the lights and build the alias table
+    *
+    * @param lights Scene lights
+    * @param reference Point the contributions are estimated at
+    */
+    void Build(const std::vector<VLight>& lights, const glm::vec3& reference);
+
+    /**
+    * Estimated contribution of a light at a point, power over squared distance
+    *
+    * @param light Light to estimate
+    * @param position Point receiving the light
+    */
+    static float EstimateContribution(const VLightData& light, const glm::vec3& position);
+
+    /** @brief Power of a light, its intensity weighted by the luminance of its color */
+    static float GetPower(const VLightData& light);
+
+    const std::vector<VLightData>& GetLights() const { return m_lights; }
+    const std::vector<AliasEntry>& GetAliasTable() const { return m_aliasTable; }
+    size_t GetLightCount() const { return m_lights.size(); }
+
+private:
+    std::vector<VLightData> m_lights;
+    std::vector<AliasEntry> m_aliasTable;
+};
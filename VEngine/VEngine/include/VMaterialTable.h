@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* GPU material, uploaded as is (std430, two vec4 per material).
+* colorAndRoughness: albedo and roughness
+* ior: material type (1 diffuse, 2 metal, 3 emissive), reflectivity, index of refraction, unused
+*/
+struct VMaterial
+{
+    glm::vec4 colorAndRoughness;
+    glm::vec4 ior;
+};
+
+/**
+* Scene-wide material table.
+*
+* Materials are deduplicated on their content, so every instance and every mesh using the same material
+* shares one entry. Primitives reference the table with the id returned by Add.
+*/
+class VMaterialTable
+{
+public:
+    VMaterialTable() = default;
+    ~VMaterialTable() = default;
+
+    /**
+    * Add a material, or find the identical one already in the table
+    *
+    * @param material Material to add
+    *
+    * @return Id of the material in the table
+    */
+    uint32_t Add(const VMaterial& material);
+
+    void Clear();
+
+    const VMaterial& GetMaterial(uint32_t id) const { return m_materials[id]; }
+    /** @brief Materials to upload, indexed by material id */
+    const std::vector<VMaterial>& GetMaterials() const { return m_materials; }
+    size_t GetMaterialCount() const { return m_materials.size(); }
+
+private:
+    using Key = std::array<float, 8>;
+
+    std::vector<VMaterial> m_materials;
+    std::map<Key, uint32_t> m_ids;
+};
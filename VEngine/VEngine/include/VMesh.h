@@ -10,6 +10,7 @@
 #include <map>
 
 #include <VInitializers.h>
+#include <VMaterialTable.h>
 
 struct GeometryInstance
 {
@@ -37,6 +38,7 @@ public:
     void LoadMesh(const std::string& path, bool flipNormals);
     void processNode(aiNode *node, const aiScene *scene);
     void processMesh(aiMesh* mesh, const aiScene* scene);
+    void processMaterials(const aiScene* scene);
 
 
 
@@ -54,6 +56,10 @@ public:
 
     const std::vector<Vertex>& GetVertices() const {return vertices;}
     const std::vector<uint32_t>& GetIndices() const {return indices;}
+    /** @brief Materials of the model file (MTL), in file order */
+    const std::vector<VMaterial>& GetMaterials() const {return materials;}
+    /** @brief Index into GetMaterials() of every triangle */
+    const std::vector<uint32_t>& GetMaterialIds() const {return materialIds;}
 
     VBuffer::Buffer meshBuffer;
     GeometryInstance meshGeometry;
@@ -62,5 +68,7 @@ public:
 private:
     std::vector<uint32_t> indices;
     std::vector<Vertex> vertices;
+    std::vector<VMaterial> materials;
+    std::vector<uint32_t> materialIds;
     std::string directory;
 };
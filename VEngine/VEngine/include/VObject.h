@@ -1,14 +1,10 @@
 #pragma once
 #include <VMesh.h>
+#include <VMaterialTable.h>
+#include <VPrimitive.h>
 #include <glm/glm.hpp>
 #include <vector>
 
-struct VMaterial
-{
-    glm::vec4 colorAndRoughness;
-    glm::vec4 ior;
-};
-
 struct Material
 {
     std::vector<VMaterial> m_materials;
@@ -56,19 +52,29 @@ public:
         m_transform = glm::transpose(translationMat * rotationMat * scaleMat);
         m_mesh.meshGeometry.transform = m_transform;
     }
+    //Setting any material value overrides the materials of the model file for the whole object
     void SetColor(float r, float g, float b)
     {
         m_material.colorAndRoughness = {r, g, b, m_material.colorAndRoughness.w};
+        m_overrideMaterial = true;
     }
     void SetMaterialType(int type)
     {
         m_material.ior.x = type;
+        m_overrideMaterial = true;
     }
 
     //Only if material type is "2"
     void SetReflectivity(float factor)
     {
         m_material.ior.y = factor;
+        m_overrideMaterial = true;
+    }
+
+    //Trace the object as an analytic primitive instead of a mesh, the transform places and scales the unit shape
+    void SetPrimitive(PrimitiveType type)
+    {
+        m_primitive = type;
     }
 
     const char* GetName() const
@@ -76,6 +82,10 @@ public:
 
     VMesh m_mesh;
     VMaterial m_material;
+    //Use m_material instead of the materials of the mesh
+    bool m_overrideMaterial = false;
+    //Triangle mesh, or procedural primitive traced with an intersection shader (no vertices)
+    PrimitiveType m_primitive = PrimitiveType::Mesh;
 
     glm::mat3x4 m_transform;
     glm::vec3 position;
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/** @brief Functions of shaders/primitives.glsl, compiled as C++ */
+namespace VPrimitiveShader
+{
+    using namespace glm;
+    using uint = uint32_t;
+
+#define PRIMITIVE_FUNC inline
+#include "../shaders/primitives.glsl"
+#undef PRIMITIVE_FUNC
+}
+
+/**
+* Shape of an object: a triangle mesh loaded from a model file, or one of the analytic primitives traced with an
+* intersection shader. A primitive is one AABB in its BLAS instead of a tree over every triangle of a tessellation,
+* and its normals are exact.
+*/
+enum class PrimitiveType : uint32_t
+{
+    Mesh = VPrimitiveShader::PRIMITIVE_MESH,
+    Sphere = VPrimitiveShader::PRIMITIVE_SPHERE,
+    Box = VPrimitiveShader::PRIMITIVE_BOX,
+    Disc = VPrimitiveShader::PRIMITIVE_DISC,
+    Count
+};
+
+constexpr uint32_t PRIMITIVE_TYPE_COUNT = static_cast<uint32_t>(PrimitiveType::Count);
+
+inline const char* GetPrimitiveTypeName(PrimitiveType type)
+{
+    switch (type)
+    {
+    case PrimitiveType::Sphere:
+        return "Sphere";
+    case PrimitiveType::Box:
+        return "Box";
+    case PrimitiveType::Disc:
+        return "Disc";
+    case PrimitiveType::Mesh:
+    default:
+        return "Mesh";
+    }
+}
+
+/**
+* CPU side of a procedural object: the unit shape of primitives.glsl and the transform of its instance.
+*
+* Traces world space rays with the same code as the intersection shader, and gives the bounds its BLAS is built from.
+*/
+struct VPrimitive
+{
+    PrimitiveType type = PrimitiveType::Sphere;
+    // Object to world, rows of a 3x4 matrix (see GeometryInstance)
+    glm::mat3x4 transform{ 1.0f };
+
+    /** @brief Object space AABB of a primitive type, min then max */
+    static void GetObjectBounds(PrimitiveType type, glm::vec3& min, glm::vec3& max);
+
+    /**
+    * Intersect a world space ray
+    *
+    * @param origin Origin of the ray
+    * @param direction Direction of the ray, the distance is in units of its length
+    * @param tMin Closest distance accepted
+    * @param tMax Farthest distance accepted
+    * @param normal (Optional) Normalized world space normal at the hit
+    *
+    * @return Distance to the closest hit, VPrimitiveShader::PRIMITIVE_NO_HIT if the ray misses
+    */
+    float Intersect(const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax, glm::vec3* normal = nullptr) const;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+* Quality tiers of the ray tracing pipeline.
+*
+* A preset is a set of specialization constants of ray_gen.glsl. One pipeline is created per preset from the same
+* SPIR-V, so changing the quality at runtime is a pipeline switch instead of a shader rebuild.
+*/
+enum class QualityPreset : uint32_t
+{
+    Performance,
+    Balanced,
+    Quality,
+    Count
+};
+
+/**
+* Specialization constants of ray_gen.glsl, the member order is the constant_id order.
+* Booleans are 32 bit (VkBool32) as required for bool specialization constants.
+*/
+struct QualitySettings
+{
+    uint32_t enableReflections;
+    uint32_t enableHardShadows;
+    uint32_t enableSoftShadows;
+    int32_t maxReflectionRecursion;
+    int32_t shadowSamples;
+    //Bounces of the path after the primary hit, Russian roulette usually stops it earlier
+    int32_t maxBounces;
+};
+
+constexpr uint32_t QUALITY_PRESET_COUNT = static_cast<uint32_t>(QualityPreset::Count);
+constexpr uint32_t QUALITY_CONSTANT_COUNT = sizeof(QualitySettings) / sizeof(uint32_t);
+
+inline QualitySettings GetQualitySettings(QualityPreset preset)
+{
+    switch (preset)
+    {
+    case QualityPreset::Performance:
+        return { 1, 1, 0, 1, 1, 1 };
+    case QualityPreset::Quality:
+        return { 1, 0, 1, 4, 2, 8 };
+    case QualityPreset::Balanced:
+    default:
+        return { 1, 0, 1, 2, 1, 3 };
+    }
+}
+
+inline const char* GetQualityPresetName(QualityPreset preset)
+{
+    switch (preset)
+    {
+    case QualityPreset::Performance:
+        return "Performance";
+    case QualityPreset::Quality:
+        return "Quality";
+    case QualityPreset::Balanced:
+    default:
+        return "Balanced";
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+* Dynamic resolution: picks the scale of the trace resolution relative to the output resolution so that the
+* GPU frame time stays close to a target.
+*
+* The trace cost is roughly proportional to the number of pixels, i.e. to scale², so the scale that would hit
+* the target is scale * sqrt(target / measured). The measured time is smoothed, the scale only moves by whole
+* steps and waits a few frames after every change so render targets are not recreated every frame.
+*/
+class VResolutionController
+{
+public:
+    /**
+    * @param minScale Lowest allowed scale
+    * @param maxScale Highest allowed scale
+    * @param targetFrameTime GPU frame time to reach, in ms
+    */
+    VResolutionController(float minScale = 0.5f, float maxScale = 1.0f, float targetFrameTime = 16.0f)
+        : m_minScale(minScale), m_maxScale(maxScale), m_targetFrameTime(targetFrameTime), m_scale(maxScale) {}
+    ~VResolutionController() = default;
+
+    /**
+    * Feed the GPU time of the last frame
+    *
+    * @param frameTime GPU frame time in ms
+    *
+    * @return True if the scale changed and the render targets must be resized
+    */
+    bool Update(float frameTime)
+    {
+        if (!enabled || frameTime <= 0)
+            return false;
+
+        m_averageFrameTime = m_averageFrameTime == 0 ? frameTime : m_averageFrameTime + (frameTime - m_averageFrameTime) * SMOOTHING;
+        if (++m_framesSinceChange < COOLDOWN_FRAMES)
+            return false;
+
+        const float ideal = std::clamp(m_scale * std::sqrt(m_targetFrameTime / m_averageFrameTime), m_minScale, m_maxScale);
+        if (std::fabs(ideal - m_scale) < STEP)
+            return false;
+
+        //Round toward the safe side: down when too slow, up only by whole steps that still fit the target
+        const float steps = ideal < m_scale ? std::floor(ideal / STEP) : std::floor(ideal / STEP + 0.001f);
+        const float scale = std::clamp(steps * STEP, m_minScale, m_maxScale);
+        if (scale == m_scale)
+            return false;
+
+        m_scale = scale;
+        m_framesSinceChange = 0;
+        m_averageFrameTime = 0;
+        return true;
+    }
+
+    /** @brief Size of the render target for an output size */
+    uint32_t Scale(uint32_t size) const
+    {
+        return std::max(1u, static_cast<uint32_t>(static_cast<float>(size) * m_scale + 0.5f));
+    }
+
+    void SetBounds(float minScale, float maxScale)
+    {
+        m_minScale = minScale;
+        m_maxScale = maxScale;
+        m_scale = std::clamp(m_scale, m_minScale, m_maxScale);
+    }
+    void SetTargetFrameTime(float targetFrameTime) { m_targetFrameTime = targetFrameTime; }
+    float GetScale() const { return m_scale; }
+    float GetAverageFrameTime() const { return m_averageFrameTime; }
+
+    bool enabled = true;
+
+private:
+    static constexpr float STEP = 0.05f;
+    static constexpr float SMOOTHING = 0.1f;
+    static constexpr uint32_t COOLDOWN_FRAMES = 30;
+
+    float m_minScale;
+    float m_maxScale;
+    float m_targetFrameTime;
+    float m_scale;
+    float m_averageFrameTime = 0;
+    uint32_t m_framesSinceChange = 0;
+};
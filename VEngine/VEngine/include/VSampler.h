@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/** @brief Functions of shaders/sampling.glsl, compiled as C++ */
+namespace VSampling
+{
+    using uint = uint32_t;
+    using uvec2 = glm::uvec2;
+    using vec2 = glm::vec2;
+
+    inline uint bitfieldReverse(uint v)
+    {
+        v = ((v >> 1u) & 0x55555555u) | ((v & 0x55555555u) << 1u);
+        v = ((v >> 2u) & 0x33333333u) | ((v & 0x33333333u) << 2u);
+        v = ((v >> 4u) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4u);
+        v = ((v >> 8u) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8u);
+        return (v >> 16u) | (v << 16u);
+    }
+
+#define SAMPLER_FUNC inline
+#include "../shaders/sampling.glsl"
+#undef SAMPLER_FUNC
+}
+
+enum class SamplerType : uint32_t
+{
+    Random = VSampling::SAMPLER_RANDOM,
+    Sobol = VSampling::SAMPLER_SOBOL,
+    BlueNoise = VSampling::SAMPLER_BLUE_NOISE,
+    Count
+};
+
+constexpr uint32_t SAMPLER_TYPE_COUNT = static_cast<uint32_t>(SamplerType::Count);
+
+inline const char* GetSamplerTypeName(SamplerType type)
+{
+    switch (type)
+    {
+    case SamplerType::Random:
+        return "Random";
+    case SamplerType::BlueNoise:
+        return "Blue noise";
+    case SamplerType::Sobol:
+    default:
+        return "Sobol";
+    }
+}
+
+/**
+* CPU version of the sampler of ray_gen.glsl.
+*
+* A sampler is started for a pixel and a sample index; every call to Next2D consumes the next pair of
+* dimensions, StartBounce jumps to the first dimension of a bounce. The same sequence as the GPU is produced
+* for the same pixel, sample index and dimension.
+*/
+class VSampler
+{
+public:
+    /**
+    * @param type Sequence to draw from
+    * @param blueNoise (Optional) Tile made by GenerateBlueNoiseTile, required by SamplerType::BlueNoise
+    */
+    explicit VSampler(SamplerType type, const std::vector<uint32_t>* blueNoise = nullptr)
+        : m_type(type), m_blueNoise(blueNoise) {}
+    ~VSampler() = default;
+
+    void StartPixel(uint32_t x, uint32_t y, uint32_t width, uint32_t sampleIndex);
+    void StartBounce(uint32_t bounce) { m_dimension = bounce * VSampling::DIMENSIONS_PER_BOUNCE; }
+    glm::vec2 Next2D();
+
+    /**
+    * Blue-noise tile made with the void-and-cluster method (Ulichney 1993)
+    *
+    * @param size Side of the tile, a power of two
+    * @param seed (Optional) Seed of the initial random pattern
+    *
+    * @return size * size ranks as 0.32 fixed point values, uniformly distributed
+    */
+    static std::vector<uint32_t> GenerateBlueNoiseTile(uint32_t size = VSampling::BLUE_NOISE_SIZE, uint32_t seed = 0);
+
+private:
+    SamplerType m_type;
+    const std::vector<uint32_t>* m_blueNoise;
+    uint32_t m_x = 0;
+    uint32_t m_y = 0;
+    uint32_t m_pixelSeed = 0;
+    uint32_t m_index = 0;
+    uint32_t m_dimension = 0;
+};
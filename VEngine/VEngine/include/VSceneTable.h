@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Per-instance offsets into the scene-wide vertex and index buffers.
+*
+* Instances are added in TLAS order (the instance index is gl_InstanceID), each one gets the exclusive prefix sum
+* of the primitive and vertex counts of the instances before it. The offsets are uploaded as is so a hit shader
+* finds the first index and the base vertex of its instance with a single load instead of summing the counts of
+* every previous instance.
+*/
+class VSceneTable
+{
+public:
+    VSceneTable() = default;
+    ~VSceneTable() = default;
+
+    /**
+    * Append an instance
+    *
+    * @param primitiveCount Number of primitives (triangles) of the instance
+    * @param vertexCount (Optional) Number of vertices of the instance
+    *
+    * @return Index of the instance
+    */
+    uint32_t Add(uint32_t primitiveCount, uint32_t vertexCount = 0);
+
+    void Clear();
+
+    /**
+    * Find the instance owning a scene-wide primitive index
+    *
+    * @param primitive Scene-wide primitive index, must be lower than GetPrimitiveCount()
+    *
+    * @return Index of the instance
+    */
+    uint32_t FindInstance(uint32_t primitive) const;
+
+    uint32_t GetFirstPrimitive(uint32_t instance) const { return m_firstPrimitives[instance]; }
+    uint32_t GetPrimitiveCount(uint32_t instance) const { return m_primitiveCounts[instance]; }
+    uint32_t GetFirstVertex(uint32_t instance) const { return m_firstVertices[instance]; }
+    uint32_t GetVertexCount(uint32_t instance) const { return m_vertexCounts[instance]; }
+    const std::vector<uint32_t>& GetFirstPrimitives() const { return m_firstPrimitives; }
+    /** @brief Offsets to upload, a (first primitive, first vertex) pair per instance */
+    std::vector<uint32_t> GetInstanceOffsets() const;
+    size_t GetInstanceCount() const { return m_firstPrimitives.size(); }
+    uint32_t GetPrimitiveCount() const { return m_primitiveCount; }
+    uint32_t GetVertexCount() const { return m_vertexCount; }
+
+private:
+    std::vector<uint32_t> m_firstPrimitives;
+    std::vector<uint32_t> m_primitiveCounts;
+    std::vector<uint32_t> m_firstVertices;
+    std::vector<uint32_t> m_vertexCounts;
+    uint32_t m_primitiveCount = 0;
+    uint32_t m_vertexCount = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Memory aliasing for transient resources.
+*
+* Each resource declares its size, alignment and the interval of steps (passes of a frame, or phases of the
+* scene setup) during which its content is alive. Place() packs the resources into a single memory range so that
+* resources whose lifetimes do not overlap share the same bytes. The placement only depends on the declared
+* resources, so it is deterministic and can run without a device.
+*/
+class VTransientPool
+{
+public:
+    struct Resource
+    {
+        uint64_t size;
+        uint64_t alignment;
+        uint32_t memoryTypeBits;
+        uint32_t firstUse;
+        uint32_t lastUse;
+        uint64_t offset;
+    };
+
+    VTransientPool() = default;
+    ~VTransientPool() = default;
+
+    /**
+    * Declare a transient resource
+    *
+    * @param size Size in bytes of the resource
+    * @param alignment Required alignment of the resource offset
+    * @param firstUse First step using the resource
+    * @param lastUse Last step using the resource (inclusive)
+    * @param memoryTypeBits (Optional) Memory types compatible with the resource
+    *
+    * @return Id of the resource, used to query its offset once placed
+    */
+    uint32_t Add(uint64_t size, uint64_t alignment, uint32_t firstUse, uint32_t lastUse, uint32_t memoryTypeBits = ~0u);
+
+    /**
+    * Compute the offset of every resource
+    *
+    * @return Size in bytes of the memory range needed by the pool
+    */
+    uint64_t Place();
+
+    void Clear();
+
+    uint64_t GetOffset(uint32_t id) const { return m_resources[id].offset; }
+    const Resource& GetResource(uint32_t id) const { return m_resources[id]; }
+    size_t GetResourceCount() const { return m_resources.size(); }
+    uint64_t GetSize() const { return m_size; }
+    /** @brief Size the resources would need without aliasing, to report the savings */
+    uint64_t GetUnaliasedSize() const;
+    /** @brief Intersection of the memory type bits of every resource */
+    uint32_t GetMemoryTypeBits() const;
+    /** @brief Largest alignment requested by a resource, to align the backing allocation */
+    uint64_t GetAlignment() const;
+
+    static bool Overlaps(const Resource& a, const Resource& b)
+    {
+        return a.firstUse <= b.lastUse && b.firstUse <= a.lastUse;
+    }
+
+private:
+    std::vector<Resource> m_resources;
+    uint64_t m_size = 0;
+};
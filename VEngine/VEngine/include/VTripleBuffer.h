@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/**
+* Lock-free single producer / single consumer triple buffer.
+*
+* The producer always owns one slot and the consumer another; the third slot is shared and swapped in and out
+* with a single atomic exchange. The consumer always gets the latest published value and neither side ever
+* waits for the other. Intermediate values are dropped when the producer is faster than the consumer, so
+* anything that must not be lost has to be stored cumulatively (counters, absolute positions).
+*/
+template <typename T>
+class VTripleBuffer
+{
+public:
+    VTripleBuffer() = default;
+    ~VTripleBuffer() = default;
+
+    VTripleBuffer(const VTripleBuffer&) = delete;
+    VTripleBuffer& operator=(const VTripleBuffer&) = delete;
+
+    /** @brief Slot owned by the producer, only valid until the next Publish */
+    T& GetWriteBuffer() { return m_buffers[m_write]; }
+
+    /** @brief Hand the write slot to the consumer and take the shared slot as the new write slot */
+    void Publish()
+    {
+        m_write = m_shared.exchange(static_cast<uint8_t>(m_write | DIRTY_BIT), std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    /**
+    * Take the latest published value, if any
+    *
+    * @return True if a new value was published since the last call
+    */
+    bool Update()
+    {
+        if (!(m_shared.load(std::memory_order_relaxed) & DIRTY_BIT))
+            return false;
+
+        m_read = m_shared.exchange(m_read, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    /** @brief Slot owned by the consumer, only valid until the next successful Update */
+    const T& GetReadBuffer() const { return m_buffers[m_read]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t DIRTY_BIT = 0x4;
+
+    T m_buffers[3]{};
+    uint8_t m_write = 0;
+    uint8_t m_read = 1;
+    // Index of the shared slot, with DIRTY_BIT set when it holds a value the consumer has not taken yet
+    std::atomic<uint8_t> m_shared{ 2 };
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include <VJobSystem.h>
+
+/** @brief Functions of shaders/wavefront.glsl, compiled as C++ */
+namespace VWavefrontShader
+{
+    using namespace glm;
+    using uint = uint32_t;
+
+#define WAVEFRONT_FUNC inline
+#include "../shaders/wavefront.glsl"
+#undef WAVEFRONT_FUNC
+}
+
+/**
+* GPU layouts of the wavefront buffers, same as wavefront_data.glsl (std430).
+*/
+struct WavefrontPath
+{
+    // xyz: origin of the next ray
+    glm::vec4 origin;
+    // xyz: direction of the next ray, w: 1 if the sky is visible along it
+    glm::vec4 direction;
+    // rgb: throughput, w: sample index of the pixel (bits of a uint)
+    glm::vec4 throughput;
+    glm::vec4 radiance;
+};
+
+struct WavefrontHit
+{
+    // w: 1 if something was hit
+    glm::vec4 albedo;
+    // w: material type
+    glm::vec4 normal;
+    // w: reflectivity
+    glm::vec4 hitPoint;
+};
+
+struct WavefrontShadowRay
+{
+    // w: distance to the light
+    glm::vec4 origin;
+    // w: index of the path (bits of a uint)
+    glm::vec4 direction;
+    glm::vec4 contribution;
+};
+
+// Same layout as VkDispatchIndirectCommand
+struct WavefrontDispatch
+{
+    uint32_t groupsX;
+    uint32_t groupsY;
+    uint32_t groupsZ;
+};
+
+struct WavefrontCounters
+{
+    // Paths queued for the bounce of each parity
+    uint32_t rays[2];
+    uint32_t shadowRays;
+    uint32_t padding;
+    glm::uvec4 binCounts;
+    glm::uvec4 binCursors;
+};
+
+/**
+* CPU reference of the wavefront scheduler.
+*
+* Runs the stages in the order of the wavefront kernels, with the same queues: camera rays, then for every bounce the
+* extension rays, the counting sort of the paths by bin, the shading and the shadow rays. Paths are appended to the
+* queues with atomic counters from jobs of the job system, so the queues come out in a different order every run just
+* like on the GPU. The stages are callbacks, which lets the scheduling be checked without a GPU.
+*/
+class VWavefrontScheduler
+{
+public:
+    struct Stages
+    {
+        // Closest hit of the extension ray of a path, returns the bin of the hit (see WavefrontBin)
+        std::function<uint32_t(uint32_t path, uint32_t bounce)> extend;
+        // Shade a path, returns true to queue its next extension ray. Setting shadowRay queues a shadow ray
+        std::function<bool(uint32_t path, uint32_t bin, uint32_t bounce, bool& shadowRay)> shade;
+        // Trace the shadow ray queued by a path
+        std::function<void(uint32_t path, uint32_t bounce)> shadow;
+    };
+
+    // Queue sizes of one bounce
+    struct BounceStats
+    {
+        uint32_t rays;
+        uint32_t shadowRays;
+        glm::uvec4 binCounts;
+    };
+
+    explicit VWavefrontScheduler(VJobSystem& jobSystem) : m_jobSystem(jobSystem) {}
+    ~VWavefrontScheduler() = default;
+
+    /**
+    * Trace a set of paths
+    *
+    * @param pathCount Number of paths, one camera ray each
+    * @param maxBounces Bounces after the camera ray, the paths are not queued again after the last one
+    * @param stages Work of each stage
+    */
+    void Run(uint32_t pathCount, uint32_t maxBounces, const Stages& stages);
+
+    /** @brief Queue sizes of every bounce of the last run, the run stops at the first empty queue */
+    const std::vector<BounceStats>& GetStats() const { return m_stats; }
+    /** @brief Paths of the last bounce sorted by bin, only the first GetStats().back().rays are valid */
+    const std::vector<uint32_t>& GetSortedQueue() const { return m_sortedQueue; }
+
+private:
+    VJobSystem& m_jobSystem;
+
+    std::vector<uint32_t> m_rayQueues[2];
+    std::vector<uint32_t> m_sortedQueue;
+    std::vector<uint32_t> m_shadowQueue;
+    // Bin of the last hit of every path
+    std::vector<uint32_t> m_bins;
+
+    std::atomic<uint32_t> m_rayCounts[2]{};
+    std::atomic<uint32_t> m_shadowCount{ 0 };
+    std::atomic<uint32_t> m_binCounts[VWavefrontShader::WAVEFRONT_BIN_COUNT]{};
+    std::atomic<uint32_t> m_binCursors[VWavefrontShader::WAVEFRONT_BIN_COUNT]{};
+
+    std::vector<BounceStats> m_stats;
+};
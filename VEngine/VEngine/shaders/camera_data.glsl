@@ -0,0 +1,41 @@
+//Uniform data of the frame, see UniformData
+layout(set = 0, binding = 2) uniform CamData 
+{
+    mat4 view;
+    mat4 projection;
+    //Ray generation constants, see CameraConstants
+    vec4 origin;
+    vec4 lowerLeft;
+    vec4 du;
+    vec4 dv;
+    vec4 lensU;
+    vec4 lensV;
+    vec4 data;
+    //x: light sampler, y: ReSTIR flags, z: ReSTIR candidates, w: ReSTIR neighbours
+    uvec4 settings;
+    //Ray constants of the previous frame
+    vec4 previousOrigin;
+    vec4 previousLowerLeft;
+    vec4 previousDu;
+    vec4 previousDv;
+    vec4 previousLensU;
+    vec4 previousLensV;
+} ubo;
+
+//Same as Camera::GenerateRay on the CPU, lensSample is only used by the thin lens
+void GenerateCameraRay(uvec2 pixel, vec2 lensSample, out vec3 origin, out vec3 direction)
+{
+    vec2 filmPoint = vec2(pixel) + vec2(ubo.du.w, ubo.dv.w);
+    vec3 dir = ubo.lowerLeft.xyz + filmPoint.x * ubo.du.xyz + filmPoint.y * ubo.dv.xyz;
+
+    origin = ubo.origin.xyz;
+    direction = normalize(dir);
+    if(ubo.lowerLeft.w != 0)
+    {
+        //Uniform point on the lens, the forward component of dir is 1 so the focus plane is at dir * focus distance
+        vec2 lens = sqrt(lensSample.x) * vec2(cos(6.28318530718 * lensSample.y), sin(6.28318530718 * lensSample.y));
+        vec3 focusPoint = origin + dir * ubo.origin.w;
+        origin += lens.x * ubo.lensU.xyz + lens.y * ubo.lensV.xyz;
+        direction = normalize(focusPoint - origin);
+    }
+}
@@ -1,19 +1,50 @@
 @echo off
 
 setlocal
+:: Paths are relative to this folder, the build runs the script from the project folder (pre-build event of VEngine.vcxproj)
+cd /d "%~dp0"
+if not exist bin mkdir bin
+
+:: The compiler of the Vulkan SDK when it is installed, the one on the PATH otherwise
 set GLSL_COMPILER=glslangValidator.exe
+if defined VULKAN_SDK set GLSL_COMPILER="%VULKAN_SDK%\Bin\glslangValidator.exe"
 set SOURCE_FOLDER=""
 set BINARIES_FOLDER="bin/"
+set FAILED=
 
 :: raygen shaders
-%GLSL_COMPILER% -V -S rgen %SOURCE_FOLDER%ray_gen.glsl -o %BINARIES_FOLDER%ray_gen.spv
+%GLSL_COMPILER% -V -S rgen %SOURCE_FOLDER%ray_gen.glsl -o %BINARIES_FOLDER%ray_gen.spv || set FAILED=1
+%GLSL_COMPILER% -V -S rgen %SOURCE_FOLDER%wavefront_extend.glsl -o %BINARIES_FOLDER%wavefront_extend.spv || set FAILED=1
+%GLSL_COMPILER% -V -S rgen %SOURCE_FOLDER%wavefront_shadow.glsl -o %BINARIES_FOLDER%wavefront_shadow.spv || set FAILED=1
+%GLSL_COMPILER% -V -S rgen %SOURCE_FOLDER%visibility_gen.glsl -o %BINARIES_FOLDER%visibility_gen.spv || set FAILED=1
 
 :: closest hit shaders
-%GLSL_COMPILER% -V -S rchit %SOURCE_FOLDER%ray_chit.glsl -o %BINARIES_FOLDER%ray_chit.spv
+%GLSL_COMPILER% -V -S rchit %SOURCE_FOLDER%ray_chit.glsl -o %BINARIES_FOLDER%ray_chit.spv || set FAILED=1
+%GLSL_COMPILER% -V -S rchit %SOURCE_FOLDER%visibility_chit.glsl -o %BINARIES_FOLDER%visibility_chit.spv || set FAILED=1
+%GLSL_COMPILER% -V -S rchit %SOURCE_FOLDER%ray_pchit.glsl -o %BINARIES_FOLDER%ray_pchit.spv || set FAILED=1
+
+:: intersection shaders
+%GLSL_COMPILER% -V -S rint %SOURCE_FOLDER%ray_int.glsl -o %BINARIES_FOLDER%ray_int.spv || set FAILED=1
 
 :: miss shaders
-%GLSL_COMPILER% -V -S rmiss %SOURCE_FOLDER%ray_miss.glsl -o %BINARIES_FOLDER%ray_miss.spv
+%GLSL_COMPILER% -V -S rmiss %SOURCE_FOLDER%ray_miss.glsl -o %BINARIES_FOLDER%ray_miss.spv || set FAILED=1
+%GLSL_COMPILER% -V -S rmiss %SOURCE_FOLDER%visibility_miss.glsl -o %BINARIES_FOLDER%visibility_miss.spv || set FAILED=1
 
 :: miss shaders
-%GLSL_COMPILER% -V -S rmiss %SOURCE_FOLDER%ray_smiss.glsl -o %BINARIES_FOLDER%ray_smiss.spv
-pause
\ No newline at end of file
+%GLSL_COMPILER% -V -S rmiss %SOURCE_FOLDER%ray_smiss.glsl -o %BINARIES_FOLDER%ray_smiss.spv || set FAILED=1
+
+:: compute shaders
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%tonemap.comp -o %BINARIES_FOLDER%tonemap.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%adaptive.comp -o %BINARIES_FOLDER%adaptive.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%reproject.comp -o %BINARIES_FOLDER%reproject.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%reconstruct.comp -o %BINARIES_FOLDER%reconstruct.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%wavefront_camera.comp -o %BINARIES_FOLDER%wavefront_camera.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%wavefront_bin.comp -o %BINARIES_FOLDER%wavefront_bin.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%wavefront_shade.comp -o %BINARIES_FOLDER%wavefront_shade.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%wavefront_accumulate.comp -o %BINARIES_FOLDER%wavefront_accumulate.spv || set FAILED=1
+%GLSL_COMPILER% -V -S comp %SOURCE_FOLDER%wavefront_args.comp -o %BINARIES_FOLDER%wavefront_args.spv || set FAILED=1
+
+:: "nopause" when called from the build, a failed shader fails the build instead of leaving a stale binary
+if not "%1"=="nopause" pause
+if defined FAILED exit /b 1
+exit /b 0
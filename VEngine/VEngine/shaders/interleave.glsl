@@ -0,0 +1,47 @@
+/*
+* Interleaved tracing: a frame only traces one pixel of every pair (checkerboard) or of every 2x2 block (quarter). The
+* pixel picked rotates with the frame, so every pixel is traced every 2 or 4 frames. The ray tracing passes launch the
+* reduced grid and map each launch to its pixel, reconstruct.comp fills the pixels skipped by a frame that restarted
+* the accumulation. Same modes as InterleaveMode in VInterleave.h, sent in bits INTERLEAVE_SHIFT of settings.y.
+*/
+const uint INTERLEAVE_OFF = 0u;
+const uint INTERLEAVE_CHECKERBOARD = 1u;
+const uint INTERLEAVE_QUARTER = 2u;
+const uint INTERLEAVE_SHIFT = 5u;
+
+//Pixel of a 2x2 block traced by a frame, the diagonal first so two consecutive frames also form a checkerboard
+ivec2 QuarterOffset(uint frame)
+{
+    const ivec2 offsets[4] = ivec2[4](ivec2(0, 0), ivec2(1, 1), ivec2(1, 0), ivec2(0, 1));
+    return offsets[frame & 3u];
+}
+
+//Pixel traced by a launch of the reduced grid
+ivec2 InterleavedPixel(uvec2 launch, uint mode, uint frame)
+{
+    if(mode == INTERLEAVE_CHECKERBOARD)
+        return ivec2(2u * launch.x + ((launch.y + frame) & 1u), launch.y);
+    if(mode == INTERLEAVE_QUARTER)
+        return 2 * ivec2(launch) + QuarterOffset(frame);
+    return ivec2(launch);
+}
+
+//Pixels covered by a launch of the reduced grid: the pair or block starting at launch * InterleaveBlockSize
+ivec2 InterleaveBlockSize(uint mode)
+{
+    if(mode == INTERLEAVE_CHECKERBOARD)
+        return ivec2(2, 1);
+    if(mode == INTERLEAVE_QUARTER)
+        return ivec2(2, 2);
+    return ivec2(1, 1);
+}
+
+//True when a frame traces the pixel
+bool IsTracedPixel(ivec2 pixel, uint mode, uint frame)
+{
+    if(mode == INTERLEAVE_CHECKERBOARD)
+        return ((uint(pixel.x + pixel.y) + frame) & 1u) == 0u;
+    if(mode == INTERLEAVE_QUARTER)
+        return all(equal(pixel & 1, QuarterOffset(frame)));
+    return true;
+}
@@ -0,0 +1,82 @@
+/*
+* Importance of a node of the light BVH, shared by ray_gen.glsl and the CPU reference (VLightBvh): LightBvh.cpp
+* includes this file in C++. Keep the code in the common subset of GLSL and C++ (see sampling.glsl).
+*
+* Conty Estevez and Kulla, "Importance Sampling of Many Lights with Adaptive Tree Splitting" (2018), in the form
+* used by pbrt-v4: power over squared distance, bounded by the angles the node can be seen under.
+*/
+#ifndef LIGHT_BVH_FUNC
+#define LIGHT_BVH_FUNC
+#endif
+
+//Second child of a leaf, the first one is the light index
+const uint LIGHT_BVH_LEAF = 0xffffffffu;
+
+//cos(max(a - b, 0)) from the sines and cosines of a and b
+LIGHT_BVH_FUNC float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    if(cosA > cosB)
+        return 1.0f;
+    return cosA * cosB + sinA * sinB;
+}
+
+//sin(max(a - b, 0)) from the sines and cosines of a and b
+LIGHT_BVH_FUNC float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    if(cosA > cosB)
+        return 0.0f;
+    return sinA * cosB - cosA * sinB;
+}
+
+/*
+* Upper bound of the light a node sends toward a point
+* p, n: shading point and normal, n = 0 ignores the orientation of the receiver
+* boundsMin, boundsMax, power: bounds and power of the lights of the node
+* axis, cosThetaO, cosThetaE: normal cone of the lights (axis, spread) and emission spread around the normals
+*/
+LIGHT_BVH_FUNC float LightBoundsImportance(vec3 p, vec3 n, vec3 boundsMin, vec3 boundsMax, float power, vec3 axis,
+    float cosThetaO, float cosThetaE)
+{
+    if(power <= 0.0f)
+        return 0.0f;
+
+    vec3 center = (boundsMin + boundsMax) * 0.5f;
+    vec3 halfDiagonal = boundsMax - center;
+    float radiusSquared = dot(halfDiagonal, halfDiagonal);
+    vec3 toPoint = p - center;
+    //Clamped so points inside or next to the bounds don't get an unbounded importance
+    float distanceSquared = max(dot(toPoint, toPoint), radiusSquared);
+    vec3 wi = toPoint * (1.0f / sqrt(max(dot(toPoint, toPoint), 1e-12f)));
+
+    //Angle between the cone axis and the point, reduced by the cone spread and by the angle the bounds subtend
+    float cosThetaW = dot(axis, wi);
+    float sinThetaW = sqrt(max(1.0f - cosThetaW * cosThetaW, 0.0f));
+    float sinThetaO = sqrt(max(1.0f - cosThetaO * cosThetaO, 0.0f));
+    float sinThetaB2 = min(radiusSquared / distanceSquared, 1.0f);
+    float cosThetaB = sqrt(1.0f - sinThetaB2);
+    float sinThetaB = sqrt(sinThetaB2);
+    if(dot(toPoint, toPoint) < radiusSquared)
+    {
+        cosThetaB = -1.0f;
+        sinThetaB = 0.0f;
+    }
+
+    float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if(cosThetaP <= cosThetaE)
+        return 0.0f;
+
+    float importance = power * cosThetaP / distanceSquared;
+
+    //Lambert term of the receiver, the light can come from anywhere in the cone of the bounds
+    if(dot(n, n) > 0.0f)
+    {
+        float cosThetaI = -dot(wi, n);
+        float sinThetaI = sqrt(max(1.0f - cosThetaI * cosThetaI, 0.0f));
+        float cosThetaIPrime = CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+        importance *= max(cosThetaIPrime, 0.0f);
+    }
+
+    return max(importance, 0.0f);
+}
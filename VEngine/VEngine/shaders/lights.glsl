@@ -0,0 +1,116 @@
+/*
+* Scene lights and the light samplers, shared by the megakernel (ray_gen.glsl) and the wavefront shading kernel.
+* The including shader declares the CamData block as ubo (settings.x selects the light sampler).
+*/
+#include "light_bvh.glsl"
+
+//Light samplers, see LightSampler
+#define LIGHT_SAMPLER_ALIAS_TABLE 0
+#define LIGHT_SAMPLER_BVH 1
+
+//Spherical lights, see VLightData
+struct LightData
+{
+    vec4 position;
+    vec4 colorIntensity;
+};
+
+//Alias table of the lights, see VLightTable::AliasEntry
+struct LightAlias
+{
+    float probability;
+    uint alias;
+    float pdf;
+    float padding;
+};
+
+layout(set = 0, binding = 13) readonly buffer Lights
+{
+    LightData l[];
+}lights;
+
+layout(set = 0, binding = 14) readonly buffer LightAliasTable
+{
+    LightAlias a[];
+}lightAlias;
+
+//Node of the light BVH, see VLightBvhNode
+struct LightBvhNode
+{
+    //w: power
+    vec4 boundsMin;
+    //w: cosThetaO
+    vec4 boundsMax;
+    //w: cosThetaE
+    vec4 axis;
+    uint first;
+    uint second;
+    uint padding0;
+    uint padding1;
+};
+
+layout(set = 0, binding = 15) readonly buffer LightBvh
+{
+    LightBvhNode n[];
+}lightBvh;
+
+//Pick a light with the alias table: u.x selects an entry, u.y keeps the entry or takes its alias
+int SampleLightAlias(vec2 u, out float pdf)
+{
+    uint count = uint(lights.l.length());
+    uint index = min(uint(u.x * float(count)), count - 1);
+    LightAlias entry = lightAlias.a[index];
+    if(u.y >= entry.probability)
+        index = entry.alias;
+    pdf = lightAlias.a[index].pdf;
+    return int(index);
+}
+
+float LightBvhImportance(LightBvhNode node, vec3 p, vec3 n)
+{
+    return LightBoundsImportance(p, n, node.boundsMin.xyz, node.boundsMax.xyz, node.boundsMin.w, node.axis.xyz,
+        node.boundsMax.w, node.axis.w);
+}
+
+//Pick a light by walking down the light BVH, each child is chosen by its importance for the shading point.
+//Same traversal as VLightBvh::SampleLight
+int SampleLightBvh(float u, vec3 p, vec3 n, out float pdf)
+{
+    pdf = 0;
+    uint current = 0;
+    float probability = 1;
+    while(lightBvh.n[current].second != LIGHT_BVH_LEAF)
+    {
+        LightBvhNode node = lightBvh.n[current];
+        float left = LightBvhImportance(lightBvh.n[node.first], p, n);
+        float right = LightBvhImportance(lightBvh.n[node.second], p, n);
+        if(left + right <= 0)
+            return -1;
+
+        //Rescale u so the rest of the traversal still has a uniform number
+        float pLeft = left / (left + right);
+        if(u < pLeft)
+        {
+            u = min(u / pLeft, 0.99999994);
+            probability *= pLeft;
+            current = node.first;
+        }
+        else
+        {
+            u = min((u - pLeft) / (1 - pLeft), 0.99999994);
+            probability *= 1 - pLeft;
+            current = node.second;
+        }
+    }
+
+    pdf = probability;
+    return int(lightBvh.n[current].first);
+}
+
+//Index of the light of a shadow ray, -1 when no light can reach the point
+int SampleLight(vec2 u, vec3 p, vec3 n, out float pdf)
+{
+    if(ubo.settings.x == LIGHT_SAMPLER_BVH)
+        return SampleLightBvh(u.x, p, n, pdf);
+    return SampleLightAlias(u, pdf);
+}
@@ -0,0 +1,31 @@
+/*
+* Sample points of a pixel, same sequences as VSampler on the CPU. The including shader declares the CamData block
+* as ubo (data.w selects the sequence) and includes sampling.glsl.
+*/
+
+//Blue-noise tile, BLUE_NOISE_SIZE² ranks in 0.32 fixed point (see VSampler::GenerateBlueNoiseTile)
+layout(set = 0, binding = 10) readonly buffer BlueNoise
+{
+    uint v[];
+}blueNoise;
+
+//2D point of a sample of a pixel, pixelSeed is the PcgHash of the pixel index
+vec2 PixelSample2D(uvec2 pixel, uint pixelSeed, uint sampleIndex, uint dimension)
+{
+    uint samplerType = uint(ubo.data.w);
+
+    if(samplerType == SAMPLER_SOBOL)
+        return OwenSobol2D(sampleIndex, HashCombine(pixelSeed, dimension));
+
+    if(samplerType == SAMPLER_BLUE_NOISE)
+    {
+        uint mask = BLUE_NOISE_SIZE - 1;
+        uvec2 offset = BlueNoiseOffset(dimension);
+        uint x = blueNoise.v[((pixel.y + offset.y) & mask) * BLUE_NOISE_SIZE + ((pixel.x + offset.x) & mask)];
+        uint y = blueNoise.v[((pixel.y + offset.x) & mask) * BLUE_NOISE_SIZE + ((pixel.x + offset.y) & mask)];
+        return BlueNoise2D(sampleIndex, uvec2(x, y));
+    }
+
+    uint h = RandomHash(pixelSeed, sampleIndex, dimension);
+    return vec2(ToUnitFloat(h), ToUnitFloat(PcgHash(h)));
+}
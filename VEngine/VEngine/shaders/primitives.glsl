@@ -0,0 +1,110 @@
+/*
+* Procedural primitives: analytic shapes traced through AABB geometry and an intersection shader instead of a mesh.
+* Shared by the shaders and the CPU: VPrimitive.h includes this file in C++. Keep the code in the common subset of
+* GLSL and C++ (see sampling.glsl).
+*
+* Every primitive is a unit shape in object space, the transform of its instance places and scales it:
+* the sphere has a radius of 1, the box spans [-1, 1] on every axis, the disc has a radius of 1 in the xz plane.
+* Ray directions are not normalized, an object space ray keeps the distances of the world space one.
+*/
+#ifndef PRIMITIVE_FUNC
+#define PRIMITIVE_FUNC
+#endif
+
+//Primitive types, PRIMITIVE_MESH is a triangle mesh (see PrimitiveType in VPrimitive.h)
+const uint PRIMITIVE_MESH = 0u;
+const uint PRIMITIVE_SPHERE = 1u;
+const uint PRIMITIVE_BOX = 2u;
+const uint PRIMITIVE_DISC = 3u;
+
+//Distance returned when the ray misses
+const float PRIMITIVE_NO_HIT = -1.0f;
+//Half thickness of the bounds of the disc, an AABB can't be flat
+const float PRIMITIVE_DISC_THICKNESS = 0.001f;
+
+//Half extent of the object space AABB of a primitive, centered on the origin
+PRIMITIVE_FUNC vec3 PrimitiveExtent(uint type)
+{
+    if(type == PRIMITIVE_DISC)
+        return vec3(1, PRIMITIVE_DISC_THICKNESS, 1);
+    return vec3(1);
+}
+
+//Closest of the two roots of a ray crossing a surface in [tMin, tMax], the far one when the ray starts inside
+PRIMITIVE_FUNC float ClosestRoot(float t0, float t1, float tMin, float tMax)
+{
+    if(t0 >= tMin && t0 <= tMax)
+        return t0;
+    if(t1 >= tMin && t1 <= tMax)
+        return t1;
+    return PRIMITIVE_NO_HIT;
+}
+
+PRIMITIVE_FUNC float IntersectSphere(vec3 origin, vec3 direction, float tMin, float tMax)
+{
+    float a = dot(direction, direction);
+    float b = dot(origin, direction);
+    float c = dot(origin, origin) - 1.0f;
+    float discriminant = b * b - a * c;
+    if(discriminant < 0.0f)
+        return PRIMITIVE_NO_HIT;
+    float root = sqrt(discriminant);
+    return ClosestRoot((-b - root) / a, (-b + root) / a, tMin, tMax);
+}
+
+//Slab test, the entry distance is the last slab entered and the exit distance the first slab left
+PRIMITIVE_FUNC float IntersectBox(vec3 origin, vec3 direction, float tMin, float tMax)
+{
+    vec3 invDirection = vec3(1) / direction;
+    vec3 t0 = (vec3(-1) - origin) * invDirection;
+    vec3 t1 = (vec3(1) - origin) * invDirection;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+    float entry = max(max(tNear.x, tNear.y), tNear.z);
+    float leave = min(min(tFar.x, tFar.y), tFar.z);
+    if(entry > leave)
+        return PRIMITIVE_NO_HIT;
+    return ClosestRoot(entry, leave, tMin, tMax);
+}
+
+PRIMITIVE_FUNC float IntersectDisc(vec3 origin, vec3 direction, float tMin, float tMax)
+{
+    if(direction.y == 0.0f)
+        return PRIMITIVE_NO_HIT;
+    float t = -origin.y / direction.y;
+    vec3 p = origin + direction * t;
+    if(t < tMin || t > tMax || p.x * p.x + p.z * p.z > 1.0f)
+        return PRIMITIVE_NO_HIT;
+    return t;
+}
+
+//Distance to the closest hit in [tMin, tMax] of an object space ray, PRIMITIVE_NO_HIT if there is none
+PRIMITIVE_FUNC float IntersectPrimitive(uint type, vec3 origin, vec3 direction, float tMin, float tMax)
+{
+    if(type == PRIMITIVE_SPHERE)
+        return IntersectSphere(origin, direction, tMin, tMax);
+    if(type == PRIMITIVE_BOX)
+        return IntersectBox(origin, direction, tMin, tMax);
+    if(type == PRIMITIVE_DISC)
+        return IntersectDisc(origin, direction, tMin, tMax);
+    return PRIMITIVE_NO_HIT;
+}
+
+//Object space normal at a point of the surface, exact instead of interpolated from vertex normals. The disc has no
+//inside, its normal faces the incoming ray
+PRIMITIVE_FUNC vec3 PrimitiveNormal(uint type, vec3 p, vec3 direction)
+{
+    if(type == PRIMITIVE_SPHERE)
+        return normalize(p);
+    if(type == PRIMITIVE_BOX)
+    {
+        //Face of the largest coordinate
+        vec3 a = abs(p);
+        if(a.x >= a.y && a.x >= a.z)
+            return vec3(p.x > 0.0f ? 1 : -1, 0, 0);
+        if(a.y >= a.z)
+            return vec3(0, p.y > 0.0f ? 1 : -1, 0);
+        return vec3(0, 0, p.z > 0.0f ? 1 : -1);
+    }
+    return vec3(0, direction.y > 0.0f ? -1 : 1, 0);
+}
@@ -1,35 +1,122 @@
 #version 460
 #extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "sampling.glsl"
+#include "wavefront.glsl"
+#include "visibility.glsl"
 
 #define M_PI 3.1415926535897932384626433832795
 #define GAMMA 2.2
 #define INV_GAMMA 0.45454545454545453
+#define LUMINANCE vec3(0.2126, 0.7152, 0.0722)
 
-#define ENABLE_REFLECTIONS
-//#define ENABLE_HARD_SHADOWS
-#define ENABLE_SOFT_SHADOWS
 #define ENABLE_GI
-
-#define MAX_REFLECTIONS_RECURSION 2
-#define SHADOW_SAMPLES 4
-
-//#define ENABLE_ACCUMULATION
+#define SKY_COLOR vec3(0.53, 0.81, 0.92)
+
+//Quality settings, set per pipeline from the quality preset (see VQualityPreset.h). The defaults are the balanced preset
+layout(constant_id = 0) const bool ENABLE_REFLECTIONS = true;
+layout(constant_id = 1) const bool ENABLE_HARD_SHADOWS = false;
+layout(constant_id = 2) const bool ENABLE_SOFT_SHADOWS = true;
+layout(constant_id = 3) const int MAX_REFLECTIONS_RECURSION = 2;
+layout(constant_id = 4) const int SHADOW_SAMPLES = 1;
+layout(constant_id = 5) const int MAX_BOUNCES = 3;
+
+#define ENABLE_ACCUMULATION
+//Side of the tiles of the sample map, same as TILE_SIZE in adaptive.comp
+#define ADAPTIVE_TILE_SIZE 8
+//ReSTIR flags, see RESTIR_ENABLED and RESTIR_HISTORY in VContext.h
+#define RESTIR_ENABLED 1u
+#define RESTIR_HISTORY 2u
+//The primary hits come from the visibility buffer, see VISIBILITY_BUFFER_ENABLED in VContext.h
+#define VISIBILITY_BUFFER_ENABLED 4u
+//The guides of the CPU denoiser are written, see DENOISER_GUIDES in VContext.h
+#define DENOISER_GUIDES 8u
+//Motion and surface of every pixel are written for the temporal reprojection, see TEMPORAL_REPROJECTION in VContext.h
+#define TEMPORAL_REPROJECTION 16u
+//History of a reused reservoir is capped to this many frames of candidates so new samples can still replace it
+#define RESTIR_HISTORY_LIMIT 20.0
+//Radius in pixels of the spatial reuse
+#define RESTIR_SPATIAL_RADIUS 16.0
 
 layout(set = 0, binding = 0) uniform accelerationStructureNV Scene;
-layout(set = 0, binding = 1, rgba8) uniform image2D ResultImage;
+//rgb: mean radiance, a: number of samples accumulated
 layout(set = 0, binding = 7, rgba32f) uniform image2D accImage;
-layout(set = 0, binding = 2) uniform CamData 
-{
-    mat4 viewInverse;
-    mat4 projInverse;
-    vec4 data;
-} ubo;
+//Mean of the squared luminance, for the variance estimate of the adaptive sampling
+layout(set = 0, binding = 11, r32f) uniform image2D momentsImage;
+//Samples per pixel of each tile, written by adaptive.comp
+layout(set = 0, binding = 12, r32ui) uniform readonly uimage2D sampleMap;
+#include "camera_data.glsl"
 
 layout(set = 0, binding = 5) uniform Time
 {
     float t[];
 }time;
 
+#include "lights.glsl"
+
+//Reservoir of a pixel, see RestirReservoir. The buffer holds two reservoirs per pixel, the frame parity picks the
+//half written this frame, the other half is the previous frame
+struct Reservoir
+{
+    //xyz: sampled point on the light, w: index of the light (uint bits)
+    vec4 lightPoint;
+    float M;
+    float W;
+    //Normal (packSnorm4x8) and distance to the camera of the surface owning the reservoir
+    uint normal;
+    float depth;
+};
+
+layout(set = 0, binding = 16) buffer Reservoirs
+{
+    Reservoir r[];
+}reservoirs;
+
+#include "pixel_sampler.glsl"
+#include "scene_data.glsl"
+#include "primitives.glsl"
+
+//Primary hit of every pixel, written by visibility_gen.glsl
+layout(set = 0, binding = 17, rg32ui) uniform readonly uimage2D visibilityImage;
+
+//TLAS instances of the frame, see GeometryInstance
+struct SceneInstance
+{
+    //Object to world, rows of a 3x4 matrix
+    vec4 transform[3];
+    uint instanceId;
+    uint instanceOffset;
+    uvec2 accelerationStructureHandle;
+};
+
+layout(set = 0, binding = 18) readonly buffer Instances
+{
+    SceneInstance i[];
+}instances;
+
+//Primary surface of every pixel for the CPU denoiser: x: distance (float bits, 0 for the sky),
+//y: normal (packSnorm4x8), z: albedo (packUnorm4x8)
+layout(set = 0, binding = 19, rgba32ui) uniform writeonly uimage2D guideImage;
+
+#include "temporal.glsl"
+#include "interleave.glsl"
+
+//Offset in pixels from where a pixel sees its surface to where the previous frame saw it
+layout(set = 0, binding = 20, rg32f) uniform writeonly image2D motionImage;
+
+//Object to world of every instance in the previous frame, rows of a 3x4 matrix
+layout(set = 0, binding = 21) readonly buffer PreviousTransforms
+{
+    vec4 t[];
+}previousTransforms;
+
+//The ray tracing pass writes the surfaces, reproject.comp the radiance
+layout(set = 0, binding = 22) buffer TemporalSamples
+{
+    TemporalSample s[];
+}temporalSamples;
+
 
 struct ObjInfo
 {
@@ -38,6 +125,8 @@ struct ObjInfo
     vec3 hitPoint;
     vec3 material;
     bool isValid;
+    //Index of the instance hit, in the TLAS
+    uint instance;
 };
 
 struct Payload
@@ -48,37 +137,43 @@ struct Payload
 layout(location = 0) rayPayloadNV Payload payloadData;
 layout(location = 2) rayPayloadNV bool shadowed;
 
+//First hit of the last path traced, the guides of the denoiser keep the one of the first sample
+ObjInfo primaryHit;
+
 const uint rayFlags = gl_RayFlagsOpaqueNV;
 const uint cullMask = 0xFF;
 const float tmin = 0.0001;
 const float tmax = 150;
-float seedRand = 0;
 
-//float rand() { return fract(sin(seedRand++)*43758.5453123); }
+//Pixel traced by this launch and size of the render targets, the launch grid is smaller with interleaved tracing
+ivec2 tracedPixel;
+uvec2 renderSize;
+
+//Sampler state of the current path, same sequence as VSampler on the CPU
+uint samplerPixelSeed;
+uint samplerIndex;
+uint samplerDimension;
 
-uint base_hash(uvec2 p) 
+void InitSampler(uint sampleIndex)
 {
-    p = 1103515245U*((p >> 1U)^(p.yx));
-    uint h32 = 1103515245U*((p.x)^(p.y>>3U));
-    return h32^(h32 >> 16);
+    samplerPixelSeed = PcgHash(uint(tracedPixel.y) * renderSize.x + uint(tracedPixel.x));
+    samplerIndex = sampleIndex;
+    samplerDimension = 0;
 }
 
-vec2 hash2(inout float seed) 
+//Every bounce starts at a fixed dimension so the dimensions of a bounce don't depend on the samples drawn before
+void StartBounce(uint bounce)
 {
-    uint n = base_hash(floatBitsToUint(vec2(seed+=.1,seed+=.1)));
-    uvec2 rz = uvec2(n, n*48271U);
-    return vec2(rz.xy & uvec2(0x7fffffffU))/float(0x7fffffff);
+    samplerDimension = bounce * DIMENSIONS_PER_BOUNCE;
 }
 
-vec3 hash3(inout float seed) 
+vec2 NextSample2D()
 {
-    uint n = base_hash(floatBitsToUint(vec2(seed+=.1,seed+=.1)));
-    uvec3 rz = uvec3(n, n*16807U, n*48271U);
-    return vec3(rz & uvec3(0x7fffffffU))/float(0x7fffffff);
+    return PixelSample2D(uvec2(tracedPixel), samplerPixelSeed, samplerIndex, samplerDimension++);
 }
 
-vec4 cosWeightedRandomHemisphereDirection( const vec3 n, inout float seed, const vec3 rayDir) {
-  	vec2 r = hash2(seed);
+vec4 cosWeightedRandomHemisphereDirection( const vec3 n, const vec3 rayDir) {
+  	vec2 r = NextSample2D();
     
 	vec3  uu = normalize( cross( n, vec3(0.0,1.0,1.0) ) );
 	vec3  vv = cross( uu, n );
@@ -89,46 +184,22 @@ vec4 cosWeightedRandomHemisphereDirection( const vec3 n, inout float seed, const
 	float rz = sqrt( 1.0-r.y );
 	vec3  rr = vec3( rx*uu + ry*vv + rz*n );
     
-    return normalize( vec4(rr, dot(n, -rayDir)) );
+    return vec4(normalize(rr), dot(n, -rayDir));
 }
 
-vec3 randomSphereDirection(inout float seed) {
-    vec2 h = hash2(seed) * vec2(2.,6.28318530718)-vec2(1,0);
+vec3 sphereDirection(vec2 u) {
+    vec2 h = u * vec2(2.,6.28318530718)-vec2(1,0);
     float phi = h.y;
 	return vec3(sqrt(1.-h.x*h.x)*vec2(sin(phi),cos(phi)),h.x);
 }
 
-vec3 randomHemisphereDirection( const vec3 n, inout float seed ) {
-	vec3 dr = randomSphereDirection(seed);
-	return dot(dr,n) * dr;
+vec3 randomSphereDirection() {
+    return sphereDirection(NextSample2D());
 }
 
-bool getScattering(Payload rayHit, inout vec3 origin, inout vec3 dir, inout vec3 attenuation, inout float cosTheta)
-{
-    //LAMBERTIAN
-    /*if(rayHit.matSpecs.x == 1)
-    {
-        vec3 forigin = rayHit.pointHit;
-        vec4 fdir = normalize(cosWeightedRandomHemisphereDirection(rayHit.pointNormal, seedRand, dir));
-        attenuation = rayHit.pointColor;
-        cosTheta = fdir.w;
-        origin = forigin;
-        dir = fdir.xyz;
-        return true;
-    }
-    //METAL
-    if(rayHit.matSpecs.x == 2)
-    {
-        vec3 rd = reflect(dir, rayHit.pointNormal);
-        vec3 forigin = rayHit.pointHit;
-        vec3 fdir = normalize(rd + (1 - rayHit.matSpecs.y) * randomHemisphereDirection(rayHit.pointNormal, seedRand));
-        attenuation = rayHit.pointColor;
-        cosTheta = 1;
-        origin = forigin;
-        dir = fdir;
-        return true;
-    }*/
-    return false;
+vec3 randomHemisphereDirection( const vec3 n ) {
+	vec3 dr = randomSphereDirection();
+	return dot(dr,n) * dr;
 }
 
 /*float getEmitted(Payload ray, vec3 origin)
@@ -138,7 +209,7 @@ bool getScattering(Payload rayHit, inout vec3 origin, inout vec3 dir, inout vec3
     float intensity = 20;
     for(int i = 0; i < SHADOW_RES; ++i)
     {
-        vec3 rd = normalize(randomSphereDirection(seedRand));
+        vec3 rd = normalize(randomSphereDirection());
         vec3 pointOnSphere = position + rd * radius;
         vec3 dir = normalize(pointOnSphere - ray.pointHit);
         shadowed = true;
@@ -153,6 +224,12 @@ bool getScattering(Payload rayHit, inout vec3 origin, inout vec3 dir, inout vec3
 }
 */
 
+void GenerateRay(out vec3 origin, out vec3 direction)
+{
+    vec2 lensSample = ubo.lowerLeft.w != 0 ? NextSample2D() : vec2(0);
+    GenerateCameraRay(uvec2(tracedPixel), lensSample, origin, direction);
+}
+
 ObjInfo GetObjectInfo(vec3 origin, vec3 dir)
 {
     traceNV(Scene, rayFlags, cullMask, 0, 0, 0, origin, tmin, dir, tmax, 0);
@@ -160,43 +237,337 @@ ObjInfo GetObjectInfo(vec3 origin, vec3 dir)
     return info;
 }
 
-float GetLightIntensity(ObjInfo obj)
+vec3 ObjectToWorld(SceneInstance instance, vec4 v)
 {
-    float totalLight = 0;
-    float intensity = 1;
-    vec3 lightPos = vec3(0, -200, -1200);
-    float radius = 100;
+    return vec3(dot(instance.transform[0], v), dot(instance.transform[1], v), dot(instance.transform[2], v));
+}
 
-    #ifdef ENABLE_HARD_SHADOWS
-        vec3 dir = normalize(lightPos - obj.hitPoint);
-        shadowed = true;
-        traceNV(Scene, rayFlags | gl_RayFlagsTerminateOnFirstHitNV | gl_RayFlagsSkipClosestHitShaderNV, cullMask, 0, 0, 0, obj.hitPoint, tmin, dir, 100, 2);
-        if(!shadowed)
-            totalLight += intensity * dot(obj.normal, dir);
-    #endif
+//Primary hit rebuilt from the visibility buffer, same attributes as ray_chit.glsl and ray_pchit.glsl. The barycentrics
+//are only 16 bit, so the hit point is the intersection of the camera ray with the plane of the triangle rather than
+//their blend. A procedural primitive is intersected again
+ObjInfo LoadPrimaryHit(vec3 origin, vec3 dir)
+{
+    ObjInfo obj;
+    uvec2 visibility = imageLoad(visibilityImage, tracedPixel).xy;
+    if(visibility.x == VISIBILITY_MISS)
+    {
+        //Same as ray_miss.glsl
+        obj.isValid = false;
+        obj.albedo = SKY_COLOR;
+        obj.hitPoint = vec3(0);
+        obj.normal = vec3(0);
+        obj.material = vec3(0);
+        obj.instance = 0;
+        return obj;
+    }
+
+    uint instance;
+    uint primitive;
+    vec2 attribs;
+    UnpackVisibility(visibility, instance, primitive, attribs);
+    SceneInstance sceneInstance = instances.i[instance];
+
+    float t;
+    vec3 normal;
+    uint type = primitiveTypes.t[instance];
+    if(type != PRIMITIVE_MESH)
+    {
+        mat4 objectToWorld = transpose(mat4(sceneInstance.transform[0], sceneInstance.transform[1], sceneInstance.transform[2], vec4(0, 0, 0, 1)));
+        mat4 worldToObject = inverse(objectToWorld);
+        vec3 objectOrigin = (worldToObject * vec4(origin, 1)).xyz;
+        vec3 objectDirection = (worldToObject * vec4(dir, 0)).xyz;
+        t = IntersectPrimitive(type, objectOrigin, objectDirection, tmin, tmax);
+        //Rounding can make a grazing ray miss what the visibility pass hit, that one is traced again
+        if(t == PRIMITIVE_NO_HIT)
+            return GetObjectInfo(origin, dir);
+        normal = PrimitiveNormal(type, objectOrigin + objectDirection * t, objectDirection);
+    }
+    else
+    {
+        vec3 barycentricCoords = vec3(1.0 - attribs.x - attribs.y, attribs.x, attribs.y);
+
+        Vertex v0, v1, v2;
+        GetTriangle(instance, primitive, v0, v1, v2);
+        vec3 p0 = ObjectToWorld(sceneInstance, vec4(v0.pos, 1));
+        vec3 p1 = ObjectToWorld(sceneInstance, vec4(v1.pos, 1));
+        vec3 p2 = ObjectToWorld(sceneInstance, vec4(v2.pos, 1));
+        vec3 planeNormal = cross(p1 - p0, p2 - p0);
+        t = dot(p0 - origin, planeNormal) / dot(dir, planeNormal);
+
+        normal = v0.normal * barycentricCoords.x + v1.normal * barycentricCoords.y + v2.normal * barycentricCoords.z;
+    }
+    normal = normalize(ObjectToWorld(sceneInstance, vec4(normalize(normal), 0)));
+
+    vec4 matData, matData2;
+    GetTriangleMaterial(instance, primitive, matData, matData2);
+    obj.albedo = matData.xyz;
+    obj.normal = normal;
+    obj.hitPoint = origin + dir * t + normal * 0.0001;
+    obj.isValid = true;
+    obj.material = matData2.xyz;
+    obj.instance = instance;
+    return obj;
+}
+
+//Shadow ray from a surface to a point on a light
+bool IsVisible(vec3 origin, vec3 target)
+{
+    vec3 toTarget = target - origin;
+    float dist = length(toTarget);
+    shadowed = true;
+    traceNV(Scene, rayFlags | gl_RayFlagsTerminateOnFirstHitNV | gl_RayFlagsSkipClosestHitShaderNV, cullMask, 0, 0, 1, origin, tmin, toTarget / dist, dist, 2);
+    return !shadowed;
+}
+
+//Light reaching a point from one sampled light, divided by the probability of the sample. Soft shadows aim at a
+//random point of the light sphere, hard shadows at its center
+vec3 SampleDirectLight(ObjInfo obj, bool soft)
+{
+    float pdf;
+    int index = SampleLight(NextSample2D(), obj.hitPoint, obj.normal, pdf);
+    if(index < 0)
+        return vec3(0);
+
+    LightData light = lights.l[index];
+    vec3 target = light.position.xyz;
+    if(soft)
+        target += light.position.w * randomSphereDirection();
+
+    vec3 toLight = target - obj.hitPoint;
+    float distanceSquared = dot(toLight, toLight);
+    float cosTheta = dot(obj.normal, toLight) * inversesqrt(distanceSquared);
+    if(cosTheta <= 0 || pdf <= 0 || !IsVisible(obj.hitPoint, target))
+        return vec3(0);
+
+    return light.colorIntensity.rgb * (light.colorIntensity.w * cosTheta / (distanceSquared * pdf));
+}
+
+vec3 GetDirectLight(ObjInfo obj)
+{
+    vec3 totalLight = vec3(0);
+
+    if(ENABLE_HARD_SHADOWS)
+        totalLight += SampleDirectLight(obj, false);
 
-    #ifdef ENABLE_SOFT_SHADOWS
+    if(ENABLE_SOFT_SHADOWS)
+    {
         for(int i = 0; i  < SHADOW_SAMPLES; ++i)
+            totalLight += SampleDirectLight(obj, true);
+        totalLight /= float(SHADOW_SAMPLES);
+    }
+
+    return totalLight;
+}
+
+//RESTIR
+//Reservoir resampling of the direct light (Bitterli et al. 2020). Candidates drawn from the light sampler are resampled
+//toward the unshadowed contribution, then merged with the reservoirs the previous frame left at the reprojected pixel
+//and around it. Both reuses read the previous frame only, so a single pass never reads a reservoir being written
+struct ReservoirState
+{
+    vec3 point;
+    uint light;
+    float weightSum;
+    float M;
+    //Target function of the selected sample at this pixel
+    float target;
+};
+
+//Random numbers of the resampling, an independent stream: the candidate count would overrun the dimensions of a bounce
+uint restirSeed;
+
+float RestirRandom()
+{
+    restirSeed = PcgHash(restirSeed);
+    return ToUnitFloat(restirSeed);
+}
+
+void UpdateReservoir(inout ReservoirState state, vec3 point, uint light, float weight, float target, float M)
+{
+    state.weightSum += weight;
+    state.M += M;
+    if(weight > 0 && RestirRandom() * state.weightSum < weight)
+    {
+        state.point = point;
+        state.light = light;
+        state.target = target;
+    }
+}
+
+//Unshadowed light a point on a light sends to the surface, the color is reduced to its luminance
+float RestirTarget(ObjInfo obj, vec3 point, uint light)
+{
+    vec3 toLight = point - obj.hitPoint;
+    float distanceSquared = dot(toLight, toLight);
+    float cosTheta = dot(obj.normal, toLight) * inversesqrt(distanceSquared);
+    if(cosTheta <= 0)
+        return 0;
+
+    vec4 colorIntensity = lights.l[light].colorIntensity;
+    return dot(colorIntensity.rgb, LUMINANCE) * colorIntensity.w * cosTheta / distanceSquared;
+}
+
+//Pixel coordinates of a point (pixel centers at integers), GenerateRay inverted with a set of ray constants (the lens
+//is ignored). False when the point is behind the camera
+bool ProjectPoint(vec3 p, vec3 origin, vec4 lowerLeftConstant, vec4 duConstant, vec4 dvConstant, out vec2 coords)
+{
+    vec3 lowerLeft = lowerLeftConstant.xyz;
+    vec3 du = duConstant.xyz;
+    vec3 dv = dvConstant.xyz;
+    vec3 forward = lowerLeft - du * (dot(lowerLeft, du) / dot(du, du)) - dv * (dot(lowerLeft, dv) / dot(dv, dv));
+
+    //Scale the direction so it reaches the image plane of GenerateRay, then read its coordinates along du and dv
+    vec3 dir = p - origin;
+    float z = dot(dir, forward) / dot(forward, forward);
+    if(z <= 0)
+        return false;
+    vec3 onPlane = dir / z - lowerLeft;
+    coords = vec2(dot(onPlane, du) / dot(du, du), dot(onPlane, dv) / dot(dv, dv)) - vec2(duConstant.w, dvConstant.w);
+    return true;
+}
+
+//Pixel that saw a point in the previous frame
+bool ReprojectPixel(vec3 p, out ivec2 pixel)
+{
+    vec2 coords;
+    if(!ProjectPoint(p, ubo.previousOrigin.xyz, ubo.previousLowerLeft, ubo.previousDu, ubo.previousDv, coords))
+        return false;
+    pixel = ivec2(floor(coords + 0.5));
+    return all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, ivec2(renderSize)));
+}
+
+//Position a surface point had in the previous frame, carried back through the transform its instance had then
+vec3 PreviousPosition(ObjInfo obj)
+{
+    SceneInstance current = instances.i[obj.instance];
+    mat3 linear = transpose(mat3(current.transform[0].xyz, current.transform[1].xyz, current.transform[2].xyz));
+    vec3 translation = vec3(current.transform[0].w, current.transform[1].w, current.transform[2].w);
+    vec4 local = vec4(inverse(linear) * (obj.hitPoint - translation), 1);
+    uint row = 3 * obj.instance;
+    return vec3(dot(previousTransforms.t[row], local), dot(previousTransforms.t[row + 1], local), dot(previousTransforms.t[row + 2], local));
+}
+
+//Motion of the pixel and surface it sees, for reproject.comp. The sky only moves with the direction of the camera
+void StoreTemporalSurface(ivec2 pixel, vec3 origin, vec3 dir, ObjInfo obj)
+{
+    vec3 current = obj.isValid ? obj.hitPoint : ubo.origin.xyz + dir;
+    vec3 previous = obj.isValid ? PreviousPosition(obj) : ubo.previousOrigin.xyz + dir;
+    vec2 currentCoords;
+    vec2 previousCoords;
+    vec2 motion = vec2(MOTION_NONE);
+    if(ProjectPoint(current, ubo.origin.xyz, ubo.lowerLeft, ubo.du, ubo.dv, currentCoords)
+       && ProjectPoint(previous, ubo.previousOrigin.xyz, ubo.previousLowerLeft, ubo.previousDu, ubo.previousDv, previousCoords))
+        motion = previousCoords - currentCoords;
+    imageStore(motionImage, pixel, vec4(motion, 0, 0));
+
+    uint index = (uint(ubo.data.z) & 1u) * renderSize.x * renderSize.y + pixel.y * renderSize.x + pixel.x;
+    temporalSamples.s[index].depth = obj.isValid ? distance(origin, obj.hitPoint) : 0.0;
+    temporalSamples.s[index].normal = packSnorm4x8(vec4(obj.normal, 0));
+    temporalSamples.s[index].previousDepth = obj.isValid ? distance(ubo.previousOrigin.xyz, previous) : 0.0;
+}
+
+void StoreReservoir(vec3 point, uint light, float M, float W, vec3 normal, float depth)
+{
+    uint pixelCount = renderSize.x * renderSize.y;
+    uint index = (uint(ubo.data.z) & 1u) * pixelCount + tracedPixel.y * renderSize.x + tracedPixel.x;
+    reservoirs.r[index].lightPoint = vec4(point, uintBitsToFloat(light));
+    reservoirs.r[index].M = M;
+    reservoirs.r[index].W = W;
+    reservoirs.r[index].normal = packSnorm4x8(vec4(normal, 0));
+    reservoirs.r[index].depth = depth;
+}
+
+//Pixels that trace nothing this frame keep the reservoir of the previous frame, the next frame reuses this half
+void CarryReservoir(ivec2 pixel)
+{
+    uint pixelCount = renderSize.x * renderSize.y;
+    uint pixelIndex = pixel.y * renderSize.x + pixel.x;
+    uint current = uint(ubo.data.z) & 1u;
+    reservoirs.r[current * pixelCount + pixelIndex] = reservoirs.r[(current ^ 1u) * pixelCount + pixelIndex];
+}
+
+vec3 GetRestirDirectLight(ObjInfo obj)
+{
+    restirSeed = HashCombine(samplerPixelSeed, uint(ubo.data.z));
+    uint candidates = ubo.settings.z;
+
+    //Candidates from the light sampler, weighted by target over source pdf
+    ReservoirState candidate = ReservoirState(vec3(0), 0u, 0.0, 0.0, 0.0);
+    for(uint i = 0; i < candidates; ++i)
+    {
+        float pdf;
+        int index = SampleLight(vec2(RestirRandom(), RestirRandom()), obj.hitPoint, obj.normal, pdf);
+        if(index < 0 || pdf <= 0)
         {
-            vec3 rd = normalize(randomSphereDirection(seedRand));
-            vec3 pointOnSphere = lightPos + rd * radius;
-            vec3 dir = normalize(pointOnSphere - obj.hitPoint);
-            shadowed = true;
-            traceNV(Scene, gl_RayFlagsTerminateOnFirstHitNV | gl_RayFlagsOpaqueNV| gl_RayFlagsSkipClosestHitShaderNV, cullMask, 0, 0, 0, obj.hitPoint, tmin, dir, tmax, 2);
-            if(!shadowed)
-                totalLight += (intensity); /// (distance(position, ray.pointHit) * distance(position, ray.pointHit));
+            candidate.M += 1;
+            continue;
         }
-        totalLight /= SHADOW_SAMPLES;
-    #endif
 
-    
-    return totalLight;
+        LightData light = lights.l[index];
+        vec3 point = light.position.xyz + light.position.w * sphereDirection(vec2(RestirRandom(), RestirRandom()));
+        float target = RestirTarget(obj, point, uint(index));
+        UpdateReservoir(candidate, point, uint(index), target / pdf, target, 1);
+    }
+
+    //An occluded candidate is dropped before it can spread to the neighbours
+    float W = candidate.target > 0 ? candidate.weightSum / (candidate.M * candidate.target) : 0;
+    if(W > 0 && !IsVisible(obj.hitPoint, candidate.point))
+        W = 0;
+
+    ReservoirState state = ReservoirState(vec3(0), 0u, 0.0, 0.0, 0.0);
+    UpdateReservoir(state, candidate.point, candidate.light, candidate.target * W * candidate.M, candidate.target, candidate.M);
+
+    ivec2 previousPixel;
+    if((ubo.settings.y & RESTIR_HISTORY) != 0 && ReprojectPixel(obj.hitPoint, previousPixel))
+    {
+        uint previousBase = ((uint(ubo.data.z) & 1u) ^ 1u) * renderSize.x * renderSize.y;
+        float depth = distance(obj.hitPoint, ubo.previousOrigin.xyz);
+        float historyLimit = RESTIR_HISTORY_LIMIT * float(candidates);
+
+        //Temporal reuse at the reprojected pixel, then spatial reuse around it
+        for(uint i = 0; i <= ubo.settings.w; ++i)
+        {
+            ivec2 q = previousPixel;
+            if(i > 0)
+                q += ivec2((vec2(RestirRandom(), RestirRandom()) * 2 - 1) * RESTIR_SPATIAL_RADIUS);
+            if(any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, ivec2(renderSize))))
+                continue;
+
+            //Only reservoirs of a similar surface are reused, the others were seen on another object or disoccluded
+            Reservoir previous = reservoirs.r[previousBase + q.y * renderSize.x + q.x];
+            if(previous.M <= 0 || abs(previous.depth - depth) > 0.1 * depth || dot(unpackSnorm4x8(previous.normal).xyz, obj.normal) < 0.9)
+                continue;
+
+            uint light = floatBitsToUint(previous.lightPoint.w);
+            float target = RestirTarget(obj, previous.lightPoint.xyz, light);
+            float M = min(previous.M, historyLimit);
+            UpdateReservoir(state, previous.lightPoint.xyz, light, target * previous.W * M, target, M);
+        }
+    }
+
+    //Reused samples were visible from another pixel or another frame, the selected one is tested again here and an
+    //occluded sample is stored with a null weight so it stops spreading
+    W = state.target > 0 ? state.weightSum / (state.M * state.target) : 0;
+    vec3 radiance = vec3(0);
+    if(W > 0 && IsVisible(obj.hitPoint, state.point))
+    {
+        vec3 toLight = state.point - obj.hitPoint;
+        float distanceSquared = dot(toLight, toLight);
+        float cosTheta = dot(obj.normal, toLight) * inversesqrt(distanceSquared);
+        vec4 colorIntensity = lights.l[state.light].colorIntensity;
+        radiance = colorIntensity.rgb * (colorIntensity.w * cosTheta / distanceSquared) * W;
+    }
+    else
+        W = 0;
+
+    StoreReservoir(state.point, state.light, min(state.M, RESTIR_HISTORY_LIMIT * float(candidates)), W, obj.normal, distance(obj.hitPoint, ubo.origin.xyz));
+    return radiance;
 }
 
 ObjInfo GetReflection(ObjInfo obj, inout vec3 origin, inout vec3 dir, inout bool ContinueReflection)
 {
     vec3 reflection = reflect(dir, obj.normal);
-    vec3 direction = normalize(reflection + (1 - obj.material.y) * randomHemisphereDirection(obj.normal, seedRand));
+    vec3 direction = normalize(reflection + (1 - obj.material.y) * randomHemisphereDirection(obj.normal));
     traceNV(Scene, rayFlags | gl_RayFlagsTerminateOnFirstHitNV, cullMask, 0, 0, 0, origin, tmin, direction, tmax, 0);
     ObjInfo reflectedObj = payloadData.objInfos;
 
@@ -214,40 +585,154 @@ ObjInfo GetReflection(ObjInfo obj, inout vec3 origin, inout vec3 dir, inout bool
     return reflectedObj;
 }
 
+//Radiance along a camera ray. Every vertex gathers the direct light (next-event estimation) then continues with a
+//cosine-weighted diffuse bounce, or a reflection on metals picked with their reflectivity as probability. The lights
+//are not in the scene, the sky is only seen directly or through reflections and does not light the diffuse surfaces
+vec3 TracePath(vec3 origin, vec3 dir, bool restir, bool visibility)
+{
+    vec3 radiance = vec3(0);
+    vec3 throughput = vec3(1);
+    bool seesSky = true;
+    for(int bounce = 0; ; ++bounce)
+    {
+        if(bounce > 0)
+            StartBounce(bounce);
+
+        ObjInfo obj = visibility && bounce == 0 ? LoadPrimaryHit(origin, dir) : GetObjectInfo(origin, dir);
+        if(bounce == 0)
+            primaryHit = obj;
+        if(!obj.isValid)
+        {
+            if(seesSky)
+                radiance += throughput * SKY_COLOR;
+            if(restir && bounce == 0)
+                StoreReservoir(vec3(0), 0u, 0.0, 0.0, vec3(0), 0.0);
+            break;
+        }
+
+        //u.x picks the lobe, u.y is the roulette
+        vec2 u = NextSample2D();
+        float reflectivity = ENABLE_REFLECTIONS && obj.material.x == 2 ? obj.material.y : 0;
+        bool reflection = u.x < reflectivity;
+        if(!reflection)
+        {
+            vec3 direct = restir && bounce == 0 ? GetRestirDirectLight(obj) : GetDirectLight(obj);
+            radiance += throughput * obj.albedo * (1 / M_PI) * direct;
+        }
+
+        if(bounce >= MAX_BOUNCES)
+            break;
+
+        //The cosine-weighted pdf cancels the cosine and the 1/PI of the diffuse BRDF, only the albedo is left
+        if(reflection)
+            dir = normalize(reflect(dir, obj.normal) + (1 - obj.material.y) * randomHemisphereDirection(obj.normal));
+        else
+            dir = cosWeightedRandomHemisphereDirection(obj.normal, dir).xyz;
+        origin = obj.hitPoint;
+        throughput *= obj.albedo;
+        seesSky = reflection;
+
+        //Paths that can't bring much light back are stopped, the survivors are weighted up to stay unbiased
+        float survival = RouletteSurvival(throughput, uint(bounce));
+        if(u.y >= survival)
+            break;
+        throughput /= survival;
+    }
+
+    return radiance;
+}
+
 void main() 
 {
-    vec3 color = vec3(0);
-    float lightIncoming = 0;
+    renderSize = uvec2(imageSize(accImage));
+    uint interleave = (ubo.settings.y >> INTERLEAVE_SHIFT) & 3u;
+    tracedPixel = InterleavedPixel(gl_LaunchIDNV.xy, interleave, uint(ubo.data.z));
 
-    float samples = 1;
-    for(int k = 0; k < samples; ++k)
+    //The pixels of the pair or block skipped this frame also carry their reservoir over
+    if((ubo.settings.y & RESTIR_ENABLED) != 0 && interleave != INTERLEAVE_OFF)
     {
-        //+ hash2(seedRand))
-        const vec2 pixelCenter = vec2(gl_LaunchIDNV.xy);
-        seedRand =  pixelCenter.x * pixelCenter.y * (k + 1);
+        ivec2 blockSize = InterleaveBlockSize(interleave);
+        ivec2 blockStart = ivec2(gl_LaunchIDNV.xy) * blockSize;
+        for(int y = 0; y < blockSize.y; ++y)
+        {
+            for(int x = 0; x < blockSize.x; ++x)
+            {
+                ivec2 skipped = blockStart + ivec2(x, y);
+                if(skipped != tracedPixel && all(lessThan(skipped, ivec2(renderSize))))
+                    CarryReservoir(skipped);
+            }
+        }
+    }
 
-        const vec2 inUV = pixelCenter/vec2(gl_LaunchSizeNV.xy);
-        vec2 d = inUV * 2.0 - 1.0;
+    if(any(greaterThanEqual(tracedPixel, ivec2(renderSize))))
+        return;
+    ivec2 pixel = tracedPixel;
 
-        vec4 origin = inverse(ubo.viewInverse) * vec4(0,0,0,1);
-        vec4 target = inverse(ubo.projInverse) * vec4(d.x, d.y, -1, 1) ;
-        vec4 direction = inverse(ubo.viewInverse) * vec4(normalize(target.xyz), 0);
+    //Mean color and sample count accumulated so far, nothing is kept when the accumulation restarts
+    vec4 previous = vec4(0);
+    #ifdef ENABLE_ACCUMULATION
+        if(ubo.data.y > 0)
+            previous = imageLoad(accImage, pixel);
+    #endif
 
-        vec3 forigin = vec3(origin.xyz);
-        vec3 fdir = vec3(direction.xyz);
+    //Samples of this frame, from the map built by the adaptive pass of the previous frame. A restarted
+    //accumulation has no variance estimate yet and traces one sample everywhere
+    uint samples = previous.a > 0 ? imageLoad(sampleMap, pixel / ADAPTIVE_TILE_SIZE).r : 1;
+    if(samples == 0)
+    {
+        if((ubo.settings.y & RESTIR_ENABLED) != 0)
+            CarryReservoir(pixel);
+        //Nothing moved since the last frame, the surface it stored is still the one of this pixel
+        if((ubo.settings.y & TEMPORAL_REPROJECTION) != 0)
+        {
+            uint pixelCount = renderSize.x * renderSize.y;
+            uint index = pixel.y * renderSize.x + pixel.x;
+            uint current = (uint(ubo.data.z) & 1u) * pixelCount + index;
+            uint last = ((uint(ubo.data.z) & 1u) ^ 1u) * pixelCount + index;
+            temporalSamples.s[current] = temporalSamples.s[last];
+            imageStore(motionImage, pixel, vec4(0));
+        }
+        return;
+    }
 
+    vec3 radiance = vec3(0);
+    float luminanceSquared = 0;
+    for(uint k = 0; k < samples; ++k)
+    {
+        //Accumulated pixels continue their own sequence, restarted ones follow the frame number so
+        //consecutive frames don't all reuse the first point
+        InitSampler(previous.a > 0 ? uint(previous.a) + k : uint(ubo.data.z) * samples + k);
+
+        vec3 color = vec3(0);
+        vec3 forigin;
+        vec3 fdir;
+        GenerateRay(forigin, fdir);
+
+        //ReSTIR keeps one reservoir per pixel, the extra samples of adaptive sampling use the light sampler directly
+        bool restir = (ubo.settings.y & RESTIR_ENABLED) != 0 && k == 0;
+        //The visibility pass traced the first sample only
+        bool visibility = (ubo.settings.y & VISIBILITY_BUFFER_ENABLED) != 0 && k == 0;
+    #ifdef ENABLE_GI
+        color = TracePath(forigin, fdir, restir, visibility);
+    #else
+        vec3 lightIncoming = vec3(0);
         float lambertPDF = 1 / (2 * M_PI);
 
         ObjInfo object;
-        object = GetObjectInfo(forigin, fdir);
+        object = visibility ? LoadPrimaryHit(forigin, fdir) : GetObjectInfo(forigin, fdir);
+        primaryHit = object;
         if(object.isValid)
         {
             //ALL FURTHER CALCULATIONS ARE HERE
-            lightIncoming = GetLightIntensity(object);
+            if(restir)
+                lightIncoming = GetRestirDirectLight(object);
+            else
+                lightIncoming = GetDirectLight(object);
             float cosT = dot(-fdir, object.normal);
             vec3 FbaseColor = (object.albedo  * (1 / M_PI) ) * lightIncoming;
             vec3 FreflectionColor = vec3(0);
-            #ifdef ENABLE_REFLECTIONS
+            if(ENABLE_REFLECTIONS)
+            {
                 if(object.material.x == 2)
                 {
                     vec3 reflectionColor = vec3(1);
@@ -256,11 +741,12 @@ void main()
                     ObjInfo reflectionObject = object;
                     for(int i = 0; i < MAX_REFLECTIONS_RECURSION; ++i)
                     {
+                        StartBounce(i + 1);
                         bool continueReflections;
                         ObjInfo refObj = GetReflection(reflectionObject, ori, dir, continueReflections);
                         reflectionObject = refObj;
                         if(reflectionObject.isValid)
-                            reflectionColor *= reflectionObject.albedo * GetLightIntensity(reflectionObject);
+                            reflectionColor *= reflectionObject.albedo * GetDirectLight(reflectionObject);
                         else
                             reflectionColor *= vec3(0.53, 0.81, 0.92);
 
@@ -270,17 +756,38 @@ void main()
                     }
                     FreflectionColor = reflectionColor;
                 }
-            #endif
+            }
 
             color = FbaseColor * (cosT / lambertPDF) * (1 - object.material.y) + FreflectionColor * object.material.y;
 
         }
         else
         {
-            color = vec3(0.53, 0.81, 0.92);
+            color = SKY_COLOR;
+            //Nothing to reuse from the sky
+            if(restir)
+                StoreReservoir(vec3(0), 0u, 0.0, 0.0, vec3(0), 0.0);
         }
-        
+    #endif
+
+        radiance += color;
+        float luminance = dot(color, LUMINANCE);
+        luminanceSquared += luminance * luminance;
+
+        if(k == 0 && (ubo.settings.y & DENOISER_GUIDES) != 0)
+        {
+            uint distanceBits = primaryHit.isValid ? floatBitsToUint(distance(forigin, primaryHit.hitPoint)) : 0u;
+            imageStore(guideImage, pixel, uvec4(distanceBits, packSnorm4x8(vec4(primaryHit.normal, 0)), packUnorm4x8(vec4(primaryHit.albedo, 0)), 0u));
+        }
+        if(k == 0 && (ubo.settings.y & TEMPORAL_REPROJECTION) != 0)
+            StoreTemporalSurface(pixel, forigin, fdir, primaryHit);
     }
 
-    imageStore(ResultImage, ivec2(gl_LaunchIDNV.xy), vec4(color, 0.0));
-}
\ No newline at end of file
+    //Running averages of the radiance and of the squared luminance, the adaptive pass derives the variance from them.
+    //The tonemap pass writes the displayable image
+    float n = previous.a;
+    float total = n + float(samples);
+    float previousSquared = n > 0 ? imageLoad(momentsImage, pixel).r : 0;
+    imageStore(accImage, pixel, vec4((previous.rgb * n + radiance) / total, total));
+    imageStore(momentsImage, pixel, vec4((previousSquared * n + luminanceSquared) / total));
+}
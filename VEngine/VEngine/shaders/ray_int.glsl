@@ -0,0 +1,23 @@
+#version 460
+#extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+//Intersection shader of the procedural primitives, shared by every pipeline tracing the scene
+
+#include "scene_data.glsl"
+#include "primitives.glsl"
+
+//Same size as the barycentrics of a triangle so the hit shaders of the visibility pass work for both. Nothing is
+//passed: the hit shaders rebuild the normal from the hit distance
+hitAttributeNV vec2 HitAttribs;
+
+void main()
+{
+    uint type = primitiveTypes.t[gl_InstanceID];
+    float t = IntersectPrimitive(type, gl_ObjectRayOriginNV, gl_ObjectRayDirectionNV, gl_RayTminNV, gl_RayTmaxNV);
+    if(t != PRIMITIVE_NO_HIT)
+    {
+        HitAttribs = vec2(0);
+        reportIntersectionNV(t, 0u);
+    }
+}
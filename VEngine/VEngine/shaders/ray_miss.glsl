@@ -8,6 +8,8 @@ struct ObjInfo
     vec3 hitPoint;
     vec3 material;
     bool isValid;
+    //Index of the instance hit, in the TLAS
+    uint instance;
 };
 
 struct Payload
@@ -24,4 +26,5 @@ void main()
     payloadData.objInfos.hitPoint = vec3(0);
     payloadData.objInfos.normal = vec3(0);
     payloadData.objInfos.material = vec3(0);
+    payloadData.objInfos.instance = 0;
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#version 460
+#extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+//Closest hit of the procedural primitives, same payload as ray_chit.glsl
+
+struct ObjInfo
+{
+    vec3 albedo;
+    vec3 normal;
+    vec3 hitPoint;
+    vec3 material;
+    bool isValid;
+    //Index of the instance hit, in the TLAS
+    uint instance;
+};
+
+struct Payload
+{
+    ObjInfo objInfos;
+};
+
+layout(location = 0) rayPayloadInNV Payload payloadData;
+
+#include "scene_data.glsl"
+#include "primitives.glsl"
+
+void main()
+{
+    //Exact normal at the hit point, in object space where the primitive is a unit shape
+    uint type = primitiveTypes.t[gl_InstanceID];
+    vec3 objectPoint = gl_ObjectRayOriginNV + gl_ObjectRayDirectionNV * gl_HitTNV;
+    vec3 normal = PrimitiveNormal(type, objectPoint, gl_ObjectRayDirectionNV);
+    normal = normalize(gl_ObjectToWorldNV * vec4(normal, 0));
+
+    //A primitive is the only primitive of its instance
+    vec4 matData, matData2;
+    GetTriangleMaterial(uint(gl_InstanceID), 0u, matData, matData2);
+
+    payloadData.objInfos.albedo = matData.xyz;
+    payloadData.objInfos.normal = normal;
+    payloadData.objInfos.hitPoint = gl_WorldRayOriginNV + gl_WorldRayDirectionNV * gl_HitTNV + normal * 0.0001;
+    payloadData.objInfos.isValid = true;
+    payloadData.objInfos.material = matData2.xyz;
+    payloadData.objInfos.instance = uint(gl_InstanceID);
+}
@@ -0,0 +1,105 @@
+/*
+* Sampler functions shared by the shaders and the CPU: VSampler.h includes this file in C++.
+* Keep the code in the common subset of GLSL and C++: uint/uvec2/vec2 types, function-style casts, no inout,
+* no arrays, functions declared with SAMPLER_FUNC.
+*/
+#ifndef SAMPLER_FUNC
+#define SAMPLER_FUNC
+#endif
+
+//Sampler types, selected at runtime through the uniform data
+const uint SAMPLER_RANDOM = 0u;
+const uint SAMPLER_SOBOL = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+//Every bounce starts at its own dimension so the dimensions a bounce uses don't depend on the previous bounces
+const uint DIMENSIONS_PER_BOUNCE = 32u;
+//Side of the blue-noise tile, a power of two
+const uint BLUE_NOISE_SIZE = 64u;
+
+//PCG hash, Jarzynski and Olano, "Hash Functions for GPU Rendering" (2020)
+SAMPLER_FUNC uint PcgHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+SAMPLER_FUNC uint HashCombine(uint seed, uint v)
+{
+    return seed ^ (PcgHash(v) + 0x9e3779b9u + (seed << 6u) + (seed >> 2u));
+}
+
+//[0, 1) float from the 24 high bits
+SAMPLER_FUNC float ToUnitFloat(uint x)
+{
+    return float(x >> 8u) * float(1.0 / 16777216.0);
+}
+
+//Independent random value, used by SAMPLER_RANDOM
+SAMPLER_FUNC uint RandomHash(uint seed, uint index, uint dimension)
+{
+    return PcgHash(HashCombine(HashCombine(seed, index), dimension));
+}
+
+//First two Sobol dimensions, as 0.32 fixed point
+SAMPLER_FUNC uint SobolDimension0(uint index)
+{
+    return bitfieldReverse(index);
+}
+
+SAMPLER_FUNC uint SobolDimension1(uint index)
+{
+    uint result = 0u;
+    uint direction = 0x80000000u;
+    while(index != 0u)
+    {
+        if((index & 1u) != 0u)
+            result ^= direction;
+        index >>= 1u;
+        direction ^= direction >> 1u;
+    }
+    return result;
+}
+
+//Burley, "Practical Hash-based Owen Scrambling" (2020): a hash that only propagates from low to high bits
+SAMPLER_FUNC uint LaineKarrasPermutation(uint x, uint seed)
+{
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16u) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return x;
+}
+
+//Owen scrambling of a 0.32 fixed point value
+SAMPLER_FUNC uint NestedUniformScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x = LaineKarrasPermutation(x, seed);
+    return bitfieldReverse(x);
+}
+
+//Shuffled, Owen-scrambled 2D Sobol point. Every pair of dimensions uses its own seed (padding), the pairs are
+//decorrelated while each one keeps the stratification of the (0,2)-sequence over power of two prefixes
+SAMPLER_FUNC vec2 OwenSobol2D(uint index, uint seed)
+{
+    uint shuffled = NestedUniformScramble(index, seed);
+    uint x = NestedUniformScramble(SobolDimension0(shuffled), HashCombine(seed, 0u));
+    uint y = NestedUniformScramble(SobolDimension1(shuffled), HashCombine(seed, 1u));
+    return vec2(ToUnitFloat(x), ToUnitFloat(y));
+}
+
+//R2 sequence (Roberts 2018) in 0.32 fixed point, rotated by two blue-noise values. Over the samples of a pixel the
+//points are low-discrepancy, over the screen the error is blue-noise distributed
+SAMPLER_FUNC vec2 BlueNoise2D(uint index, uvec2 blueNoise)
+{
+    return vec2(ToUnitFloat(blueNoise.x + index * 3242174889u), ToUnitFloat(blueNoise.y + index * 2447445414u));
+}
+
+//Toroidal shift of the blue-noise tile for a dimension, one per component
+SAMPLER_FUNC uvec2 BlueNoiseOffset(uint dimension)
+{
+    return uvec2(PcgHash(2u * dimension), PcgHash(2u * dimension + 1u));
+}
@@ -0,0 +1,76 @@
+/*
+* Scene geometry and materials, shared by the closest hit shaders and the passes that rebuild a hit from the
+* visibility buffer. Every object is a range of the scene buffers (see VSceneTable), a procedural primitive is one
+* primitive without vertices.
+*/
+
+struct Vertex
+{
+    vec3 pos;
+    vec3 normal;
+    int id;
+};
+
+//Scene material table, two vec4 per material (see VMaterial)
+layout(binding = 3, set = 0) buffer Materials
+{
+    vec4 m[];
+}materials;
+
+layout(binding = 4, set = 0) buffer Vertices 
+{ 
+    vec4 v[]; 
+} objverts;
+
+//First triangle (x) and base vertex (y) of every instance in the scene buffers
+layout(binding = 6, set = 0) buffer InstanceOffsets
+{
+    uvec2 o[];
+}instanceOffsets;
+
+//Scene index buffer, indices are local to their instance
+layout(binding = 8, set = 0) buffer Indices
+{
+    uint i[];
+}objindices;
+
+//Material table id of every scene triangle
+layout(binding = 9, set = 0) buffer MaterialIds
+{
+    uint id[];
+}materialIds;
+
+//PRIMITIVE_MESH or the procedural primitive of every instance (see primitives.glsl)
+layout(binding = 23, set = 0) buffer PrimitiveTypes
+{
+    uint t[];
+}primitiveTypes;
+
+Vertex getVertex(uint index)
+{
+    vec4 d0 = objverts.v[2 * index];
+	vec4 d1 = objverts.v[2 * index + 1];
+	Vertex v;
+	v.pos = d0.xyz;
+	v.normal = d1.xyz;
+    v.id = int(d0.w);
+    return v;
+}
+
+//Vertices of a triangle, fetched through the same indices the BLAS was built from
+void GetTriangle(uint instance, uint primitive, out Vertex v0, out Vertex v1, out Vertex v2)
+{
+    uvec2 offsets = instanceOffsets.o[instance];
+    uint firstIndex = (offsets.x + primitive) * 3;
+    v0 = getVertex(offsets.y + objindices.i[firstIndex]);
+    v1 = getVertex(offsets.y + objindices.i[firstIndex + 1]);
+    v2 = getVertex(offsets.y + objindices.i[firstIndex + 2]);
+}
+
+//Material of a triangle, albedo in the first vec4 and type, reflectivity, ior in the second (see VMaterial)
+void GetTriangleMaterial(uint instance, uint primitive, out vec4 matData, out vec4 matData2)
+{
+    uint materialId = materialIds.id[instanceOffsets.o[instance].x + primitive];
+    matData = materials.m[2 * materialId];
+    matData2 = materials.m[2 * materialId + 1];
+}
@@ -0,0 +1,31 @@
+/*
+* History of the temporal reprojection: the accumulation of every pixel with the surface it was accumulated on, so a
+* restarted accumulation can start from what the previous frame saw at the same point. The buffer holds two samples
+* per pixel, the frame parity picks the half written this frame, the other half is the previous frame. Same layout as
+* TemporalSample in VContext.h (std430).
+*/
+struct TemporalSample
+{
+    //rgb: mean radiance, a: samples
+    vec4 radiance;
+    //Mean squared luminance
+    float moment;
+    //Distance to the camera, 0 for the sky
+    float depth;
+    //Normal (packSnorm4x8)
+    uint normal;
+    //Distance of the same point to the camera of the previous frame, 0 for the sky
+    float previousDepth;
+};
+
+//Motion of the pixels whose surface was behind the previous camera, reprojects them off screen
+const float MOTION_NONE = -65536.0;
+
+//The history belongs to the surface seen now: both the sky, or the same distance to the previous camera and normal
+bool SameSurface(TemporalSample current, TemporalSample history)
+{
+    if(current.previousDepth <= 0 || history.depth <= 0)
+        return current.previousDepth <= 0 && history.depth <= 0;
+    return abs(history.depth - current.previousDepth) < 0.1 * current.previousDepth
+        && dot(unpackSnorm4x8(current.normal).xyz, unpackSnorm4x8(history.normal).xyz) > 0.9;
+}
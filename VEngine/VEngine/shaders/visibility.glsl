@@ -0,0 +1,21 @@
+/*
+* Visibility buffer: the primary hit of a pixel in 64 bits, instance and primitive in x, barycentrics in y.
+* The shading pass rebuilds the attributes from the scene buffers (see LoadPrimaryHit in ray_gen.glsl).
+*/
+
+//Bits of x holding the primitive, the instance takes the rest. Same as VISIBILITY_PRIMITIVE_BITS in VContext.h
+const uint VISIBILITY_PRIMITIVE_BITS = 22u;
+//x of a pixel that sees the sky, never a valid instance and primitive pair
+const uint VISIBILITY_MISS = 0xFFFFFFFFu;
+
+uvec2 PackVisibility(uint instance, uint primitive, vec2 barycentrics)
+{
+    return uvec2((instance << VISIBILITY_PRIMITIVE_BITS) | primitive, packUnorm2x16(barycentrics));
+}
+
+void UnpackVisibility(uvec2 visibility, out uint instance, out uint primitive, out vec2 barycentrics)
+{
+    instance = visibility.x >> VISIBILITY_PRIMITIVE_BITS;
+    primitive = visibility.x & ((1u << VISIBILITY_PRIMITIVE_BITS) - 1u);
+    barycentrics = unpackUnorm2x16(visibility.y);
+}
@@ -0,0 +1,15 @@
+#version 460
+#extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "visibility.glsl"
+
+layout(location = 3) rayPayloadInNV uvec2 visibility;
+
+//Barycentrics of a triangle, unused for a procedural primitive (LoadPrimaryHit intersects it again)
+hitAttributeNV vec2 HitAttribs;
+
+void main()
+{
+    visibility = PackVisibility(uint(gl_InstanceID), uint(gl_PrimitiveID), HitAttribs);
+}
@@ -0,0 +1,39 @@
+#version 460
+#extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+//First pass of the visibility buffer: traces the primary ray of every pixel and only keeps which triangle it hit.
+//The payload is 8 bytes instead of the ObjInfo of the megakernel, the shading happens in ray_gen.glsl
+
+#include "sampling.glsl"
+#include "visibility.glsl"
+#include "interleave.glsl"
+
+layout(set = 0, binding = 0) uniform accelerationStructureNV Scene;
+//a: number of samples accumulated, picks the sample of the pixel
+layout(set = 0, binding = 7, rgba32f) uniform readonly image2D accImage;
+#include "camera_data.glsl"
+#include "pixel_sampler.glsl"
+layout(set = 0, binding = 17, rg32ui) uniform writeonly uimage2D visibilityImage;
+
+layout(location = 3) rayPayloadNV uvec2 visibility;
+
+void main()
+{
+    //Same ray as the first sample of the pixel in ray_gen.glsl, launched over the same interleaved grid
+    uvec2 renderSize = uvec2(imageSize(accImage));
+    ivec2 pixel = InterleavedPixel(gl_LaunchIDNV.xy, (ubo.settings.y >> INTERLEAVE_SHIFT) & 3u, uint(ubo.data.z));
+    if(any(greaterThanEqual(pixel, ivec2(renderSize))))
+        return;
+    float accumulated = ubo.data.y > 0 ? imageLoad(accImage, pixel).a : 0;
+    uint sampleIndex = accumulated > 0 ? uint(accumulated) : uint(ubo.data.z);
+    uint pixelSeed = PcgHash(uint(pixel.y) * renderSize.x + uint(pixel.x));
+
+    vec3 origin;
+    vec3 direction;
+    vec2 lensSample = ubo.lowerLeft.w != 0 ? PixelSample2D(uvec2(pixel), pixelSeed, sampleIndex, 0u) : vec2(0);
+    GenerateCameraRay(uvec2(pixel), lensSample, origin, direction);
+
+    traceNV(Scene, gl_RayFlagsOpaqueNV, 0xFF, 0, 0, 0, origin, 0.0001, direction, 150, 3);
+    imageStore(visibilityImage, pixel, uvec4(visibility, 0, 0));
+}
@@ -0,0 +1,12 @@
+#version 460
+#extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "visibility.glsl"
+
+layout(location = 3) rayPayloadInNV uvec2 visibility;
+
+void main()
+{
+    visibility = uvec2(VISIBILITY_MISS, 0u);
+}
@@ -0,0 +1,55 @@
+/*
+* Scheduling logic of the wavefront path tracer, shared by the wavefront kernels and the CPU reference
+* (VWavefrontScheduler): Wavefront.cpp includes this file in C++. Keep the code in the common subset of GLSL and C++
+* (see sampling.glsl).
+*
+* Paths move between the stages through compact queues: a stage appends the paths it keeps with an atomic counter.
+* Before shading, the paths of a bounce are sorted by bin with a counting sort (count, then scatter at the offset of
+* the bin) so neighbouring lanes run the same material code.
+*/
+#ifndef WAVEFRONT_FUNC
+#define WAVEFRONT_FUNC
+#endif
+
+const uint WAVEFRONT_BIN_MISS = 0u;
+const uint WAVEFRONT_BIN_DIFFUSE = 1u;
+const uint WAVEFRONT_BIN_METAL = 2u;
+const uint WAVEFRONT_BIN_COUNT = 3u;
+
+//Lanes of the compute stages that run over a queue (local_size_x)
+const uint WAVEFRONT_GROUP_SIZE = 64u;
+
+//Russian roulette starts after this many bounces, survival is capped so the expected path length stays bounded
+const uint RR_MIN_BOUNCES = 2u;
+const float RR_MAX_SURVIVAL = 0.95f;
+
+//Bin of a hit: misses, diffuse surfaces and metals (material type 2, see VMaterial) are shaded separately
+WAVEFRONT_FUNC uint WavefrontBin(bool valid, float materialType)
+{
+    if(!valid)
+        return WAVEFRONT_BIN_MISS;
+    return materialType == 2.0f ? WAVEFRONT_BIN_METAL : WAVEFRONT_BIN_DIFFUSE;
+}
+
+//First slot of a bin in the sorted queue, the exclusive prefix sum of the bin counts
+WAVEFRONT_FUNC uint WavefrontBinOffset(uvec4 binCounts, uint bin)
+{
+    uint offset = 0u;
+    for(uint i = 0u; i < bin; ++i)
+        offset += binCounts[i];
+    return offset;
+}
+
+//Groups of WAVEFRONT_GROUP_SIZE lanes that cover a queue of count paths
+WAVEFRONT_FUNC uint WavefrontGroupCount(uint count)
+{
+    return (count + WAVEFRONT_GROUP_SIZE - 1u) / WAVEFRONT_GROUP_SIZE;
+}
+
+//Probability for a path to continue after a bounce, 1 while the roulette is off
+WAVEFRONT_FUNC float RouletteSurvival(vec3 throughput, uint bounce)
+{
+    if(bounce + 1u < RR_MIN_BOUNCES)
+        return 1.0f;
+    return min(max(throughput.x, max(throughput.y, throughput.z)), RR_MAX_SURVIVAL);
+}
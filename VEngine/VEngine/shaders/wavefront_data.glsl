@@ -0,0 +1,108 @@
+/*
+* Buffers of the wavefront path tracer (set 1), included by every wavefront shader after camera_data.glsl. The queues
+* and bins follow wavefront.glsl, VWavefrontScheduler runs the same scheduling on the CPU.
+*/
+#include "sampling.glsl"
+#include "wavefront.glsl"
+
+//Path of a pixel, indexed by pixel. See WavefrontPath
+struct WavefrontPath
+{
+    //xyz: origin of the next ray
+    vec4 origin;
+    //xyz: direction of the next ray, w: 1 if the sky is visible along it (camera ray or reflection)
+    vec4 direction;
+    //rgb: throughput, w: sample index of the pixel (uint bits)
+    vec4 throughput;
+    vec4 radiance;
+};
+
+//Closest hit of the last extension ray of a path
+struct WavefrontHit
+{
+    //w: 1 if something was hit
+    vec4 albedo;
+    //w: material type
+    vec4 normal;
+    //w: reflectivity
+    vec4 hitPoint;
+};
+
+struct WavefrontShadowRay
+{
+    //w: distance to the light
+    vec4 origin;
+    //w: index of the path (uint bits)
+    vec4 direction;
+    //Light added to the path when the ray is not occluded
+    vec4 contribution;
+};
+
+layout(set = 1, binding = 0) buffer WavefrontCounters
+{
+    //Paths queued for the bounce of each parity
+    uint rays[2];
+    uint shadowRays;
+    uint padding;
+    uvec4 binCounts;
+    uvec4 binCursors;
+}counters;
+
+layout(set = 1, binding = 1) buffer WavefrontPaths
+{
+    WavefrontPath p[];
+}paths;
+
+layout(set = 1, binding = 2) buffer WavefrontHits
+{
+    WavefrontHit h[];
+}hits;
+
+//Two queues of path indices, the queue of a bounce starts at (bounce & 1) * pathCount
+layout(set = 1, binding = 3) buffer WavefrontRayQueues
+{
+    uint q[];
+}rayQueues;
+
+//Paths of the bounce sorted by bin
+layout(set = 1, binding = 4) buffer WavefrontSortedQueue
+{
+    uint q[];
+}sortedQueue;
+
+layout(set = 1, binding = 5) buffer WavefrontShadowRays
+{
+    WavefrontShadowRay r[];
+}shadowRays;
+
+//Groups of the compute stages of the bounce, written by wavefront_args.comp (layout of VkDispatchIndirectCommand)
+layout(set = 1, binding = 6) buffer WavefrontDispatch
+{
+    uint groupsX;
+    uint groupsY;
+    uint groupsZ;
+}dispatchArgs;
+
+//See WavefrontConstants
+layout(push_constant) uniform WavefrontConstants
+{
+    uint bounce;
+    uint maxBounces;
+    uint pathCount;
+    uint width;
+    uint softShadows;
+    uint reflections;
+} params;
+
+#include "pixel_sampler.glsl"
+
+uvec2 PathPixel(uint path)
+{
+    return uvec2(path % params.width, path / params.width);
+}
+
+//Same sequences as NextSample2D in ray_gen.glsl, the path index is the pixel index
+vec2 WavefrontSample2D(uint path, uint sampleIndex, uint dimension)
+{
+    return PixelSample2D(PathPixel(path), PcgHash(path), sampleIndex, dimension);
+}
@@ -0,0 +1,47 @@
+#version 460
+#extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+//Extension stage of the wavefront path tracer: closest hit of every queued path. The hit is only recorded, the
+//shading runs in wavefront_shade.comp once the paths are sorted by material
+
+#include "camera_data.glsl"
+#include "wavefront_data.glsl"
+
+layout(set = 0, binding = 0) uniform accelerationStructureNV Scene;
+
+struct ObjInfo
+{
+    vec3 albedo;
+    vec3 normal;
+    vec3 hitPoint;
+    vec3 material;
+    bool isValid;
+    //Index of the instance hit, in the TLAS
+    uint instance;
+};
+
+struct Payload
+{
+    ObjInfo objInfos;
+};
+
+layout(location = 0) rayPayloadNV Payload payloadData;
+
+void main()
+{
+    //Launched over every path, only the lanes of queued paths trace
+    uint lane = gl_LaunchIDNV.y * gl_LaunchSizeNV.x + gl_LaunchIDNV.x;
+    uint queue = params.bounce & 1u;
+    if(lane >= counters.rays[queue])
+        return;
+
+    uint path = rayQueues.q[queue * params.pathCount + lane];
+    WavefrontPath state = paths.p[path];
+    traceNV(Scene, gl_RayFlagsOpaqueNV, 0xFF, 0, 0, 0, state.origin.xyz, 0.0001, state.direction.xyz, 150, 0);
+
+    ObjInfo obj = payloadData.objInfos;
+    hits.h[path].albedo = vec4(obj.albedo, obj.isValid ? 1 : 0);
+    hits.h[path].normal = vec4(obj.normal, obj.material.x);
+    hits.h[path].hitPoint = vec4(obj.hitPoint, obj.material.y);
+}
@@ -0,0 +1,26 @@
+#version 460
+#extension GL_NV_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+
+//Shadow stage of the wavefront path tracer: adds the light of every unoccluded shadow ray to its path. A path queues
+//at most one shadow ray per bounce, so the radiance is updated without atomics
+
+#include "camera_data.glsl"
+#include "wavefront_data.glsl"
+
+layout(set = 0, binding = 0) uniform accelerationStructureNV Scene;
+
+layout(location = 2) rayPayloadNV bool shadowed;
+
+void main()
+{
+    uint lane = gl_LaunchIDNV.y * gl_LaunchSizeNV.x + gl_LaunchIDNV.x;
+    if(lane >= counters.shadowRays)
+        return;
+
+    WavefrontShadowRay ray = shadowRays.r[lane];
+    shadowed = true;
+    traceNV(Scene, gl_RayFlagsOpaqueNV | gl_RayFlagsTerminateOnFirstHitNV | gl_RayFlagsSkipClosestHitShaderNV, 0xFF, 0, 0, 1, ray.origin.xyz, 0.0001, ray.direction.xyz, ray.origin.w, 2);
+    if(!shadowed)
+        paths.p[floatBitsToUint(ray.direction.w)].radiance.rgb += ray.contribution.rgb;
+}
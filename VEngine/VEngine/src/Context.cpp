@@ -1,6 +1,10 @@
 #include <VContext.h>
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstddef>
 #include <set> 
+#include <glm/gtc/packing.hpp>
 #include <optix_function_table_definition.h>
 
 #ifdef NDEBUG
@@ -9,17 +13,40 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
-#define WIDTH 1920
-#define HEIGHT 1080
-
 #define INDEX_RAYGEN 0
 #define INDEX_MISS 1
 #define INDEX_SHADOWMISS 2
-#define INDEX_SHADOWHIT 4
 #define INDEX_CLOSEST_HIT 3
+#define INDEX_PROCEDURAL_HIT 4
 
 #define NUM_SHADER_GROUPS 5
 
+//Shader groups of the wavefront ray tracing pipeline
+#define WAVEFRONT_GROUP_EXTEND 0
+#define WAVEFRONT_GROUP_SHADOW 1
+#define WAVEFRONT_GROUP_MISS 2
+#define WAVEFRONT_GROUP_SHADOWMISS 3
+#define WAVEFRONT_GROUP_CLOSEST_HIT 4
+#define WAVEFRONT_GROUP_PROCEDURAL_HIT 5
+
+#define WAVEFRONT_GROUP_COUNT 6
+
+//Shader groups of the visibility pass
+#define VISIBILITY_GROUP_RAYGEN 0
+#define VISIBILITY_GROUP_MISS 1
+#define VISIBILITY_GROUP_CLOSEST_HIT 2
+#define VISIBILITY_GROUP_PROCEDURAL_HIT 3
+
+#define VISIBILITY_GROUP_COUNT 4
+
+//SBT offset of the procedural instances: every traceNV uses a record offset and stride of 0, so an instance selects the
+//hit group instanceOffset entries after the closest hit group of the pipeline. The three pipelines keep the procedural
+//hit group right after the triangle one
+#define PROCEDURAL_HIT_OFFSET 1
+static_assert(INDEX_PROCEDURAL_HIT - INDEX_CLOSEST_HIT == PROCEDURAL_HIT_OFFSET, "procedural hit group of the megakernel");
+static_assert(WAVEFRONT_GROUP_PROCEDURAL_HIT - WAVEFRONT_GROUP_CLOSEST_HIT == PROCEDURAL_HIT_OFFSET, "procedural hit group of the wavefront pipeline");
+static_assert(VISIBILITY_GROUP_PROCEDURAL_HIT - VISIBILITY_GROUP_CLOSEST_HIT == PROCEDURAL_HIT_OFFSET, "procedural hit group of the visibility pass");
+
 #pragma region Queues
 QueueFamilyIndices VContext::FindQueueFamilies(VkPhysicalDevice p_device)
 {
@@ -62,6 +89,17 @@ QueueFamilyIndices VContext::FindQueueFamilies(VkPhysicalDevice p_device)
 
         i++;
     }
+
+    //A compute family without graphics support runs asynchronously to the graphics queue
+    for (uint32_t j = 0; j < device.queueFamilyProperties.size(); ++j)
+    {
+        const VkQueueFlags flags = device.queueFamilyProperties[j].queueFlags;
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            indices.computeFamily = j;
+            break;
+        }
+    }
     return indices;
 }
 #pragma endregion
@@ -154,6 +192,8 @@ void VContext::SelectGPU()
 void VContext::CREATETHEFUCKINGWINDOW(int width, int height, const char* name)
 {
      window = glfwCreateWindow(width, height, name, nullptr, nullptr);
+     glfwSetWindowUserPointer(window, this);
+     glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
      fd = new int(-1);
 }
 void VContext::SetupInstance()
@@ -211,6 +251,13 @@ void VContext::createLogicalDevice()
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+    if (useAsyncCompute && !indices.computeFamily.has_value())
+    {
+        std::cout << "NO DEDICATED COMPUTE QUEUE, TLAS UPDATES STAY ON THE GRAPHICS QUEUE\n";
+        useAsyncCompute = false;
+    }
+    if (useAsyncCompute)
+        uniqueQueueFamilies.insert(indices.computeFamily.value());
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -251,6 +298,11 @@ void VContext::createLogicalDevice()
 
     vkGetDeviceQueue(device.logicalDevice, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device.logicalDevice, indices.presentFamily.value(), 0, &presentQueue);
+    if (useAsyncCompute)
+    {
+        vkGetDeviceQueue(device.logicalDevice, indices.computeFamily.value(), 0, &computeQueue);
+        asyncQueueFamilies = { indices.graphicsFamily.value(), indices.computeFamily.value() };
+    }
 }
 
 SwapChainSupportDetails VContext::querySwapChainSupport(VkPhysicalDevice p_device) const
@@ -417,6 +469,7 @@ void VContext::setupSwapChain(uint32_t width, uint32_t height, bool vsync)
     }
 
     CHECK_ERROR(vkCreateSwapchainKHR(device.logicalDevice, &swapchain_ci, nullptr, &swapChain.swapChain));
+    swapChain.extent = swapchain_extent;
 
     // If an existing swap chain is re-created, destroy the old swap chain
     // This also cleans up all the presentable images
@@ -538,6 +591,9 @@ bool VContext::CheckValidationLayerSupport() const
 }
 void VContext::CleanUp()
 {
+    vkDeviceWaitIdle(device.logicalDevice);
+    deletionQueue.Flush();
+
     m_pixelBufferIn.destroy(m_alloc);   // Closing Handle
     m_pixelBufferOut.destroy(m_alloc);  // Closing Handle
 
@@ -585,23 +641,82 @@ void VContext::CleanUp()
 
     for (auto& obj : bottomLevelAS)
         vkFreeMemory(device.logicalDevice, obj.memory, nullptr);
-    vkFreeMemory(device.logicalDevice, topLevelAS.memory, nullptr);
 
-    vkDestroyPipeline(device.logicalDevice, Rpipeline, nullptr);
+    for (auto& rayTracingPipeline : rayTracingPipelines)
+    {
+        vkDestroyPipeline(device.logicalDevice, rayTracingPipeline.pipeline, nullptr);
+        rayTracingPipeline.shaderBindingTable.destroy();
+    }
     vkDestroyPipelineLayout(device.logicalDevice, RpipelineLayout, nullptr);
+    vkDestroyPipeline(device.logicalDevice, tonemapPipeline, nullptr);
+    vkDestroyPipelineLayout(device.logicalDevice, tonemapPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.logicalDevice, tonemapDescriptorSetLayout, nullptr);
+    vkDestroyPipeline(device.logicalDevice, temporalPipeline, nullptr);
+    vkDestroyPipeline(device.logicalDevice, reconstructPipeline, nullptr);
+    vkDestroyPipelineLayout(device.logicalDevice, temporalPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.logicalDevice, temporalDescriptorSetLayout, nullptr);
+    vkDestroyPipeline(device.logicalDevice, wavefrontRayPipeline.pipeline, nullptr);
+    wavefrontRayPipeline.shaderBindingTable.destroy();
+    vkDestroyPipeline(device.logicalDevice, visibilityPipeline.pipeline, nullptr);
+    visibilityPipeline.shaderBindingTable.destroy();
+    vkDestroyPipeline(device.logicalDevice, wavefrontCameraPipeline, nullptr);
+    vkDestroyPipeline(device.logicalDevice, wavefrontBinCountPipeline, nullptr);
+    vkDestroyPipeline(device.logicalDevice, wavefrontBinScatterPipeline, nullptr);
+    vkDestroyPipeline(device.logicalDevice, wavefrontShadePipeline, nullptr);
+    vkDestroyPipeline(device.logicalDevice, wavefrontAccumulatePipeline, nullptr);
+    vkDestroyPipeline(device.logicalDevice, wavefrontArgsPipeline, nullptr);
+    vkDestroyPipelineLayout(device.logicalDevice, wavefrontPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.logicalDevice, wavefrontDescriptorSetLayout, nullptr);
     vkDestroyRenderPass(device.logicalDevice, renderPass, nullptr);
 
     vkDestroySwapchainKHR(device.logicalDevice, swapChain.swapChain, nullptr);
     
-    for (auto& fence : waitFences)
-        vkDestroyFence(device.logicalDevice, fence, nullptr);
-    
-    vkDestroySemaphore(device.logicalDevice, semaphores.presentComplete, nullptr);
-    vkDestroySemaphore(device.logicalDevice, semaphores.renderComplete, nullptr);
+    for (auto& frame : frames)
+    {
+        vkDestroyFence(device.logicalDevice, frame.fence, nullptr);
+        vkDestroySemaphore(device.logicalDevice, frame.semaphores.presentComplete, nullptr);
+        vkDestroySemaphore(device.logicalDevice, frame.semaphores.renderComplete, nullptr);
+        if (frame.asBuildComplete != VK_NULL_HANDLE)
+            vkDestroySemaphore(device.logicalDevice, frame.asBuildComplete, nullptr);
+        frame.ubo.unmap();
+        frame.ubo.destroy();
+        frame.adaptiveStats.unmap();
+        frame.adaptiveStats.destroy();
+        frame.lightBuffer.unmap();
+        frame.lightBuffer.destroy();
+        frame.lightAliasBuffer.unmap();
+        frame.lightAliasBuffer.destroy();
+        frame.instanceBuffer.destroy();
+        frame.scratchBuffer.destroy();
+        frame.previousTransformBuffer.destroy();
+        vkDestroyAccelerationStructureNV(device.logicalDevice, frame.topLevelAS.accelerationStructure, nullptr);
+        vkFreeMemory(device.logicalDevice, frame.topLevelAS.memory, nullptr);
+    }
+    lightBvhBuffer.destroy();
+    reservoirBuffer.destroy();
+    temporalBuffer.destroy();
+    wavefrontBuffers.counters.destroy();
+    wavefrontBuffers.paths.destroy();
+    wavefrontBuffers.hits.destroy();
+    wavefrontBuffers.rayQueues.destroy();
+    wavefrontBuffers.sortedQueue.destroy();
+    wavefrontBuffers.shadowRays.destroy();
+    wavefrontBuffers.dispatchArgs.destroy();
+    denoiseReadback.destroy();
+    denoiseUpload.destroy();
+    if (computeCommandPool != VK_NULL_HANDLE)
+        vkDestroyCommandPool(device.logicalDevice, computeCommandPool, nullptr);
+    vkDestroyQueryPool(device.logicalDevice, timestampPool, nullptr);
 
     dev.destroyBuffer(pixelBufferOut);
     vkFreeMemory(device.logicalDevice, storageImage.memory, nullptr);
     vkFreeMemory(device.logicalDevice, accImage.memory, nullptr);
+    vkFreeMemory(device.logicalDevice, momentsImage.memory, nullptr);
+    vkFreeMemory(device.logicalDevice, sampleMapImage.memory, nullptr);
+    vkFreeMemory(device.logicalDevice, visibilityImage.memory, nullptr);
+    vkFreeMemory(device.logicalDevice, guideImage.memory, nullptr);
+    vkFreeMemory(device.logicalDevice, denoisedImage.memory, nullptr);
+    vkFreeMemory(device.logicalDevice, motionImage.memory, nullptr);
     vkDestroyDevice(device.logicalDevice, nullptr);
     vkDestroySurfaceKHR(GetInstance(), device.surface, nullptr);
     vkDestroyInstance(GetInstance(), nullptr);
@@ -610,41 +725,75 @@ void VContext::CleanUp()
 }
 void VContext::UpdateObjects(std::vector<VObject>& objects)
 {
-    const VkCommandBuffer cmdBuffer = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-    //Generate TLAS
-    std::vector<GeometryInstance> instances;
+    //Only gather the instances here, the TLAS is rebuilt at the start of the next frame's command buffer
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    sceneInstances.clear();
     for(auto& obj: objects)
-        instances.push_back(obj.m_mesh.meshGeometry);
+        sceneInstances.push_back(obj.m_mesh.meshGeometry);
+
+    updateObjectsTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void VContext::UpdateObjects(const std::vector<glm::mat3x4>& transforms)
+{
+    //Same as above for a render thread that only receives transforms, the instance order is the object order
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < transforms.size() && i < sceneInstances.size(); ++i)
+        sceneInstances[i].transform = transforms[i];
+
+    updateObjectsTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void VContext::createFrameTopLevel(FrameData& frame, uint32_t instanceCount)
+{
+    //The previous TLAS of this slot can still be referenced by a recorded frame
+    if (frame.topLevelAS.accelerationStructure != VK_NULL_HANDLE)
+    {
+        DestroyDeferred(frame.topLevelAS);
+        DestroyDeferred(frame.instanceBuffer);
+        DestroyDeferred(frame.scratchBuffer);
+        DestroyDeferred(frame.previousTransformBuffer);
+    }
 
-    //Get all instances and create a buffer with all of them
-    VBuffer::Buffer instanceBuffer;
-    createBuffer(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &instanceBuffer,
-        sizeof(GeometryInstance) * instances.size(),
-        instances.data());
+    CreateTopLevelAccelerationStructure(frame.topLevelAS, instanceCount);
 
-    //Generate TLAS
-    AccelerationStructure newDataAS;
-    CreateTopLevelAccelerationStructure(newDataAS, instances.size());
+    //Instances are written by the CPU every frame, keep the buffer mapped. The ray tracing pass also reads the
+    //transforms to rebuild the hits of the visibility buffer: with async compute the build reads it on the compute
+    //queue and the trace on the graphics queue, so it is shared by both families
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &frame.instanceBuffer,
+        sizeof(GeometryInstance) * instanceCount, nullptr, true));
+    CHECK_ERROR(frame.instanceBuffer.map());
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &frame.previousTransformBuffer,
+        sizeof(glm::mat3x4) * instanceCount));
+    CHECK_ERROR(frame.previousTransformBuffer.map());
 
     //Get memory requirements
     VkMemoryRequirements2 memReqTopLevelAS;
-    VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo2{};
-    memoryRequirementsInfo2.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
-    memoryRequirementsInfo2.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
-    memoryRequirementsInfo2.accelerationStructure = newDataAS.accelerationStructure;
-    vkGetAccelerationStructureMemoryRequirementsNV(device.logicalDevice, &memoryRequirementsInfo2, &memReqTopLevelAS);
-
-    const VkDeviceSize scratchBufferSize = memReqTopLevelAS.memoryRequirements.size;
+    VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{};
+    memoryRequirementsInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
+    memoryRequirementsInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
+    memoryRequirementsInfo.accelerationStructure = frame.topLevelAS.accelerationStructure;
+    vkGetAccelerationStructureMemoryRequirementsNV(device.logicalDevice, &memoryRequirementsInfo, &memReqTopLevelAS);
 
-    //Generate Scratch buffer
-    VBuffer::Buffer scratchBuffer;
-    createBuffer(
+    //The scratch buffer is only used by the build, it stays on the queue family that records it
+    CHECK_ERROR(createBuffer(
         VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        &scratchBuffer,
-        scratchBufferSize);
+        &frame.scratchBuffer,
+        memReqTopLevelAS.memoryRequirements.size));
+
+    frame.instanceCapacity = instanceCount;
+
+    if (frame.descriptorSet != VK_NULL_HANDLE)
+        writeDescriptorSet(frame);
+}
 
+void VContext::recordTopLevelBuild(VkCommandBuffer cmdBuffer, const FrameData& frame) const
+{
     //Generate build info for TLAS
     VkAccelerationStructureInfoNV buildInfo{};
     buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
@@ -652,33 +801,71 @@ void VContext::UpdateObjects(std::vector<VObject>& objects)
     buildInfo.flags = /*VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_NV |*/ VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_NV;
     buildInfo.pGeometries = nullptr;
     buildInfo.geometryCount = 0;
-    buildInfo.instanceCount = instances.size();
+    buildInfo.instanceCount = frame.instanceCapacity;
 
-    //Build Actual TLAS
+    //The TLAS, instance and scratch buffers of this slot are only used by this frame, the fence wait
+    //in draw() already covers the previous use, so only the build -> trace dependency is needed
     vkCmdBuildAccelerationStructureNV(
         cmdBuffer,
         &buildInfo,
-        instanceBuffer.buffer,
+        frame.instanceBuffer.buffer,
         0,
         VK_FALSE,
-        newDataAS.accelerationStructure,
+        frame.topLevelAS.accelerationStructure,
         nullptr,
-        scratchBuffer.buffer,
+        frame.scratchBuffer.buffer,
         0);
+}
 
-    VkMemoryBarrier memoryBarrier = Initializers::memoryBarrier();
-    memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
-    memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
-    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
-
-    vkCmdCopyAccelerationStructureNV(cmdBuffer, topLevelAS.accelerationStructure, newDataAS.accelerationStructure, VK_COPY_ACCELERATION_STRUCTURE_MODE_CLONE_NV);
-    flushCommandBuffer(cmdBuffer, graphicsQueue, true);
-    vkDestroyAccelerationStructureNV(device.logicalDevice, newDataAS.accelerationStructure, nullptr);
-    vkFreeMemory(device.logicalDevice, newDataAS.memory, nullptr);
-
-    instances.clear();
-    scratchBuffer.destroy();
-    instanceBuffer.destroy();
+void VContext::DestroyDeferred(const VBuffer::Buffer& buffer)
+{
+    VkDevice logicalDevice = device.logicalDevice;
+    VkBuffer handle = buffer.buffer;
+    VkDeviceMemory memory = buffer.memory;
+    deletionQueue.Push(frameNumber, [logicalDevice, handle, memory]()
+    {
+        if (handle)
+            vkDestroyBuffer(logicalDevice, handle, nullptr);
+        if (memory)
+            vkFreeMemory(logicalDevice, memory, nullptr);
+    });
+}
+void VContext::DestroyDeferred(const AccelerationStructure& accelerationStruct)
+{
+    VkDevice logicalDevice = device.logicalDevice;
+    VkAccelerationStructureNV handle = accelerationStruct.accelerationStructure;
+    VkDeviceMemory memory = accelerationStruct.memory;
+    deletionQueue.Push(frameNumber, [logicalDevice, handle, memory]()
+    {
+        if (handle)
+            vkDestroyAccelerationStructureNV(logicalDevice, handle, nullptr);
+        if (memory)
+            vkFreeMemory(logicalDevice, memory, nullptr);
+    });
+}
+void VContext::DestroyDeferred(const StorageImage& image)
+{
+    VkDevice logicalDevice = device.logicalDevice;
+    VkImageView view = image.view;
+    VkImage handle = image.image;
+    VkDeviceMemory memory = image.memory;
+    deletionQueue.Push(frameNumber, [logicalDevice, view, handle, memory]()
+    {
+        if (view)
+            vkDestroyImageView(logicalDevice, view, nullptr);
+        if (handle)
+            vkDestroyImage(logicalDevice, handle, nullptr);
+        if (memory)
+            vkFreeMemory(logicalDevice, memory, nullptr);
+    });
+}
+void VContext::DestroyDeferred(VkDeviceMemory memory)
+{
+    VkDevice logicalDevice = device.logicalDevice;
+    deletionQueue.Push(frameNumber, [logicalDevice, memory]()
+    {
+        vkFreeMemory(logicalDevice, memory, nullptr);
+    });
 }
 void VContext::InitOptix()
 {
@@ -729,7 +916,7 @@ void VContext::AllocateBuffers()
         CUDA_CHECK(cudaFree((void*)m_dMinRGB));
     }
 
-    vk::DeviceSize bufferSize = WIDTH * HEIGHT * 3 * sizeof(float);
+    vk::DeviceSize bufferSize = renderExtent.width * renderExtent.height * 3 * sizeof(float);
 
     // Using direct method
     vk::BufferUsageFlags usage{ vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst };
@@ -741,14 +928,14 @@ void VContext::AllocateBuffers()
     exportToCudaPointer(m_pixelBufferOut);
 
     // Computing the amount of memory needed to do the denoiser
-    OPTIX_CHECK(optixDenoiserComputeMemoryResources(m_denoiser, WIDTH, HEIGHT, &m_dSizes));
+    OPTIX_CHECK(optixDenoiserComputeMemoryResources(m_denoiser, renderExtent.width, renderExtent.height, &m_dSizes));
 
     CUDA_CHECK(cudaMalloc((void**)&m_dState, m_dSizes.stateSizeInBytes));
     CUDA_CHECK(cudaMalloc((void**)&m_dScratch, m_dSizes.recommendedScratchSizeInBytes));
     CUDA_CHECK(cudaMalloc((void**)&m_dIntensity, sizeof(float)));
     CUDA_CHECK(cudaMalloc((void**)&m_dMinRGB, 4 * sizeof(float)));
 
-    OPTIX_CHECK(optixDenoiserSetup(m_denoiser, cudaStream, WIDTH, HEIGHT, m_dState,
+    OPTIX_CHECK(optixDenoiserSetup(m_denoiser, cudaStream, renderExtent.width, renderExtent.height, m_dState,
         m_dSizes.stateSizeInBytes, m_dScratch, m_dSizes.recommendedScratchSizeInBytes));*/
     
 }
@@ -757,7 +944,7 @@ void VContext::ConvertVulkan2Optix(VkImage& vkIMG, vk::Buffer& pixelBuffer)
     /*nvvkpp::SingleCommandBuffer sc(dev, 0);
     vk::CommandBuffer cmdBuffer = sc.createCommandBuffer();
 
-    vk::DeviceSize bufferSize = WIDTH * HEIGHT * 3 * sizeof(float);
+    vk::DeviceSize bufferSize = renderExtent.width * renderExtent.height * 3 * sizeof(float);
 
     vk::ImageSubresourceRange subresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
     //nvvkpp::image::setImageLayout(cmdBuffer, img, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal, subresourceRange);
@@ -772,7 +959,7 @@ void VContext::ConvertVulkan2Optix(VkImage& vkIMG, vk::Buffer& pixelBuffer)
 
     vk::BufferImageCopy copyRegion;
     copyRegion.setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 });
-    copyRegion.setImageExtent(vk::Extent3D(WIDTH, HEIGHT, 1));
+    copyRegion.setImageExtent(vk::Extent3D(renderExtent.width, renderExtent.height, 1));
     
     cmdBuffer.copyImageToBuffer(vkIMG, vk::ImageLayout::eTransferSrcOptimal, pixelBuffer, { copyRegion });
     //nvvkpp::image::setImageLayout(cmdBuffer, img, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral, subresourceRange);
@@ -833,7 +1020,7 @@ void VContext::ConvertVulkan2Optix(VkImage& vkIMG, vk::Buffer& pixelBuffer)
 
     cudaExternalMemoryGetMappedBuffer(&cudaBuffer.cudaPtr, cudaExtMemVertexBuffer, &cudaExtBufferDesc);
 
-    OptixImage2D inputImage{ (CUdeviceptr)cudaBuffer.cudaPtr, WIDTH, HEIGHT, 0, 0, OPTIX_PIXEL_FORMAT_FLOAT4 };*/
+    OptixImage2D inputImage{ (CUdeviceptr)cudaBuffer.cudaPtr, renderExtent.width, renderExtent.height, 0, 0, OPTIX_PIXEL_FORMAT_FLOAT4 };*/
     
 
 }
@@ -843,7 +1030,7 @@ void VContext::ConvertOptix2Vulkan(VkImage& vkIMG, vk::Buffer& pixelBuffer)
     nvvkpp::SingleCommandBuffer sc(dev, 0);
     vk::CommandBuffer cmdBuffer = sc.createCommandBuffer();
 
-    vk::DeviceSize bufferSize = WIDTH * HEIGHT * 4 * sizeof(float);
+    vk::DeviceSize bufferSize = renderExtent.width * renderExtent.height * 4 * sizeof(float);
     //vk::Image img = vkIMG;
 
     vk::ImageSubresourceRange subresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
@@ -860,7 +1047,7 @@ void VContext::ConvertOptix2Vulkan(VkImage& vkIMG, vk::Buffer& pixelBuffer)
     vk::BufferImageCopy copyRegion;
     copyRegion.setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 });
     copyRegion.setImageOffset({ 0, 0, 0 });
-    copyRegion.setImageExtent(vk::Extent3D(WIDTH, HEIGHT, 1));
+    copyRegion.setImageExtent(vk::Extent3D(renderExtent.width, renderExtent.height, 1));
 
     cmdBuffer.copyBufferToImage(pixelBuffer, vkIMG, vk::ImageLayout::eTransferSrcOptimal,{ copyRegion });
     //nvvkpp::image::setImageLayout(cmdBuffer, img, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral, subresourceRange);
@@ -887,8 +1074,8 @@ void VContext::DenoiseImage()
     auto             sizeofPixel = static_cast<uint32_t>(sizeof(float3));
 
 
-    OptixImage2D inputLayer{ (CUdeviceptr)m_pixelBufferIn.cudaPtr, WIDTH, HEIGHT, 0, 0, pixelFormat };
-    OptixImage2D outputLayer = { (CUdeviceptr)m_pixelBufferOut.cudaPtr, WIDTH, HEIGHT, 0, 0, pixelFormat };
+    OptixImage2D inputLayer{ (CUdeviceptr)m_pixelBufferIn.cudaPtr, renderExtent.width, renderExtent.height, 0, 0, pixelFormat };
+    OptixImage2D outputLayer = { (CUdeviceptr)m_pixelBufferOut.cudaPtr, renderExtent.width, renderExtent.height, 0, 0, pixelFormat };
 
     OPTIX_CHECK(optixDenoiserComputeIntensity(m_denoiser, cudaStream, &inputLayer, m_dIntensity, m_dScratch,
         m_dSizes.recommendedScratchSizeInBytes));
@@ -963,7 +1150,7 @@ void VContext::CreateImageBuffer(vk::Buffer& buf, vk::MemoryAllocateInfo& bufAll
     // Copy the image to the buffer
     vk::BufferCreateInfo createInfo;
 
-    createInfo.size = WIDTH * HEIGHT * sizeof(float);
+    createInfo.size = renderExtent.width * renderExtent.height * sizeof(float);
     createInfo.usage = usage;
     buf = dev.createBuffer(createInfo);
     bufReqs = dev.getBufferMemoryRequirements(buf);
@@ -1260,8 +1447,9 @@ void VContext::CreateCommandPool()
 
 void VContext::CreateCommandBuffers()
 {
-    // Create one command buffer for each swap chain image and reuse for rendering
-    commandBuffers.resize(swapChain.imageCount);
+    // Create one command buffer for each frame in flight, it is re-recorded every time the frame slot is reused
+    frames.resize(framesInFlight);
+    std::vector<VkCommandBuffer> commandBuffers(framesInFlight);
 
     VkCommandBufferAllocateInfo cmdBufAllocateInfo =
         Initializers::commandBufferAllocateInfo(
@@ -1270,6 +1458,28 @@ void VContext::CreateCommandBuffers()
             static_cast<uint32_t>(commandBuffers.size()));
 
     CHECK_ERROR(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, commandBuffers.data()));
+
+    for (uint32_t i = 0; i < framesInFlight; ++i)
+        frames[i].commandBuffer = commandBuffers[i];
+
+    CHECK_ERROR(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, commandBuffers.data()));
+    for (uint32_t i = 0; i < framesInFlight; ++i)
+        frames[i].denoiseCommandBuffer = commandBuffers[i];
+
+    if (!useAsyncCompute)
+        return;
+
+    //TLAS builds submitted to the async compute queue need command buffers from a pool of that family
+    VkCommandPoolCreateInfo cmdPoolInfo = {};
+    cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmdPoolInfo.queueFamilyIndex = FindQueueFamilies(device.physicalDevice).computeFamily.value();
+    cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    CHECK_ERROR(vkCreateCommandPool(device.logicalDevice, &cmdPoolInfo, nullptr, &computeCommandPool));
+
+    cmdBufAllocateInfo.commandPool = computeCommandPool;
+    CHECK_ERROR(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, commandBuffers.data()));
+    for (uint32_t i = 0; i < framesInFlight; ++i)
+        frames[i].computeCommandBuffer = commandBuffers[i];
 }
 
 void VContext::CreateBottomLevelAccelerationStructure(const VkGeometryNV* geometries)
@@ -1351,22 +1561,22 @@ void VContext::CreateStorageImage()
     VkImageCreateInfo accImageInfo = Initializers::imageCreateInfo();
     accImageInfo.imageType = VK_IMAGE_TYPE_2D;
     accImageInfo.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-    accImageInfo.extent.width = WIDTH;
-    accImageInfo.extent.height = HEIGHT;
+    accImageInfo.extent.width = renderExtent.width;
+    accImageInfo.extent.height = renderExtent.height;
     accImageInfo.extent.depth = 1;
     accImageInfo.mipLevels = 1;
     accImageInfo.arrayLayers = 1;
     accImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     accImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    accImageInfo.usage =  VK_IMAGE_USAGE_STORAGE_BIT;
+    accImageInfo.usage =  VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     accImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     vkCreateImage(device.logicalDevice, &accImageInfo, nullptr, &accImage.image);
 
     VkImageCreateInfo image = Initializers::imageCreateInfo();
     image.imageType = VK_IMAGE_TYPE_2D;
     image.format = swapChain.colorFormat;
-    image.extent.width = WIDTH;
-    image.extent.height = HEIGHT;
+    image.extent.width = renderExtent.width;
+    image.extent.height = renderExtent.height;
     image.extent.depth = 1;
     image.mipLevels = 1;
     image.arrayLayers = 1;
@@ -1407,20 +1617,153 @@ void VContext::CreateStorageImage()
 
     VkImageViewCreateInfo colorImageViewAcc = Initializers::imageViewCreateInfo();
     colorImageViewAcc.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    colorImageViewAcc.format = swapChain.colorFormat;
+    colorImageViewAcc.format = accImageInfo.format;
     colorImageViewAcc.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     colorImageViewAcc.subresourceRange.baseMipLevel = 0;
     colorImageViewAcc.subresourceRange.levelCount = 1;
     colorImageViewAcc.subresourceRange.baseArrayLayer = 0;
     colorImageViewAcc.subresourceRange.layerCount = 1;
     colorImageViewAcc.image = accImage.image;
-    vkCreateImageView(device.logicalDevice, &colorImageView, nullptr, &accImage.view);
+    vkCreateImageView(device.logicalDevice, &colorImageViewAcc, nullptr, &accImage.view);
+
+    //ADAPTIVE SAMPLING: mean squared luminance per pixel, sample count per tile
+    CreateTargetImage(momentsImage, VK_FORMAT_R32_SFLOAT, renderExtent.width, renderExtent.height,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    CreateTargetImage(sampleMapImage, VK_FORMAT_R32_UINT,
+        (renderExtent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE, (renderExtent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE);
+
+    //VISIBILITY BUFFER: instance and triangle (x), barycentrics (y) of the primary hit of every pixel
+    CreateTargetImage(visibilityImage, VK_FORMAT_R32G32_UINT, renderExtent.width, renderExtent.height);
+
+    //CPU DENOISER: guides read back with the accumulation, filtered radiance uploaded for the tonemap pass
+    CreateTargetImage(guideImage, VK_FORMAT_R32G32B32A32_UINT, renderExtent.width, renderExtent.height,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    CreateTargetImage(denoisedImage, VK_FORMAT_R32G32B32A32_SFLOAT, renderExtent.width, renderExtent.height, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+    //TEMPORAL REPROJECTION: motion of every pixel, history of this frame and of the previous one, zeroed so nothing is
+    //reprojected before it is written
+    CreateTargetImage(motionImage, VK_FORMAT_R32G32_SFLOAT, renderExtent.width, renderExtent.height);
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &temporalBuffer,
+        2ull * renderExtent.width * renderExtent.height * sizeof(TemporalSample)));
+
+    //RESTIR: current and previous reservoir of every pixel, zeroed so nothing is reused before it is written
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &reservoirBuffer,
+        2ull * renderExtent.width * renderExtent.height * sizeof(RestirReservoir)));
 
     const VkCommandBuffer cmd_buffer = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    vkCmdFillBuffer(cmd_buffer, reservoirBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(cmd_buffer, temporalBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
     setImageLayout(cmd_buffer, storageImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-    //setImageLayout(cmd_buffer, accImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    setImageLayout(cmd_buffer, accImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    setImageLayout(cmd_buffer, momentsImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    setImageLayout(cmd_buffer, sampleMapImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    setImageLayout(cmd_buffer, visibilityImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    setImageLayout(cmd_buffer, guideImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    setImageLayout(cmd_buffer, denoisedImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    setImageLayout(cmd_buffer, motionImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    //The accumulation and the moments are read back by the raygen before they are written (data.y > 0), a new target
+    //starts from zero samples instead of whatever its memory held
+    const VkClearColorValue clearValue{};
+    const VkImageSubresourceRange clearRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdClearColorImage(cmd_buffer, accImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+    vkCmdClearColorImage(cmd_buffer, momentsImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+
+    VkMemoryBarrier clearBarrier = Initializers::memoryBarrier();
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
     flushCommandBuffer(cmd_buffer, graphicsQueue);
 }
+
+void VContext::CreateTargetImage(StorageImage& target, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usage)
+{
+    //Device local image accessed as a storage image (and by clears and the copies of the CPU denoiser), the caller
+    //transitions it to the general layout
+    VkImageCreateInfo imageInfo = Initializers::imageCreateInfo();
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = { width, height, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    CHECK_ERROR(vkCreateImage(device.logicalDevice, &imageInfo, nullptr, &target.image));
+    target.format = format;
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(device.logicalDevice, target.image, &memoryRequirements);
+    VkMemoryAllocateInfo memoryAllocateInfo = Initializers::memoryAllocateInfo();
+    memoryAllocateInfo.allocationSize = memoryRequirements.size;
+    memoryAllocateInfo.memoryTypeIndex = getMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    CHECK_ERROR(vkAllocateMemory(device.logicalDevice, &memoryAllocateInfo, nullptr, &target.memory));
+    CHECK_ERROR(vkBindImageMemory(device.logicalDevice, target.image, target.memory, 0));
+
+    VkImageViewCreateInfo viewInfo = Initializers::imageViewCreateInfo();
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    viewInfo.image = target.image;
+    CHECK_ERROR(vkCreateImageView(device.logicalDevice, &viewInfo, nullptr, &target.view));
+}
+void VContext::createWavefrontBuffers()
+{
+    //One path per pixel, each queue can hold every path
+    const VkDeviceSize pathCount = static_cast<VkDeviceSize>(renderExtent.width) * renderExtent.height;
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    CHECK_ERROR(createBuffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &wavefrontBuffers.counters, sizeof(WavefrontCounters)));
+    CHECK_ERROR(createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &wavefrontBuffers.paths, pathCount * sizeof(WavefrontPath)));
+    CHECK_ERROR(createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &wavefrontBuffers.hits, pathCount * sizeof(WavefrontHit)));
+    CHECK_ERROR(createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &wavefrontBuffers.rayQueues, 2 * pathCount * sizeof(uint32_t)));
+    CHECK_ERROR(createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &wavefrontBuffers.sortedQueue, pathCount * sizeof(uint32_t)));
+    CHECK_ERROR(createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &wavefrontBuffers.shadowRays, pathCount * sizeof(WavefrontShadowRay)));
+    CHECK_ERROR(createBuffer(usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &wavefrontBuffers.dispatchArgs, sizeof(WavefrontDispatch)));
+}
+
+void VContext::destroyWavefrontBuffers()
+{
+    // Still used by the frames in flight
+    DestroyDeferred(wavefrontBuffers.counters);
+    DestroyDeferred(wavefrontBuffers.paths);
+    DestroyDeferred(wavefrontBuffers.hits);
+    DestroyDeferred(wavefrontBuffers.rayQueues);
+    DestroyDeferred(wavefrontBuffers.sortedQueue);
+    DestroyDeferred(wavefrontBuffers.shadowRays);
+    DestroyDeferred(wavefrontBuffers.dispatchArgs);
+    wavefrontBuffers = WavefrontBuffers{};
+}
+
+void VContext::createDenoiserBuffers()
+{
+    //Read by the CPU pixel by pixel, cached memory when the device has it
+    const VkDeviceSize pixelCount = static_cast<VkDeviceSize>(renderExtent.width) * renderExtent.height;
+    VkBool32 cachedFound = VK_FALSE;
+    getMemoryType(~0u, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &cachedFound);
+    const VkMemoryPropertyFlags readbackFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | (cachedFound ? VK_MEMORY_PROPERTY_HOST_CACHED_BIT : 0);
+
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, readbackFlags, &denoiseReadback,
+        pixelCount * (sizeof(glm::vec4) + sizeof(float) + sizeof(glm::uvec4))));
+    CHECK_ERROR(denoiseReadback.map());
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &denoiseUpload,
+        pixelCount * sizeof(glm::vec4)));
+    CHECK_ERROR(denoiseUpload.map());
+}
+
+void VContext::destroyDenoiserBuffers()
+{
+    // Still used by the frames in flight
+    DestroyDeferred(denoiseReadback);
+    DestroyDeferred(denoiseUpload);
+    denoiseReadback = VBuffer::Buffer{};
+    denoiseUpload = VBuffer::Buffer{};
+}
+
 //VALID
 VkResult VContext::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory, void* data) const
 {
@@ -1487,58 +1830,174 @@ VkBool32 VContext::getSupportedDepthFormat(VkPhysicalDevice physicalDevice, VkFo
 
     return false;
 }
-void VContext::createScene(std::vector<VObject>& objects)
+void VContext::createSceneGeometry(const std::vector<VObject>& objects)
 {
-    int j = 0;
-    VkCommandBuffer cmdBuffer = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-    for(auto obj : objects)
+    //Every object writes its vertices and indices at its own offset, so the flattening runs in parallel
+    //A procedural primitive is one primitive without vertices: it keeps a material id, and 3 unused indices so the
+    //triangles of the next objects stay at (first primitive * 3)
+    sceneTable.Clear();
+    for(auto& obj : objects)
     {
-
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
-
-        for(auto vertex : obj.m_mesh.GetVertices())
+        if(obj.m_primitive != PrimitiveType::Mesh)
+            sceneTable.Add(1, 0);
+        else
+            sceneTable.Add(static_cast<uint32_t>(obj.m_mesh.GetIndices().size() / 3), static_cast<uint32_t>(obj.m_mesh.GetVertices().size()));
+    }
+    bufferVertices.resize(static_cast<size_t>(sceneTable.GetVertexCount()) * SCENE_VERTEX_FLOATS);
+    sceneIndices.assign(static_cast<size_t>(sceneTable.GetPrimitiveCount()) * 3, 0);
+    sceneMaterialIds.resize(sceneTable.GetPrimitiveCount());
+
+    //Shared material table, every object maps its mesh materials to table ids
+    materialTable.Clear();
+    std::vector<std::vector<uint32_t>> materialRemaps(objects.size());
+    for(size_t i = 0; i < objects.size(); ++i)
+    {
+        const VObject& obj = objects[i];
+        const auto& meshMaterials = obj.m_mesh.GetMaterials();
+        if(obj.m_overrideMaterial || meshMaterials.empty())
         {
-            vertices.push_back(vertex);
+            materialRemaps[i].assign(std::max<size_t>(1, meshMaterials.size()), materialTable.Add(obj.m_material));
+            continue;
         }
+        for(auto& material : meshMaterials)
+            materialRemaps[i].push_back(materialTable.Add(material));
+    }
 
-        for(auto index : obj.m_mesh.GetIndices())
+    jobSystem.ParallelFor(objects.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
         {
-            indices.push_back(index);
-            sceneIndices.push_back(index);
+            const VObject& obj = objects[i];
+            const uint32_t instance = static_cast<uint32_t>(i);
+            float* dst = bufferVertices.data() + static_cast<size_t>(sceneTable.GetFirstVertex(instance)) * SCENE_VERTEX_FLOATS;
+            for(auto& vertex : obj.m_mesh.GetVertices())
+            {
+                *dst++ = vertex.pos.x;
+                *dst++ = vertex.pos.y;
+                *dst++ = vertex.pos.z;
+                *dst++ = static_cast<float>(instance);
+                *dst++ = vertex.normal.x;
+                *dst++ = vertex.normal.y;
+                *dst++ = vertex.normal.z;
+                *dst++ = 0;
+            }
+
+            //Indices stay local to the object, the base vertex is applied by the BLAS vertex offset and by the hit shader
+            const auto& indices = obj.m_mesh.GetIndices();
+            std::copy(indices.begin(), indices.end(), sceneIndices.begin() + static_cast<size_t>(sceneTable.GetFirstPrimitive(instance)) * 3);
+
+            //Material id of every triangle, meshes without materials use the first (and only) entry of their remap
+            const auto& materialIds = obj.m_mesh.GetMaterialIds();
+            const auto& remap = materialRemaps[i];
+            uint32_t* ids = sceneMaterialIds.data() + sceneTable.GetFirstPrimitive(instance);
+            for(uint32_t t = 0; t < sceneTable.GetPrimitiveCount(instance); ++t)
+                ids[t] = t < materialIds.size() && materialIds[t] < remap.size() ? remap[materialIds[t]] : remap[0];
         }
+    });
 
-        indexCount = static_cast<uint32_t>(indices.size());
+    //One vertex and one index buffer for the whole scene, read by the BLAS builds and by the hit shader
+    CHECK_ERROR(createBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &vertexBuffer,
+        bufferVertices.size() * sizeof(float),
+        bufferVertices.data()));
 
-        //Vertex buffer
-        createBuffer(
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            &vertexBuffer,
-            vertices.size() * sizeof(Vertex),
-            vertices.data());
+    CHECK_ERROR(createBuffer(
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &indexBuffer,
+        sceneIndices.size() * sizeof(uint32_t),
+        sceneIndices.data()));
 
-        // Index buffer
-        createBuffer(
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    //First triangle and base vertex of every instance, indexed by gl_InstanceID in the hit shader
+    const std::vector<uint32_t> instanceOffsets = sceneTable.GetInstanceOffsets();
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &instanceOffsetBuffer,
+        instanceOffsets.size() * sizeof(uint32_t),
+        instanceOffsets.data()));
+
+    std::vector<VMaterial> materials = materialTable.GetMaterials();
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &matBuffer,
+        materials.size() * sizeof(VMaterial),
+        materials.data()));
+
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &materialIdBuffer,
+        sceneMaterialIds.size() * sizeof(uint32_t),
+        sceneMaterialIds.data()));
+
+    //Primitive type of every instance for the hit shaders, unit bounds of every procedural primitive for its BLAS
+    std::vector<uint32_t> primitiveTypes;
+    primitiveTypes.reserve(objects.size());
+    sceneAabbs.clear();
+    for(auto& obj : objects)
+    {
+        primitiveTypes.push_back(static_cast<uint32_t>(obj.m_primitive));
+        if(obj.m_primitive == PrimitiveType::Mesh)
+            continue;
+        glm::vec3 boundsMin, boundsMax;
+        VPrimitive::GetObjectBounds(obj.m_primitive, boundsMin, boundsMax);
+        sceneAabbs.insert(sceneAabbs.end(), { boundsMin.x, boundsMin.y, boundsMin.z, boundsMax.x, boundsMax.y, boundsMax.z });
+    }
+
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &primitiveTypeBuffer,
+        primitiveTypes.size() * sizeof(uint32_t),
+        primitiveTypes.data()));
+
+    if(!sceneAabbs.empty())
+    {
+        CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            &indexBuffer,
-            indices.size() * sizeof(uint32_t),
-            indices.data());
+            &aabbBuffer,
+            sceneAabbs.size() * sizeof(float),
+            sceneAabbs.data()));
+    }
+
+    std::cout << "SCENE GEOMETRY: " << sceneTable.GetVertexCount() << " VERTICES, " << sceneTable.GetPrimitiveCount() << " TRIANGLES, "
+              << sceneAabbs.size() / 6 << " PROCEDURAL PRIMITIVES, " << materialTable.GetMaterialCount() << " MATERIALS\n";
+
+    //The visibility buffer packs instance and triangle in 32 bits, all ones is kept for the misses
+    visibilityBufferSupported = sceneTable.GetInstanceCount() < (1u << (32 - VISIBILITY_PRIMITIVE_BITS));
+    for (uint32_t instance = 0; instance < sceneTable.GetInstanceCount(); ++instance)
+        visibilityBufferSupported &= sceneTable.GetPrimitiveCount(instance) <= (1u << VISIBILITY_PRIMITIVE_BITS);
+    if (!visibilityBufferSupported)
+        visibilityBuffer = false;
+}
+
+void VContext::createScene(std::vector<VObject>& objects)
+{
+    createSceneGeometry(objects);
+
+    //Build scratch buffers are transient: every build is followed by a barrier, so a scratch buffer is only
+    //alive during its own build step. They are packed in a VTransientPool and alias the same memory.
+    VTransientPool scratchPool;
+    std::vector<VBuffer::Buffer> scratchBuffers;
+    std::vector<VkGeometryNV> geometries;
+    geometries.reserve(objects.size());
+    uint32_t aabbCount = 0;
 
-        //Generate Geometry data
+    for(uint32_t j = 0; j < static_cast<uint32_t>(objects.size()); ++j)
+    {
+        //Generate Geometry data, the object is a range of the scene buffers
         VkGeometryNV geometry{};
         geometry.sType = VK_STRUCTURE_TYPE_GEOMETRY_NV;
         geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_NV;
         geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_GEOMETRY_TRIANGLES_NV;
         geometry.geometry.triangles.vertexData = vertexBuffer.buffer;
-        geometry.geometry.triangles.vertexOffset = 0;
-        geometry.geometry.triangles.vertexCount = static_cast<uint32_t>(vertices.size());
-        geometry.geometry.triangles.vertexStride = sizeof(Vertex);
+        geometry.geometry.triangles.vertexOffset = static_cast<VkDeviceSize>(sceneTable.GetFirstVertex(j)) * SCENE_VERTEX_FLOATS * sizeof(float);
+        geometry.geometry.triangles.vertexCount = sceneTable.GetVertexCount(j);
+        geometry.geometry.triangles.vertexStride = SCENE_VERTEX_FLOATS * sizeof(float);
         geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
         geometry.geometry.triangles.indexData = indexBuffer.buffer;
-        geometry.geometry.triangles.indexOffset = 0;
-        geometry.geometry.triangles.indexCount = indexCount;
+        geometry.geometry.triangles.indexOffset = static_cast<VkDeviceSize>(sceneTable.GetFirstPrimitive(j)) * 3 * sizeof(uint32_t);
+        geometry.geometry.triangles.indexCount = sceneTable.GetPrimitiveCount(j) * 3;
         geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
         geometry.geometry.triangles.transformData = nullptr;
         geometry.geometry.triangles.transformOffset = 0;
@@ -1546,8 +2005,22 @@ void VContext::createScene(std::vector<VObject>& objects)
         geometry.geometry.aabbs.sType = { VK_STRUCTURE_TYPE_GEOMETRY_AABB_NV };
         geometry.flags = VK_GEOMETRY_OPAQUE_BIT_NV;
 
+        //A procedural primitive is a single AABB, its instance selects the hit group with the intersection shader
+        if(objects[j].m_primitive != PrimitiveType::Mesh)
+        {
+            geometry.geometryType = VK_GEOMETRY_TYPE_AABBS_NV;
+            geometry.geometry.triangles = {};
+            geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_GEOMETRY_TRIANGLES_NV;
+            geometry.geometry.aabbs.aabbData = aabbBuffer.buffer;
+            geometry.geometry.aabbs.numAABBs = 1;
+            geometry.geometry.aabbs.stride = 6 * sizeof(float);
+            geometry.geometry.aabbs.offset = static_cast<VkDeviceSize>(aabbCount++) * 6 * sizeof(float);
+            objects[j].m_mesh.SetOffset(PROCEDURAL_HIT_OFFSET);
+        }
+        geometries.push_back(geometry);
+
         //Create Bottom Level AS for specific geometry
-        CreateBottomLevelAccelerationStructure(&geometry);
+        CreateBottomLevelAccelerationStructure(&geometries.back());
 
         //Get memory requirements for BLAS
          VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{};
@@ -1558,20 +2031,40 @@ void VContext::createScene(std::vector<VObject>& objects)
         vkGetAccelerationStructureMemoryRequirementsNV(device.logicalDevice, &memoryRequirementsInfo, &memReqBottomLevelAS);
         const VkDeviceSize scratchBufferSize = memReqBottomLevelAS.memoryRequirements.size;
 
-        //Create scratch buffer, because BLAS needs temp memory to be built
-        VBuffer::Buffer scratchBuffer;
-        createBuffer(
-        VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        &scratchBuffer,
-        scratchBufferSize);
+        //Declare the scratch buffer, because BLAS needs temp memory to be built, it is only alive during build step j
+        scratchBuffers.emplace_back();
+        addTransientBuffer(scratchPool, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, scratchBufferSize, j, j, &scratchBuffers.back());
+
+        //set correct object acceleration structure to the one we just built
+        objects[j].m_mesh.meshGeometry.accelerationStructureHandle = bottomLevelAS[j].handle;
+        objects[j].m_mesh.meshGeometry.instanceId = j;
+    }
+
+    //The TLAS is built per frame at the start of the frame command buffer
+    sceneInstances.clear();
+    for(auto& obj: objects)
+        sceneInstances.push_back(obj.m_mesh.meshGeometry);
+
+    //Pack every scratch buffer in one allocation
+    const VkDeviceMemory scratchMemory = bindTransientBuffers(scratchPool, scratchBuffers, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    std::cout << "BUILD SCRATCH MEMORY: " << scratchPool.GetSize() / 1024 << " KB (without aliasing: "
+              << scratchPool.GetUnaliasedSize() / 1024 << " KB)\n";
+
+    VkCommandBuffer cmdBuffer = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+    //Create memory barrier to prevent issues (it creates a command dependency)
+    VkMemoryBarrier memoryBarrier = Initializers::memoryBarrier();
+    memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+    memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
 
+    for (size_t i = 0; i < geometries.size(); ++i)
+    {
         //Set build info
         VkAccelerationStructureInfoNV buildInfo{};
         buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
         buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
         buildInfo.geometryCount = 1;
-        buildInfo.pGeometries = &geometry;
+        buildInfo.pGeometries = &geometries[i];
         //Build BLAS for specific object
         vkCmdBuildAccelerationStructureNV(
             cmdBuffer,
@@ -1579,88 +2072,76 @@ void VContext::createScene(std::vector<VObject>& objects)
             nullptr,
             0,
             VK_FALSE,
-            bottomLevelAS[j].accelerationStructure,
+            bottomLevelAS[i].accelerationStructure,
             nullptr,
-            scratchBuffer.buffer,
+            scratchBuffers[i].buffer,
             0);
 
-        //Create memory barrier to prevent issues (it creates a command dependency)
-        VkMemoryBarrier memoryBarrier = Initializers::memoryBarrier();
-        memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
-        memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+        //The barrier also ends the lifetime of this scratch buffer, the next build can reuse its memory
         vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
-
-        //set correct object acceleration structure to the one we just built
-        objects[j].m_mesh.meshGeometry.accelerationStructureHandle = bottomLevelAS[j].handle;
-        objects[j].m_mesh.meshGeometry.instanceId = j;
-
-        j++;
     }
-    j = 0;
 
-    //Generate TLAS
-    std::vector<GeometryInstance> instances;
-    for(auto& obj: objects)
-        instances.push_back(obj.m_mesh.meshGeometry);
-
-    //Get all instances and create a buffer with all of them
-    VBuffer::Buffer instanceBuffer;
-    createBuffer(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &instanceBuffer,
-        sizeof(GeometryInstance) * instances.size(),
-        instances.data());
+    flushCommandBuffer(cmdBuffer, graphicsQueue);
 
-    //Generate TLAS
-    CreateTopLevelAccelerationStructure(topLevelAS, instances.size());
+    for (auto& scratchBuffer : scratchBuffers)
+        DestroyDeferred(scratchBuffer);
+    DestroyDeferred(scratchMemory);
+}
+/**
+* Create a buffer handle whose memory will be aliased with the other resources of a transient pool
+*
+* @param pool Pool the buffer is declared in, buffers must be declared in the same order they are later bound
+* @param usageFlags Usage flag bitmask for the buffer
+* @param size Size of the buffer in bytes
+* @param firstUse First step of the pool using the buffer
+* @param lastUse Last step of the pool using the buffer
+* @param buffer Pointer to the buffer object, no memory is allocated for it
+*
+* @return Id of the buffer in the pool
+*/
+uint32_t VContext::addTransientBuffer(VTransientPool& pool, VkBufferUsageFlags usageFlags, VkDeviceSize size, uint32_t firstUse, uint32_t lastUse, VBuffer::Buffer* buffer) const
+{
+    buffer->device = device.logicalDevice;
 
-    //Get memory requirements
-    VkMemoryRequirements2 memReqTopLevelAS;
-    VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo2{};
-    memoryRequirementsInfo2.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
-    memoryRequirementsInfo2.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
-    memoryRequirementsInfo2.accelerationStructure = topLevelAS.accelerationStructure;
-    vkGetAccelerationStructureMemoryRequirementsNV(device.logicalDevice, &memoryRequirementsInfo2, &memReqTopLevelAS);
+    VkBufferCreateInfo bufferCreateInfo = Initializers::bufferCreateInfo(usageFlags, size);
+    CHECK_ERROR(vkCreateBuffer(device.logicalDevice, &bufferCreateInfo, nullptr, &buffer->buffer));
 
-    const VkDeviceSize scratchBufferSize = memReqTopLevelAS.memoryRequirements.size;
+    VkMemoryRequirements memory_requierements;
+    vkGetBufferMemoryRequirements(device.logicalDevice, buffer->buffer, &memory_requierements);
 
-    //Generate Scratch buffer
-    VBuffer::Buffer scratchBuffer;
-    createBuffer(
-        VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        &scratchBuffer,
-        scratchBufferSize);
+    buffer->alignment = memory_requierements.alignment;
+    buffer->size = memory_requierements.size;
+    buffer->usageFlags = usageFlags;
+    buffer->setupDescriptor();
 
-    //Generate build info for TLAS
-    VkAccelerationStructureInfoNV buildInfo{};
-    buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
-    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
-    buildInfo.flags = /*VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_NV | */VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_NV;
-    buildInfo.pGeometries = nullptr;
-    buildInfo.geometryCount = 0;
-    buildInfo.instanceCount = instances.size();
+    return pool.Add(memory_requierements.size, memory_requierements.alignment, firstUse, lastUse, memory_requierements.memoryTypeBits);
+}
+/**
+* Allocate the memory of a transient pool and bind every buffer at its aliased offset
+*
+* @note The buffers do not own the memory (their memory member stays null), the returned allocation must be released
+* once every buffer of the pool has been destroyed
+*
+* @return Memory backing the whole pool
+*/
+VkDeviceMemory VContext::bindTransientBuffers(VTransientPool& pool, std::vector<VBuffer::Buffer>& buffers, VkMemoryPropertyFlags memoryPropertyFlags) const
+{
+    assert(buffers.size() == pool.GetResourceCount());
 
-    //Build Actual TLAS
-    vkCmdBuildAccelerationStructureNV(
-        cmdBuffer,
-        &buildInfo,
-        instanceBuffer.buffer,
-        0,
-        VK_FALSE,
-        topLevelAS.accelerationStructure,
-        nullptr,
-        scratchBuffer.buffer,
-        0);
+    VkMemoryAllocateInfo memAlloc = Initializers::memoryAllocateInfo();
+    memAlloc.allocationSize = pool.Place();
+    memAlloc.memoryTypeIndex = getMemoryType(pool.GetMemoryTypeBits(), memoryPropertyFlags);
 
-    VkMemoryBarrier memoryBarrier = Initializers::memoryBarrier();
-    memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
-    memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
-    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    VkDeviceMemory memory;
+    CHECK_ERROR(vkAllocateMemory(device.logicalDevice, &memAlloc, nullptr, &memory));
 
-    flushCommandBuffer(cmdBuffer, graphicsQueue);
+    for (uint32_t i = 0; i < buffers.size(); ++i)
+    {
+        buffers[i].memoryPropertyFlags = memoryPropertyFlags;
+        CHECK_ERROR(vkBindBufferMemory(device.logicalDevice, buffers[i].buffer, memory, pool.GetOffset(i)));
+    }
 
-    scratchBuffer.destroy();
-    instanceBuffer.destroy();
+    return memory;
 }
 
 
@@ -1670,6 +2151,7 @@ void VContext::createRayTracingPipeline()
 {
     //Binding Uniforms to specific shader,
     //here we set the bindings for the RAYGEN shader (VK_SHADER_STAGE_RAYGEN_BIT_NV)
+    //The wavefront kernels share this set, the bindings they read are also visible to compute shaders
 
     VkDescriptorSetLayoutBinding accelerationStructureLayoutBinding{};
     accelerationStructureLayoutBinding.binding = 0;
@@ -1687,19 +2169,19 @@ void VContext::createRayTracingPipeline()
     uniformBufferBinding.binding = 2;
     uniformBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     uniformBufferBinding.descriptorCount = 1;
-    uniformBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV |  VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
+    uniformBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV |  VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
 
     VkDescriptorSetLayoutBinding matBufferBinding{};
     matBufferBinding.binding = 3;
     matBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     matBufferBinding.descriptorCount = 1;
-    matBufferBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
+    matBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
 
     VkDescriptorSetLayoutBinding vertexBufferBinding{};
 	vertexBufferBinding.binding = 4;
 	vertexBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	vertexBufferBinding.descriptorCount = 1;
-	vertexBufferBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
+	vertexBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
 
     VkDescriptorSetLayoutBinding timeBufferBinding{};
 	timeBufferBinding.binding = 5;
@@ -1711,13 +2193,109 @@ void VContext::createRayTracingPipeline()
 	TriNumberBinding.binding = 6;
 	TriNumberBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	TriNumberBinding.descriptorCount = 1;
-	TriNumberBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
+	TriNumberBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
 
     VkDescriptorSetLayoutBinding AccImageLayoutBinding{};
     AccImageLayoutBinding.binding = 7;
     AccImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
     AccImageLayoutBinding.descriptorCount = 1;
-    AccImageLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+    AccImageLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding indexBufferBinding{};
+	indexBufferBinding.binding = 8;
+	indexBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	indexBufferBinding.descriptorCount = 1;
+	indexBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
+
+    VkDescriptorSetLayoutBinding materialIdBinding{};
+	materialIdBinding.binding = 9;
+	materialIdBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialIdBinding.descriptorCount = 1;
+	materialIdBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
+
+    VkDescriptorSetLayoutBinding blueNoiseBinding{};
+	blueNoiseBinding.binding = 10;
+	blueNoiseBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	blueNoiseBinding.descriptorCount = 1;
+	blueNoiseBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding lightBufferBinding{};
+	lightBufferBinding.binding = 13;
+	lightBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lightBufferBinding.descriptorCount = 1;
+	lightBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding lightAliasBinding{};
+	lightAliasBinding.binding = 14;
+	lightAliasBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lightAliasBinding.descriptorCount = 1;
+	lightAliasBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding lightBvhBinding{};
+	lightBvhBinding.binding = 15;
+	lightBvhBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lightBvhBinding.descriptorCount = 1;
+	lightBvhBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding reservoirBinding{};
+	reservoirBinding.binding = 16;
+	reservoirBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	reservoirBinding.descriptorCount = 1;
+	reservoirBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding momentsImageBinding{};
+    momentsImageBinding.binding = 11;
+    momentsImageBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    momentsImageBinding.descriptorCount = 1;
+    momentsImageBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding sampleMapBinding{};
+    sampleMapBinding.binding = 12;
+    sampleMapBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    sampleMapBinding.descriptorCount = 1;
+    sampleMapBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding visibilityImageBinding{};
+    visibilityImageBinding.binding = 17;
+    visibilityImageBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    visibilityImageBinding.descriptorCount = 1;
+    visibilityImageBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding instanceBufferBinding{};
+	instanceBufferBinding.binding = 18;
+	instanceBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceBufferBinding.descriptorCount = 1;
+	instanceBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding guideImageBinding{};
+    guideImageBinding.binding = 19;
+    guideImageBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    guideImageBinding.descriptorCount = 1;
+    guideImageBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding motionImageBinding{};
+    motionImageBinding.binding = 20;
+    motionImageBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    motionImageBinding.descriptorCount = 1;
+    motionImageBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding previousTransformBinding{};
+    previousTransformBinding.binding = 21;
+    previousTransformBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    previousTransformBinding.descriptorCount = 1;
+    previousTransformBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding temporalBufferBinding{};
+    temporalBufferBinding.binding = 22;
+    temporalBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    temporalBufferBinding.descriptorCount = 1;
+    temporalBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
+    VkDescriptorSetLayoutBinding primitiveTypeBinding{};
+    primitiveTypeBinding.binding = 23;
+    primitiveTypeBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    primitiveTypeBinding.descriptorCount = 1;
+    primitiveTypeBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_INTERSECTION_BIT_NV;
 
     //create a Binding vector for Uniform bindings
     std::vector<VkDescriptorSetLayoutBinding> bindings({
@@ -1728,7 +2306,23 @@ void VContext::createRayTracingPipeline()
         vertexBufferBinding,
         timeBufferBinding,
         TriNumberBinding,
-        AccImageLayoutBinding
+        AccImageLayoutBinding,
+        indexBufferBinding,
+        materialIdBinding,
+        blueNoiseBinding,
+        momentsImageBinding,
+        sampleMapBinding,
+        lightBufferBinding,
+        lightAliasBinding,
+        lightBvhBinding,
+        reservoirBinding,
+        visibilityImageBinding,
+        instanceBufferBinding,
+        guideImageBinding,
+        motionImageBinding,
+        previousTransformBinding,
+        temporalBufferBinding,
+        primitiveTypeBinding
     });
 
     //Create the buffer that will map the shader uniforms to the actual shader
@@ -1749,11 +2343,15 @@ void VContext::createRayTracingPipeline()
     const uint32_t shaderIndexMiss = 1;
     const uint32_t shaderIndexShadowMiss = 2;
     const uint32_t shaderIndexClosestHit = 3;
-    std::array<VkPipelineShaderStageCreateInfo, 4> shaderStages{};
+    const uint32_t shaderIndexProceduralHit = 4;
+    const uint32_t shaderIndexIntersection = 5;
+    std::array<VkPipelineShaderStageCreateInfo, 6> shaderStages{};
     shaderStages[shader_index_ray] = loadShader("shaders/bin/ray_gen.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV);
     shaderStages[shaderIndexMiss] = loadShader("shaders/bin/ray_miss.spv", VK_SHADER_STAGE_MISS_BIT_NV);
     shaderStages[shaderIndexShadowMiss] = loadShader("shaders/bin/ray_smiss.spv", VK_SHADER_STAGE_MISS_BIT_NV);
     shaderStages[shaderIndexClosestHit] = loadShader("shaders/bin/ray_chit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    shaderStages[shaderIndexProceduralHit] = loadShader("shaders/bin/ray_pchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    shaderStages[shaderIndexIntersection] = loadShader("shaders/bin/ray_int.spv", VK_SHADER_STAGE_INTERSECTION_BIT_NV);
     /*
         Setup ray tracing shader groups
     */
@@ -1783,62 +2381,472 @@ void VContext::createRayTracingPipeline()
     groups[INDEX_CLOSEST_HIT].generalShader = VK_SHADER_UNUSED_NV;
     groups[INDEX_CLOSEST_HIT].closestHitShader = shaderIndexClosestHit;
 
-    groups[INDEX_SHADOWHIT].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_NV;
-	groups[INDEX_SHADOWHIT].generalShader = VK_SHADER_UNUSED_NV;
-		// Reuse shadow miss shader
-	groups[INDEX_SHADOWHIT].closestHitShader = shaderIndexShadowMiss;
+    //Procedural primitives: the intersection shader reports the hit, shadow rays skip the closest hit like for triangles
+    groups[INDEX_PROCEDURAL_HIT].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_NV;
+    groups[INDEX_PROCEDURAL_HIT].generalShader = VK_SHADER_UNUSED_NV;
+    groups[INDEX_PROCEDURAL_HIT].closestHitShader = shaderIndexProceduralHit;
+    groups[INDEX_PROCEDURAL_HIT].intersectionShader = shaderIndexIntersection;
 
-    VkRayTracingPipelineCreateInfoNV rayPipelineInfo{};
-    rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_NV;
-    rayPipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-    rayPipelineInfo.pStages = shaderStages.data();
-    rayPipelineInfo.groupCount = static_cast<uint32_t>(groups.size());
-    rayPipelineInfo.pGroups = groups.data();
-    rayPipelineInfo.maxRecursionDepth = 1;
-    rayPipelineInfo.layout = RpipelineLayout;
-    vkCreateRayTracingPipelinesNV(device.logicalDevice, nullptr, 1, &rayPipelineInfo, nullptr, &Rpipeline);
+    //One pipeline per quality preset, they only differ by the specialization constants of the raygen shader
+    std::array<VkSpecializationMapEntry, QUALITY_CONSTANT_COUNT> specializationEntries{};
+    for (uint32_t i = 0; i < QUALITY_CONSTANT_COUNT; ++i)
+    {
+        specializationEntries[i].constantID = i;
+        specializationEntries[i].offset = i * sizeof(uint32_t);
+        specializationEntries[i].size = sizeof(uint32_t);
+    }
+
+    for (uint32_t preset = 0; preset < QUALITY_PRESET_COUNT; ++preset)
+    {
+        const QualitySettings settings = GetQualitySettings(static_cast<QualityPreset>(preset));
+
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+        specializationInfo.pMapEntries = specializationEntries.data();
+        specializationInfo.dataSize = sizeof(QualitySettings);
+        specializationInfo.pData = &settings;
+        shaderStages[shader_index_ray].pSpecializationInfo = &specializationInfo;
+
+        VkRayTracingPipelineCreateInfoNV rayPipelineInfo{};
+        rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_NV;
+        rayPipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        rayPipelineInfo.pStages = shaderStages.data();
+        rayPipelineInfo.groupCount = static_cast<uint32_t>(groups.size());
+        rayPipelineInfo.pGroups = groups.data();
+        rayPipelineInfo.maxRecursionDepth = 1;
+        rayPipelineInfo.layout = RpipelineLayout;
+        CHECK_ERROR(vkCreateRayTracingPipelinesNV(device.logicalDevice, pipelineCache, 1, &rayPipelineInfo, nullptr, &rayTracingPipelines[preset].pipeline));
+    }
 }
 
-VkPipelineShaderStageCreateInfo VContext::loadShader(const std::string file_name, VkShaderStageFlagBits stage)
+void VContext::SetQualityPreset(QualityPreset preset)
 {
-    VkPipelineShaderStageCreateInfo shaderStage = {};
-    shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStage.stage = stage;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-    shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
-#else
-    shaderStage.module = Tools::loadShader(file_name.c_str(), device.logicalDevice);
-#endif
-    shaderStage.pName = "main"; // todo : make param
-    assert(shaderStage.module != VK_NULL_HANDLE);
-    shaderModules.push_back(shaderStage.module);
-    return shaderStage;
+    //Every preset is already built, the next recorded frame binds the other pipeline
+    if (preset == qualityPreset)
+        return;
+
+    qualityPreset = preset;
+    accumulationFrame = 0;
+    std::cout << "QUALITY PRESET: " << GetQualityPresetName(preset) << '\n';
 }
 
-void VContext::createSynchronizationPrimitives()
+void VContext::SetSamplerType(SamplerType type)
 {
-    // Wait fences to sync command buffer access
-    VkFenceCreateInfo fenceCreateInfo = Initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-    waitFences.resize(commandBuffers.size());
-    for (auto& fence : waitFences)
-    {
-        vkCreateFence(device.logicalDevice, &fenceCreateInfo, nullptr, &fence);
-    }
+    if (type == samplerType)
+        return;
+
+    //Samples of different sequences must not be mixed in the running average
+    samplerType = type;
+    accumulationFrame = 0;
+    std::cout << "SAMPLER: " << GetSamplerTypeName(type) << '\n';
 }
 
-void VContext::createPipelineCache()
+void VContext::createTonemapPipeline()
 {
-    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-    vkCreatePipelineCache(device.logicalDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+    //Reads the accumulated radiance and writes the displayable image that is blitted to the swap chain
+    const std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1)
+    };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Initializers::descriptorSetLayoutCreateInfo(bindings);
+    CHECK_ERROR(vkCreateDescriptorSetLayout(device.logicalDevice, &layoutInfo, nullptr, &tonemapDescriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange = Initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(TonemapConstants), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = Initializers::pipelineLayoutCreateInfo(&tonemapDescriptorSetLayout, 1);
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    CHECK_ERROR(vkCreatePipelineLayout(device.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &tonemapPipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineInfo = Initializers::computePipelineCreateInfo(tonemapPipelineLayout);
+    pipelineInfo.stage = loadShader("shaders/bin/tonemap.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    CHECK_ERROR(vkCreateComputePipelines(device.logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &tonemapPipeline));
 }
 
-void VContext::setupFrameBuffer()
+void VContext::createAdaptiveSamplingPipeline()
 {
-    VkImageView attachments[2];
-
-    // Depth/Stencil attachment is the same for all frame buffers
-    attachments[1] = depthStencil.view;
+    //Reads the accumulated mean and moments, writes the sample map of the next frame and the frame statistics
+    const std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3)
+    };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Initializers::descriptorSetLayoutCreateInfo(bindings);
+    CHECK_ERROR(vkCreateDescriptorSetLayout(device.logicalDevice, &layoutInfo, nullptr, &adaptiveDescriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange = Initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(AdaptiveSamplingConstants), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = Initializers::pipelineLayoutCreateInfo(&adaptiveDescriptorSetLayout, 1);
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    CHECK_ERROR(vkCreatePipelineLayout(device.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &adaptivePipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineInfo = Initializers::computePipelineCreateInfo(adaptivePipelineLayout);
+    pipelineInfo.stage = loadShader("shaders/bin/adaptive.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    CHECK_ERROR(vkCreateComputePipelines(device.logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &adaptivePipeline));
+}
+
+void VContext::createTemporalPipeline()
+{
+    //Reads and writes the accumulation, moments and history, reads the motion written by the ray tracing pass
+    const std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3)
+    };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Initializers::descriptorSetLayoutCreateInfo(bindings);
+    CHECK_ERROR(vkCreateDescriptorSetLayout(device.logicalDevice, &layoutInfo, nullptr, &temporalDescriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange = Initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(TemporalConstants), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = Initializers::pipelineLayoutCreateInfo(&temporalDescriptorSetLayout, 1);
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    CHECK_ERROR(vkCreatePipelineLayout(device.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &temporalPipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineInfo = Initializers::computePipelineCreateInfo(temporalPipelineLayout);
+    pipelineInfo.stage = loadShader("shaders/bin/reproject.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    CHECK_ERROR(vkCreateComputePipelines(device.logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &temporalPipeline));
+
+    //The reconstruction of interleaved tracing reads and writes the same resources
+    pipelineInfo.stage = loadShader("shaders/bin/reconstruct.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    CHECK_ERROR(vkCreateComputePipelines(device.logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &reconstructPipeline));
+}
+
+void VContext::createWavefrontPipelines()
+{
+    //Set 1: counters, paths, hits, ray queues, sorted queue, shadow rays, dispatch arguments (see wavefront_data.glsl)
+    const VkShaderStageFlags stages = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT;
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    for (uint32_t binding = 0; binding < 7; ++binding)
+        bindings.push_back(Initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stages, binding));
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Initializers::descriptorSetLayoutCreateInfo(bindings);
+    CHECK_ERROR(vkCreateDescriptorSetLayout(device.logicalDevice, &layoutInfo, nullptr, &wavefrontDescriptorSetLayout));
+
+    //Set 0 is the set of the megakernel, every stage reads the scene and the frame constants from it
+    const std::array<VkDescriptorSetLayout, 2> setLayouts = { RdescriptorSetLayout, wavefrontDescriptorSetLayout };
+    VkPushConstantRange pushConstantRange = Initializers::pushConstantRange(stages, sizeof(WavefrontConstants), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = Initializers::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    CHECK_ERROR(vkCreatePipelineLayout(device.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &wavefrontPipelineLayout));
+
+    //Extension and shadow stages: two raygen groups sharing the miss and hit shaders of the megakernel
+    //One stage per group, the intersection shader of the procedural hit group comes last
+    std::array<VkPipelineShaderStageCreateInfo, WAVEFRONT_GROUP_COUNT + 1> shaderStages{};
+    shaderStages[WAVEFRONT_GROUP_EXTEND] = loadShader("shaders/bin/wavefront_extend.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    shaderStages[WAVEFRONT_GROUP_SHADOW] = loadShader("shaders/bin/wavefront_shadow.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    shaderStages[WAVEFRONT_GROUP_MISS] = loadShader("shaders/bin/ray_miss.spv", VK_SHADER_STAGE_MISS_BIT_NV);
+    shaderStages[WAVEFRONT_GROUP_SHADOWMISS] = loadShader("shaders/bin/ray_smiss.spv", VK_SHADER_STAGE_MISS_BIT_NV);
+    shaderStages[WAVEFRONT_GROUP_CLOSEST_HIT] = loadShader("shaders/bin/ray_chit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    shaderStages[WAVEFRONT_GROUP_PROCEDURAL_HIT] = loadShader("shaders/bin/ray_pchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    shaderStages[WAVEFRONT_GROUP_COUNT] = loadShader("shaders/bin/ray_int.spv", VK_SHADER_STAGE_INTERSECTION_BIT_NV);
+
+    std::array<VkRayTracingShaderGroupCreateInfoNV, WAVEFRONT_GROUP_COUNT> groups{};
+    for (uint32_t i = 0; i < WAVEFRONT_GROUP_COUNT; ++i)
+    {
+        groups[i].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_NV;
+        groups[i].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_NV;
+        groups[i].generalShader = i;
+        groups[i].closestHitShader = VK_SHADER_UNUSED_NV;
+        groups[i].anyHitShader = VK_SHADER_UNUSED_NV;
+        groups[i].intersectionShader = VK_SHADER_UNUSED_NV;
+    }
+    groups[WAVEFRONT_GROUP_CLOSEST_HIT].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_NV;
+    groups[WAVEFRONT_GROUP_CLOSEST_HIT].generalShader = VK_SHADER_UNUSED_NV;
+    groups[WAVEFRONT_GROUP_CLOSEST_HIT].closestHitShader = WAVEFRONT_GROUP_CLOSEST_HIT;
+    groups[WAVEFRONT_GROUP_PROCEDURAL_HIT].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_NV;
+    groups[WAVEFRONT_GROUP_PROCEDURAL_HIT].generalShader = VK_SHADER_UNUSED_NV;
+    groups[WAVEFRONT_GROUP_PROCEDURAL_HIT].closestHitShader = WAVEFRONT_GROUP_PROCEDURAL_HIT;
+    groups[WAVEFRONT_GROUP_PROCEDURAL_HIT].intersectionShader = WAVEFRONT_GROUP_COUNT;
+
+    VkRayTracingPipelineCreateInfoNV rayPipelineInfo{};
+    rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_NV;
+    rayPipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    rayPipelineInfo.pStages = shaderStages.data();
+    rayPipelineInfo.groupCount = static_cast<uint32_t>(groups.size());
+    rayPipelineInfo.pGroups = groups.data();
+    rayPipelineInfo.maxRecursionDepth = 1;
+    rayPipelineInfo.layout = wavefrontPipelineLayout;
+    CHECK_ERROR(vkCreateRayTracingPipelinesNV(device.logicalDevice, pipelineCache, 1, &rayPipelineInfo, nullptr, &wavefrontRayPipeline.pipeline));
+
+    //Each stage starts its own table, so every group is placed on the base alignment
+    const uint32_t handleSize = rayTracingProperties.shaderGroupHandleSize;
+    const uint32_t baseAlignment = std::max(1u, rayTracingProperties.shaderGroupBaseAlignment);
+    wavefrontSbtStride = (handleSize + baseAlignment - 1) / baseAlignment * baseAlignment;
+    std::vector<uint8_t> shaderHandleStorage(handleSize * WAVEFRONT_GROUP_COUNT);
+    CHECK_ERROR(vkGetRayTracingShaderGroupHandlesNV(device.logicalDevice, wavefrontRayPipeline.pipeline, 0, WAVEFRONT_GROUP_COUNT, shaderHandleStorage.size(), shaderHandleStorage.data()));
+    CHECK_ERROR(createBuffer(
+        VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        &wavefrontRayPipeline.shaderBindingTable,
+        wavefrontSbtStride * WAVEFRONT_GROUP_COUNT));
+    CHECK_ERROR(wavefrontRayPipeline.shaderBindingTable.map());
+    auto* data = static_cast<uint8_t*>(wavefrontRayPipeline.shaderBindingTable.mapped);
+    for (uint32_t group = 0; group < WAVEFRONT_GROUP_COUNT; ++group)
+        copyShaderIdentifier(data + group * wavefrontSbtStride, shaderHandleStorage.data(), group);
+    wavefrontRayPipeline.shaderBindingTable.unmap();
+
+    //Compute stages, the two passes of the bin sort only differ by their specialization constant
+    const auto createComputePipeline = [this](const std::string& file, const VkSpecializationInfo* specialization, VkPipeline& pipeline)
+    {
+        VkComputePipelineCreateInfo pipelineInfo = Initializers::computePipelineCreateInfo(wavefrontPipelineLayout);
+        pipelineInfo.stage = loadShader(file, VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineInfo.stage.pSpecializationInfo = specialization;
+        CHECK_ERROR(vkCreateComputePipelines(device.logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+    };
+
+    const VkBool32 scatter = VK_TRUE;
+    VkSpecializationMapEntry scatterEntry{ 0, 0, sizeof(VkBool32) };
+    VkSpecializationInfo scatterInfo{ 1, &scatterEntry, sizeof(VkBool32), &scatter };
+
+    createComputePipeline("shaders/bin/wavefront_camera.spv", nullptr, wavefrontCameraPipeline);
+    createComputePipeline("shaders/bin/wavefront_bin.spv", nullptr, wavefrontBinCountPipeline);
+    createComputePipeline("shaders/bin/wavefront_bin.spv", &scatterInfo, wavefrontBinScatterPipeline);
+    createComputePipeline("shaders/bin/wavefront_shade.spv", nullptr, wavefrontShadePipeline);
+    createComputePipeline("shaders/bin/wavefront_accumulate.spv", nullptr, wavefrontAccumulatePipeline);
+    createComputePipeline("shaders/bin/wavefront_args.spv", nullptr, wavefrontArgsPipeline);
+}
+
+void VContext::createVisibilityPipeline()
+{
+    //Camera rays only: one raygen, one miss and one hit group, all writing the 8 byte payload of visibility.glsl
+    std::array<VkPipelineShaderStageCreateInfo, VISIBILITY_GROUP_COUNT> shaderStages{};
+    shaderStages[VISIBILITY_GROUP_RAYGEN] = loadShader("shaders/bin/visibility_gen.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    shaderStages[VISIBILITY_GROUP_MISS] = loadShader("shaders/bin/visibility_miss.spv", VK_SHADER_STAGE_MISS_BIT_NV);
+    shaderStages[VISIBILITY_GROUP_CLOSEST_HIT] = loadShader("shaders/bin/visibility_chit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    //The procedural hit group reuses the closest hit shader, its own stage is the intersection shader
+    shaderStages[VISIBILITY_GROUP_PROCEDURAL_HIT] = loadShader("shaders/bin/ray_int.spv", VK_SHADER_STAGE_INTERSECTION_BIT_NV);
+
+    std::array<VkRayTracingShaderGroupCreateInfoNV, VISIBILITY_GROUP_COUNT> groups{};
+    for (uint32_t i = 0; i < VISIBILITY_GROUP_COUNT; ++i)
+    {
+        groups[i].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_NV;
+        groups[i].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_NV;
+        groups[i].generalShader = i;
+        groups[i].closestHitShader = VK_SHADER_UNUSED_NV;
+        groups[i].anyHitShader = VK_SHADER_UNUSED_NV;
+        groups[i].intersectionShader = VK_SHADER_UNUSED_NV;
+    }
+    groups[VISIBILITY_GROUP_CLOSEST_HIT].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_NV;
+    groups[VISIBILITY_GROUP_CLOSEST_HIT].generalShader = VK_SHADER_UNUSED_NV;
+    groups[VISIBILITY_GROUP_CLOSEST_HIT].closestHitShader = VISIBILITY_GROUP_CLOSEST_HIT;
+    groups[VISIBILITY_GROUP_PROCEDURAL_HIT].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_NV;
+    groups[VISIBILITY_GROUP_PROCEDURAL_HIT].generalShader = VK_SHADER_UNUSED_NV;
+    groups[VISIBILITY_GROUP_PROCEDURAL_HIT].closestHitShader = VISIBILITY_GROUP_CLOSEST_HIT;
+    groups[VISIBILITY_GROUP_PROCEDURAL_HIT].intersectionShader = VISIBILITY_GROUP_PROCEDURAL_HIT;
+
+    //Same layout as the megakernel, the pass reads the TLAS, the camera and the accumulation image of set 0
+    VkRayTracingPipelineCreateInfoNV rayPipelineInfo{};
+    rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_NV;
+    rayPipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    rayPipelineInfo.pStages = shaderStages.data();
+    rayPipelineInfo.groupCount = static_cast<uint32_t>(groups.size());
+    rayPipelineInfo.pGroups = groups.data();
+    rayPipelineInfo.maxRecursionDepth = 1;
+    rayPipelineInfo.layout = RpipelineLayout;
+    CHECK_ERROR(vkCreateRayTracingPipelinesNV(device.logicalDevice, pipelineCache, 1, &rayPipelineInfo, nullptr, &visibilityPipeline.pipeline));
+
+    //The raygen group starts its own table, so every group is placed on the base alignment
+    const uint32_t handleSize = rayTracingProperties.shaderGroupHandleSize;
+    const uint32_t baseAlignment = std::max(1u, rayTracingProperties.shaderGroupBaseAlignment);
+    visibilitySbtStride = (handleSize + baseAlignment - 1) / baseAlignment * baseAlignment;
+    std::vector<uint8_t> shaderHandleStorage(handleSize * VISIBILITY_GROUP_COUNT);
+    CHECK_ERROR(vkGetRayTracingShaderGroupHandlesNV(device.logicalDevice, visibilityPipeline.pipeline, 0, VISIBILITY_GROUP_COUNT, shaderHandleStorage.size(), shaderHandleStorage.data()));
+    CHECK_ERROR(createBuffer(
+        VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        &visibilityPipeline.shaderBindingTable,
+        visibilitySbtStride * VISIBILITY_GROUP_COUNT));
+    CHECK_ERROR(visibilityPipeline.shaderBindingTable.map());
+    auto* data = static_cast<uint8_t*>(visibilityPipeline.shaderBindingTable.mapped);
+    for (uint32_t group = 0; group < VISIBILITY_GROUP_COUNT; ++group)
+        copyShaderIdentifier(data + group * visibilitySbtStride, shaderHandleStorage.data(), group);
+    visibilityPipeline.shaderBindingTable.unmap();
+}
+
+void VContext::SetVisibilityBuffer(bool enabled)
+{
+    if (enabled == visibilityBuffer)
+        return;
+    if (enabled && !visibilityBufferSupported)
+    {
+        std::cout << "VISIBILITY BUFFER: NOT SUPPORTED BY THE SCENE\n";
+        return;
+    }
+
+    visibilityBuffer = enabled;
+    accumulationFrame = 0;
+    std::cout << "VISIBILITY BUFFER: " << (enabled ? "ON" : "OFF") << '\n';
+}
+
+void VContext::SetTemporalReprojection(bool enabled)
+{
+    if (enabled == temporalReprojection)
+        return;
+
+    //The history is not written while the reprojection is off, the first frame after enabling it only stores one
+    temporalReprojection = enabled;
+    temporalHistory = false;
+    std::cout << "TEMPORAL REPROJECTION: " << (enabled ? "ON" : "OFF") << '\n';
+}
+
+void VContext::SetInterleaveMode(InterleaveMode mode)
+{
+    if (mode == interleaveMode)
+        return;
+
+    //No restart: the pixels a frame skips keep their accumulation, the new pattern reaches all of them in a few frames
+    interleaveMode = mode;
+    std::cout << "INTERLEAVE: " << GetInterleaveModeName(mode) << '\n';
+}
+
+void VContext::SetDenoiser(bool enabled)
+{
+    if (enabled == denoiserEnabled)
+        return;
+
+    //The tonemap descriptor sets switch between the accumulation and the denoised image when their slot is reused
+    denoiserEnabled = enabled;
+    if (enabled)
+        createDenoiserBuffers();
+    else
+        destroyDenoiserBuffers();
+    denoiser.Reset();
+    targetsVersion++;
+    std::cout << "CPU DENOISER: " << (enabled ? "ON" : "OFF") << '\n';
+}
+
+void VContext::SetAdaptiveSampling(bool enabled)
+{
+    if (enabled == adaptiveSampling)
+        return;
+
+    //Restart so the reported error compares both modes from the same number of frames
+    adaptiveSampling = enabled;
+    accumulationFrame = 0;
+    std::cout << "ADAPTIVE SAMPLING: " << (enabled ? "ON" : "OFF") << '\n';
+}
+
+void VContext::SetLightSampler(LightSampler sampler)
+{
+    if (sampler == lightSampler)
+        return;
+
+    lightSampler = sampler;
+    accumulationFrame = 0;
+    std::cout << "LIGHT SAMPLER: " << GetLightSamplerName(sampler) << '\n';
+}
+
+void VContext::SetRestir(bool enabled)
+{
+    if (enabled == restirEnabled)
+        return;
+
+    restirEnabled = enabled;
+    restirHistory = false;
+    accumulationFrame = 0;
+    std::cout << "RESTIR: " << (enabled ? "ON" : "OFF") << '\n';
+}
+
+void VContext::SetRestirCandidates(uint32_t candidates)
+{
+    restirCandidates = std::max(1u, candidates);
+    accumulationFrame = 0;
+    std::cout << "RESTIR CANDIDATES: " << restirCandidates << '\n';
+}
+
+void VContext::SetRestirNeighbours(uint32_t neighbours)
+{
+    restirNeighbours = neighbours;
+    accumulationFrame = 0;
+    std::cout << "RESTIR NEIGHBOURS: " << restirNeighbours << '\n';
+}
+
+void VContext::SetWavefront(bool enabled)
+{
+    if (enabled == wavefrontEnabled)
+        return;
+
+    //The queues are sized for the render targets, the descriptor sets pick them up when their frame slot is reused
+    wavefrontEnabled = enabled;
+    if (enabled)
+        createWavefrontBuffers();
+    else
+        destroyWavefrontBuffers();
+    targetsVersion++;
+
+    //The wavefront stages don't resample the direct light, the reservoirs are stale when the megakernel comes back
+    restirHistory = false;
+    accumulationFrame = 0;
+    std::cout << "WAVEFRONT: " << (enabled ? "ON" : "OFF") << '\n';
+}
+
+VkPipelineShaderStageCreateInfo VContext::loadShader(const std::string file_name, VkShaderStageFlagBits stage)
+{
+    VkPipelineShaderStageCreateInfo shaderStage = {};
+    shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStage.stage = stage;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+    shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
+#else
+    shaderStage.module = Tools::loadShader(file_name.c_str(), device.logicalDevice);
+#endif
+    shaderStage.pName = "main"; // todo : make param
+    assert(shaderStage.module != VK_NULL_HANDLE);
+    shaderModules.push_back(shaderStage.module);
+    return shaderStage;
+}
+
+void VContext::createSynchronizationPrimitives()
+{
+    // Wait fences to sync command buffer access, created signaled so the first use of a frame slot doesn't wait
+    VkFenceCreateInfo fenceCreateInfo = Initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+    VkSemaphoreCreateInfo semaphoreCreateInfo = Initializers::semaphoreCreateInfo();
+    for (auto& frame : frames)
+    {
+        CHECK_ERROR(vkCreateFence(device.logicalDevice, &fenceCreateInfo, nullptr, &frame.fence));
+        // Create a semaphore used to synchronize image presentation
+        // Ensures that the image is displayed before we start submitting new commands to the queu
+        CHECK_ERROR(vkCreateSemaphore(device.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.semaphores.presentComplete));
+        // Create a semaphore used to synchronize command submission
+        // Ensures that the image is not presented until all commands have been sumbitted and executed
+        CHECK_ERROR(vkCreateSemaphore(device.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.semaphores.renderComplete));
+        // Signaled by the async compute queue once the TLAS of the frame is built
+        if (useAsyncCompute)
+            CHECK_ERROR(vkCreateSemaphore(device.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.asBuildComplete));
+    }
+
+    // No swap chain image is used by a frame yet
+    imagesInFlight.assign(swapChain.imageCount, VK_NULL_HANDLE);
+
+    // Two timestamps per frame in flight, around the whole frame
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * framesInFlight;
+    CHECK_ERROR(vkCreateQueryPool(device.logicalDevice, &queryPoolInfo, nullptr, &timestampPool));
+    for (uint32_t i = 0; i < framesInFlight; ++i)
+        frames[i].timestampQuery = 2 * i;
+
+    // Upscaling uses a linear filter when the format supports it
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(device.physicalDevice, swapChain.colorFormat, &formatProperties);
+    upscaleFilter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+}
+
+void VContext::createPipelineCache()
+{
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    vkCreatePipelineCache(device.logicalDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+}
+
+void VContext::setupFrameBuffer()
+{
+    VkImageView attachments[2];
+
+    // Depth/Stencil attachment is the same for all frame buffers
+    attachments[1] = depthStencil.view;
 
     VkFramebufferCreateInfo frameBufferCreateInfo = {};
     frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -1846,8 +2854,8 @@ void VContext::setupFrameBuffer()
     frameBufferCreateInfo.renderPass = renderPass;
     frameBufferCreateInfo.attachmentCount = 2;
     frameBufferCreateInfo.pAttachments = attachments;
-    frameBufferCreateInfo.width = WIDTH;
-    frameBufferCreateInfo.height = HEIGHT;
+    frameBufferCreateInfo.width = swapChain.extent.width;
+    frameBufferCreateInfo.height = swapChain.extent.height;
     frameBufferCreateInfo.layers = 1;
 
     // Create frame buffers for every swap chain image
@@ -1865,7 +2873,7 @@ void VContext::setupDepthstencil()
     imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageCI.imageType = VK_IMAGE_TYPE_2D;
     imageCI.format = depthFormat;
-    imageCI.extent = { WIDTH, HEIGHT, 1 };
+    imageCI.extent = { swapChain.extent.width, swapChain.extent.height, 1 };
     imageCI.mipLevels = 1;
     imageCI.arrayLayers = 1;
     imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -1984,12 +2992,19 @@ void VContext::setupRenderPass()
 *
 * @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
 */
-VkResult VContext::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VBuffer::Buffer* buffer, VkDeviceSize size, void* data) const
+VkResult VContext::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VBuffer::Buffer* buffer, VkDeviceSize size, void* data,
+                               bool sharedWithCompute) const
 {
     buffer->device = device.logicalDevice;
 
-    // Create the buffer handle
+    // Create the buffer handle, a buffer used by both queues needs no ownership transfer when it is concurrent
     VkBufferCreateInfo bufferCreateInfo = Initializers::bufferCreateInfo(usageFlags, size);
+    if (sharedWithCompute && !asyncQueueFamilies.empty())
+    {
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferCreateInfo.queueFamilyIndexCount = static_cast<uint32_t>(asyncQueueFamilies.size());
+        bufferCreateInfo.pQueueFamilyIndices = asyncQueueFamilies.data();
+    }
     vkCreateBuffer(device.logicalDevice, &bufferCreateInfo, nullptr, &buffer->buffer);
 
     // Create the memory backing up the buffer handle
@@ -2183,26 +3198,30 @@ void VContext::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue,
 
 void VContext::createShaderBindingTable()
 {
-    // Create buffer for the shader binding table
+    // The shader group handles belong to a pipeline, so each quality preset has its own table
     const uint32_t sbtSize = rayTracingProperties.shaderGroupHandleSize * NUM_SHADER_GROUPS;
-    createBuffer(
-        VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        &mShaderBindingTable,
-        sbtSize);
-    mShaderBindingTable.map();
-
-    const auto shaderHandleStorage = new uint8_t[sbtSize];
-    // Get shader identifiers
-    vkGetRayTracingShaderGroupHandlesNV(device.logicalDevice, Rpipeline, 0, NUM_SHADER_GROUPS, sbtSize, shaderHandleStorage);
-    auto* data = static_cast<uint8_t*>(mShaderBindingTable.mapped);
-    // Copy the shader identifiers to the shader binding table
-    data += copyShaderIdentifier(data, shaderHandleStorage, INDEX_RAYGEN);
-    data += copyShaderIdentifier(data, shaderHandleStorage, INDEX_MISS);
-    data += copyShaderIdentifier(data, shaderHandleStorage, INDEX_SHADOWMISS);
-    data += copyShaderIdentifier(data, shaderHandleStorage, INDEX_CLOSEST_HIT);
-    data += copyShaderIdentifier(data, shaderHandleStorage, INDEX_SHADOWHIT);
-    mShaderBindingTable.unmap();
+    std::vector<uint8_t> shaderHandleStorage(sbtSize);
+    for (auto& rayTracingPipeline : rayTracingPipelines)
+    {
+        // Create buffer for the shader binding table
+        createBuffer(
+            VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            &rayTracingPipeline.shaderBindingTable,
+            sbtSize);
+        rayTracingPipeline.shaderBindingTable.map();
+
+        // Get shader identifiers
+        vkGetRayTracingShaderGroupHandlesNV(device.logicalDevice, rayTracingPipeline.pipeline, 0, NUM_SHADER_GROUPS, sbtSize, shaderHandleStorage.data());
+        auto* data = static_cast<uint8_t*>(rayTracingPipeline.shaderBindingTable.mapped);
+        // Copy the shader identifiers to the shader binding table
+        data += copyShaderIdentifier(data, shaderHandleStorage.data(), INDEX_RAYGEN);
+        data += copyShaderIdentifier(data, shaderHandleStorage.data(), INDEX_MISS);
+        data += copyShaderIdentifier(data, shaderHandleStorage.data(), INDEX_SHADOWMISS);
+        data += copyShaderIdentifier(data, shaderHandleStorage.data(), INDEX_CLOSEST_HIT);
+        data += copyShaderIdentifier(data, shaderHandleStorage.data(), INDEX_PROCEDURAL_HIT);
+        rayTracingPipeline.shaderBindingTable.unmap();
+    }
 }
 
 VkDeviceSize VContext::copyShaderIdentifier(uint8_t* data, const uint8_t* shaderHandleStorage, uint32_t groupIndex) const
@@ -2215,27 +3234,67 @@ VkDeviceSize VContext::copyShaderIdentifier(uint8_t* data, const uint8_t* shader
 
 void VContext::createDescriptorSets()
 {
+    // One descriptor set per frame in flight, they only differ by the uniform buffer slice they point to
     const std::vector<VkDescriptorPoolSize> poolSizes = {
-        { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, 1 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
+        { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5 * framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 * framesInFlight },
+        //Tonemap set
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * framesInFlight },
+        //Adaptive sampling set
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight },
+        //Wavefront set
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7 * framesInFlight },
+        //Temporal reprojection set
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight }
     };
-    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = Initializers::descriptorPoolCreateInfo(poolSizes, 1);
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = Initializers::descriptorPoolCreateInfo(poolSizes, 5 * framesInFlight);
     vkCreateDescriptorPool(device.logicalDevice, &descriptorPoolCreateInfo, nullptr, &descriptorPool);
 
-    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = Initializers::descriptorSetAllocateInfo(descriptorPool, &RdescriptorSetLayout, 1);
-    vkAllocateDescriptorSets(device.logicalDevice, &descriptorSetAllocateInfo, &RdescriptorSet);
+    for (auto& frame : frames)
+    {
+        createFrameTopLevel(frame, static_cast<uint32_t>(sceneInstances.size()));
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = Initializers::descriptorSetAllocateInfo(descriptorPool, &RdescriptorSetLayout, 1);
+        CHECK_ERROR(vkAllocateDescriptorSets(device.logicalDevice, &descriptorSetAllocateInfo, &frame.descriptorSet));
+
+        VkDescriptorSetAllocateInfo tonemapSetAllocateInfo = Initializers::descriptorSetAllocateInfo(descriptorPool, &tonemapDescriptorSetLayout, 1);
+        CHECK_ERROR(vkAllocateDescriptorSets(device.logicalDevice, &tonemapSetAllocateInfo, &frame.tonemapDescriptorSet));
+
+        VkDescriptorSetAllocateInfo adaptiveSetAllocateInfo = Initializers::descriptorSetAllocateInfo(descriptorPool, &adaptiveDescriptorSetLayout, 1);
+        CHECK_ERROR(vkAllocateDescriptorSets(device.logicalDevice, &adaptiveSetAllocateInfo, &frame.adaptiveDescriptorSet));
+
+        VkDescriptorSetAllocateInfo wavefrontSetAllocateInfo = Initializers::descriptorSetAllocateInfo(descriptorPool, &wavefrontDescriptorSetLayout, 1);
+        CHECK_ERROR(vkAllocateDescriptorSets(device.logicalDevice, &wavefrontSetAllocateInfo, &frame.wavefrontDescriptorSet));
+
+        VkDescriptorSetAllocateInfo temporalSetAllocateInfo = Initializers::descriptorSetAllocateInfo(descriptorPool, &temporalDescriptorSetLayout, 1);
+        CHECK_ERROR(vkAllocateDescriptorSets(device.logicalDevice, &temporalSetAllocateInfo, &frame.temporalDescriptorSet));
+        writeDescriptorSet(frame);
+    }
+}
+
+void VContext::writeDescriptorSet(FrameData& frame)
+{
+    const VkDescriptorSet RdescriptorSet = frame.descriptorSet;
+    frame.targetsVersion = targetsVersion;
 
     //Acceleration Structure
     VkWriteDescriptorSetAccelerationStructureNV descriptorAccelerationStructureInfo{};
     descriptorAccelerationStructureInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_NV;
     descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
-    descriptorAccelerationStructureInfo.pAccelerationStructures = &topLevelAS.accelerationStructure;
+    descriptorAccelerationStructureInfo.pAccelerationStructures = &frame.topLevelAS.accelerationStructure;
 
     VkWriteDescriptorSet accelerationStructureWrite{};
     accelerationStructureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -2255,13 +3314,33 @@ void VContext::createDescriptorSets()
     accImageDescriptor.imageView = accImage.view;
     accImageDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-    VkDescriptorBufferInfo vertexBufferDescriptor{};
-	vertexBufferDescriptor.buffer = vertBuffer.buffer;
-	vertexBufferDescriptor.range = VK_WHOLE_SIZE;
+    //ADAPTIVE SAMPLING IMAGES
+    VkDescriptorImageInfo momentsImageDescriptor{};
+    momentsImageDescriptor.imageView = momentsImage.view;
+    momentsImageDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorImageInfo sampleMapDescriptor{};
+    sampleMapDescriptor.imageView = sampleMapImage.view;
+    sampleMapDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    //VISIBILITY BUFFER
+    VkDescriptorImageInfo visibilityImageDescriptor{};
+    visibilityImageDescriptor.imageView = visibilityImage.view;
+    visibilityImageDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    //CPU DENOISER
+    VkDescriptorImageInfo guideImageDescriptor{};
+    guideImageDescriptor.imageView = guideImage.view;
+    guideImageDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-    VkDescriptorBufferInfo TriNumberDescriptor{};
-	TriNumberDescriptor.buffer = NumberOfTriangles.buffer;
-	TriNumberDescriptor.range = VK_WHOLE_SIZE;
+    VkDescriptorImageInfo denoisedImageDescriptor{};
+    denoisedImageDescriptor.imageView = denoisedImage.view;
+    denoisedImageDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    //TEMPORAL REPROJECTION
+    VkDescriptorImageInfo motionImageDescriptor{};
+    motionImageDescriptor.imageView = motionImage.view;
+    motionImageDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
     VkDescriptorBufferInfo TimeBufferDescriptor{};
 	TimeBufferDescriptor.buffer = TimeBuffer.buffer;
@@ -2272,11 +3351,27 @@ void VContext::createDescriptorSets()
     const VkWriteDescriptorSet resultImageWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &storageImageDescriptor);
     const VkWriteDescriptorSet accImageWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 7, &accImageDescriptor);
     //Uniform Data
-    const VkWriteDescriptorSet uniformBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &ubo.descriptor);
+    const VkWriteDescriptorSet uniformBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &frame.ubo.descriptor);
     const VkWriteDescriptorSet matBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &matBuffer.descriptor);
-    VkWriteDescriptorSet vertexBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &vertBuffer.descriptor);
+    VkWriteDescriptorSet vertexBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &vertexBuffer.descriptor);
 	VkWriteDescriptorSet TimeBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, &TimeBuffer.descriptor);
-	VkWriteDescriptorSet TriNumberWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &NumberOfTriangles.descriptor);
+	VkWriteDescriptorSet instanceOffsetWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &instanceOffsetBuffer.descriptor);
+	VkWriteDescriptorSet indexBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8, &indexBuffer.descriptor);
+	VkWriteDescriptorSet materialIdWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 9, &materialIdBuffer.descriptor);
+	VkWriteDescriptorSet blueNoiseWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10, &blueNoiseBuffer.descriptor);
+    const VkWriteDescriptorSet momentsImageWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 11, &momentsImageDescriptor);
+    const VkWriteDescriptorSet sampleMapWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 12, &sampleMapDescriptor);
+	VkWriteDescriptorSet lightBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 13, &frame.lightBuffer.descriptor);
+	VkWriteDescriptorSet lightAliasWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 14, &frame.lightAliasBuffer.descriptor);
+	VkWriteDescriptorSet lightBvhWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 15, &lightBvhBuffer.descriptor);
+	VkWriteDescriptorSet reservoirWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 16, &reservoirBuffer.descriptor);
+    const VkWriteDescriptorSet visibilityImageWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 17, &visibilityImageDescriptor);
+	VkWriteDescriptorSet instanceBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 18, &frame.instanceBuffer.descriptor);
+    const VkWriteDescriptorSet guideImageWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 19, &guideImageDescriptor);
+    const VkWriteDescriptorSet motionImageWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 20, &motionImageDescriptor);
+    const VkWriteDescriptorSet previousTransformWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 21, &frame.previousTransformBuffer.descriptor);
+    const VkWriteDescriptorSet temporalBufferWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 22, &temporalBuffer.descriptor);
+    const VkWriteDescriptorSet primitiveTypeWrite = Initializers::writeDescriptorSet(RdescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 23, &primitiveTypeBuffer.descriptor);
 
     std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
         accelerationStructureWrite,
@@ -2285,53 +3380,320 @@ void VContext::createDescriptorSets()
         matBufferWrite,
         vertexBufferWrite,
         TimeBufferWrite,
-        TriNumberWrite,
-        accImageWrite
+        instanceOffsetWrite,
+        accImageWrite,
+        indexBufferWrite,
+        materialIdWrite,
+        blueNoiseWrite,
+        momentsImageWrite,
+        sampleMapWrite,
+        lightBufferWrite,
+        lightAliasWrite,
+        lightBvhWrite,
+        reservoirWrite,
+        visibilityImageWrite,
+        instanceBufferWrite,
+        guideImageWrite,
+        motionImageWrite,
+        previousTransformWrite,
+        temporalBufferWrite,
+        primitiveTypeWrite
     };
 
+    //Tonemap pass: accumulated (or denoised) radiance in, displayable image out
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.tonemapDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, denoiserEnabled ? &denoisedImageDescriptor : &accImageDescriptor));
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.tonemapDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &storageImageDescriptor));
+
+    //Adaptive sampling pass: accumulation and moments in, sample map and statistics out
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.adaptiveDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, &accImageDescriptor));
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.adaptiveDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &momentsImageDescriptor));
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.adaptiveDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &sampleMapDescriptor));
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.adaptiveDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &frame.adaptiveStats.descriptor));
+
+    //Temporal reprojection pass: accumulation and moments in and out, motion in, history in and out
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.temporalDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, &accImageDescriptor));
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.temporalDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &momentsImageDescriptor));
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.temporalDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &motionImageDescriptor));
+    writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.temporalDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &temporalBuffer.descriptor));
+
+    //Wavefront queues, see wavefront_data.glsl
+    if (wavefrontBuffers.counters.buffer != VK_NULL_HANDLE)
+    {
+        writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.wavefrontDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &wavefrontBuffers.counters.descriptor));
+        writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.wavefrontDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &wavefrontBuffers.paths.descriptor));
+        writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.wavefrontDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &wavefrontBuffers.hits.descriptor));
+        writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.wavefrontDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &wavefrontBuffers.rayQueues.descriptor));
+        writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.wavefrontDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &wavefrontBuffers.sortedQueue.descriptor));
+        writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.wavefrontDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &wavefrontBuffers.shadowRays.descriptor));
+        writeDescriptorSets.push_back(Initializers::writeDescriptorSet(frame.wavefrontDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &wavefrontBuffers.dispatchArgs.descriptor));
+    }
+
     vkUpdateDescriptorSets(device.logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 }
 
 void VContext::createUniformBuffer()
 {
-    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &ubo,
-        sizeof(uniformData),
-        &uniformData));
-    CHECK_ERROR(ubo.map());
+    // Each frame in flight owns its slice of uniform data, so the CPU never writes data the GPU is still reading
+    for (auto& frame : frames)
+    {
+        CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &frame.ubo,
+            sizeof(uniformData),
+            &uniformData));
+        CHECK_ERROR(frame.ubo.map());
+
+        // Statistics of the adaptive sampling pass, read back by draw() once the frame has completed
+        AdaptiveSamplingStats stats{};
+        CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &frame.adaptiveStats,
+            sizeof(AdaptiveSamplingStats),
+            &stats));
+        CHECK_ERROR(frame.adaptiveStats.map());
+
+        // Lights and alias table, the light count never changes so draw() only copies the latest table
+        CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &frame.lightBuffer,
+            sceneLights.size() * sizeof(VLightData)));
+        CHECK_ERROR(frame.lightBuffer.map());
+        CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &frame.lightAliasBuffer,
+            sceneLights.size() * sizeof(VLightTable::AliasEntry)));
+        CHECK_ERROR(frame.lightAliasBuffer.map());
+    }
 
     updateUniformBuffers(true);
 }
 
 void VContext::updateUniformBuffers(bool updateAcc)
 {
-    uniformData.projInverse = camera.matrices.perspective;
-    uniformData.viewInverse = camera.matrices.view;
-
-    memcpy(ubo.mapped, &uniformData, sizeof(uniformData));
-
-    if(updateAcc)
-        uniformData.data.y += camera.sample;
-    else
-        uniformData.data.y = camera.sample;
+    // Only the CPU copy is updated here, draw() uploads it to the slice of the frame being recorded
+    uniformData.projection = camera.matrices.perspective;
+    uniformData.view = camera.matrices.view;
+
+    //A restart caused by motion starts from the reprojected history. One asked for by a setter (accumulationFrame
+    //already 0) drops it, the old settings would bleed into the new image
+    const bool temporal = temporalReprojection && !wavefrontEnabled;
+    temporalReuse = temporal && temporalHistory && (!updateAcc || !accumulationEnabled) && accumulationFrame > 0;
+
+    //Any change of the view restarts the running average, the raygen overwrites the accumulation when data.y is 0
+    if(!updateAcc || !accumulationEnabled)
+        accumulationFrame = 0;
+
+    //Each accumulated frame samples another point of the pixel, Halton (2, 3) covers it evenly
+    const glm::vec2 subpixel = camera.jitter && accumulationEnabled
+        ? glm::vec2(Camera::Halton(accumulationFrame + 1, 2), Camera::Halton(accumulationFrame + 1, 3))
+        : glm::vec2(0.5f);
+    uniformData.previousCamera = uniformData.camera;
+    uniformData.camera = camera.BuildRayConstants(renderExtent.width, renderExtent.height, subpixel);
+    uniformData.data.x = static_cast<float>(camera.sample);
+    uniformData.data.y = static_cast<float>(accumulationFrame++);
+    uniformData.data.z = static_cast<float>(frameNumber % (1u << 24));
+    uniformData.data.w = static_cast<float>(static_cast<uint32_t>(samplerType));
+
+    //Light selection probabilities follow the contribution of each light around the camera
+    lightTable.Build(sceneLights, camera.position);
+    uniformData.settings.x = static_cast<uint32_t>(lightSampler);
+
+    //Reservoirs written while ReSTIR was off are stale, the first frame after enabling it starts from scratch
+    uniformData.settings.y = restirEnabled ? RESTIR_ENABLED | (restirHistory ? RESTIR_HISTORY : 0) : 0;
+    if (visibilityBuffer)
+        uniformData.settings.y |= VISIBILITY_BUFFER_ENABLED;
+    if (denoiserEnabled)
+        uniformData.settings.y |= DENOISER_GUIDES;
+    if (temporal)
+        uniformData.settings.y |= TEMPORAL_REPROJECTION;
+    if (!wavefrontEnabled)
+        uniformData.settings.y |= static_cast<uint32_t>(interleaveMode) << INTERLEAVE_SHIFT;
+    uniformData.settings.z = restirCandidates;
+    uniformData.settings.w = restirNeighbours;
+    restirHistory = restirEnabled;
+    temporalHistory = temporal;
 }
 
-void VContext::buildCommandbuffers()
+void VContext::recordCommandBuffer(const FrameData& frame, uint32_t imageIndex)
 {
     VkCommandBufferBeginInfo cmdBufInfo = Initializers::commandBufferBeginInfo();
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     const VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    const VkCommandBuffer cmdBuffer = frame.commandBuffer;
 
-    for (size_t i = 0; i < commandBuffers.size(); ++i)
-    {
-        CHECK_ERROR(vkBeginCommandBuffer(commandBuffers[i], &cmdBufInfo));
+    CHECK_ERROR(vkResetCommandBuffer(cmdBuffer, 0));
+    CHECK_ERROR(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
 
+    // GPU time of the frame, read back once the frame fence has signaled. A denoised frame starts with its trace
+    if (!denoiserEnabled)
+    {
+        vkCmdResetQueryPool(cmdBuffer, timestampPool, frame.timestampQuery, 2);
+        vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, frame.timestampQuery);
+        recordTrace(cmdBuffer, frame);
+    }
+    else
+    {
         /*
-            Dispatch the ray tracing commands
+            Upload the radiance filtered by the CPU denoiser, the trace was submitted on its own
         */
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, Rpipeline);
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, RpipelineLayout, 0, 1, &RdescriptorSet, 0, nullptr);
+        VkBufferImageCopy copyRegion{};
+        copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copyRegion.imageExtent = { renderExtent.width, renderExtent.height, 1 };
+        vkCmdCopyBufferToImage(cmdBuffer, denoiseUpload.buffer, denoisedImage.image, VK_IMAGE_LAYOUT_GENERAL, 1, &copyRegion);
+
+        VkMemoryBarrier uploadBarrier = Initializers::memoryBarrier();
+        uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        uploadBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    //DenoiseImage();
+
+    /*
+        Tonemap the accumulated radiance into the displayable image
+    */
+    VkMemoryBarrier accBarrier = Initializers::memoryBarrier();
+    accBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    accBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &accBarrier, 0, nullptr, 0, nullptr);
+
+    /*
+        Build the sample map of the next frame from the variance of the accumulated samples
+    */
+    const AdaptiveSamplingConstants adaptiveConstants{ adaptiveErrorThreshold, adaptiveMaxSamples, adaptiveMinSamples,
+        adaptiveSampling ? 1u : 0u, static_cast<uint32_t>(frameNumber), uniformData.data.y == 0 ? 1u : 0u };
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, adaptivePipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, adaptivePipelineLayout, 0, 1, &frame.adaptiveDescriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, adaptivePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AdaptiveSamplingConstants), &adaptiveConstants);
+    vkCmdDispatch(cmdBuffer, (renderExtent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE, (renderExtent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE, 1);
+
+    // The next frame's ray tracing pass reads the sample map, the CPU reads the statistics once the fence signals
+    VkMemoryBarrier sampleMapBarrier = Initializers::memoryBarrier();
+    sampleMapBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    sampleMapBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &sampleMapBarrier, 0, nullptr, 0, nullptr);
+
+    const TonemapConstants tonemapConstants{ exposure, tonemapOperator };
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tonemapPipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tonemapPipelineLayout, 0, 1, &frame.tonemapDescriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, tonemapPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TonemapConstants), &tonemapConstants);
+    vkCmdDispatch(cmdBuffer, (renderExtent.width + 7) / 8, (renderExtent.height + 7) / 8, 1);
+
+    VkMemoryBarrier tonemapBarrier = Initializers::memoryBarrier();
+    tonemapBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    tonemapBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &tonemapBarrier, 0, nullptr, 0, nullptr);
+
+    /*
+        Copy raytracing output to swap chain image
+    */
+
+    // Prepare current swapchain image as transfer destination
+    Tools::setImageLayout(
+        cmdBuffer,
+        swapChain.images[imageIndex],
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        subresource_range,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    // Prepare ray tracing output image as transfer source
+    Tools::setImageLayout(
+        cmdBuffer,
+        storageImage.image,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        subresource_range,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    //OptixImage2D imgOut;
+    //ConvertVulkan2Optix(storageImage.image, imgOut, cmdBuffer);
+
+    // Upscale the trace resolution to the swap chain, a plain copy when both match
+    VkImageBlit blitRegion{};
+    blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blitRegion.srcOffsets[1] = { static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1 };
+    blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blitRegion.dstOffsets[1] = { static_cast<int32_t>(swapChain.extent.width), static_cast<int32_t>(swapChain.extent.height), 1 };
+    vkCmdBlitImage(cmdBuffer, storageImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChain.images[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, upscaleFilter);
+
+    // Transition swap chain image back for presentation
+    Tools::setImageLayout(
+        cmdBuffer,
+        swapChain.images[imageIndex],
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        subresource_range,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    // Transition ray tracing output image back to general layout
+    Tools::setImageLayout(
+        cmdBuffer,
+        storageImage.image,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_LAYOUT_GENERAL,
+        subresource_range,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, frame.timestampQuery + 1);
+
+    CHECK_ERROR(vkEndCommandBuffer(cmdBuffer));
+}
+
+void VContext::recordTrace(VkCommandBuffer cmdBuffer, const FrameData& frame) const
+{
+    /*
+        Update the TLAS, unless the async compute queue already did
+    */
+    if (!useAsyncCompute)
+    {
+        recordTopLevelBuild(cmdBuffer, frame);
+
+        VkMemoryBarrier memoryBarrier = Initializers::memoryBarrier();
+        memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+        memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    /*
+        Dispatch the ray tracing commands, as one megakernel or as the wavefront stages
+    */
+    if (wavefrontEnabled)
+        recordWavefront(cmdBuffer, frame);
+    else
+    {
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, RpipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+
+        //Interleaved tracing launches one ray generation per traced pixel, the shaders map it to its pixel
+        uint32_t launchWidth = renderExtent.width;
+        uint32_t launchHeight = renderExtent.height;
+        GetInterleavedLaunchSize(interleaveMode, launchWidth, launchHeight);
+
+        //Visibility pass first, the megakernel reads its hits back instead of tracing the camera rays
+        if (visibilityBuffer)
+        {
+            const VkBuffer sbt = visibilityPipeline.shaderBindingTable.buffer;
+            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, visibilityPipeline.pipeline);
+            vkCmdTraceRaysNV(cmdBuffer,
+                sbt, VISIBILITY_GROUP_RAYGEN * visibilitySbtStride,
+                sbt, VISIBILITY_GROUP_MISS * visibilitySbtStride, visibilitySbtStride,
+                sbt, VISIBILITY_GROUP_CLOSEST_HIT * visibilitySbtStride, visibilitySbtStride,
+                nullptr, 0, 0,
+                launchWidth, launchHeight, 1);
+
+            VkMemoryBarrier visibilityBarrier = Initializers::memoryBarrier();
+            visibilityBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            visibilityBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &visibilityBarrier, 0, nullptr, 0, nullptr);
+        }
+
+        const RayTracingPipeline& rayTracingPipeline = rayTracingPipelines[static_cast<uint32_t>(qualityPreset)];
+        const VkBuffer shaderBindingTable = rayTracingPipeline.shaderBindingTable.buffer;
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rayTracingPipeline.pipeline);
 
         // Calculate shader binding offsets, which is pretty straight forward in our example 
         const VkDeviceSize bindingOffsetRayGenShader = rayTracingProperties.shaderGroupHandleSize * INDEX_RAYGEN;
@@ -2339,74 +3701,254 @@ void VContext::buildCommandbuffers()
         const VkDeviceSize bindingOffsetHitShader = rayTracingProperties.shaderGroupHandleSize * INDEX_CLOSEST_HIT;
         const VkDeviceSize bindingStride = rayTracingProperties.shaderGroupHandleSize;
 
-        vkCmdTraceRaysNV(commandBuffers[i],
-            mShaderBindingTable.buffer, bindingOffsetRayGenShader,
-            mShaderBindingTable.buffer, bindingOffsetMissShader, bindingStride,
-            mShaderBindingTable.buffer, bindingOffsetHitShader, bindingStride,
+        vkCmdTraceRaysNV(cmdBuffer,
+            shaderBindingTable, bindingOffsetRayGenShader,
+            shaderBindingTable, bindingOffsetMissShader, bindingStride,
+            shaderBindingTable, bindingOffsetHitShader, bindingStride,
             nullptr, 0, 0,
-            WIDTH, HEIGHT, 1);
+            launchWidth, launchHeight, 1);
 
-        //DenoiseImage();
+        if (temporalReprojection)
+            recordTemporalReprojection(cmdBuffer, frame);
+        //A restart leaves the skipped pixels with the previous view, they are rebuilt before anything reads them
+        if (interleaveMode != InterleaveMode::Off && uniformData.data.y == 0)
+            recordInterleaveReconstruction(cmdBuffer, frame);
+    }
+}
 
-        /*
-            Copy raytracing output to swap chain image
-        */
+void VContext::recordTemporalReprojection(VkCommandBuffer cmdBuffer, const FrameData& frame) const
+{
+    VkMemoryBarrier traceBarrier = Initializers::memoryBarrier();
+    traceBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    traceBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &traceBarrier, 0, nullptr, 0, nullptr);
+
+    //Every frame stores its history, only a frame restarted by motion blends the previous one in and copies it back
+    TemporalConstants constants{ temporalClampGamma, temporalHistoryLimit, static_cast<uint32_t>(frameNumber), 0, temporalReuse ? 1u : 0u, static_cast<uint32_t>(interleaveMode) };
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, temporalPipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, temporalPipelineLayout, 0, 1, &frame.temporalDescriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, temporalPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalConstants), &constants);
+    vkCmdDispatch(cmdBuffer, (renderExtent.width + 7) / 8, (renderExtent.height + 7) / 8, 1);
+
+    if (!temporalReuse)
+        return;
+
+    VkMemoryBarrier blendBarrier = Initializers::memoryBarrier();
+    blendBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    blendBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &blendBarrier, 0, nullptr, 0, nullptr);
+
+    constants.pass = 1;
+    vkCmdPushConstants(cmdBuffer, temporalPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalConstants), &constants);
+    vkCmdDispatch(cmdBuffer, (renderExtent.width + 7) / 8, (renderExtent.height + 7) / 8, 1);
+}
+
+void VContext::recordInterleaveReconstruction(VkCommandBuffer cmdBuffer, const FrameData& frame) const
+{
+    //Reads the traced pixels once the ray tracing pass, and the reprojection when it ran, are done with them
+    VkMemoryBarrier traceBarrier = Initializers::memoryBarrier();
+    traceBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    traceBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &traceBarrier, 0, nullptr, 0, nullptr);
+
+    //Without the reprojection there is no history to blend, the skipped pixels only get the spatial estimate
+    const TemporalConstants constants{ temporalClampGamma, temporalHistoryLimit, static_cast<uint32_t>(frameNumber), 0, temporalReuse ? 1u : 0u, static_cast<uint32_t>(interleaveMode) };
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reconstructPipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, temporalPipelineLayout, 0, 1, &frame.temporalDescriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, temporalPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalConstants), &constants);
+    vkCmdDispatch(cmdBuffer, (renderExtent.width + 7) / 8, (renderExtent.height + 7) / 8, 1);
+}
+
+void VContext::recordDenoiseTrace(const FrameData& frame) const
+{
+    VkCommandBufferBeginInfo cmdBufInfo = Initializers::commandBufferBeginInfo();
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    const VkCommandBuffer cmdBuffer = frame.denoiseCommandBuffer;
+
+    CHECK_ERROR(vkResetCommandBuffer(cmdBuffer, 0));
+    CHECK_ERROR(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
+
+    vkCmdResetQueryPool(cmdBuffer, timestampPool, frame.timestampQuery, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, frame.timestampQuery);
+
+    // The wavefront stages don't write the guides, the denoiser only has the radiance to go on
+    if (wavefrontEnabled)
+    {
+        const VkClearColorValue clearValue{};
+        const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdClearColorImage(cmdBuffer, guideImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &range);
+    }
+
+    recordTrace(cmdBuffer, frame);
+
+    VkMemoryBarrier traceBarrier = Initializers::memoryBarrier();
+    traceBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    traceBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &traceBarrier, 0, nullptr, 0, nullptr);
+
+    // Accumulation, moments and guides, packed one after the other in the readback buffer
+    const VkDeviceSize pixelCount = static_cast<VkDeviceSize>(renderExtent.width) * renderExtent.height;
+    VkBufferImageCopy copyRegion{};
+    copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    copyRegion.imageExtent = { renderExtent.width, renderExtent.height, 1 };
+    vkCmdCopyImageToBuffer(cmdBuffer, accImage.image, VK_IMAGE_LAYOUT_GENERAL, denoiseReadback.buffer, 1, &copyRegion);
+    copyRegion.bufferOffset = pixelCount * sizeof(glm::vec4);
+    vkCmdCopyImageToBuffer(cmdBuffer, momentsImage.image, VK_IMAGE_LAYOUT_GENERAL, denoiseReadback.buffer, 1, &copyRegion);
+    copyRegion.bufferOffset = pixelCount * (sizeof(glm::vec4) + sizeof(float));
+    vkCmdCopyImageToBuffer(cmdBuffer, guideImage.image, VK_IMAGE_LAYOUT_GENERAL, denoiseReadback.buffer, 1, &copyRegion);
+
+    VkMemoryBarrier readbackBarrier = Initializers::memoryBarrier();
+    readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &readbackBarrier, 0, nullptr, 0, nullptr);
+
+    CHECK_ERROR(vkEndCommandBuffer(cmdBuffer));
+}
+
+void VContext::runDenoiser()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    const size_t pixelCount = static_cast<size_t>(renderExtent.width) * renderExtent.height;
+    const auto* accumulation = static_cast<const glm::vec4*>(denoiseReadback.mapped);
+    const auto* moments = reinterpret_cast<const float*>(accumulation + pixelCount);
+    const auto* guides = reinterpret_cast<const glm::uvec4*>(moments + pixelCount);
+    denoiseVariance.resize(pixelCount);
+    denoiseGuides.resize(pixelCount);
+    denoiseAlbedo.resize(pixelCount);
+
+    jobSystem.ParallelFor(renderExtent.height, 0, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin * renderExtent.width; i < end * renderExtent.width; ++i)
+        {
+            //Variance of the accumulated mean, left to the denoiser while a single sample can't tell
+            const float samples = accumulation[i].a;
+            const float luminance = glm::dot(glm::vec3(accumulation[i]), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+            denoiseVariance[i] = samples >= 2.0f ? std::max(0.0f, moments[i] - luminance * luminance) / samples : -1.0f;
+
+            const glm::uvec4& guide = guides[i];
+            denoiseGuides[i] = glm::vec4(glm::vec3(glm::unpackSnorm4x8(guide.y)), glm::uintBitsToFloat(guide.x));
+            denoiseAlbedo[i] = glm::unpackUnorm4x8(guide.z);
+        }
+    });
+
+    VDenoiser::Frame input;
+    input.width = renderExtent.width;
+    input.height = renderExtent.height;
+    input.color = accumulation;
+    input.variance = denoiseVariance.data();
+    input.normalDepth = denoiseGuides.data();
+    input.albedo = denoiseAlbedo.data();
+    denoiser.Denoise(input, static_cast<glm::vec4*>(denoiseUpload.mapped));
+
+    denoiseTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void VContext::recordWavefront(VkCommandBuffer cmdBuffer, const FrameData& frame) const
+{
+    const QualitySettings settings = GetQualitySettings(qualityPreset);
+    WavefrontConstants constants{};
+    constants.maxBounces = static_cast<uint32_t>(settings.maxBounces);
+    constants.pathCount = renderExtent.width * renderExtent.height;
+    constants.width = renderExtent.width;
+    constants.softShadows = settings.enableSoftShadows;
+    constants.reflections = settings.enableReflections;
+
+    const std::array<VkDescriptorSet, 2> descriptorSets = { frame.descriptorSet, frame.wavefrontDescriptorSet };
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, wavefrontPipelineLayout, 0, 2, descriptorSets.data(), 0, nullptr);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontPipelineLayout, 0, 2, descriptorSets.data(), 0, nullptr);
+
+    //Every stage reads the queues written by the previous one, the indirect dispatches read the groups sized from them
+    const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV
+                                        | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    const auto stageBarrier = [cmdBuffer, stages]()
+    {
+        VkMemoryBarrier barrier = Initializers::memoryBarrier();
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, stages, stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    };
+    const auto pushConstants = [this, cmdBuffer, &constants]()
+    {
+        vkCmdPushConstants(cmdBuffer, wavefrontPipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(WavefrontConstants), &constants);
+    };
+    //The ray stages always launch one lane per pixel: VK_NV_ray_tracing has no indirect trace, so only the compute
+    //stages shrink with the queues. The lanes past the queue size return before tracing
+    const auto traceRays = [this, cmdBuffer](uint32_t raygenGroup)
+    {
+        const VkBuffer sbt = wavefrontRayPipeline.shaderBindingTable.buffer;
+        vkCmdTraceRaysNV(cmdBuffer,
+            sbt, wavefrontSbtStride * raygenGroup,
+            sbt, wavefrontSbtStride * WAVEFRONT_GROUP_MISS, wavefrontSbtStride,
+            sbt, wavefrontSbtStride * WAVEFRONT_GROUP_CLOSEST_HIT, wavefrontSbtStride,
+            nullptr, 0, 0,
+            renderExtent.width, renderExtent.height, 1);
+    };
+
+    //The queue sizes stay on the GPU: the camera stage covers every path, the compute stages of a bounce are sized from
+    //its queue by wavefront_args.comp and dispatched indirectly
+    const uint32_t pathGroups = VWavefrontShader::WavefrontGroupCount(constants.pathCount);
+    const VkBuffer counters = wavefrontBuffers.counters.buffer;
+    const VkBuffer dispatchArgs = wavefrontBuffers.dispatchArgs.buffer;
+
+    /*
+        Camera stage: every pixel starts a path and queues its camera ray
+    */
+    vkCmdFillBuffer(cmdBuffer, counters, 0, sizeof(WavefrontCounters), 0);
+    stageBarrier();
+    pushConstants();
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontCameraPipeline);
+    vkCmdDispatch(cmdBuffer, pathGroups, 1, 1);
+
+    for (uint32_t bounce = 0; bounce <= constants.maxBounces; ++bounce)
+    {
+        //Clear the queue of the next bounce, the shadow rays and the bins
+        const uint32_t next = (bounce + 1) & 1u;
+        vkCmdFillBuffer(cmdBuffer, counters, offsetof(WavefrontCounters, rays) + next * sizeof(uint32_t), sizeof(uint32_t), 0);
+        vkCmdFillBuffer(cmdBuffer, counters, offsetof(WavefrontCounters, shadowRays), sizeof(WavefrontCounters) - offsetof(WavefrontCounters, shadowRays), 0);
+        stageBarrier();
+
+        constants.bounce = bounce;
+        pushConstants();
+
+        //The queue of the bounce is complete (camera or previous shading stage), size the compute stages to it. The
+        //barrier after the extension stage makes the groups visible to the indirect dispatches
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontArgsPipeline);
+        vkCmdDispatch(cmdBuffer, 1, 1, 1);
+
+        //Extension stage: closest hit of the queued paths
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, wavefrontRayPipeline.pipeline);
+        traceRays(WAVEFRONT_GROUP_EXTEND);
+        stageBarrier();
+
+        //Sort the paths by bin so neighbouring lanes shade the same material
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontBinCountPipeline);
+        vkCmdDispatchIndirect(cmdBuffer, dispatchArgs, 0);
+        stageBarrier();
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontBinScatterPipeline);
+        vkCmdDispatchIndirect(cmdBuffer, dispatchArgs, 0);
+        stageBarrier();
+
+        //Shading stage: queues the shadow rays and the extension rays of the next bounce
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontShadePipeline);
+        vkCmdDispatchIndirect(cmdBuffer, dispatchArgs, 0);
+        stageBarrier();
+
+        //Shadow stage
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, wavefrontRayPipeline.pipeline);
+        traceRays(WAVEFRONT_GROUP_SHADOW);
+        stageBarrier();
+    }
+
+    /*
+        Add the radiance of the paths to the running averages
+    */
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontAccumulatePipeline);
+    vkCmdDispatch(cmdBuffer, (renderExtent.width + 7) / 8, (renderExtent.height + 7) / 8, 1);
+}
 
-        // Prepare current swapchain image as transfer destination
-        Tools::setImageLayout(
-            commandBuffers[i],
-            swapChain.images[i],
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            subresource_range,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-        // Prepare ray tracing output image as transfer source
-        Tools::setImageLayout(
-            commandBuffers[i],
-            storageImage.image,
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            subresource_range,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-        //OptixImage2D imgOut;
-        //ConvertVulkan2Optix(storageImage.image, imgOut, commandBuffers[i]);
-
-        VkImageCopy copyRegion{};
-        copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-        copyRegion.srcOffset = { 0, 0, 0 };
-        copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-        copyRegion.dstOffset = { 0, 0, 0 };
-        copyRegion.extent = { WIDTH, HEIGHT, 1 };
-        vkCmdCopyImage(commandBuffers[i], storageImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChain.images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-        // Transition swap chain image back for presentation
-        Tools::setImageLayout(
-            commandBuffers[i],
-            swapChain.images[i],
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-            subresource_range,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-        // Transition ray tracing output image back to general layout
-        Tools::setImageLayout(
-            commandBuffers[i],
-            storageImage.image,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-        CHECK_ERROR(vkEndCommandBuffer(commandBuffers[i]));
-    }
-}
-
-void VContext::setupRayTracingSupport(std::vector<VObject>& objects, std::vector<int>& trianglesNumber)
+void VContext::setupRayTracingSupport(std::vector<VObject>& objects, const std::vector<VLight>& lights, std::vector<int>& trianglesNumber)
 {
     // Query the ray tracing properties of the current implementation, we will need them later on
     rayTracingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PROPERTIES_NV;
@@ -2415,62 +3957,50 @@ void VContext::setupRayTracingSupport(std::vector<VObject>& objects, std::vector
     deviceProps2.pNext = &rayTracingProperties;
     vkGetPhysicalDeviceProperties2(device.physicalDevice, &deviceProps2);
 
-    VkSemaphoreCreateInfo semaphoreCreateInfo = Initializers::semaphoreCreateInfo();
-    // Create a semaphore used to synchronize image presentation
-    // Ensures that the image is displayed before we start submitting new commands to the queu
-    CHECK_ERROR(vkCreateSemaphore(device.logicalDevice, &semaphoreCreateInfo, nullptr, &semaphores.presentComplete));
-    // Create a semaphore used to synchronize command submission
-    // Ensures that the image is not presented until all commands have been sumbitted and executed
-    CHECK_ERROR(vkCreateSemaphore(device.logicalDevice, &semaphoreCreateInfo, nullptr, &semaphores.renderComplete));
-
     camera.setPosition(glm::vec3(0, -6, -2));
-    camera.setPerspective(80, static_cast<float>(WIDTH) / static_cast<float>(HEIGHT), 0.1, 1024);
+    camera.setPerspective(80, static_cast<float>(swapChain.extent.width) / static_cast<float>(swapChain.extent.height), 0.1, 1024);
     camera.Pitch = 25;
     camera.Yaw = 90;
     uniformData.data.x = camera.sample;
-    uniformData.data.y = 1;
-    // Set up submit info structure
-    // Semaphores will stay the same during application lifetime
-    // Command buffer submission info is set by each example
-    submitInfo = Initializers::submitInfo();
-    submitInfo.pWaitDstStageMask = &submitPipelineStages;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &semaphores.presentComplete;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &semaphores.renderComplete;
-
-    createScene(objects);
-    CreateStorageImage();
-
-    std::vector<float> mat;
+    uniformData.data.y = 0;
 
-    for(auto obj : objects)
+    //The shaders need at least one light, a scene without any gets the default sun
+    sceneLights = lights;
+    if (sceneLights.empty())
     {
-        trianglesNumber.push_back(obj.m_mesh.GetVertices().size() / 3);
-        std::cout << "NUMBER OF TRIANGLES: " << obj.m_mesh.GetVertices().size() / 3
-                  << " INSTANCE ID: " << obj.m_mesh.meshGeometry.instanceId << '\n';
+        VLight sun;
+        sun.SetPosition({ 0, -200, -1200 });
+        sun.SetRadius(100);
+        sun.SetIntensity(1.5e6f);
+        sceneLights.push_back(sun);
+    }
+    std::cout << "LIGHTS: " << sceneLights.size() << '\n';
+
+    //Many lights are picked through the tree, it only depends on the lights so it is built once
+    std::vector<VLightData> lightData;
+    lightData.reserve(sceneLights.size());
+    for (const VLight& light : sceneLights)
+        lightData.push_back(light.data);
+    const auto bvhStart = std::chrono::high_resolution_clock::now();
+    lightBvh.Build(lightData, jobSystem);
+    const float bvhTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - bvhStart).count();
+    std::cout << "LIGHT BVH: " << lightBvh.GetNodeCount() << " NODES IN " << bvhTime << " MS\n";
+    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &lightBvhBuffer,
+        lightBvh.GetNodeCount() * sizeof(VLightBvhNode),
+        const_cast<VLightBvhNode*>(lightBvh.GetNodes().data())));
+    lightSampler = sceneLights.size() >= LIGHT_BVH_MIN_LIGHTS ? LightSampler::Bvh : LightSampler::AliasTable;
 
-        for(auto vertex : obj.m_mesh.GetVertices())
-        {
-            bufferVertices.push_back(vertex.pos.x);
-            bufferVertices.push_back(vertex.pos.y);
-           // bufferVertices.push_back(vertex.pos.z);
-            bufferVertices.push_back(vertex.pos.z);
-            bufferVertices.push_back(obj.m_mesh.meshGeometry.instanceId);
-            bufferVertices.push_back(vertex.normal.x);
-            bufferVertices.push_back(vertex.normal.y);
-            bufferVertices.push_back(vertex.normal.z);
-            bufferVertices.push_back(0);
-        }
+    createScene(objects);
+    resizeRenderTargets();
 
-        mat.push_back(obj.m_material.colorAndRoughness.x);
-        mat.push_back(obj.m_material.colorAndRoughness.y);
-        mat.push_back(obj.m_material.colorAndRoughness.z);
-        mat.push_back(obj.m_material.colorAndRoughness.w);
-        mat.push_back(obj.m_material.ior.x);
-        mat.push_back(obj.m_material.ior.y);
-        mat.push_back(obj.m_material.ior.z);
-        mat.push_back(obj.m_material.ior.w);
+    for(auto& obj : objects)
+    {
+        const uint32_t instance = obj.m_mesh.meshGeometry.instanceId;
+        trianglesNumber.push_back(static_cast<int>(sceneTable.GetPrimitiveCount(instance)));
+        std::cout << "NUMBER OF TRIANGLES: " << sceneTable.GetPrimitiveCount(instance)
+                  << " INSTANCE ID: " << instance << '\n';
     }
     t.push_back(1.0f);
     CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
@@ -2479,71 +4009,272 @@ void VContext::setupRayTracingSupport(std::vector<VObject>& objects, std::vector
         t.size() * sizeof(float),
         t.data()));
 
+    //Built once at startup, the tile only depends on its seed
+    const std::vector<uint32_t> blueNoise = VSampler::GenerateBlueNoiseTile();
     CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &matBuffer,
-        mat.size() * sizeof(float),
-        mat.data()));
-
-    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &vertBuffer,
-        bufferVertices.size() * sizeof(float),
-        bufferVertices.data()));
-    
-    CHECK_ERROR(createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &NumberOfTriangles,
-        trianglesNumber.size() * sizeof(int),
-        trianglesNumber.data()));
+        &blueNoiseBuffer,
+        blueNoise.size() * sizeof(uint32_t),
+        blueNoise.data()));
 
     //CHECK_ERROR(ubo.map());
 
     createUniformBuffer();
     createRayTracingPipeline();
+    createTonemapPipeline();
+    createAdaptiveSamplingPipeline();
+    createTemporalPipeline();
     createShaderBindingTable();
+    createWavefrontPipelines();
+    createVisibilityPipeline();
 
 
     createDescriptorSets();
 }
 
-void VContext::prepareFrame()
+VkResult VContext::prepareFrame(const FrameData& frame)
 {
     // Acquire the next image from the swap chain
-    const VkResult result = acquireNextImage(semaphores.presentComplete, &currentBuffer);
-    // Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
-    if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR))
+    const VkResult result = acquireNextImage(frame.semaphores.presentComplete, &currentBuffer);
+    // Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE), no image was acquired so the frame is skipped.
+    // A SUBOPTIMAL swap chain still acquired the image, it is recreated after presenting
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
-        //windowResize();
+        windowResize();
     }
-    else
+    else if (result != VK_SUBOPTIMAL_KHR)
     {
         CHECK_ERROR(result);
     }
+    return result;
 }
-void VContext::submitFrame() const
+void VContext::submitFrame(const FrameData& frame)
 {
-    const VkResult result = queuePresent(graphicsQueue, currentBuffer, semaphores.renderComplete);
-    if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR)))
+    const VkResult result = queuePresent(graphicsQueue, currentBuffer, frame.semaphores.renderComplete);
+    if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR) || framebufferResized)
     {
-        if (result == VK_ERROR_OUT_OF_DATE_KHR)
-        {
-            // Swap chain is no longer compatible with the surface and needs to be recreated
-            //windowResize();
-            return;
-        }
-        CHECK_ERROR(result);
+        // Swap chain is no longer compatible with the surface and needs to be recreated
+        windowResize();
+        return;
+    }
+    CHECK_ERROR(result);
+}
+
+void VContext::windowResize()
+{
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
+    // A minimized window has no surface to present to, wait until it is restored
+    while (width == 0 || height == 0)
+    {
+        glfwWaitEvents();
+        glfwGetFramebufferSize(window, &width, &height);
+    }
+    framebufferResized = false;
+
+    // Swap chain images can still be used by frames in flight
+    CHECK_ERROR(vkDeviceWaitIdle(device.logicalDevice));
+
+    setupSwapChain(static_cast<uint32_t>(width), static_cast<uint32_t>(height), false);
+    imagesInFlight.assign(swapChain.imageCount, VK_NULL_HANDLE);
+
+    for (auto frame_buffer : swapChainFramebuffers)
+        vkDestroyFramebuffer(device.logicalDevice, frame_buffer, nullptr);
+    vkDestroyImageView(device.logicalDevice, depthStencil.view, nullptr);
+    vkDestroyImage(device.logicalDevice, depthStencil.image, nullptr);
+    vkFreeMemory(device.logicalDevice, depthStencil.mem, nullptr);
+    setupDepthstencil();
+    setupFrameBuffer();
+
+    camera.updateAspectRatio(static_cast<float>(swapChain.extent.width) / static_cast<float>(swapChain.extent.height));
+    resizeRenderTargets();
+}
+
+void VContext::resizeRenderTargets()
+{
+    renderExtent.width = resolutionController.Scale(swapChain.extent.width);
+    renderExtent.height = resolutionController.Scale(swapChain.extent.height);
+
+    // The previous targets are still used by the frames in flight
+    if (storageImage.image != VK_NULL_HANDLE)
+    {
+        DestroyDeferred(storageImage);
+        DestroyDeferred(accImage);
+        DestroyDeferred(momentsImage);
+        DestroyDeferred(sampleMapImage);
+        DestroyDeferred(visibilityImage);
+        DestroyDeferred(guideImage);
+        DestroyDeferred(denoisedImage);
+        DestroyDeferred(motionImage);
+        DestroyDeferred(temporalBuffer);
+        DestroyDeferred(reservoirBuffer);
     }
-    CHECK_ERROR(vkQueueWaitIdle(graphicsQueue));
+    CreateStorageImage();
+    if (wavefrontEnabled)
+    {
+        destroyWavefrontBuffers();
+        createWavefrontBuffers();
+    }
+    if (denoiserEnabled)
+    {
+        destroyDenoiserBuffers();
+        createDenoiserBuffers();
+    }
+
+    // Descriptor sets are rewritten when their frame slot is reused
+    targetsVersion++;
+
+    // Accumulated samples and their history belong to the previous resolution. The restart doesn't count as a frame:
+    // the next one still writes sample 0 over the cleared targets
+    temporalHistory = false;
+    updateUniformBuffers(false);
+    accumulationFrame = 0;
+}
+
+void VContext::FramebufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+    auto context = static_cast<VContext*>(glfwGetWindowUserPointer(window));
+    context->framebufferResized = true;
 }
 
 void VContext::draw()
 {
-    prepareFrame();
+    FrameData& frame = frames[currentFrame];
+
+    // Only wait if the GPU is still working on the last frame submitted from this slot,
+    // the time spent here is the CPU wait of the frame
+    const auto waitStart = std::chrono::high_resolution_clock::now();
+    CHECK_ERROR(vkWaitForFences(device.logicalDevice, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+
+    // Frames are submitted in order to a single queue, so every frame up to this one has completed
+    if (frame.frameValue > completedFrame)
+        completedFrame = frame.frameValue;
+    deletionQueue.Collect(completedFrame);
+
+    // GPU time of the last frame submitted from this slot drives the trace resolution
+    if (frame.frameValue > 0 && timestampPool != VK_NULL_HANDLE)
+    {
+        uint64_t timestamps[2] = {};
+        if (vkGetQueryPoolResults(device.logicalDevice, timestampPool, frame.timestampQuery, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        {
+            gpuFrameTime = static_cast<float>(timestamps[1] - timestamps[0]) * device.properties.limits.timestampPeriod / 1000000.0f;
+            if (resolutionController.Update(gpuFrameTime))
+                resizeRenderTargets();
+        }
+    }
+
+    // Statistics of the adaptive sampling pass of the last frame submitted from this slot, cleared for the next one
+    if (frame.frameValue > 0)
+    {
+        auto* stats = static_cast<AdaptiveSamplingStats*>(frame.adaptiveStats.mapped);
+        if (stats->tileCount > 0)
+        {
+            adaptiveRayRatio = static_cast<float>(stats->samples) / static_cast<float>(renderExtent.width * renderExtent.height);
+            adaptiveError = static_cast<float>(stats->errorSum) / (1024.0f * static_cast<float>(stats->tileCount));
+        }
+        *stats = AdaptiveSamplingStats{};
+    }
+
+    // Render targets changed since this slot last used its descriptor set
+    if (frame.targetsVersion != targetsVersion)
+        writeDescriptorSet(frame);
+
+    if (prepareFrame(frame) == VK_ERROR_OUT_OF_DATE_KHR)
+        return;
+
+    // The acquired image can still be in use by a frame submitted from another slot
+    if (imagesInFlight[currentBuffer] != VK_NULL_HANDLE && imagesInFlight[currentBuffer] != frame.fence)
+        CHECK_ERROR(vkWaitForFences(device.logicalDevice, 1, &imagesInFlight[currentBuffer], VK_TRUE, UINT64_MAX));
+    imagesInFlight[currentBuffer] = frame.fence;
+
+    cpuWaitTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+
+    // Upload the uniform data and instances of this frame, the GPU is done with this slot
+    memcpy(frame.ubo.mapped, &uniformData, sizeof(uniformData));
+    memcpy(frame.lightBuffer.mapped, lightTable.GetLights().data(), sizeof(VLightData) * lightTable.GetLightCount());
+    memcpy(frame.lightAliasBuffer.mapped, lightTable.GetAliasTable().data(), sizeof(VLightTable::AliasEntry) * lightTable.GetLightCount());
+    if (frame.instanceCapacity != sceneInstances.size())
+        createFrameTopLevel(frame, static_cast<uint32_t>(sceneInstances.size()));
+    memcpy(frame.instanceBuffer.mapped, sceneInstances.data(), sizeof(GeometryInstance) * sceneInstances.size());
+
+    // Transforms of the last frame drawn, the ray tracing pass moves the hits of moving objects back with them
+    if (previousTransforms.size() != sceneInstances.size())
+    {
+        previousTransforms.resize(sceneInstances.size());
+        for (size_t i = 0; i < sceneInstances.size(); ++i)
+            previousTransforms[i] = sceneInstances[i].transform;
+    }
+    memcpy(frame.previousTransformBuffer.mapped, previousTransforms.data(), sizeof(glm::mat3x4) * previousTransforms.size());
+    for (size_t i = 0; i < sceneInstances.size(); ++i)
+        previousTransforms[i] = sceneInstances[i].transform;
+
+    std::vector<VkSemaphore> waitSemaphores = { frame.semaphores.presentComplete };
+    std::vector<VkPipelineStageFlags> waitStages = { submitPipelineStages };
+
+    if (useAsyncCompute)
+    {
+        // The build runs on the compute queue while the graphics queue finishes the previous frame
+        VkCommandBufferBeginInfo cmdBufInfo = Initializers::commandBufferBeginInfo();
+        cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        CHECK_ERROR(vkResetCommandBuffer(frame.computeCommandBuffer, 0));
+        CHECK_ERROR(vkBeginCommandBuffer(frame.computeCommandBuffer, &cmdBufInfo));
+        recordTopLevelBuild(frame.computeCommandBuffer, frame);
+        CHECK_ERROR(vkEndCommandBuffer(frame.computeCommandBuffer));
+
+        VkSubmitInfo computeSubmitInfo = Initializers::submitInfo();
+        computeSubmitInfo.commandBufferCount = 1;
+        computeSubmitInfo.pCommandBuffers = &frame.computeCommandBuffer;
+        computeSubmitInfo.signalSemaphoreCount = 1;
+        computeSubmitInfo.pSignalSemaphores = &frame.asBuildComplete;
+        CHECK_ERROR(vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+
+        // Acceleration structures have no sharing mode in VK_NV_ray_tracing and the instance buffer is concurrent, the
+        // semaphore is the only dependency needed
+        waitSemaphores.push_back(frame.asBuildComplete);
+        waitStages.push_back(VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV);
+    }
+
+    if (denoiserEnabled)
+    {
+        // The trace is submitted and waited for first, the CPU filters its result before the rest of the frame is recorded.
+        // It only waits for the TLAS build, the swap chain image is not touched until the second submission
+        recordDenoiseTrace(frame);
+
+        VkSubmitInfo traceSubmitInfo = Initializers::submitInfo();
+        traceSubmitInfo.pWaitDstStageMask = waitStages.data() + 1;
+        traceSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size() - 1);
+        traceSubmitInfo.pWaitSemaphores = waitSemaphores.data() + 1;
+        traceSubmitInfo.commandBufferCount = 1;
+        traceSubmitInfo.pCommandBuffers = &frame.denoiseCommandBuffer;
+
+        CHECK_ERROR(vkResetFences(device.logicalDevice, 1, &frame.fence));
+        CHECK_ERROR(vkQueueSubmit(graphicsQueue, 1, &traceSubmitInfo, frame.fence));
+        CHECK_ERROR(vkWaitForFences(device.logicalDevice, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+
+        runDenoiser();
+        waitSemaphores.resize(1);
+        waitStages.resize(1);
+    }
+
+    recordCommandBuffer(frame, currentBuffer);
+
+    VkSubmitInfo submitInfo = Initializers::submitInfo();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &frame.semaphores.renderComplete;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentBuffer];
-    CHECK_ERROR(vkQueueSubmit(graphicsQueue, 1, &submitInfo, nullptr));
-    submitFrame();
+    submitInfo.pCommandBuffers = &frame.commandBuffer;
+
+    CHECK_ERROR(vkResetFences(device.logicalDevice, 1, &frame.fence));
+    CHECK_ERROR(vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.fence));
+    frame.frameValue = frameNumber++;
+
+    submitFrame(frame);
+
+    currentFrame = (currentFrame + 1) % framesInFlight;
 }
 
 #pragma endregion
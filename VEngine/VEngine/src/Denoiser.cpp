@@ -0,0 +1,280 @@
+#include <VDenoiser.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DENOISER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const glm::vec3 LUMINANCE(0.2126f, 0.7152f, 0.0722f);
+    //B3 spline, the 5x5 kernel of every wavelet pass is its outer product
+    constexpr float KERNEL[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+    //Frames of history below which the variance is estimated spatially
+    constexpr float MIN_HISTORY = 4.0f;
+
+    /**
+    * Weighted sum of the taps of a pixel: the radiance is weighted by w and its variance by w², so both go
+    * through a single 4 wide multiply-add per tap
+    */
+    struct TapSum
+    {
+#ifdef DENOISER_SSE
+        __m128 sum = _mm_setzero_ps();
+#else
+        glm::vec4 sum{ 0.0f };
+#endif
+        float weight = 0.0f;
+
+        void Add(const glm::vec4& value, float w)
+        {
+#ifdef DENOISER_SSE
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set_ps(w * w, w, w, w), _mm_loadu_ps(&value.x)));
+#else
+            sum += glm::vec4(w, w, w, w * w) * value;
+#endif
+            weight += w;
+        }
+
+        glm::vec4 Resolve() const
+        {
+            glm::vec4 result;
+#ifdef DENOISER_SSE
+            _mm_storeu_ps(&result.x, sum);
+#else
+            result = sum;
+#endif
+            return result / glm::vec4(weight, weight, weight, weight * weight);
+        }
+    };
+
+    //Same surface test for the history and the spatial variance: both empty, or close depth and normal
+    bool SameSurface(const glm::vec4& a, const glm::vec4& b)
+    {
+        if (a.w <= 0.0f || b.w <= 0.0f)
+            return a.w <= 0.0f && b.w <= 0.0f;
+        return std::fabs(a.w - b.w) < 0.1f * a.w && glm::dot(glm::vec3(a), glm::vec3(b)) > 0.9f;
+    }
+}
+
+void VDenoiser::Reset()
+{
+    std::fill(m_moments.begin(), m_moments.end(), glm::vec3(0.0f));
+}
+
+void VDenoiser::Denoise(const Frame& frame, glm::vec4* output)
+{
+    Prepare(frame);
+
+    uint32_t source = 1;
+    for (uint32_t i = 0; i < settings.iterations; ++i)
+    {
+        Filter(1u << i, source);
+        source ^= 1u;
+    }
+
+    //Put the albedo back on the filtered lighting
+    const std::vector<glm::vec4>& result = m_work[source];
+    m_jobSystem.ParallelFor(m_height, 0, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin * m_width; i < end * m_width; ++i)
+            output[i] = glm::vec4(glm::vec3(result[i]) * m_albedo[i], 1.0f);
+    });
+
+    m_previousGuides.swap(m_guides);
+}
+
+void VDenoiser::Prepare(const Frame& frame)
+{
+    if (frame.width != m_width || frame.height != m_height)
+    {
+        //No history matches a new resolution
+        m_width = frame.width;
+        m_height = frame.height;
+        const size_t pixelCount = static_cast<size_t>(m_width) * m_height;
+        m_guides.assign(pixelCount, glm::vec4(0.0f));
+        m_previousGuides.assign(pixelCount, glm::vec4(0.0f));
+        m_depthGradients.assign(pixelCount, 0.0f);
+        m_albedo.assign(pixelCount, glm::vec3(1.0f));
+        m_work[0].assign(pixelCount, glm::vec4(0.0f));
+        m_work[1].assign(pixelCount, glm::vec4(0.0f));
+        m_moments.assign(pixelCount, glm::vec3(0.0f));
+    }
+
+    //Guides, demodulated radiance and temporal variance
+    m_jobSystem.ParallelFor(m_height, 0, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin * m_width; i < end * m_width; ++i)
+        {
+            glm::vec4 guide = frame.normalDepth ? frame.normalDepth[i] : glm::vec4(0.0f);
+            const float normalLength = glm::length(glm::vec3(guide));
+            guide = normalLength > 0.0f ? glm::vec4(glm::vec3(guide) / normalLength, guide.w) : glm::vec4(0.0f, 0.0f, 0.0f, guide.w);
+            m_guides[i] = guide;
+
+            //The sky has no albedo, its radiance is filtered as is
+            const glm::vec3 albedo = frame.albedo && guide.w > 0.0f ? glm::max(glm::vec3(frame.albedo[i]), glm::vec3(0.001f)) : glm::vec3(1.0f);
+            m_albedo[i] = albedo;
+
+            const glm::vec3 irradiance = glm::vec3(frame.color[i]) / albedo;
+            const float luminance = glm::dot(irradiance, LUMINANCE);
+            glm::vec3& moments = m_moments[i];
+            const float history = SameSurface(guide, m_previousGuides[i]) ? moments.z : 0.0f;
+            const float alpha = std::max(1.0f / (history + 1.0f), settings.temporalAlpha);
+            moments.x = history > 0.0f ? moments.x + (luminance - moments.x) * alpha : luminance;
+            moments.y = history > 0.0f ? moments.y + (luminance * luminance - moments.y) * alpha : luminance * luminance;
+            moments.z = history + 1.0f;
+
+            float variance = std::max(0.0f, moments.y - moments.x * moments.x);
+            if (frame.variance && frame.variance[i] >= 0.0f)
+            {
+                //Dividing by the albedo scales the deviation by about its luminance
+                const float albedoLuminance = glm::dot(albedo, LUMINANCE);
+                variance = frame.variance[i] / std::max(albedoLuminance * albedoLuminance, 1e-6f);
+            }
+            m_work[0][i] = glm::vec4(irradiance, variance);
+        }
+    });
+
+    //Depth gradients, and the spatial variance of the pixels that have too little history
+    m_jobSystem.ParallelFor(m_height, 0, [&](size_t begin, size_t end)
+    {
+        for (size_t y = begin; y < end; ++y)
+        {
+            for (uint32_t x = 0; x < m_width; ++x)
+            {
+                const size_t i = y * m_width + x;
+                const glm::vec4& guide = m_guides[i];
+
+                //Largest change of the depth to a neighbour, per pixel
+                float gradient = 0.0f;
+                if (guide.w > 0.0f)
+                {
+                    const auto depthAt = [&](int32_t nx, int32_t ny)
+                    {
+                        if (nx < 0 || ny < 0 || nx >= static_cast<int32_t>(m_width) || ny >= static_cast<int32_t>(m_height))
+                            return guide.w;
+                        const float depth = m_guides[static_cast<size_t>(ny) * m_width + nx].w;
+                        return depth > 0.0f ? depth : guide.w;
+                    };
+                    const int32_t ix = static_cast<int32_t>(x);
+                    const int32_t iy = static_cast<int32_t>(y);
+                    gradient = 0.5f * std::max(std::fabs(depthAt(ix + 1, iy) - depthAt(ix - 1, iy)), std::fabs(depthAt(ix, iy + 1) - depthAt(ix, iy - 1)));
+                }
+                m_depthGradients[i] = gradient;
+
+                glm::vec4 work = m_work[0][i];
+                if ((!frame.variance || frame.variance[i] < 0.0f) && m_moments[i].z < MIN_HISTORY)
+                {
+                    //3x3 luminance moments over the same surface
+                    float sum = 0.0f;
+                    float sumSquared = 0.0f;
+                    float count = 0.0f;
+                    for (int32_t dy = -1; dy <= 1; ++dy)
+                    {
+                        for (int32_t dx = -1; dx <= 1; ++dx)
+                        {
+                            const int32_t nx = static_cast<int32_t>(x) + dx;
+                            const int32_t ny = static_cast<int32_t>(y) + dy;
+                            if (nx < 0 || ny < 0 || nx >= static_cast<int32_t>(m_width) || ny >= static_cast<int32_t>(m_height))
+                                continue;
+                            const size_t n = static_cast<size_t>(ny) * m_width + nx;
+                            if (!SameSurface(guide, m_guides[n]))
+                                continue;
+                            const float luminance = glm::dot(glm::vec3(m_work[0][n]), LUMINANCE);
+                            sum += luminance;
+                            sumSquared += luminance * luminance;
+                            count += 1.0f;
+                        }
+                    }
+                    const float mean = sum / count;
+                    work.w = std::max(work.w, sumSquared / count - mean * mean);
+                }
+                m_work[1][i] = work;
+            }
+        }
+    });
+}
+
+void VDenoiser::Filter(uint32_t step, uint32_t source)
+{
+    const std::vector<glm::vec4>& src = m_work[source];
+    std::vector<glm::vec4>& dst = m_work[source ^ 1u];
+    const int32_t width = static_cast<int32_t>(m_width);
+    const int32_t height = static_cast<int32_t>(m_height);
+    const int32_t offset = static_cast<int32_t>(step);
+
+    m_jobSystem.ParallelFor(m_height, 0, [&](size_t begin, size_t end)
+    {
+        for (int32_t y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+        {
+            for (int32_t x = 0; x < width; ++x)
+            {
+                const size_t i = static_cast<size_t>(y) * width + x;
+                const glm::vec4& center = src[i];
+                const glm::vec4& guide = m_guides[i];
+
+                //The variance is blurred over 3x3 first, a single pixel estimate is too noisy to steer the filter
+                float variance = 0.0f;
+                float varianceWeight = 0.0f;
+                for (int32_t dy = -1; dy <= 1; ++dy)
+                {
+                    for (int32_t dx = -1; dx <= 1; ++dx)
+                    {
+                        const int32_t nx = x + dx;
+                        const int32_t ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+                            continue;
+                        const float w = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+                        variance += w * src[static_cast<size_t>(ny) * width + nx].w;
+                        varianceWeight += w;
+                    }
+                }
+                variance /= varianceWeight;
+
+                const float luminance = glm::dot(glm::vec3(center), LUMINANCE);
+                const float phiLuminance = settings.sigmaLuminance * std::sqrt(std::max(variance, 0.0f)) + 1e-4f;
+                const float phiDepth = settings.sigmaDepth * std::max(m_depthGradients[i], 1e-4f) * static_cast<float>(step);
+
+                TapSum taps;
+                for (int32_t ky = -2; ky <= 2; ++ky)
+                {
+                    const int32_t ny = y + ky * offset;
+                    if (ny < 0 || ny >= height)
+                        continue;
+                    for (int32_t kx = -2; kx <= 2; ++kx)
+                    {
+                        const int32_t nx = x + kx * offset;
+                        if (nx < 0 || nx >= width)
+                            continue;
+
+                        const size_t n = static_cast<size_t>(ny) * width + nx;
+                        const glm::vec4& tap = src[n];
+                        const glm::vec4& tapGuide = m_guides[n];
+                        float w = KERNEL[std::abs(kx)] * KERNEL[std::abs(ky)];
+                        if (n != i)
+                        {
+                            //Depth: a surface never blends with the sky, and only with depths its gradient can explain
+                            if (guide.w > 0.0f || tapGuide.w > 0.0f)
+                            {
+                                if (guide.w <= 0.0f || tapGuide.w <= 0.0f)
+                                    continue;
+                                w *= std::exp(-std::fabs(guide.w - tapGuide.w) / (phiDepth * std::sqrt(static_cast<float>(kx * kx + ky * ky))));
+                            }
+
+                            //Normal, ignored without a normal guide
+                            const float cosine = glm::dot(glm::vec3(guide), glm::vec3(tapGuide));
+                            if (guide.x != 0.0f || guide.y != 0.0f || guide.z != 0.0f)
+                                w *= std::pow(std::max(cosine, 0.0f), settings.sigmaNormal);
+
+                            w *= std::exp(-std::fabs(luminance - glm::dot(glm::vec3(tap), LUMINANCE)) / phiLuminance);
+                        }
+                        taps.Add(tap, w);
+                    }
+                }
+                dst[i] = taps.Resolve();
+            }
+        }
+    });
+}
@@ -5,7 +5,7 @@ void Game::InitAPI()
 {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
     GameInstance = new VContext;
     GameInstance->CREATETHEFUCKINGWINDOW(WIDTH, HEIGHT, "VEngine");
     GameInstance->SetupInstance();
@@ -34,9 +34,14 @@ void Game::SetupGame()
     Diffuse = 1;
     Metal (Dieletric) = 2;
     (not working yet) Emissive = 3;*/
-    
+
+    //Meshes are imported in parallel once every object is declared, one path per object (empty for a procedural primitive)
+    std::vector<std::string> meshPaths;
+
+    //Analytic unit sphere traced with the intersection shader instead of a tessellated model
     VObject sphere2("sphere");
-    sphere2.m_mesh.LoadMesh("shaders/models/sphere.obj", true);
+    sphere2.SetPrimitive(PrimitiveType::Sphere);
+    meshPaths.push_back("");
     sphere2.SetColor(0.9, 0.9, 0.9);
     sphere2.SetMaterialType(2);
     sphere2.SetReflectivity(0.5);
@@ -47,7 +52,7 @@ void Game::SetupGame()
     m_objects.push_back(sphere2);
 
     VObject sphere3("sphere2");
-    sphere3.m_mesh.LoadMesh("shaders/models/monkey.obj", true);
+    meshPaths.push_back("shaders/models/monkey.obj");
     sphere3.SetColor(0.9, 0.1, 0.9);
     sphere3.SetMaterialType(1);
 
@@ -57,7 +62,7 @@ void Game::SetupGame()
     m_objects.push_back(sphere3);
 
     VObject monkey("house");
-    monkey.m_mesh.LoadMesh("shaders/models/Pantheon.obj", true);
+    meshPaths.push_back("shaders/models/Pantheon.obj");
     monkey.SetColor(0.9, 0.9, 0.9);
     monkey.SetMaterialType(1);
 
@@ -67,7 +72,7 @@ void Game::SetupGame()
     m_objects.push_back(monkey);
 
     VObject plane("floor");
-    plane.m_mesh.LoadMesh("shaders/models/plane.obj", true);
+    meshPaths.push_back("shaders/models/plane.obj");
     plane.SetColor(0.3,0.95,0.2);
     plane.SetMaterialType(1);
 
@@ -76,101 +81,341 @@ void Game::SetupGame()
     plane.SetScale(1);
     m_objects.push_back(plane);
 
-    GameInstance->setupRayTracingSupport(m_objects, trianglesNumber);
+    //Spherical lights, the radiance they bring is color * intensity / distance²
+    VLight sun;
+    sun.SetPosition({0, -200, -1200});
+    sun.SetRadius(100);
+    sun.SetIntensity(1.5e6f);
+    m_lights.push_back(sun);
+
+    VLight warmLight;
+    warmLight.SetPosition({-3, -8, 4});
+    warmLight.SetRadius(0.5);
+    warmLight.SetColor(1.0, 0.6, 0.3);
+    warmLight.SetIntensity(20);
+    m_lights.push_back(warmLight);
+
+    VLight coolLight;
+    coolLight.SetPosition({4, -9, -10});
+    coolLight.SetRadius(0.5);
+    coolLight.SetColor(0.4, 0.6, 1.0);
+    coolLight.SetIntensity(30);
+    m_lights.push_back(coolLight);
+
+    //Each job has its own Assimp importer
+    GameInstance->jobSystem.ParallelFor(m_objects.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (m_objects[i].m_primitive == PrimitiveType::Mesh)
+                m_objects[i].m_mesh.LoadMesh(meshPaths[i], true);
+        }
+    });
+
+    GameInstance->setupRayTracingSupport(m_objects, m_lights, trianglesNumber);
     //SetupIMGUI();
-    GameInstance->buildCommandbuffers();
     GameLoop();
 }
 void Game::GameLoop()
 {
-     float sinus = 0;
-    double xpos = 0;
-    double ypos = 0;
-    double sensivity = 0.2;
-
-    float lastX = 0;
-    float lastY = 0;
-    glm::vec3 lastPos;
     int frameCount = 0;
+    float cpuWaitTotal = 0;
+    float updateObjectsTotal = 0;
     float lastFPS = glfwGetTime();
+
+    //The simulation thread takes ownership of the objects and its own copy of the camera
+    m_simCamera = GameInstance->camera;
+    m_running = true;
+    m_simulationThread = std::thread(&Game::SimulationLoop, this);
+
+    std::vector<glm::mat3x4> transforms;
+    bool cameraMoving = false;
+    bool lastCameraMoving = false;
+    bool sceneMoving = false;
+    bool lastSceneMoving = false;
+    bool toggleDown = false;
+    bool qualityDown = false;
+    bool samplerDown = false;
+    bool adaptiveDown = false;
+    bool lightSamplerDown = false;
+    bool restirDown = false;
+    bool restirCandidatesDown = false;
+    bool restirNeighboursDown = false;
+    bool wavefrontDown = false;
+    bool visibilityDown = false;
+    bool denoiserDown = false;
+    bool temporalDown = false;
+    bool interleaveDown = false;
+    uint32_t mouseToggleCount = 0;
     while (!glfwWindowShouldClose(GameInstance->GetWindow()))
     {
         float currentTime = glfwGetTime();
         frameCount++;
         time[0] += 0.001f;
+
+        //GLFW events and input must stay on the main thread, the simulation only sees the published input
         glfwPollEvents();
+        InputState& input = m_input.GetWriteBuffer();
+        InputManager(input);
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F1) == GLFW_PRESS && !toggleDown)
+            mouseToggleCount++;
+        toggleDown = glfwGetKey(GameInstance->window, GLFW_KEY_F1) == GLFW_PRESS;
 
+        //F2 cycles through the quality presets, the pipelines are already built so the switch is immediate
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F2) == GLFW_PRESS && !qualityDown)
+        {
+            const uint32_t next = (static_cast<uint32_t>(GameInstance->qualityPreset) + 1) % QUALITY_PRESET_COUNT;
+            GameInstance->SetQualityPreset(static_cast<QualityPreset>(next));
+        }
+        qualityDown = glfwGetKey(GameInstance->window, GLFW_KEY_F2) == GLFW_PRESS;
+
+        //F3 cycles through the sampler sequences
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F3) == GLFW_PRESS && !samplerDown)
+        {
+            const uint32_t next = (static_cast<uint32_t>(GameInstance->samplerType) + 1) % SAMPLER_TYPE_COUNT;
+            GameInstance->SetSamplerType(static_cast<SamplerType>(next));
+        }
+        samplerDown = glfwGetKey(GameInstance->window, GLFW_KEY_F3) == GLFW_PRESS;
+
+        //F4 switches between adaptive and uniform sampling, the title compares their rays and error
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F4) == GLFW_PRESS && !adaptiveDown)
+            GameInstance->SetAdaptiveSampling(!GameInstance->adaptiveSampling);
+        adaptiveDown = glfwGetKey(GameInstance->window, GLFW_KEY_F4) == GLFW_PRESS;
+
+        //F5 switches between the light BVH and the alias table
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F5) == GLFW_PRESS && !lightSamplerDown)
+        {
+            const uint32_t next = (static_cast<uint32_t>(GameInstance->lightSampler) + 1) % LIGHT_SAMPLER_COUNT;
+            GameInstance->SetLightSampler(static_cast<LightSampler>(next));
+        }
+        lightSamplerDown = glfwGetKey(GameInstance->window, GLFW_KEY_F5) == GLFW_PRESS;
+
+        //F6 toggles ReSTIR, F7 and F8 cycle its candidates (1 to 32) and neighbours (0 to 5)
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F6) == GLFW_PRESS && !restirDown)
+            GameInstance->SetRestir(!GameInstance->restirEnabled);
+        restirDown = glfwGetKey(GameInstance->window, GLFW_KEY_F6) == GLFW_PRESS;
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F7) == GLFW_PRESS && !restirCandidatesDown)
+            GameInstance->SetRestirCandidates(GameInstance->restirCandidates >= 32 ? 1 : GameInstance->restirCandidates * 2);
+        restirCandidatesDown = glfwGetKey(GameInstance->window, GLFW_KEY_F7) == GLFW_PRESS;
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F8) == GLFW_PRESS && !restirNeighboursDown)
+            GameInstance->SetRestirNeighbours((GameInstance->restirNeighbours + 1) % 6);
+        restirNeighboursDown = glfwGetKey(GameInstance->window, GLFW_KEY_F8) == GLFW_PRESS;
 
-        InputManager();
+        //F9 switches between the megakernel and the wavefront stages
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F9) == GLFW_PRESS && !wavefrontDown)
+            GameInstance->SetWavefront(!GameInstance->wavefrontEnabled);
+        wavefrontDown = glfwGetKey(GameInstance->window, GLFW_KEY_F9) == GLFW_PRESS;
 
+        //F10 traces the camera rays in a separate visibility pass
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F10) == GLFW_PRESS && !visibilityDown)
+            GameInstance->SetVisibilityBuffer(!GameInstance->visibilityBuffer);
+        visibilityDown = glfwGetKey(GameInstance->window, GLFW_KEY_F10) == GLFW_PRESS;
 
-        double x, y;
-        x = y = 0;
-        glfwGetCursorPos( GameInstance->window, &x, &y );
+        //F11 filters the frame with the CPU denoiser before the tonemap
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F11) == GLFW_PRESS && !denoiserDown)
+            GameInstance->SetDenoiser(!GameInstance->denoiserEnabled);
+        denoiserDown = glfwGetKey(GameInstance->window, GLFW_KEY_F11) == GLFW_PRESS;
 
-        if (mouseControl)
+        //F12 keeps the reprojected history when the camera or an object moves instead of restarting from scratch
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_F12) == GLFW_PRESS && !temporalDown)
+            GameInstance->SetTemporalReprojection(!GameInstance->temporalReprojection);
+        temporalDown = glfwGetKey(GameInstance->window, GLFW_KEY_F12) == GLFW_PRESS;
+
+        //I cycles the interleaved tracing: every pixel, a checkerboard or a quarter of them per frame
+        if (glfwGetKey(GameInstance->window, GLFW_KEY_I) == GLFW_PRESS && !interleaveDown)
         {
-            GameInstance->camera.Pitch -= (ypos - y) * sensivity;
-            GameInstance->camera.Yaw -= (xpos - x) * sensivity;
+            const uint32_t next = (static_cast<uint32_t>(GameInstance->interleaveMode) + 1) % INTERLEAVE_MODE_COUNT;
+            GameInstance->SetInterleaveMode(static_cast<InterleaveMode>(next));
         }
-        //FindObject("sphere2")->SetPosition(glm::vec3( -3, -4, 1 ) + glm::vec3(cos(sinus * 0.5) * 2, 0, sin(sinus * 0.5) * 2));
-        GameInstance->UpdateObjects(m_objects);
-        GameInstance->draw();
+        interleaveDown = glfwGetKey(GameInstance->window, GLFW_KEY_I) == GLFW_PRESS;
+        input.mouseToggleCount = mouseToggleCount;
+        m_input.Publish();
 
-        if (GameInstance->camera.updated)
+        //Render the latest snapshot, interpolated between its two steps
+        m_snapshots.Update();
+        const SceneSnapshot& snapshot = m_snapshots.GetReadBuffer();
+        if (snapshot.step > 0)
         {
-            
-            GameInstance->camera.updateViewMatrix();
-            bool updateAccumulation = false;
-            if(GameInstance->camera.Front.x == lastX && GameInstance->camera.Front.y == lastY && GameInstance->camera.position == lastPos)
-                updateAccumulation = true;
+            const float alpha = glm::clamp(static_cast<float>((glfwGetTime() - snapshot.stepTime) / m_simulationStep), 0.0f, 1.0f);
 
-            GameInstance->updateUniformBuffers(updateAccumulation);
+            transforms.resize(snapshot.currentTransforms.size());
+            sceneMoving = false;
+            for (size_t i = 0; i < transforms.size(); ++i)
+            {
+                //Same as the camera, an object that did not move during the step is copied
+                if (snapshot.previousTransforms[i] == snapshot.currentTransforms[i])
+                {
+                    transforms[i] = snapshot.currentTransforms[i];
+                    continue;
+                }
+                //Component-wise blend, exact for translation and close enough for the rotation of a single step
+                for (int r = 0; r < 3; ++r)
+                    transforms[i][r] = glm::mix(snapshot.previousTransforms[i][r], snapshot.currentTransforms[i][r], alpha);
+                sceneMoving = true;
+            }
+            GameInstance->UpdateObjects(transforms);
+
+            //mix(x, x, alpha) is not always x, a camera that did not move during the step is copied so it stays bit-exact
+            cameraMoving = snapshot.previousCameraPosition != snapshot.cameraPosition || snapshot.previousPitch != snapshot.pitch
+                           || snapshot.previousYaw != snapshot.yaw;
+            if (cameraMoving)
+            {
+                GameInstance->camera.position = glm::mix(snapshot.previousCameraPosition, snapshot.cameraPosition, alpha);
+                GameInstance->camera.Pitch = glm::mix(snapshot.previousPitch, snapshot.pitch, alpha);
+                GameInstance->camera.Yaw = glm::mix(snapshot.previousYaw, snapshot.yaw, alpha);
+            }
+            else
+            {
+                GameInstance->camera.position = snapshot.cameraPosition;
+                GameInstance->camera.Pitch = snapshot.pitch;
+                GameInstance->camera.Yaw = snapshot.yaw;
+            }
         }
+        updateObjectsTotal += GameInstance->updateObjectsTime;
+
+        //Keep accumulating only while the camera and the scene are still, a move restarts from the reprojected history.
+        //Motion is read from the simulation steps, not from the interpolated values. The first frame after a moving step
+        //still restarts: the last frame showed it part of the way through that step
+        GameInstance->camera.updateViewMatrix();
+        const bool updateAccumulation = !cameraMoving && !lastCameraMoving && !sceneMoving && !lastSceneMoving;
+        lastCameraMoving = cameraMoving;
+        lastSceneMoving = sceneMoving;
+        GameInstance->updateUniformBuffers(updateAccumulation);
+
+        GameInstance->draw();
+        cpuWaitTotal += GameInstance->cpuWaitTime;
+
         if ( currentTime - lastFPS >= 1.0 )
         {
-            // Display the frame count here any way you want.
-            glfwSetWindowTitle(GameInstance->window,std::to_string(frameCount).c_str());
+            // Display the frame count and the average time the CPU spent per frame waiting for the GPU and updating the scene
+            char title[352];
+            snprintf(title, sizeof(title), "%d FPS | CPU wait %.2f ms | UpdateObjects %.3f ms | GPU %.2f ms | Render %ux%u | Accumulated %u | %s%s | %s | %s | %s | ReSTIR %s %u/%u | %s rays %.0f%% error %.4f | Denoiser %s %.2f ms | Reprojection %s | Interleave %s",
+                frameCount, cpuWaitTotal / frameCount, updateObjectsTotal / frameCount, GameInstance->gpuFrameTime,
+                GameInstance->renderExtent.width, GameInstance->renderExtent.height, GameInstance->accumulationFrame,
+                GameInstance->wavefrontEnabled ? "Wavefront" : "Megakernel", GameInstance->visibilityBuffer ? " + visibility" : "",
+                GetQualityPresetName(GameInstance->qualityPreset), GetSamplerTypeName(GameInstance->samplerType), GetLightSamplerName(GameInstance->lightSampler),
+                GameInstance->restirEnabled ? "on" : "off", GameInstance->restirCandidates, GameInstance->restirNeighbours,
+                GameInstance->adaptiveSampling ? "Adaptive" : "Uniform", GameInstance->adaptiveRayRatio * 100.0f, GameInstance->adaptiveError,
+                GameInstance->denoiserEnabled ? "on" : "off", GameInstance->denoiseTime,
+                GameInstance->temporalReprojection ? "on" : "off", GetInterleaveModeName(GameInstance->interleaveMode));
+            glfwSetWindowTitle(GameInstance->window, title);
 
             frameCount = 0;
+            cpuWaitTotal = 0;
+            updateObjectsTotal = 0;
             lastFPS = currentTime;
         }
         //glfwSetWindowTitle(GameInstance->window, std::to_string(GameInstance->uniformData.data.y).c_str());
-        sinus += 0.25f;
         GameInstance->UpdateTime(time);
-        xpos = x;
-        ypos = y;
-
-        lastX = GameInstance->camera.Front.x;
-        lastY = GameInstance->camera.Front.y;
-        lastPos = GameInstance->camera.position;
     }
+    m_running = false;
+    m_simulationThread.join();
     GameInstance->CleanUp();
 }
-void Game::InputManager()
+void Game::SimulationLoop()
 {
-    float moveSpeed = 0.1;
-    if(glfwGetKey(GameInstance->window, GLFW_KEY_W) == GLFW_PRESS)
-    {
-        GameInstance->camera.setPosition(GameInstance->camera.position + GameInstance->camera.Front * moveSpeed);
-    }
-    if(glfwGetKey(GameInstance->window, GLFW_KEY_S) == GLFW_PRESS)
-    {
-        GameInstance->camera.setPosition(GameInstance->camera.position - GameInstance->camera.Front * moveSpeed);
-    }
-    if(glfwGetKey(GameInstance->window, GLFW_KEY_A) == GLFW_PRESS)
-    {
-        GameInstance->camera.setPosition(GameInstance->camera.position - GameInstance->camera.Right * moveSpeed);
-    }
-    if(glfwGetKey(GameInstance->window, GLFW_KEY_D) == GLFW_PRESS)
-    {
-        GameInstance->camera.setPosition(GameInstance->camera.position + GameInstance->camera.Right * moveSpeed);
-    }
-    if (glfwGetKey(GameInstance->window, GLFW_KEY_F1) == GLFW_PRESS)
+    double sensivity = 0.2;
+    float sinus = 0;
+    double xpos = 0;
+    double ypos = 0;
+    bool firstInput = true;
+    uint32_t mouseToggleCount = 0;
+
+    std::vector<glm::mat3x4> previousTransforms;
+    std::vector<glm::mat3x4> currentTransforms;
+    for (auto& obj : m_objects)
+        currentTransforms.push_back(obj.m_mesh.meshGeometry.transform);
+    Camera previousCamera = m_simCamera;
+
+    double simulationTime = glfwGetTime();
+    uint64_t step = 0;
+    InputState input{};
+    while (m_running)
     {
-        mouseControl = !mouseControl;
+        if (m_input.Update())
+            input = m_input.GetReadBuffer();
+
+        //Run as many fixed steps as needed to catch up with the real time
+        bool stepped = false;
+        while (simulationTime + m_simulationStep <= glfwGetTime())
+        {
+            previousTransforms = currentTransforms;
+            previousCamera = m_simCamera;
+
+            if (firstInput)
+            {
+                xpos = input.cursorX;
+                ypos = input.cursorY;
+                mouseToggleCount = input.mouseToggleCount;
+                firstInput = false;
+            }
+            if (input.mouseToggleCount != mouseToggleCount)
+            {
+                mouseControl = !mouseControl;
+                mouseToggleCount = input.mouseToggleCount;
+            }
+            if (mouseControl)
+            {
+                m_simCamera.Pitch -= (ypos - input.cursorY) * sensivity;
+                m_simCamera.Yaw -= (xpos - input.cursorX) * sensivity;
+            }
+            xpos = input.cursorX;
+            ypos = input.cursorY;
+
+            SimulationStep(input);
+            //FindObject("sphere2")->SetPosition(glm::vec3( -3, -4, 1 ) + glm::vec3(cos(sinus * 0.5) * 2, 0, sin(sinus * 0.5) * 2));
+            sinus += 0.25f;
+
+            currentTransforms.clear();
+            for (auto& obj : m_objects)
+                currentTransforms.push_back(obj.m_mesh.meshGeometry.transform);
+
+            simulationTime += m_simulationStep;
+            step++;
+            stepped = true;
+        }
+
+        if (!stepped)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        SceneSnapshot& snapshot = m_snapshots.GetWriteBuffer();
+        snapshot.previousTransforms = previousTransforms;
+        snapshot.currentTransforms = currentTransforms;
+        snapshot.previousCameraPosition = previousCamera.position;
+        snapshot.cameraPosition = m_simCamera.position;
+        snapshot.previousPitch = previousCamera.Pitch;
+        snapshot.pitch = m_simCamera.Pitch;
+        snapshot.previousYaw = previousCamera.Yaw;
+        snapshot.yaw = m_simCamera.Yaw;
+        snapshot.stepTime = simulationTime;
+        snapshot.step = step;
+        m_snapshots.Publish();
     }
 }
+void Game::SimulationStep(const InputState& input)
+{
+    float moveSpeed = 0.1;
+    m_simCamera.updateViewMatrix();
+    if (input.forward)
+        m_simCamera.setPosition(m_simCamera.position + m_simCamera.Front * moveSpeed);
+    if (input.backward)
+        m_simCamera.setPosition(m_simCamera.position - m_simCamera.Front * moveSpeed);
+    if (input.left)
+        m_simCamera.setPosition(m_simCamera.position - m_simCamera.Right * moveSpeed);
+    if (input.right)
+        m_simCamera.setPosition(m_simCamera.position + m_simCamera.Right * moveSpeed);
+}
+void Game::InputManager(InputState& input)
+{
+    input.forward = glfwGetKey(GameInstance->window, GLFW_KEY_W) == GLFW_PRESS;
+    input.backward = glfwGetKey(GameInstance->window, GLFW_KEY_S) == GLFW_PRESS;
+    input.left = glfwGetKey(GameInstance->window, GLFW_KEY_A) == GLFW_PRESS;
+    input.right = glfwGetKey(GameInstance->window, GLFW_KEY_D) == GLFW_PRESS;
+    glfwGetCursorPos(GameInstance->window, &input.cursorX, &input.cursorY);
+}
 void Game::CursorCallBack(GLFWwindow* window, double xpos, double ypos)
 {
 }
@@ -0,0 +1,280 @@
+#include <VJobSystem.h>
+#include <algorithm>
+
+struct VJobSystem::Job
+{
+    JobFunction function;
+    Counter* counter;
+};
+
+namespace
+{
+    struct WorkerContext
+    {
+        const VJobSystem* system = nullptr;
+        int32_t index = -1;
+    };
+
+    thread_local WorkerContext t_worker;
+}
+
+#pragma region WorkQueue
+bool VJobSystem::WorkQueue::Push(Job* job)
+{
+    const int64_t b = m_bottom.load(std::memory_order_relaxed);
+    const int64_t t = m_top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY)
+        return false;
+
+    m_jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    //Release: a thief that sees the new bottom also sees the job
+    m_bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+VJobSystem::Job* VJobSystem::WorkQueue::Pop()
+{
+    const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        //Empty
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = m_jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        //Last job, race against thieves for it
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+VJobSystem::Job* VJobSystem::WorkQueue::Steal()
+{
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Job* job = m_jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+#pragma endregion
+
+VJobSystem::VJobSystem(uint32_t workerCount)
+{
+    if (workerCount == 0)
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (uint32_t i = 0; i < workerCount; ++i)
+        m_queues.push_back(std::make_unique<WorkQueue>());
+
+    //The creating thread is worker 0, it runs jobs while waiting
+    t_worker.system = this;
+    t_worker.index = 0;
+
+    for (uint32_t i = 1; i < workerCount; ++i)
+        m_threads.emplace_back(&VJobSystem::WorkerLoop, this, i);
+}
+
+VJobSystem::~VJobSystem()
+{
+    m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+
+    //Jobs left behind are not run, only released
+    for (auto& queue : m_queues)
+        while (Job* job = queue->Steal())
+            delete job;
+    for (Job* job : m_sharedJobs)
+        delete job;
+
+    if (t_worker.system == this)
+        t_worker = WorkerContext{};
+}
+
+void VJobSystem::Run(JobFunction job, Counter* counter, Counter* dependency)
+{
+    Job* newJob = new Job{ std::move(job), counter };
+    if (counter)
+        counter->m_value.fetch_add(1, std::memory_order_relaxed);
+
+    if (dependency)
+    {
+        //Checked under the lock so the job can't miss the release done by Finish
+        std::lock_guard<std::mutex> lock(dependency->m_mutex);
+        if (!dependency->IsDone())
+        {
+            dependency->m_waiting.push_back(newJob);
+            return;
+        }
+    }
+
+    Submit(newJob);
+}
+
+void VJobSystem::Wait(Counter& counter)
+{
+    const int32_t index = GetCurrentWorker();
+    while (!counter.IsDone())
+    {
+        if (Job* job = FindJob(static_cast<uint32_t>(index)))
+            Execute(job);
+        else
+            std::this_thread::yield();
+    }
+
+    //Wait for the last job to release the counter lock
+    std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void VJobSystem::ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function)
+{
+    if (count == 0)
+        return;
+
+    if (grainSize == 0)
+        grainSize = std::max<size_t>(1, count / (GetWorkerCount() * 4));
+
+    //A single range is not worth a job
+    if (grainSize >= count)
+    {
+        function(0, count);
+        return;
+    }
+
+    Counter counter;
+    for (size_t begin = 0; begin < count; begin += grainSize)
+    {
+        const size_t end = std::min(count, begin + grainSize);
+        Run([&function, begin, end]() { function(begin, end); }, &counter);
+    }
+    Wait(counter);
+}
+
+void VJobSystem::WorkerLoop(uint32_t index)
+{
+    t_worker.system = this;
+    t_worker.index = static_cast<int32_t>(index);
+
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        if (Job* job = FindJob(index))
+        {
+            Execute(job);
+            continue;
+        }
+
+        //The timeout covers a job queued between the check and the wait
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait_for(lock, std::chrono::milliseconds(1), [this]()
+        {
+            return m_queuedJobs.load(std::memory_order_relaxed) > 0 || !m_running.load(std::memory_order_relaxed);
+        });
+    }
+}
+
+void VJobSystem::Submit(Job* job)
+{
+    const int32_t index = GetCurrentWorker();
+    if (index >= 0)
+    {
+        //The deque is full, running the job now is always correct
+        if (!m_queues[index]->Push(job))
+        {
+            Execute(job);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_sharedMutex);
+        m_sharedJobs.push_back(job);
+    }
+
+    m_queuedJobs.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_one();
+}
+
+VJobSystem::Job* VJobSystem::FindJob(uint32_t index)
+{
+    Job* job = nullptr;
+    const uint32_t workerCount = GetWorkerCount();
+
+    //Own queue first (most recent job, its data is still in cache), then the shared queue, then steal the oldest
+    //job of another worker
+    if (index < workerCount)
+        job = m_queues[index]->Pop();
+
+    if (!job)
+    {
+        std::lock_guard<std::mutex> lock(m_sharedMutex);
+        if (!m_sharedJobs.empty())
+        {
+            job = m_sharedJobs.front();
+            m_sharedJobs.pop_front();
+        }
+    }
+
+    for (uint32_t i = 1; !job && i <= workerCount; ++i)
+    {
+        const uint32_t victim = (index + i) % workerCount;
+        if (victim != index)
+            job = m_queues[victim]->Steal();
+    }
+
+    if (job)
+        m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    return job;
+}
+
+void VJobSystem::Execute(Job* job)
+{
+    job->function();
+    Finish(*this, job->counter);
+    delete job;
+}
+
+void VJobSystem::Finish(VJobSystem& system, Counter* counter)
+{
+    if (!counter)
+        return;
+
+    //The counter is only touched under its lock, Wait takes the lock before returning so the counter
+    //can't be destroyed while the last job is still releasing it
+    std::vector<Job*> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        if (counter->m_value.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        //Last job of the group, release the jobs that were waiting for it
+        released.swap(counter->m_waiting);
+    }
+    for (Job* job : released)
+        system.Submit(job);
+}
+
+int32_t VJobSystem::GetCurrentWorker() const
+{
+    return t_worker.system == this ? t_worker.index : -1;
+}
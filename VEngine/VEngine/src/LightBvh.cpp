@@ -0,0 +1,260 @@
+#include <VLightBvh.h>
+#include <VLightTable.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace VLightBvhShader
+{
+    using namespace glm;
+    using uint = uint32_t;
+
+#define LIGHT_BVH_FUNC inline
+#include "../shaders/light_bvh.glsl"
+#undef LIGHT_BVH_FUNC
+}
+
+namespace
+{
+    constexpr float PI = 3.14159265358979f;
+    //Parent of the root
+    constexpr uint32_t NO_PARENT = 0xffffffffu;
+
+    /** @brief Normal cone, direction and cosine of its spread */
+    struct Cone
+    {
+        glm::vec3 axis;
+        float cosTheta;
+    };
+
+    /** @brief Smallest cone containing both cones (pbrt-v4 DirectionCone Union) */
+    Cone Union(const Cone& a, const Cone& b)
+    {
+        //Omnidirectional lights already cover every direction, skips the trigonometry for the common case
+        if (a.cosTheta <= -1.0f)
+            return a;
+        if (b.cosTheta <= -1.0f)
+            return b;
+
+        const float thetaA = std::acos(glm::clamp(a.cosTheta, -1.0f, 1.0f));
+        const float thetaB = std::acos(glm::clamp(b.cosTheta, -1.0f, 1.0f));
+        const float thetaD = std::acos(glm::clamp(glm::dot(a.axis, b.axis), -1.0f, 1.0f));
+        if (std::min(thetaD + thetaB, PI) <= thetaA)
+            return a;
+        if (std::min(thetaD + thetaA, PI) <= thetaB)
+            return b;
+
+        const float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+        const glm::vec3 rotationAxis = glm::cross(a.axis, b.axis);
+        if (thetaO >= PI || glm::dot(rotationAxis, rotationAxis) == 0.0f)
+            return { a.axis, -1.0f };
+
+        //Rotate the axis of a toward b so the new cone just contains both (Rodrigues)
+        const float thetaR = thetaO - thetaA;
+        const glm::vec3 k = glm::normalize(rotationAxis);
+        const glm::vec3 axis = a.axis * std::cos(thetaR) + glm::cross(k, a.axis) * std::sin(thetaR) + k * glm::dot(k, a.axis) * (1.0f - std::cos(thetaR));
+        return { glm::normalize(axis), std::cos(thetaO) };
+    }
+
+    /** @brief Spread the 10 bits of a value to every third bit */
+    uint32_t ExpandBits(uint32_t v)
+    {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    int CommonPrefix(const std::vector<uint64_t>& keys, int64_t i, int64_t j)
+    {
+        if (j < 0 || j >= static_cast<int64_t>(keys.size()))
+            return -1;
+        //Keys are unique, the xor is never 0
+        const uint64_t x = keys[i] ^ keys[j];
+#if defined(_MSC_VER)
+        unsigned long highestBit;
+        _BitScanReverse64(&highestBit, x);
+        return 63 - static_cast<int>(highestBit);
+#else
+        return __builtin_clzll(x);
+#endif
+    }
+}
+
+void VLightBvh::Build(const std::vector<VLightData>& lights, VJobSystem& jobSystem)
+{
+    m_nodes.clear();
+    const size_t count = lights.size();
+    if (count == 0)
+        return;
+
+    //Morton codes of the centers in the scene bounds, the light index in the low bits makes every key unique
+    glm::vec3 sceneMin(std::numeric_limits<float>::max());
+    glm::vec3 sceneMax(-std::numeric_limits<float>::max());
+    for (const VLightData& light : lights)
+    {
+        sceneMin = glm::min(sceneMin, glm::vec3(light.position));
+        sceneMax = glm::max(sceneMax, glm::vec3(light.position));
+    }
+    const glm::vec3 extent = glm::max(sceneMax - sceneMin, glm::vec3(1e-6f));
+
+    std::vector<uint64_t> keys(count);
+    jobSystem.ParallelFor(count, 4096, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const glm::vec3 cell = glm::clamp((glm::vec3(lights[i].position) - sceneMin) / extent * 1023.0f, glm::vec3(0), glm::vec3(1023));
+            const uint32_t morton = (ExpandBits(static_cast<uint32_t>(cell.x)) << 2) | (ExpandBits(static_cast<uint32_t>(cell.y)) << 1) | ExpandBits(static_cast<uint32_t>(cell.z));
+            keys[i] = (static_cast<uint64_t>(morton) << 32) | i;
+        }
+    });
+
+    //LSD radix sort of the 30 bit codes, 10 bits per pass. It is stable and the keys start in light order, so the
+    //result is the order of the full keys
+    std::vector<uint64_t> sorted(count);
+    for (uint32_t shift = 32; shift < 62; shift += 10)
+    {
+        std::vector<uint32_t> offsets(1025, 0);
+        for (uint64_t key : keys)
+            offsets[((key >> shift) & 1023) + 1]++;
+        for (size_t bucket = 1; bucket < offsets.size(); ++bucket)
+            offsets[bucket] += offsets[bucket - 1];
+        for (uint64_t key : keys)
+            sorted[offsets[(key >> shift) & 1023]++] = key;
+        keys.swap(sorted);
+    }
+
+    //Interior nodes first (the root is node 0), then one leaf per sorted light
+    const size_t interiorCount = count - 1;
+    m_nodes.resize(interiorCount + count);
+    std::vector<uint32_t> parents(m_nodes.size(), NO_PARENT);
+
+    jobSystem.ParallelFor(interiorCount, 4096, [&](size_t begin, size_t end)
+    {
+        for (size_t node = begin; node < end; ++node)
+        {
+            //Range of keys covered by the node: it extends from i in the direction of the longest common prefix
+            const int64_t i = static_cast<int64_t>(node);
+            const int64_t d = CommonPrefix(keys, i, i + 1) - CommonPrefix(keys, i, i - 1) > 0 ? 1 : -1;
+            const int minPrefix = CommonPrefix(keys, i, i - d);
+
+            int64_t maxLength = 2;
+            while (CommonPrefix(keys, i, i + maxLength * d) > minPrefix)
+                maxLength *= 2;
+            int64_t length = 0;
+            for (int64_t t = maxLength / 2; t >= 1; t /= 2)
+                if (CommonPrefix(keys, i, i + (length + t) * d) > minPrefix)
+                    length += t;
+            const int64_t j = i + length * d;
+
+            //Split where the common prefix of the range ends
+            const int nodePrefix = CommonPrefix(keys, i, j);
+            int64_t split = 0;
+            int64_t t = length;
+            do
+            {
+                t = (t + 1) / 2;
+                if (CommonPrefix(keys, i, i + (split + t) * d) > nodePrefix)
+                    split += t;
+            } while (t > 1);
+            const int64_t gamma = i + split * d + std::min<int64_t>(d, 0);
+
+            const uint32_t left = std::min(i, j) == gamma ? static_cast<uint32_t>(interiorCount + gamma) : static_cast<uint32_t>(gamma);
+            const uint32_t right = std::max(i, j) == gamma + 1 ? static_cast<uint32_t>(interiorCount + gamma + 1) : static_cast<uint32_t>(gamma + 1);
+            m_nodes[node].first = left;
+            m_nodes[node].second = right;
+            parents[left] = static_cast<uint32_t>(node);
+            parents[right] = static_cast<uint32_t>(node);
+        }
+    });
+
+    //Bottom-up: the second child to reach a parent merges both children, so every node is written once
+    const std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[interiorCount + 1]);
+    for (size_t i = 0; i < interiorCount; ++i)
+        visits[i].store(0, std::memory_order_relaxed);
+
+    jobSystem.ParallelFor(count, 4096, [&](size_t begin, size_t end)
+    {
+        for (size_t leaf = begin; leaf < end; ++leaf)
+        {
+            const uint32_t lightIndex = static_cast<uint32_t>(keys[leaf] & 0xffffffffu);
+            const VLightData& light = lights[lightIndex];
+            const glm::vec3 center = glm::vec3(light.position);
+            const float radius = light.position.w;
+
+            //Spherical lights emit in every direction: full normal cone, emission spread of a hemisphere
+            VLightBvhNode& node = m_nodes[interiorCount + leaf];
+            node.boundsMin = glm::vec4(center - radius, VLightTable::GetPower(light));
+            node.boundsMax = glm::vec4(center + radius, -1.0f);
+            node.axis = glm::vec4(0, 0, 1, 0);
+            node.first = lightIndex;
+            node.second = VLightBvhShader::LIGHT_BVH_LEAF;
+
+            uint32_t current = parents[interiorCount + leaf];
+            while (current != NO_PARENT)
+            {
+                if (visits[current].fetch_add(1, std::memory_order_acq_rel) == 0)
+                    break;
+
+                VLightBvhNode& parent = m_nodes[current];
+                const VLightBvhNode& a = m_nodes[parent.first];
+                const VLightBvhNode& b = m_nodes[parent.second];
+                const Cone cone = a.boundsMin.w <= 0 ? Cone{ glm::vec3(b.axis), b.boundsMax.w }
+                    : b.boundsMin.w <= 0 ? Cone{ glm::vec3(a.axis), a.boundsMax.w }
+                    : Union({ glm::vec3(a.axis), a.boundsMax.w }, { glm::vec3(b.axis), b.boundsMax.w });
+                parent.boundsMin = glm::vec4(glm::min(glm::vec3(a.boundsMin), glm::vec3(b.boundsMin)), a.boundsMin.w + b.boundsMin.w);
+                parent.boundsMax = glm::vec4(glm::max(glm::vec3(a.boundsMax), glm::vec3(b.boundsMax)), cone.cosTheta);
+                parent.axis = glm::vec4(cone.axis, std::min(a.axis.w, b.axis.w));
+                current = parents[current];
+            }
+        }
+    });
+}
+
+int32_t VLightBvh::SampleLight(const glm::vec3& position, const glm::vec3& normal, float u, float& pdf) const
+{
+    pdf = 0;
+    if (m_nodes.empty())
+        return -1;
+
+    uint32_t current = 0;
+    float probability = 1;
+    while (m_nodes[current].second != VLightBvhShader::LIGHT_BVH_LEAF)
+    {
+        const VLightBvhNode& node = m_nodes[current];
+        const float left = Importance(m_nodes[node.first], position, normal);
+        const float right = Importance(m_nodes[node.second], position, normal);
+        if (left + right <= 0)
+            return -1;
+
+        //Pick a child and rescale u so the rest of the traversal still has a uniform number
+        const float pLeft = left / (left + right);
+        if (u < pLeft)
+        {
+            u = std::min(u / pLeft, 0.99999994f);
+            probability *= pLeft;
+            current = node.first;
+        }
+        else
+        {
+            u = std::min((u - pLeft) / (1 - pLeft), 0.99999994f);
+            probability *= 1 - pLeft;
+            current = node.second;
+        }
+    }
+
+    pdf = probability;
+    return static_cast<int32_t>(m_nodes[current].first);
+}
+
+float VLightBvh::Importance(const VLightBvhNode& node, const glm::vec3& position, const glm::vec3& normal)
+{
+    return VLightBvhShader::LightBoundsImportance(position, normal, glm::vec3(node.boundsMin), glm::vec3(node.boundsMax),
+        node.boundsMin.w, glm::vec3(node.axis), node.boundsMax.w, node.axis.w);
+}
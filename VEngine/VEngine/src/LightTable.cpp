@@ -0,0 +1,85 @@
+#include <VLightTable.h>
+#include <algorithm>
+
+void VLightTable::Build(const std::vector<VLight>& lights, const glm::vec3& reference)
+{
+    m_lights.clear();
+    m_aliasTable.clear();
+    for (const VLight& light : lights)
+        m_lights.push_back(light.data);
+
+    const size_t count = m_lights.size();
+    if (count == 0)
+        return;
+
+    std::vector<float> weights(count);
+    float total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        weights[i] = EstimateContribution(m_lights[i], reference);
+        total += weights[i];
+    }
+
+    //Every light gets the same weight when none is expected to contribute, the pick must stay valid
+    if (total <= 0)
+    {
+        std::fill(weights.begin(), weights.end(), 1.0f);
+        total = static_cast<float>(count);
+    }
+
+    //Vose: scale the weights so the average is 1, then pair every under-full entry with an over-full one
+    m_aliasTable.resize(count);
+    std::vector<float> scaled(count);
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    for (size_t i = 0; i < count; ++i)
+    {
+        m_aliasTable[i].pdf = weights[i] / total;
+        m_aliasTable[i].padding = 0;
+        scaled[i] = m_aliasTable[i].pdf * static_cast<float>(count);
+        (scaled[i] < 1.0f ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        const uint32_t less = small.back();
+        small.pop_back();
+        const uint32_t more = large.back();
+
+        m_aliasTable[less].probability = scaled[less];
+        m_aliasTable[less].alias = more;
+
+        scaled[more] -= 1.0f - scaled[less];
+        if (scaled[more] < 1.0f)
+        {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+
+    //What remains is full up to rounding errors
+    for (uint32_t i : large)
+    {
+        m_aliasTable[i].probability = 1.0f;
+        m_aliasTable[i].alias = i;
+    }
+    for (uint32_t i : small)
+    {
+        m_aliasTable[i].probability = 1.0f;
+        m_aliasTable[i].alias = i;
+    }
+}
+
+float VLightTable::EstimateContribution(const VLightData& light, const glm::vec3& position)
+{
+    const float power = GetPower(light);
+    const glm::vec3 offset = glm::vec3(light.position) - position;
+    //Clamped to the radius, a point inside the light doesn't make its weight explode
+    const float distanceSquared = std::max(glm::dot(offset, offset), light.position.w * light.position.w);
+    return power / std::max(distanceSquared, 1e-4f);
+}
+
+float VLightTable::GetPower(const VLightData& light)
+{
+    return light.colorIntensity.w * glm::dot(glm::vec3(light.colorIntensity), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
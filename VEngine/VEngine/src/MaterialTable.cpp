@@ -0,0 +1,24 @@
+#include <VMaterialTable.h>
+
+uint32_t VMaterialTable::Add(const VMaterial& material)
+{
+    const Key key = {
+        material.colorAndRoughness.x, material.colorAndRoughness.y, material.colorAndRoughness.z, material.colorAndRoughness.w,
+        material.ior.x, material.ior.y, material.ior.z, material.ior.w
+    };
+
+    const auto it = m_ids.find(key);
+    if (it != m_ids.end())
+        return it->second;
+
+    const uint32_t id = static_cast<uint32_t>(m_materials.size());
+    m_materials.push_back(material);
+    m_ids.emplace(key, id);
+    return id;
+}
+
+void VMaterialTable::Clear()
+{
+    m_materials.clear();
+    m_ids.clear();
+}
@@ -1,4 +1,6 @@
 #include <VMesh.h>
+#include <algorithm>
+#include <cmath>
 
 void VMesh::LoadMesh(const std::string& path, bool flipNormals)
 {
@@ -14,6 +16,7 @@ void VMesh::LoadMesh(const std::string& path, bool flipNormals)
     }
      directory = path.substr(0, path.find_last_of('/'));
 
+    processMaterials(scene);
     processNode(scene->mRootNode, scene);
 
 }
@@ -36,6 +39,9 @@ void VMesh::processMesh(aiMesh *mesh, const aiScene *scene)
         // data to fill
         //std::vector<Texture> textures;
 
+        // indices of this mesh start at the vertices of the meshes already loaded
+        const uint32_t baseVertex = static_cast<uint32_t>(vertices.size());
+
         // Walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -83,7 +89,9 @@ void VMesh::processMesh(aiMesh *mesh, const aiScene *scene)
         {
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
-                indices.push_back(mesh->mFaces[i].mIndices[j]);
+                indices.push_back(baseVertex + mesh->mFaces[i].mIndices[j]);
+            // every triangle keeps the material of its sub mesh
+            materialIds.push_back(mesh->mMaterialIndex);
         }
         // process materials
         //aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
@@ -109,4 +117,39 @@ void VMesh::processMesh(aiMesh *mesh, const aiScene *scene)
         
         // return a mesh object created from the extracted mesh data
         //return Mesh(vertices, indices, textures);
+}
+void VMesh::processMaterials(const aiScene* scene)
+{
+    // MTL values are mapped to the material model of the tracer:
+    // Kd -> albedo, Ns -> roughness, Ni -> index of refraction, Ke -> emissive, a strong Ks -> metal
+    for(unsigned int i = 0; i < scene->mNumMaterials; i++)
+    {
+        const aiMaterial* material = scene->mMaterials[i];
+
+        aiColor3D diffuse(1.0f, 1.0f, 1.0f);
+        aiColor3D specular(0.0f, 0.0f, 0.0f);
+        aiColor3D emissive(0.0f, 0.0f, 0.0f);
+        float shininess = 0.0f;
+        float refraction = 1.0f;
+        material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+        material->Get(AI_MATKEY_COLOR_SPECULAR, specular);
+        material->Get(AI_MATKEY_COLOR_EMISSIVE, emissive);
+        material->Get(AI_MATKEY_SHININESS, shininess);
+        material->Get(AI_MATKEY_REFRACTI, refraction);
+
+        // Blinn-Phong exponent to roughness
+        const float roughness = std::sqrt(2.0f / (shininess + 2.0f));
+        const float reflectivity = std::max(specular.r, std::max(specular.g, specular.b));
+
+        float type = 1;
+        if(emissive.r + emissive.g + emissive.b > 0.0f)
+            type = 3;
+        else if(reflectivity > 0.5f)
+            type = 2;
+
+        VMaterial vMaterial;
+        vMaterial.colorAndRoughness = glm::vec4(diffuse.r, diffuse.g, diffuse.b, roughness);
+        vMaterial.ior = glm::vec4(type, reflectivity, refraction, 0.0f);
+        materials.push_back(vMaterial);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include <VPrimitive.h>
+
+void VPrimitive::GetObjectBounds(PrimitiveType type, glm::vec3& min, glm::vec3& max)
+{
+    const glm::vec3 extent = VPrimitiveShader::PrimitiveExtent(static_cast<uint32_t>(type));
+    min = -extent;
+    max = extent;
+}
+
+float VPrimitive::Intersect(const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax, glm::vec3* normal) const
+{
+    //Same ray in object space, the direction is not normalized so the distances don't change
+    const glm::mat4 objectToWorld = glm::transpose(glm::mat4(transform[0], transform[1], transform[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+    const glm::mat4 worldToObject = glm::inverse(objectToWorld);
+    const glm::vec3 objectOrigin = glm::vec3(worldToObject * glm::vec4(origin, 1.0f));
+    const glm::vec3 objectDirection = glm::vec3(worldToObject * glm::vec4(direction, 0.0f));
+
+    const uint32_t shape = static_cast<uint32_t>(type);
+    const float t = VPrimitiveShader::IntersectPrimitive(shape, objectOrigin, objectDirection, tMin, tMax);
+    if (normal && t != VPrimitiveShader::PRIMITIVE_NO_HIT)
+    {
+        //The instances are only scaled uniformly, the normal goes through the transform like a direction
+        const glm::vec3 objectNormal = VPrimitiveShader::PrimitiveNormal(shape, objectOrigin + objectDirection * t, objectDirection);
+        *normal = glm::normalize(glm::vec3(objectToWorld * glm::vec4(objectNormal, 0.0f)));
+    }
+    return t;
+}
@@ -0,0 +1,156 @@
+#include <VSampler.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void VSampler::StartPixel(uint32_t x, uint32_t y, uint32_t width, uint32_t sampleIndex)
+{
+    m_x = x;
+    m_y = y;
+    m_pixelSeed = VSampling::PcgHash(y * width + x);
+    m_index = sampleIndex;
+    m_dimension = 0;
+}
+
+glm::vec2 VSampler::Next2D()
+{
+    const uint32_t dimension = m_dimension++;
+
+    switch (m_type)
+    {
+    case SamplerType::Sobol:
+        return VSampling::OwenSobol2D(m_index, VSampling::HashCombine(m_pixelSeed, dimension));
+
+    case SamplerType::BlueNoise:
+    {
+        assert(m_blueNoise);
+        const uint32_t mask = VSampling::BLUE_NOISE_SIZE - 1;
+        const glm::uvec2 offset = VSampling::BlueNoiseOffset(dimension);
+        const uint32_t x = (*m_blueNoise)[((m_y + offset.y) & mask) * VSampling::BLUE_NOISE_SIZE + ((m_x + offset.x) & mask)];
+        const uint32_t y = (*m_blueNoise)[((m_y + offset.x) & mask) * VSampling::BLUE_NOISE_SIZE + ((m_x + offset.y) & mask)];
+        return VSampling::BlueNoise2D(m_index, glm::uvec2(x, y));
+    }
+
+    case SamplerType::Random:
+    default:
+    {
+        const uint32_t hash = VSampling::RandomHash(m_pixelSeed, m_index, dimension);
+        return glm::vec2(VSampling::ToUnitFloat(hash), VSampling::ToUnitFloat(VSampling::PcgHash(hash)));
+    }
+    }
+}
+
+std::vector<uint32_t> VSampler::GenerateBlueNoiseTile(uint32_t size, uint32_t seed)
+{
+    assert(size > 0 && (size & (size - 1)) == 0);
+
+    const uint32_t count = size * size;
+    const uint32_t mask = size - 1;
+
+    //Gaussian energy of a pixel on the torus, sigma 1.5 as in the original paper
+    std::vector<float> kernel(count);
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            const float dx = static_cast<float>(std::min(x, size - x));
+            const float dy = static_cast<float>(std::min(y, size - y));
+            kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * 1.5f * 1.5f));
+        }
+    }
+
+    std::vector<uint8_t> pattern(count, 0);
+    std::vector<float> energy(count, 0.0f);
+    const auto splat = [&](uint32_t pixel, float sign)
+    {
+        const uint32_t px = pixel & mask;
+        const uint32_t py = pixel / size;
+        for (uint32_t y = 0; y < size; ++y)
+            for (uint32_t x = 0; x < size; ++x)
+                energy[y * size + x] += sign * kernel[((y - py) & mask) * size + ((x - px) & mask)];
+    };
+    //Tightest cluster: the set pixel of highest energy, largest void: the empty pixel of lowest energy
+    const auto find = [&](uint8_t value, bool highest)
+    {
+        uint32_t best = 0;
+        float bestEnergy = highest ? -1e30f : 1e30f;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (pattern[i] != value)
+                continue;
+            if (highest ? energy[i] > bestEnergy : energy[i] < bestEnergy)
+            {
+                bestEnergy = energy[i];
+                best = i;
+            }
+        }
+        return best;
+    };
+
+    //Initial pattern: 10% random pixels, relaxed by moving the tightest cluster to the largest void until stable
+    const uint32_t initialCount = std::max(1u, count / 10);
+    for (uint32_t placed = 0, i = 0; placed < initialCount; ++i)
+    {
+        const uint32_t pixel = VSampling::PcgHash(seed + i) & (count - 1);
+        if (pattern[pixel])
+            continue;
+        pattern[pixel] = 1;
+        splat(pixel, 1.0f);
+        ++placed;
+    }
+    for (;;)
+    {
+        const uint32_t cluster = find(1, true);
+        pattern[cluster] = 0;
+        splat(cluster, -1.0f);
+        const uint32_t voidPixel = find(0, false);
+        pattern[voidPixel] = 1;
+        splat(voidPixel, 1.0f);
+        if (voidPixel == cluster)
+            break;
+    }
+    const std::vector<uint8_t> initialPattern = pattern;
+    const std::vector<float> initialEnergy = energy;
+
+    std::vector<uint32_t> ranks(count, 0);
+
+    //Phase 1: remove the tightest clusters of the initial pattern, they get the ranks below initialCount
+    for (uint32_t rank = initialCount; rank-- > 0;)
+    {
+        const uint32_t cluster = find(1, true);
+        pattern[cluster] = 0;
+        splat(cluster, -1.0f);
+        ranks[cluster] = rank;
+    }
+
+    //Phase 2: fill the largest voids up to half of the tile
+    pattern = initialPattern;
+    energy = initialEnergy;
+    uint32_t rank = initialCount;
+    for (; rank < count / 2; ++rank)
+    {
+        const uint32_t voidPixel = find(0, false);
+        pattern[voidPixel] = 1;
+        splat(voidPixel, 1.0f);
+        ranks[voidPixel] = rank;
+    }
+
+    //Phase 3: the empty pixels are now the minority, fill the tightest clusters of empty pixels
+    std::fill(energy.begin(), energy.end(), 0.0f);
+    for (uint32_t i = 0; i < count; ++i)
+        if (!pattern[i])
+            splat(i, 1.0f);
+    for (; rank < count; ++rank)
+    {
+        const uint32_t cluster = find(0, true);
+        pattern[cluster] = 1;
+        splat(cluster, -1.0f);
+        ranks[cluster] = rank;
+    }
+
+    //Ranks to uniform 0.32 fixed point values, centered in their interval
+    std::vector<uint32_t> tile(count);
+    for (uint32_t i = 0; i < count; ++i)
+        tile[i] = static_cast<uint32_t>(((static_cast<uint64_t>(ranks[i]) << 32) + (1ull << 31)) / count);
+    return tile;
+}
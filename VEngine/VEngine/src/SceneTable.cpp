@@ -0,0 +1,45 @@
+#include <VSceneTable.h>
+#include <algorithm>
+#include <cassert>
+
+uint32_t VSceneTable::Add(uint32_t primitiveCount, uint32_t vertexCount)
+{
+    m_firstPrimitives.push_back(m_primitiveCount);
+    m_primitiveCounts.push_back(primitiveCount);
+    m_primitiveCount += primitiveCount;
+    m_firstVertices.push_back(m_vertexCount);
+    m_vertexCounts.push_back(vertexCount);
+    m_vertexCount += vertexCount;
+    return static_cast<uint32_t>(m_firstPrimitives.size() - 1);
+}
+
+void VSceneTable::Clear()
+{
+    m_firstPrimitives.clear();
+    m_primitiveCounts.clear();
+    m_primitiveCount = 0;
+    m_firstVertices.clear();
+    m_vertexCounts.clear();
+    m_vertexCount = 0;
+}
+
+std::vector<uint32_t> VSceneTable::GetInstanceOffsets() const
+{
+    std::vector<uint32_t> offsets;
+    offsets.reserve(m_firstPrimitives.size() * 2);
+    for (size_t i = 0; i < m_firstPrimitives.size(); ++i)
+    {
+        offsets.push_back(m_firstPrimitives[i]);
+        offsets.push_back(m_firstVertices[i]);
+    }
+    return offsets;
+}
+
+uint32_t VSceneTable::FindInstance(uint32_t primitive) const
+{
+    assert(primitive < m_primitiveCount);
+
+    //Last instance starting at or before the primitive, empty instances share their offset with the next one
+    const auto it = std::upper_bound(m_firstPrimitives.begin(), m_firstPrimitives.end(), primitive);
+    return static_cast<uint32_t>(it - m_firstPrimitives.begin() - 1);
+}
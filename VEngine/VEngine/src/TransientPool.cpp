@@ -0,0 +1,111 @@
+#include <VTransientPool.h>
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        if (alignment <= 1)
+            return value;
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+uint32_t VTransientPool::Add(uint64_t size, uint64_t alignment, uint32_t firstUse, uint32_t lastUse, uint32_t memoryTypeBits)
+{
+    assert(firstUse <= lastUse);
+
+    Resource resource{};
+    resource.size = size;
+    resource.alignment = alignment == 0 ? 1 : alignment;
+    resource.memoryTypeBits = memoryTypeBits;
+    resource.firstUse = firstUse;
+    resource.lastUse = lastUse;
+    resource.offset = 0;
+    m_resources.push_back(resource);
+    return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint64_t VTransientPool::Place()
+{
+    //Place the biggest resources first, ties are broken by lifetime then declaration order
+    //so the same declarations always produce the same layout
+    std::vector<uint32_t> order(m_resources.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+    {
+        const Resource& ra = m_resources[a];
+        const Resource& rb = m_resources[b];
+        if (ra.size != rb.size)
+            return ra.size > rb.size;
+        if (ra.firstUse != rb.firstUse)
+            return ra.firstUse < rb.firstUse;
+        return a < b;
+    });
+
+    m_size = 0;
+    std::vector<uint32_t> placed;
+    std::vector<std::pair<uint64_t, uint64_t>> busy;
+    for (uint32_t id : order)
+    {
+        Resource& resource = m_resources[id];
+
+        //Byte ranges already taken by resources alive at the same time
+        busy.clear();
+        for (uint32_t other : placed)
+        {
+            const Resource& o = m_resources[other];
+            if (Overlaps(resource, o))
+                busy.emplace_back(o.offset, o.offset + o.size);
+        }
+        std::sort(busy.begin(), busy.end());
+
+        //First fit: lowest aligned offset that does not intersect a busy range
+        uint64_t offset = 0;
+        for (const auto& range : busy)
+        {
+            if (AlignUp(offset, resource.alignment) + resource.size <= range.first)
+                break;
+            offset = std::max(offset, range.second);
+        }
+        resource.offset = AlignUp(offset, resource.alignment);
+
+        m_size = std::max(m_size, resource.offset + resource.size);
+        placed.push_back(id);
+    }
+
+    return m_size;
+}
+
+void VTransientPool::Clear()
+{
+    m_resources.clear();
+    m_size = 0;
+}
+
+uint64_t VTransientPool::GetUnaliasedSize() const
+{
+    uint64_t size = 0;
+    for (const auto& resource : m_resources)
+        size = AlignUp(size, resource.alignment) + resource.size;
+    return size;
+}
+
+uint32_t VTransientPool::GetMemoryTypeBits() const
+{
+    uint32_t bits = ~0u;
+    for (const auto& resource : m_resources)
+        bits &= resource.memoryTypeBits;
+    return bits;
+}
+
+uint64_t VTransientPool::GetAlignment() const
+{
+    uint64_t alignment = 1;
+    for (const auto& resource : m_resources)
+        alignment = std::max(alignment, resource.alignment);
+    return alignment;
+}
@@ -0,0 +1,94 @@
+#include <VWavefront.h>
+
+using namespace VWavefrontShader;
+
+void VWavefrontScheduler::Run(uint32_t pathCount, uint32_t maxBounces, const Stages& stages)
+{
+    m_stats.clear();
+    for (auto& queue : m_rayQueues)
+        queue.resize(pathCount);
+    m_sortedQueue.resize(pathCount);
+    m_shadowQueue.resize(pathCount);
+    m_bins.resize(pathCount);
+    m_rayCounts[0] = 0;
+    m_rayCounts[1] = 0;
+
+    //Camera stage: every path queues its camera ray
+    m_jobSystem.ParallelFor(pathCount, 0, [this](size_t begin, size_t end)
+    {
+        for (size_t path = begin; path < end; ++path)
+            m_rayQueues[0][m_rayCounts[0].fetch_add(1, std::memory_order_relaxed)] = static_cast<uint32_t>(path);
+    });
+
+    for (uint32_t bounce = 0; bounce <= maxBounces; ++bounce)
+    {
+        //The GPU can't see the counters and runs every bounce, an empty queue does the same as stopping here
+        const uint32_t current = bounce & 1u;
+        const uint32_t next = current ^ 1u;
+        const uint32_t rayCount = m_rayCounts[current].load();
+        if (rayCount == 0)
+            break;
+
+        m_rayCounts[next] = 0;
+        m_shadowCount = 0;
+        for (uint32_t bin = 0; bin < WAVEFRONT_BIN_COUNT; ++bin)
+        {
+            m_binCounts[bin] = 0;
+            m_binCursors[bin] = 0;
+        }
+
+        //Extension stage: closest hit of every queued path
+        const std::vector<uint32_t>& queue = m_rayQueues[current];
+        m_jobSystem.ParallelFor(rayCount, 0, [&](size_t begin, size_t end)
+        {
+            for (size_t lane = begin; lane < end; ++lane)
+                m_bins[queue[lane]] = stages.extend(queue[lane], bounce);
+        });
+
+        //Counting sort by bin: size every bin, then write each path at the offset of its bin
+        m_jobSystem.ParallelFor(rayCount, 0, [&](size_t begin, size_t end)
+        {
+            for (size_t lane = begin; lane < end; ++lane)
+                m_binCounts[m_bins[queue[lane]]].fetch_add(1, std::memory_order_relaxed);
+        });
+
+        uvec4 binCounts(0);
+        for (uint32_t bin = 0; bin < WAVEFRONT_BIN_COUNT; ++bin)
+            binCounts[bin] = m_binCounts[bin].load();
+
+        m_jobSystem.ParallelFor(rayCount, 0, [&](size_t begin, size_t end)
+        {
+            for (size_t lane = begin; lane < end; ++lane)
+            {
+                const uint32_t path = queue[lane];
+                const uint32_t bin = m_bins[path];
+                m_sortedQueue[WavefrontBinOffset(binCounts, bin) + m_binCursors[bin].fetch_add(1, std::memory_order_relaxed)] = path;
+            }
+        });
+
+        //Shading stage: queues the shadow ray and the next extension ray of every path
+        m_jobSystem.ParallelFor(rayCount, 0, [&](size_t begin, size_t end)
+        {
+            for (size_t lane = begin; lane < end; ++lane)
+            {
+                const uint32_t path = m_sortedQueue[lane];
+                bool shadowRay = false;
+                const bool extend = stages.shade(path, m_bins[path], bounce, shadowRay);
+                if (shadowRay)
+                    m_shadowQueue[m_shadowCount.fetch_add(1, std::memory_order_relaxed)] = path;
+                if (extend && bounce < maxBounces)
+                    m_rayQueues[next][m_rayCounts[next].fetch_add(1, std::memory_order_relaxed)] = path;
+            }
+        });
+
+        //Shadow stage
+        const uint32_t shadowCount = m_shadowCount.load();
+        m_jobSystem.ParallelFor(shadowCount, 0, [&](size_t begin, size_t end)
+        {
+            for (size_t lane = begin; lane < end; ++lane)
+                stages.shadow(m_shadowQueue[lane], bounce);
+        });
+
+        m_stats.push_back({ rayCount, shadowCount, binCounts });
+    }
+}
@@ -0,0 +1,1015 @@
+#include <VCamera.h>
+#include <VDeletionQueue.h>
+#include <VDenoiser.h>
+#include <VJobSystem.h>
+#include <VLightBvh.h>
+#include <VLightTable.h>
+#include <VPrimitive.h>
+#include <VSampler.h>
+#include <VSceneTable.h>
+#include <VTransientPool.h>
+#include <VWavefront.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+/**
+* CPU tests of the engine modules that run without a device.
+*
+* Usage: engine_tests [name], runs every test or only the named one (CMakeLists.txt registers one ctest per name)
+*/
+namespace
+{
+    int g_failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { std::printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); ++g_failures; } } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+    do { const double va = (a), vb = (b); if (!(std::abs(va - vb) <= (tolerance))) { \
+        std::printf("  %s:%d: CHECK_NEAR(%s, %s) failed: %g vs %g\n", __FILE__, __LINE__, #a, #b, va, vb); ++g_failures; } } while (0)
+
+    /** @brief Deterministic pseudo random values (PCG hash), the tests must not depend on the run */
+    class TestRandom
+    {
+    public:
+        explicit TestRandom(uint32_t seed) : m_state(seed) {}
+
+        uint32_t Next()
+        {
+            const uint32_t state = m_state * 747796405u + 2891336453u;
+            const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            m_state = (word >> 22u) ^ word;
+            return m_state;
+        }
+        uint32_t Next(uint32_t range) { return Next() % range; }
+        float NextFloat() { return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f); }
+
+    private:
+        uint32_t m_state;
+    };
+
+    void TestDeletionQueue()
+    {
+        VDeletionQueue queue;
+        std::vector<int> released;
+
+        queue.Push(3, [&] { released.push_back(30); });
+        queue.Push(1, [&] { released.push_back(10); });
+        queue.Push(3, [&] { released.push_back(31); });
+        queue.Push(2, [&] { released.push_back(20); });
+        CHECK(queue.Size() == 4);
+
+        //Nothing is released before its frame has completed
+        CHECK(queue.Collect(0) == 0);
+        CHECK(released.empty());
+
+        CHECK(queue.Collect(2) == 2);
+        CHECK((released == std::vector<int>{ 10, 20 }));
+
+        //Entries of the same frame keep their push order
+        CHECK(queue.Collect(3) == 2);
+        CHECK((released == std::vector<int>{ 10, 20, 30, 31 }));
+        CHECK(queue.Empty());
+
+        //A deleter can queue another resource, it waits for its own frame
+        released.clear();
+        queue.Push(5, [&]
+        {
+            released.push_back(50);
+            queue.Push(6, [&] { released.push_back(60); });
+        });
+        CHECK(queue.Collect(5) == 1);
+        CHECK((released == std::vector<int>{ 50 }));
+        CHECK(queue.Size() == 1);
+
+        queue.Flush();
+        CHECK((released == std::vector<int>{ 50, 60 }));
+        CHECK(queue.Empty());
+    }
+
+    void FillPool(VTransientPool& pool, uint32_t seed, uint32_t count)
+    {
+        TestRandom random(seed);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t firstUse = random.Next(8);
+            const uint32_t lastUse = firstUse + random.Next(4);
+            const uint64_t size = 256 * (1 + random.Next(64));
+            const uint64_t alignment = 1ull << (4 + random.Next(5));
+            pool.Add(size, alignment, firstUse, lastUse);
+        }
+    }
+
+    void TestTransientPool()
+    {
+        for (uint32_t seed = 1; seed <= 20; ++seed)
+        {
+            VTransientPool pool;
+            FillPool(pool, seed, 40);
+            const uint64_t size = pool.Place();
+
+            //Same declarations, same layout
+            VTransientPool other;
+            FillPool(other, seed, 40);
+            CHECK(other.Place() == size);
+            for (uint32_t i = 0; i < pool.GetResourceCount(); ++i)
+                CHECK(other.GetOffset(i) == pool.GetOffset(i));
+
+            //Placing again does not move anything
+            std::vector<uint64_t> offsets(pool.GetResourceCount());
+            for (uint32_t i = 0; i < offsets.size(); ++i)
+                offsets[i] = pool.GetOffset(i);
+            CHECK(pool.Place() == size);
+            for (uint32_t i = 0; i < offsets.size(); ++i)
+                CHECK(pool.GetOffset(i) == offsets[i]);
+
+            CHECK(size <= pool.GetUnaliasedSize());
+            for (uint32_t i = 0; i < pool.GetResourceCount(); ++i)
+            {
+                const VTransientPool::Resource& a = pool.GetResource(i);
+                CHECK(a.offset % a.alignment == 0);
+                CHECK(a.offset + a.size <= size);
+
+                //Resources alive at the same time never share a byte
+                for (uint32_t j = i + 1; j < pool.GetResourceCount(); ++j)
+                {
+                    const VTransientPool::Resource& b = pool.GetResource(j);
+                    if (VTransientPool::Overlaps(a, b))
+                        CHECK(a.offset + a.size <= b.offset || b.offset + b.size <= a.offset);
+                }
+            }
+        }
+
+        //Disjoint lifetimes alias the same bytes, overlapping ones are packed side by side
+        VTransientPool pool;
+        const uint32_t a = pool.Add(1024, 256, 0, 1);
+        const uint32_t b = pool.Add(512, 256, 2, 3);
+        const uint32_t c = pool.Add(512, 256, 3, 3);
+        CHECK(pool.Place() == 1024);
+        CHECK(pool.GetOffset(a) == 0);
+        CHECK(pool.GetOffset(b) == 0);
+        CHECK(pool.GetOffset(c) == 512);
+        CHECK(pool.GetUnaliasedSize() == 2048);
+    }
+
+    void TestSceneTable()
+    {
+        VSceneTable table;
+        TestRandom random(7);
+        std::vector<uint32_t> primitiveCounts;
+        std::vector<uint32_t> vertexCounts;
+        for (uint32_t i = 0; i < 200; ++i)
+        {
+            //Some instances are empty, they must never own a primitive
+            const uint32_t primitives = random.Next(4) == 0 ? 0 : 1 + random.Next(100);
+            const uint32_t vertices = primitives * 3;
+            CHECK(table.Add(primitives, vertices) == i);
+            primitiveCounts.push_back(primitives);
+            vertexCounts.push_back(vertices);
+        }
+
+        //Exclusive prefix sums of the counts
+        uint32_t firstPrimitive = 0;
+        uint32_t firstVertex = 0;
+        const std::vector<uint32_t> offsets = table.GetInstanceOffsets();
+        CHECK(offsets.size() == 2 * primitiveCounts.size());
+        for (uint32_t i = 0; i < primitiveCounts.size(); ++i)
+        {
+            CHECK(table.GetFirstPrimitive(i) == firstPrimitive);
+            CHECK(table.GetFirstVertex(i) == firstVertex);
+            CHECK(offsets[2 * i] == firstPrimitive);
+            CHECK(offsets[2 * i + 1] == firstVertex);
+            firstPrimitive += primitiveCounts[i];
+            firstVertex += vertexCounts[i];
+        }
+        CHECK(table.GetPrimitiveCount() == firstPrimitive);
+        CHECK(table.GetVertexCount() == firstVertex);
+
+        //Lookup against a linear scan over the instances
+        uint32_t instance = 0;
+        uint32_t end = primitiveCounts[0];
+        for (uint32_t primitive = 0; primitive < table.GetPrimitiveCount(); ++primitive)
+        {
+            while (primitive >= end)
+                end += primitiveCounts[++instance];
+            CHECK(table.FindInstance(primitive) == instance);
+        }
+
+        table.Clear();
+        CHECK(table.GetInstanceCount() == 0);
+        CHECK(table.GetPrimitiveCount() == 0);
+    }
+
+    //Ray generation of ray_gen.glsl before BuildRayConstants: unproject the pixel with the inverse matrices
+    void InverseMatrixRay(const Camera& camera, glm::uvec2 pixel, glm::uvec2 size, glm::vec3& origin, glm::vec3& direction)
+    {
+        const glm::vec2 d = glm::vec2(pixel) / glm::vec2(size) * 2.0f - 1.0f;
+        const glm::mat4 viewInverse = glm::inverse(camera.matrices.view);
+        const glm::mat4 projInverse = glm::inverse(camera.matrices.perspective);
+        const glm::vec4 target = projInverse * glm::vec4(d.x, d.y, -1.0f, 1.0f);
+        origin = glm::vec3(viewInverse * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        direction = glm::normalize(glm::vec3(viewInverse * glm::vec4(glm::normalize(glm::vec3(target)), 0.0f)));
+    }
+
+    void TestCameraRays()
+    {
+        const glm::uvec2 size(320, 180);
+
+        Camera camera;
+        camera.Pitch = -20.0f;
+        camera.Yaw = 35.0f;
+        camera.setPerspective(60.0f, static_cast<float>(size.x) / static_cast<float>(size.y), 0.1f, 512.0f);
+        camera.setPosition(glm::vec3(1.0f, 2.0f, -3.0f));
+
+        const CameraConstants constants = camera.BuildRayConstants(size.x, size.y, glm::vec2(0.0f));
+        for (uint32_t y = 0; y < size.y; y += 7)
+        {
+            for (uint32_t x = 0; x < size.x; x += 11)
+            {
+                glm::vec3 origin, direction, referenceOrigin, referenceDirection;
+                Camera::GenerateRay(constants, glm::uvec2(x, y), glm::vec2(0.0f), origin, direction);
+                InverseMatrixRay(camera, glm::uvec2(x, y), size, referenceOrigin, referenceDirection);
+                CHECK(glm::length(origin - referenceOrigin) < 1e-4f);
+                CHECK(glm::length(direction - referenceDirection) < 1e-5f);
+            }
+        }
+
+        //Thin lens: every lens sample of a pixel converges on the pinhole ray at the focus distance
+        camera.apertureRadius = 0.1f;
+        camera.focusDistance = 6.0f;
+        const CameraConstants lens = camera.BuildRayConstants(size.x, size.y, glm::vec2(0.25f, 0.75f));
+        CHECK(lens.lowerLeft.w == 1.0f);
+        TestRandom random(3);
+        for (uint32_t i = 0; i < 64; ++i)
+        {
+            const glm::uvec2 pixel(random.Next(size.x), random.Next(size.y));
+            glm::vec3 pinholeOrigin, pinholeDirection, origin, direction;
+            CameraConstants pinhole = lens;
+            pinhole.lowerLeft.w = 0.0f;
+            Camera::GenerateRay(pinhole, pixel, glm::vec2(0.0f), pinholeOrigin, pinholeDirection);
+            const glm::vec3 focusPoint = pinholeOrigin + pinholeDirection * (camera.focusDistance / glm::dot(pinholeDirection, camera.Front));
+
+            const float angle = random.NextFloat() * 6.2831853f;
+            const glm::vec2 lensSample = std::sqrt(random.NextFloat()) * glm::vec2(std::cos(angle), std::sin(angle));
+            Camera::GenerateRay(lens, pixel, lensSample, origin, direction);
+            CHECK(glm::length(origin - pinholeOrigin) <= camera.apertureRadius * 1.001f);
+            CHECK(glm::length(origin + direction * glm::length(focusPoint - origin) - focusPoint) < 1e-4f);
+        }
+
+        //ReSTIR reprojection (ReprojectPixel of ray_gen.glsl): a point seen through a pixel of a jittered frame maps
+        //back to that pixel from the ray constants of the frame
+        const auto reproject = [&](const CameraConstants& previous, const glm::vec3& p, glm::ivec2& pixel)
+        {
+            const glm::vec3 lowerLeft(previous.lowerLeft), du(previous.du), dv(previous.dv);
+            const glm::vec3 forward = lowerLeft - du * (glm::dot(lowerLeft, du) / glm::dot(du, du)) - dv * (glm::dot(lowerLeft, dv) / glm::dot(dv, dv));
+            const glm::vec3 dir = p - glm::vec3(previous.origin);
+            const float z = glm::dot(dir, forward) / glm::dot(forward, forward);
+            if (z <= 0.0f)
+                return false;
+            const glm::vec3 onPlane = dir / z - lowerLeft;
+            const glm::vec2 coords = glm::vec2(glm::dot(onPlane, du) / glm::dot(du, du), glm::dot(onPlane, dv) / glm::dot(dv, dv)) - glm::vec2(previous.du.w, previous.dv.w);
+            pixel = glm::ivec2(glm::floor(coords + 0.5f));
+            return pixel.x >= 0 && pixel.y >= 0 && pixel.x < static_cast<int>(size.x) && pixel.y < static_cast<int>(size.y);
+        };
+        camera.apertureRadius = 0.0f;
+        uint32_t reprojectionFailures = 0;
+        for (uint32_t frame = 0; frame < 4; ++frame)
+        {
+            const CameraConstants jittered = camera.BuildRayConstants(size.x, size.y, glm::vec2(Camera::Halton(frame + 1, 2), Camera::Halton(frame + 1, 3)));
+            for (uint32_t y = 0; y < size.y; ++y)
+            {
+                for (uint32_t x = 0; x < size.x; ++x)
+                {
+                    glm::vec3 origin, direction;
+                    Camera::GenerateRay(jittered, glm::uvec2(x, y), glm::vec2(0.0f), origin, direction);
+                    glm::ivec2 pixel;
+                    reprojectionFailures += !reproject(jittered, origin + direction * (1.0f + 0.1f * ((x + y) % 50)), pixel) || pixel != glm::ivec2(x, y);
+                }
+            }
+        }
+        CHECK(reprojectionFailures == 0);
+    }
+
+    //PixelSample2D of pixel_sampler.glsl, with the blue-noise buffer and the sampler type as parameters
+    glm::vec2 ShaderSample2D(SamplerType type, const std::vector<uint32_t>& blueNoise, glm::uvec2 pixel, uint32_t pixelSeed,
+        uint32_t sampleIndex, uint32_t dimension)
+    {
+        using namespace VSampling;
+        const uint samplerType = static_cast<uint>(type);
+
+        if (samplerType == SAMPLER_SOBOL)
+            return OwenSobol2D(sampleIndex, HashCombine(pixelSeed, dimension));
+
+        if (samplerType == SAMPLER_BLUE_NOISE)
+        {
+            uint mask = BLUE_NOISE_SIZE - 1;
+            uvec2 offset = BlueNoiseOffset(dimension);
+            uint x = blueNoise[((pixel.y + offset.y) & mask) * BLUE_NOISE_SIZE + ((pixel.x + offset.x) & mask)];
+            uint y = blueNoise[((pixel.y + offset.x) & mask) * BLUE_NOISE_SIZE + ((pixel.x + offset.y) & mask)];
+            return BlueNoise2D(sampleIndex, uvec2(x, y));
+        }
+
+        uint h = RandomHash(pixelSeed, sampleIndex, dimension);
+        return vec2(ToUnitFloat(h), ToUnitFloat(PcgHash(h)));
+    }
+
+    void TestSampler()
+    {
+        //First points of the second Sobol dimension, in index order (not Gray code order)
+        const float sobol1[] = { 0.0f, 0.5f, 0.75f, 0.25f, 0.625f, 0.125f, 0.375f, 0.875f };
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            CHECK(VSampling::SobolDimension0(i) == VSampling::bitfieldReverse(i));
+            CHECK_NEAR(VSampling::SobolDimension1(i) / 4294967296.0, sobol1[i], 0.0);
+        }
+
+        //Same sequences as the shaders, the bounces start at their own dimension
+        const uint32_t width = 97;
+        std::vector<uint32_t> blueNoise(VSampling::BLUE_NOISE_SIZE * VSampling::BLUE_NOISE_SIZE);
+        TestRandom random(11);
+        for (uint32_t& rank : blueNoise)
+            rank = random.Next();
+
+        for (uint32_t type = 0; type < SAMPLER_TYPE_COUNT; ++type)
+        {
+            VSampler sampler(static_cast<SamplerType>(type), &blueNoise);
+            for (uint32_t i = 0; i < 32; ++i)
+            {
+                const glm::uvec2 pixel(random.Next(width), random.Next(200));
+                const uint32_t sampleIndex = random.Next(4096);
+                const uint32_t pixelSeed = VSampling::PcgHash(pixel.y * width + pixel.x);
+                sampler.StartPixel(pixel.x, pixel.y, width, sampleIndex);
+                for (uint32_t bounce = 0; bounce < 3; ++bounce)
+                {
+                    sampler.StartBounce(bounce);
+                    for (uint32_t k = 0; k < 4; ++k)
+                    {
+                        const glm::vec2 value = sampler.Next2D();
+                        const uint32_t dimension = bounce * VSampling::DIMENSIONS_PER_BOUNCE + k;
+                        const glm::vec2 reference = ShaderSample2D(static_cast<SamplerType>(type), blueNoise, pixel, pixelSeed, sampleIndex, dimension);
+                        CHECK(value == reference);
+                        CHECK(value.x >= 0.0f && value.x < 1.0f && value.y >= 0.0f && value.y < 1.0f);
+                    }
+                }
+            }
+        }
+
+        //Owen-scrambled Sobol keeps the (0,2)-sequence stratification: the first 16 points of a pixel fill every
+        //elementary interval of area 1/16 once
+        VSampler sobol(SamplerType::Sobol);
+        for (uint32_t pixel = 0; pixel < 8; ++pixel)
+        {
+            std::vector<glm::vec2> points;
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                sobol.StartPixel(pixel, 0, width, i);
+                sobol.StartBounce(1);
+                points.push_back(sobol.Next2D());
+            }
+            for (uint32_t columns = 1; columns <= 16; columns *= 2)
+            {
+                const uint32_t rows = 16 / columns;
+                std::vector<uint32_t> cells(16, 0);
+                for (const glm::vec2& p : points)
+                    cells[static_cast<uint32_t>(p.y * rows) * columns + static_cast<uint32_t>(p.x * columns)]++;
+                CHECK(std::all_of(cells.begin(), cells.end(), [](uint32_t n) { return n == 1; }));
+            }
+        }
+
+        //Convergence: per pixel estimates of a smooth integrand (x * y, 1/4) and of a discontinuous one (quarter disk,
+        //pi / 4) over the first samples, the low-discrepancy sequences must clearly beat independent random samples
+        const std::vector<uint32_t> tile = VSampler::GenerateBlueNoiseTile();
+        const auto rmse = [&](SamplerType type, uint32_t sampleCount, const std::function<float(glm::vec2)>& integrand, double reference)
+        {
+            VSampler estimator(type, &tile);
+            double sum = 0.0;
+            const uint32_t pixelCount = 256;
+            for (uint32_t pixel = 0; pixel < pixelCount; ++pixel)
+            {
+                double estimate = 0.0;
+                for (uint32_t i = 0; i < sampleCount; ++i)
+                {
+                    estimator.StartPixel(pixel % 16, pixel / 16, width, i);
+                    estimate += integrand(estimator.Next2D());
+                }
+                const double error = estimate / sampleCount - reference;
+                sum += error * error;
+            }
+            return std::sqrt(sum / pixelCount);
+        };
+        const auto product = [](glm::vec2 p) { return p.x * p.y; };
+        const auto disk = [](glm::vec2 p) { return glm::dot(p, p) < 1.0f ? 1.0f : 0.0f; };
+        for (uint32_t sampleCount : { 16u, 64u })
+        {
+            double errors[2][SAMPLER_TYPE_COUNT];
+            for (uint32_t type = 0; type < SAMPLER_TYPE_COUNT; ++type)
+            {
+                errors[0][type] = rmse(static_cast<SamplerType>(type), sampleCount, product, 0.25);
+                errors[1][type] = rmse(static_cast<SamplerType>(type), sampleCount, disk, 0.78539816);
+            }
+            std::printf("  %u spp rmse x*y: random %.5f, sobol %.5f, blue noise %.5f | disk: random %.5f, sobol %.5f, blue noise %.5f\n",
+                sampleCount, errors[0][0], errors[0][1], errors[0][2], errors[1][0], errors[1][1], errors[1][2]);
+            for (int integrand = 0; integrand < 2; ++integrand)
+            {
+                CHECK(errors[integrand][VSampling::SAMPLER_SOBOL] < 0.8 * errors[integrand][VSampling::SAMPLER_RANDOM]);
+                CHECK(errors[integrand][VSampling::SAMPLER_BLUE_NOISE] < 0.8 * errors[integrand][VSampling::SAMPLER_RANDOM]);
+            }
+        }
+
+        //The blue-noise tile holds every rank once, centered in its interval
+        const uint32_t tileSize = 16;
+        std::vector<uint32_t> smallTile = VSampler::GenerateBlueNoiseTile(tileSize, 5);
+        CHECK(smallTile.size() == tileSize * tileSize);
+        std::sort(smallTile.begin(), smallTile.end());
+        for (uint32_t rank = 0; rank < smallTile.size(); ++rank)
+            CHECK(smallTile[rank] == static_cast<uint32_t>(((static_cast<uint64_t>(rank) << 32) + (1ull << 31)) / smallTile.size()));
+    }
+
+    /** @brief Probability of picking each light through the alias table, as SampleLight of ray_gen.glsl does */
+    std::vector<double> AliasPickProbabilities(const std::vector<VLightTable::AliasEntry>& table)
+    {
+        std::vector<double> probabilities(table.size(), 0.0);
+        for (const VLightTable::AliasEntry& entry : table)
+        {
+            const size_t index = &entry - table.data();
+            probabilities[index] += entry.probability / static_cast<double>(table.size());
+            probabilities[entry.alias] += (1.0 - entry.probability) / static_cast<double>(table.size());
+        }
+        return probabilities;
+    }
+
+    VLight MakeLight(const glm::vec3& position, float radius, const glm::vec3& color, float intensity)
+    {
+        VLight light;
+        light.SetPosition(position);
+        light.SetRadius(radius);
+        light.SetColor(color.r, color.g, color.b);
+        light.SetIntensity(intensity);
+        return light;
+    }
+
+    /**
+    * Relative standard deviation of the one-light estimator of sum(power / d²) at points around the reference, with
+    * the pick probabilities of the table or with uniform picking. Exact variance, no sampling noise in the comparison.
+    */
+    void LightPickNoise(const VLightTable& table, const glm::vec3& reference, float spread, double& aliasNoise, double& uniformNoise)
+    {
+        const std::vector<VLightData>& lights = table.GetLights();
+        const std::vector<double> probabilities = AliasPickProbabilities(table.GetAliasTable());
+        TestRandom random(5);
+        aliasNoise = 0.0;
+        uniformNoise = 0.0;
+        const uint32_t pointCount = 1024;
+        for (uint32_t p = 0; p < pointCount; ++p)
+        {
+            const glm::vec3 point = reference + spread * (glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 2.0f - 1.0f);
+            double total = 0.0, aliasMoment = 0.0, uniformMoment = 0.0;
+            for (size_t i = 0; i < lights.size(); ++i)
+            {
+                const double contribution = VLightTable::EstimateContribution(lights[i], point);
+                total += contribution;
+                aliasMoment += contribution * contribution / probabilities[i];
+                uniformMoment += contribution * contribution * static_cast<double>(lights.size());
+            }
+            aliasNoise += std::sqrt(std::max(aliasMoment - total * total, 0.0)) / total;
+            uniformNoise += std::sqrt(std::max(uniformMoment - total * total, 0.0)) / total;
+        }
+        aliasNoise /= pointCount;
+        uniformNoise /= pointCount;
+    }
+
+    void TestLightTable()
+    {
+        const glm::vec3 camera(0, -2, 0);
+        const auto checkTable = [](const VLightTable& table, const std::vector<double>& expected)
+        {
+            const std::vector<VLightTable::AliasEntry>& entries = table.GetAliasTable();
+            CHECK(entries.size() == expected.size());
+            const std::vector<double> probabilities = AliasPickProbabilities(entries);
+            for (size_t i = 0; i < entries.size(); ++i)
+            {
+                CHECK(entries[i].probability >= 0.0f && entries[i].probability <= 1.0f);
+                CHECK(entries[i].alias < entries.size());
+                CHECK_NEAR(probabilities[i], expected[i], 1e-5);
+                CHECK_NEAR(entries[i].pdf, expected[i], 1e-5);
+            }
+        };
+        const auto weights = [&](const std::vector<VLight>& lights)
+        {
+            std::vector<double> result;
+            double total = 0.0;
+            for (const VLight& light : lights)
+            {
+                result.push_back(VLightTable::EstimateContribution(light.data, camera));
+                total += result.back();
+            }
+            for (double& weight : result)
+                weight /= total;
+            return result;
+        };
+
+        VLightTable table;
+        table.Build({}, camera);
+        CHECK(table.GetLightCount() == 0 && table.GetAliasTable().empty());
+
+        //One light is always picked
+        table.Build({ MakeLight({ 3, -5, 1 }, 0.5f, { 1, 1, 1 }, 10) }, camera);
+        checkTable(table, { 1.0 });
+
+        //Random powers and distances reproduce power / d²
+        TestRandom random(7);
+        std::vector<VLight> lights;
+        for (uint32_t i = 0; i < 37; ++i)
+        {
+            const glm::vec3 position = glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 40.0f - 20.0f;
+            lights.push_back(MakeLight(position, 0.1f + random.NextFloat(), { random.NextFloat(), random.NextFloat(), random.NextFloat() }, 1.0f + 100.0f * random.NextFloat()));
+        }
+        table.Build(lights, camera);
+        CHECK(table.GetLightCount() == lights.size());
+        checkTable(table, weights(lights));
+
+        //Lights without power are never picked, the others keep their ratios
+        lights[3].SetIntensity(0);
+        lights[20].SetIntensity(0);
+        lights[36].SetColor(0, 0, 0);
+        table.Build(lights, camera);
+        std::vector<double> expected = weights(lights);
+        CHECK(expected[3] == 0.0 && expected[20] == 0.0 && expected[36] == 0.0);
+        checkTable(table, expected);
+
+        //No light expected to contribute: uniform picking rather than an invalid table
+        for (VLight& light : lights)
+            light.SetIntensity(0);
+        table.Build(lights, camera);
+        checkTable(table, std::vector<double>(lights.size(), 1.0 / lights.size()));
+
+        //Equal weights: every entry keeps itself
+        std::vector<VLight> ring;
+        for (uint32_t i = 0; i < 12; ++i)
+        {
+            const float angle = 6.2831853f * i / 12.0f;
+            ring.push_back(MakeLight(camera + 5.0f * glm::vec3(std::cos(angle), 0, std::sin(angle)), 0.5f, { 1, 1, 1 }, 20));
+        }
+        table.Build(ring, camera);
+        checkTable(table, std::vector<double>(ring.size(), 1.0 / ring.size()));
+        for (const VLightTable::AliasEntry& entry : table.GetAliasTable())
+            CHECK_NEAR(entry.probability, 1.0, 1e-5);
+
+        //Noise of the direct light estimator against uniform picking, for the lights of SetupGame and for a scene with
+        //many lights of uneven power, at points up to 10 units away from the camera the table was built at
+        std::vector<VLight> gameLights = {
+            MakeLight({ 0, -200, -1200 }, 100, { 1, 1, 1 }, 1.5e6f),
+            MakeLight({ -3, -8, 4 }, 0.5f, { 1.0f, 0.6f, 0.3f }, 20),
+            MakeLight({ 4, -9, -10 }, 0.5f, { 0.4f, 0.6f, 1.0f }, 30) };
+        std::vector<VLight> manyLights;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            const glm::vec3 position = glm::vec3(random.NextFloat(), random.NextFloat() * 0.25f, random.NextFloat()) * 100.0f - glm::vec3(50, 25, 50);
+            manyLights.push_back(MakeLight(position, 0.5f, { 1, 1, 1 }, std::pow(10.0f, 3.0f * random.NextFloat())));
+        }
+        for (const std::vector<VLight>* scene : { &gameLights, &manyLights })
+        {
+            table.Build(*scene, camera);
+            double aliasNoise, uniformNoise;
+            LightPickNoise(table, camera, 10.0f, aliasNoise, uniformNoise);
+            std::printf("  %zu lights, relative standard deviation per shadow sample: uniform %.3f, alias table %.3f\n",
+                scene->size(), uniformNoise, aliasNoise);
+            CHECK(aliasNoise <= uniformNoise);
+        }
+    }
+
+    /** @brief Probability of every light under the traversal of the tree, by walking down every branch */
+    std::vector<double> LightBvhPdfs(const VLightBvh& bvh, size_t lightCount, const glm::vec3& position, const glm::vec3& normal)
+    {
+        std::vector<double> pdfs(lightCount, 0.0);
+        const std::vector<VLightBvhNode>& nodes = bvh.GetNodes();
+        const std::function<void(uint32_t, double)> visit = [&](uint32_t index, double probability)
+        {
+            const VLightBvhNode& node = nodes[index];
+            if (node.second == 0xffffffffu)
+            {
+                pdfs[node.first] += probability;
+                return;
+            }
+            const double left = VLightBvh::Importance(nodes[node.first], position, normal);
+            const double right = VLightBvh::Importance(nodes[node.second], position, normal);
+            if (left + right <= 0.0)
+                return;
+            visit(node.first, probability * left / (left + right));
+            visit(node.second, probability * right / (left + right));
+        };
+        if (!nodes.empty())
+            visit(0, 1.0);
+        return pdfs;
+    }
+
+    void TestLightBvh()
+    {
+        VJobSystem jobSystem(4);
+        VLightBvh bvh;
+        bvh.Build({}, jobSystem);
+        CHECK(bvh.GetNodeCount() == 0);
+
+        TestRandom random(13);
+        for (uint32_t count : { 1u, 2u, 3u, 17u, 1000u, 10000u })
+        {
+            std::vector<VLightData> lights(count);
+            for (VLightData& light : lights)
+            {
+                light.position = glm::vec4(glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 200.0f - 100.0f, 0.05f + random.NextFloat());
+                light.colorIntensity = glm::vec4(random.NextFloat(), random.NextFloat(), random.NextFloat(), 1.0f + 50.0f * random.NextFloat());
+            }
+            //Lights at the same place share a Morton code, the light index still separates them
+            if (count > 3)
+                lights[1].position = lights[0].position;
+            bvh.Build(lights, jobSystem);
+            const std::vector<VLightBvhNode>& nodes = bvh.GetNodes();
+            CHECK(nodes.size() == 2 * count - 1);
+
+            //Every node is reached once from the root, every light has one leaf
+            std::vector<uint32_t> nodeVisits(nodes.size(), 0);
+            std::vector<uint32_t> lightVisits(count, 0);
+            std::vector<uint32_t> stack = { 0 };
+            while (!stack.empty() && stack.size() <= nodes.size())
+            {
+                const uint32_t index = stack.back();
+                stack.pop_back();
+                if (index >= nodes.size() || nodeVisits[index]++ > 0)
+                    continue;
+                const VLightBvhNode& node = nodes[index];
+                if (node.second == 0xffffffffu)
+                {
+                    if (node.first < count)
+                        lightVisits[node.first]++;
+                    continue;
+                }
+                stack.push_back(node.first);
+                stack.push_back(node.second);
+            }
+            CHECK(std::all_of(nodeVisits.begin(), nodeVisits.end(), [](uint32_t n) { return n == 1; }));
+            CHECK(std::all_of(lightVisits.begin(), lightVisits.end(), [](uint32_t n) { return n == 1; }));
+
+            //Leaves bound their light sphere, the refit parents bound their children and sum their power
+            uint32_t boundFailures = 0;
+            for (const VLightBvhNode& node : nodes)
+            {
+                if (node.second == 0xffffffffu)
+                {
+                    const VLightData& light = lights[node.first];
+                    boundFailures += glm::any(glm::greaterThan(glm::vec3(light.position) - light.position.w, glm::vec3(node.boundsMin) + 1e-4f));
+                    boundFailures += glm::any(glm::lessThan(glm::vec3(light.position) + light.position.w, glm::vec3(node.boundsMax) - 1e-4f));
+                    boundFailures += std::abs(node.boundsMin.w - VLightTable::GetPower(light)) > 1e-4f * node.boundsMin.w;
+                    continue;
+                }
+                for (uint32_t child : { node.first, node.second })
+                {
+                    boundFailures += glm::any(glm::greaterThan(glm::vec3(node.boundsMin), glm::vec3(nodes[child].boundsMin)));
+                    boundFailures += glm::any(glm::lessThan(glm::vec3(node.boundsMax), glm::vec3(nodes[child].boundsMax)));
+                    boundFailures += node.boundsMax.w > nodes[child].boundsMax.w;
+                }
+                boundFailures += std::abs(node.boundsMin.w - (nodes[node.first].boundsMin.w + nodes[node.second].boundsMin.w)) > 1e-4f * node.boundsMin.w;
+            }
+            CHECK(boundFailures == 0);
+
+            //The pdfs of the traversal sum to 1 and SampleLight returns the pdf of the light it picked. With a shading
+            //normal, branches whose bounds are all behind the surface are dropped, but a light above it never is
+            for (uint32_t p = 0; p < 8; ++p)
+            {
+                const glm::vec3 position = glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 240.0f - 120.0f;
+                const glm::vec3 normal = p % 2 ? glm::normalize(glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) - 0.5f) : glm::vec3(0);
+                const std::vector<double> pdfs = LightBvhPdfs(bvh, count, position, normal);
+                double total = 0.0;
+                for (double pdf : pdfs)
+                    total += pdf;
+                if (p % 2 == 0)
+                    CHECK_NEAR(total, 1.0, 1e-6);
+                else
+                    CHECK(total <= 1.0 + 1e-6);
+
+                uint32_t missedLights = 0;
+                for (uint32_t light = 0; light < count; ++light)
+                    missedLights += pdfs[light] <= 0.0 && glm::dot(glm::vec3(lights[light].position) - position, normal) > lights[light].position.w;
+                CHECK(missedLights == 0);
+
+                uint32_t pdfFailures = 0;
+                for (uint32_t i = 0; i < 64; ++i)
+                {
+                    float pdf;
+                    const int32_t light = bvh.SampleLight(position, normal, (i + random.NextFloat()) / 64.0f, pdf);
+                    if (light < 0)
+                        pdfFailures += p % 2 == 0 || pdf != 0.0f;
+                    else
+                        pdfFailures += light >= static_cast<int32_t>(count) || std::abs(pdf - pdfs[light]) > 1e-4 * pdfs[light];
+                }
+                CHECK(pdfFailures == 0);
+            }
+        }
+
+        //The frequencies of the sampled lights follow the pdfs
+        std::vector<VLightData> lights(8);
+        for (VLightData& light : lights)
+        {
+            light.position = glm::vec4(glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 20.0f - 10.0f, 0.5f);
+            light.colorIntensity = glm::vec4(1, 1, 1, 1.0f + 10.0f * random.NextFloat());
+        }
+        bvh.Build(lights, jobSystem);
+        const glm::vec3 position(0, 0, 0);
+        const std::vector<double> pdfs = LightBvhPdfs(bvh, lights.size(), position, glm::vec3(0));
+        std::vector<double> frequencies(lights.size(), 0.0);
+        const uint32_t sampleCount = 1 << 16;
+        for (uint32_t i = 0; i < sampleCount; ++i)
+        {
+            float pdf;
+            frequencies[bvh.SampleLight(position, glm::vec3(0), (i + 0.5f) / sampleCount, pdf)] += 1.0 / sampleCount;
+        }
+        for (size_t i = 0; i < lights.size(); ++i)
+            CHECK_NEAR(frequencies[i], pdfs[i], 1e-3);
+    }
+
+    uint32_t StageHash(uint32_t path, uint32_t bounce, uint32_t stage)
+    {
+        return VSampling::PcgHash(VSampling::HashCombine(VSampling::HashCombine(path, bounce), stage));
+    }
+
+    uint32_t TestBin(uint32_t path, uint32_t bounce)
+    {
+        return StageHash(path, bounce, 0) % VWavefrontShader::WAVEFRONT_BIN_COUNT;
+    }
+
+    //Paths continue half of the time, misses end the path, diffuse hits trace a shadow ray
+    bool TestShade(uint32_t path, uint32_t bin, uint32_t bounce, bool& shadowRay)
+    {
+        shadowRay = bin == VWavefrontShader::WAVEFRONT_BIN_DIFFUSE;
+        return bin != VWavefrontShader::WAVEFRONT_BIN_MISS && (StageHash(path, bounce, 1) & 1u) != 0;
+    }
+
+    void TestWavefrontScheduler()
+    {
+        const uint32_t pathCount = 20000;
+        const uint32_t maxBounces = 6;
+
+        //Serial reference: every path runs its bounces one after the other
+        std::vector<VWavefrontScheduler::BounceStats> expected(maxBounces + 1, { 0, 0, glm::uvec4(0) });
+        std::vector<uint32_t> expectedShades(pathCount, 0);
+        std::vector<uint32_t> expectedShadows(pathCount, 0);
+        for (uint32_t path = 0; path < pathCount; ++path)
+        {
+            for (uint32_t bounce = 0; bounce <= maxBounces; ++bounce)
+            {
+                const uint32_t bin = TestBin(path, bounce);
+                bool shadowRay = false;
+                const bool extend = TestShade(path, bin, bounce, shadowRay);
+                expected[bounce].rays++;
+                expected[bounce].binCounts[bin]++;
+                expectedShades[path]++;
+                if (shadowRay)
+                {
+                    expected[bounce].shadowRays++;
+                    expectedShadows[path]++;
+                }
+                if (!extend)
+                    break;
+            }
+        }
+        while (!expected.empty() && expected.back().rays == 0)
+            expected.pop_back();
+
+        VJobSystem jobSystem(4);
+        VWavefrontScheduler scheduler(jobSystem);
+        for (uint32_t run = 0; run < 3; ++run)
+        {
+            std::vector<std::atomic<uint32_t>> shades(pathCount);
+            std::vector<std::atomic<uint32_t>> shadows(pathCount);
+            std::vector<std::atomic<uint32_t>> badBins(1);
+
+            VWavefrontScheduler::Stages stages;
+            stages.extend = TestBin;
+            stages.shade = [&](uint32_t path, uint32_t bin, uint32_t bounce, bool& shadowRay)
+            {
+                if (bin != TestBin(path, bounce))
+                    badBins[0]++;
+                shades[path]++;
+                return TestShade(path, bin, bounce, shadowRay);
+            };
+            stages.shadow = [&](uint32_t path, uint32_t) { shadows[path]++; };
+            scheduler.Run(pathCount, maxBounces, stages);
+
+            const std::vector<VWavefrontScheduler::BounceStats>& stats = scheduler.GetStats();
+            CHECK(stats.size() == expected.size());
+            for (size_t bounce = 0; bounce < std::min(stats.size(), expected.size()); ++bounce)
+            {
+                CHECK(stats[bounce].rays == expected[bounce].rays);
+                CHECK(stats[bounce].shadowRays == expected[bounce].shadowRays);
+                CHECK(stats[bounce].binCounts == expected[bounce].binCounts);
+            }
+            CHECK(badBins[0] == 0);
+            for (uint32_t path = 0; path < pathCount; ++path)
+            {
+                CHECK(shades[path] == expectedShades[path]);
+                CHECK(shadows[path] == expectedShadows[path]);
+            }
+
+            //The last queue is sorted by bin and holds every path of the last bounce once
+            const uint32_t lastBounce = static_cast<uint32_t>(stats.size() - 1);
+            const std::vector<uint32_t>& sorted = scheduler.GetSortedQueue();
+            std::vector<uint32_t> seen(pathCount, 0);
+            for (uint32_t lane = 0; lane < stats.back().rays; ++lane)
+            {
+                if (lane > 0)
+                    CHECK(TestBin(sorted[lane - 1], lastBounce) <= TestBin(sorted[lane], lastBounce));
+                seen[sorted[lane]]++;
+            }
+            for (uint32_t path = 0; path < pathCount; ++path)
+                CHECK(seen[path] == (expectedShades[path] == lastBounce + 1 ? 1u : 0u));
+        }
+
+        //Indirect dispatches of the compute stages (wavefront_args.comp): enough groups for the queue, no empty group
+        using VWavefrontShader::WAVEFRONT_GROUP_SIZE;
+        CHECK(VWavefrontShader::WavefrontGroupCount(0) == 0);
+        CHECK(VWavefrontShader::WavefrontGroupCount(1) == 1);
+        CHECK(VWavefrontShader::WavefrontGroupCount(WAVEFRONT_GROUP_SIZE) == 1);
+        CHECK(VWavefrontShader::WavefrontGroupCount(WAVEFRONT_GROUP_SIZE + 1) == 2);
+        CHECK(VWavefrontShader::WavefrontGroupCount(pathCount) * WAVEFRONT_GROUP_SIZE >= pathCount);
+        CHECK((VWavefrontShader::WavefrontGroupCount(pathCount) - 1) * WAVEFRONT_GROUP_SIZE < pathCount);
+    }
+
+    void TestDenoiser()
+    {
+        //Two flat walls split by a depth and normal edge, with a textured albedo and uniform noise on the radiance
+        const uint32_t width = 96;
+        const uint32_t height = 64;
+        const uint32_t edge = width / 2;
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+
+        std::vector<glm::vec4> clean(pixelCount), noisy(pixelCount), normalDepth(pixelCount), albedo(pixelCount);
+        TestRandom random(13);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const size_t i = static_cast<size_t>(y) * width + x;
+                const bool left = x < edge;
+                const float lighting = left ? 0.2f : 0.9f;
+                const glm::vec3 color = ((x / 4 + y / 4) & 1) ? glm::vec3(0.8f, 0.6f, 0.4f) : glm::vec3(0.4f, 0.6f, 0.8f);
+                albedo[i] = glm::vec4(color, 1.0f);
+                clean[i] = glm::vec4(color * lighting, 1.0f);
+                noisy[i] = glm::vec4(color * lighting * (1.0f + 0.8f * (random.NextFloat() * 2.0f - 1.0f)), 1.0f);
+                normalDepth[i] = left ? glm::vec4(0.0f, 0.0f, 1.0f, 4.0f) : glm::vec4(-1.0f, 0.0f, 0.0f, 9.0f);
+            }
+        }
+
+        const auto error = [&](const std::vector<glm::vec4>& image, uint32_t minX, uint32_t maxX)
+        {
+            double sum = 0.0;
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                for (uint32_t x = minX; x < maxX; ++x)
+                {
+                    const size_t i = static_cast<size_t>(y) * width + x;
+                    const glm::vec3 difference = glm::vec3(image[i]) - glm::vec3(clean[i]);
+                    sum += glm::dot(difference, difference);
+                }
+            }
+            return std::sqrt(sum / (3.0 * height * (maxX - minX)));
+        };
+
+        VJobSystem jobSystem(4);
+        VDenoiser denoiser(jobSystem);
+        VDenoiser::Frame frame;
+        frame.width = width;
+        frame.height = height;
+        frame.color = noisy.data();
+        frame.normalDepth = normalDepth.data();
+        frame.albedo = albedo.data();
+
+        std::vector<glm::vec4> output(pixelCount);
+        denoiser.Denoise(frame, output.data());
+
+        const double noisyError = error(noisy, 0, width);
+        const double denoisedError = error(output, 0, width);
+        std::printf("  rms error: noisy %.4f, denoised %.4f\n", noisyError, denoisedError);
+        CHECK(denoisedError < 0.25 * noisyError);
+
+        //The edge does not bleed: the columns next to it stay as close as the rest of the image
+        CHECK(error(output, edge - 2, edge + 2) < 0.35 * error(noisy, edge - 2, edge + 2));
+
+        //The albedo texture is kept sharp
+        for (size_t i = 0; i < pixelCount; ++i)
+            CHECK(output[i].a == 1.0f);
+        const size_t a = 10 * width + 7, b = 10 * width + 8;
+        CHECK(glm::length(glm::vec3(output[a]) / glm::vec3(albedo[a]) - glm::vec3(output[b]) / glm::vec3(albedo[b])) < 0.05f);
+
+        //A constant image comes out unchanged
+        std::fill(noisy.begin(), noisy.end(), glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+        std::fill(albedo.begin(), albedo.end(), glm::vec4(1.0f));
+        denoiser.Reset();
+        denoiser.Denoise(frame, output.data());
+        for (size_t i = 0; i < pixelCount; ++i)
+            CHECK(glm::length(glm::vec3(output[i]) - glm::vec3(0.5f)) < 1e-4f);
+    }
+
+    void TestPrimitives()
+    {
+        using VPrimitiveShader::PRIMITIVE_NO_HIT;
+        const glm::vec3 center(3.0f, 1.0f, -4.0f);
+        const float scale = 2.0f;
+
+        VPrimitive primitive;
+        primitive.transform = glm::mat3x4(glm::vec4(scale, 0, 0, center.x), glm::vec4(0, scale, 0, center.y), glm::vec4(0, 0, scale, center.z));
+
+        //Rays from random points around the shape aimed at random points inside its bounds: the hit is on the scaled
+        //surface, the normal is the one of the analytic shape and faces the ray
+        TestRandom random(17);
+        const auto randomPoint = [&](float extent) { return (glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 2.0f - 1.0f) * extent; };
+        for (uint32_t type = 1; type < PRIMITIVE_TYPE_COUNT; ++type)
+        {
+            primitive.type = static_cast<PrimitiveType>(type);
+            glm::vec3 boundsMin, boundsMax;
+            VPrimitive::GetObjectBounds(primitive.type, boundsMin, boundsMax);
+
+            uint32_t hits = 0, failures = 0;
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                glm::vec3 origin = center + glm::normalize(randomPoint(1.0f)) * 10.0f;
+                const glm::vec3 direction = center + randomPoint(scale) * boundsMax - origin;
+                glm::vec3 normal;
+                const float t = primitive.Intersect(origin, direction, 0.0f, 1e30f, &normal);
+                if (t == PRIMITIVE_NO_HIT)
+                    continue;
+                ++hits;
+                const glm::vec3 p = (origin + direction * t - center) / scale;
+                failures += glm::any(glm::greaterThan(glm::abs(p), boundsMax + 1e-4f));
+                failures += std::abs(glm::length(normal) - 1.0f) > 1e-4f || glm::dot(normal, direction) > 0.0f;
+                if (primitive.type == PrimitiveType::Sphere)
+                    failures += std::abs(glm::length(p) - 1.0f) > 1e-4f || glm::length(normal - p) > 1e-3f;
+                else if (primitive.type == PrimitiveType::Box)
+                    failures += std::abs(glm::max(glm::max(std::abs(p.x), std::abs(p.y)), std::abs(p.z)) - 1.0f) > 1e-4f;
+                else
+                    failures += std::abs(p.y) > 1e-4f || p.x * p.x + p.z * p.z > 1.0f + 1e-4f || std::abs(normal.y) != 1.0f;
+
+                //Nothing closer than the hit, nothing when the ray points away
+                failures += primitive.Intersect(origin, direction, 0.0f, t * 0.999f) != PRIMITIVE_NO_HIT;
+                failures += primitive.Intersect(origin, -direction, 0.0f, 1e30f) != PRIMITIVE_NO_HIT;
+            }
+            CHECK(hits > 64);
+            CHECK(failures == 0);
+        }
+
+        //A ray starting inside a closed shape hits its far side
+        primitive.type = PrimitiveType::Sphere;
+        CHECK_NEAR(primitive.Intersect(center, glm::vec3(1, 0, 0), 0.0f, 1e30f), scale, 1e-5);
+        primitive.type = PrimitiveType::Box;
+        CHECK_NEAR(primitive.Intersect(center + glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), 0.0f, 1e30f), scale + 1.0f, 1e-5);
+    }
+
+    struct Test
+    {
+        const char* name;
+        void (*function)();
+    };
+
+    const Test TESTS[] = {
+        { "deletion_queue", TestDeletionQueue },
+        { "transient_pool", TestTransientPool },
+        { "scene_table", TestSceneTable },
+        { "camera_rays", TestCameraRays },
+        { "sampler", TestSampler },
+        { "light_table", TestLightTable },
+        { "light_bvh", TestLightBvh },
+        { "wavefront_scheduler", TestWavefrontScheduler },
+        { "denoiser", TestDenoiser },
+        { "primitives", TestPrimitives },
+    };
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+    int failedTests = 0;
+    bool found = false;
+    for (const Test& test : TESTS)
+    {
+        if (filter && std::strcmp(filter, test.name) != 0)
+            continue;
+        found = true;
+
+        const int failures = g_failures;
+        std::printf("[ RUN  ] %s\n", test.name);
+        test.function();
+        const bool passed = g_failures == failures;
+        std::printf("[ %s ] %s\n", passed ? " OK " : "FAIL", test.name);
+        failedTests += passed ? 0 : 1;
+    }
+
+    if (!found)
+    {
+        std::printf("unknown test %s\n", filter);
+        return 1;
+    }
+    return failedTests == 0 ? 0 : 1;
+}